@@ -51,6 +51,7 @@ struct grilio_channel {
 
 /* Status values for GRilIoResponseFunc. Zero means success,
  * negative values - GrilIo errors, positive - RIL errors */
+#define GRILIO_STATUS_DISCONNECTED (-3) /* Since 1.0.28 */
 #define GRILIO_STATUS_TIMEOUT   (-2)
 #define GRILIO_STATUS_CANCELLED (-1)
 #define GRILIO_STATUS_OK        (0)
@@ -86,6 +87,39 @@ void
     guint len,
     void* user_data);
 
+/*
+ * Response data (NULL on timeout and cancellation) are only guaranteed
+ * to stay valid during the callback, but the callback may hold on to
+ * a reference without having to copy the data. Where the transport
+ * supports it, the bytes point directly into its receive buffer.
+ *
+ * Since 1.0.28
+ */
+typedef
+void
+(*GRilIoChannelResponseBytesFunc)(
+    GRilIoChannel* channel,
+    int status,
+    GBytes* bytes,
+    void* user_data);
+
+/*
+ * Pieces of the response data, in order. The total is the size of the
+ * entire response. The data are only valid during the callback.
+ *
+ * Since 1.0.28
+ */
+typedef
+void
+(*GRilIoChannelFragmentFunc)(
+    GRilIoChannel* channel,
+    int status,
+    guint offset,
+    guint total,
+    const void* data,
+    guint len,
+    void* user_data);
+
 typedef
 void
 (*GrilIoChannelLogFunc)(
@@ -135,6 +169,90 @@ grilio_channel_set_name(
     GRilIoChannel* channel,
     const char* name);
 
+/*
+ * Request deadlines which are no more than this many milliseconds
+ * apart are handled in a single wakeup. Deadlines may be missed by
+ * up to that much but never expire early. Zero (the default) means
+ * no slack.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_channel_set_timer_slack(
+    GRilIoChannel* channel,
+    int milliseconds);
+
+/*
+ * A request which has been waiting in the queue for this long gets
+ * promoted to the next priority level, and so on. Zero disables the
+ * aging, i.e. lower priority requests wait for as long as there are
+ * higher priority ones in the queue. The default is one second.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_channel_set_priority_aging(
+    GRilIoChannel* channel,
+    int milliseconds);
+
+/*
+ * Flow control. No more than max requests are waiting for response
+ * at any time, zero (the default) means no limit. In adaptive mode
+ * the window grows by one per window's worth of responses which have
+ * arrived within latency_ms, and is cut in half by a slower response
+ * or a timeout, but never exceeds max (if set). Zero latency_ms
+ * disables the adaptive mode. Requests don't stop being accepted when
+ * the window is closed, they wait in the queue.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_channel_set_max_pending(
+    GRilIoChannel* channel,
+    guint max);
+
+void
+grilio_channel_set_adaptive_window(
+    GRilIoChannel* channel,
+    int latency_ms);
+
+guint
+grilio_channel_pending_window(
+    GRilIoChannel* channel);
+
+gboolean
+grilio_channel_window_is_open(
+    GRilIoChannel* channel);
+
+/*
+ * Deduplication of identical requests. If enabled, a request whose
+ * code and payload match a request which is already queued or waiting
+ * for response gets attached to it instead of being sent again. The
+ * response is delivered to all of them. Attached requests share the
+ * fate of the one that's actually being sent (timeout, retries) and
+ * cancelling any of them doesn't affect the others. Blocking requests,
+ * streaming requests and those without a response callback are never
+ * deduplicated. Disabled by default.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_channel_set_deduplicate(
+    GRilIoChannel* channel,
+    gboolean deduplicate);
+
+/*
+ * Replay policy for the requests which don't have their own (see
+ * grilio_request_set_replay). GRILIO_REPLAY_DEFAULT is the same as
+ * GRILIO_REPLAY_WAIT.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_channel_set_replay(
+    GRilIoChannel* channel,
+    GRILIO_REPLAY replay);
+
 guint
 grilio_channel_serialize(
     GRilIoChannel* self);
@@ -213,6 +331,13 @@ grilio_channel_add_pending_changed_handler(
     GRilIoChannelEventFunc func,
     void* arg);
 
+/* Since 1.0.28 (see grilio_channel_window_is_open) */
+gulong
+grilio_channel_add_window_changed_handler(
+    GRilIoChannel* channel,
+    GRilIoChannelEventFunc func,
+    void* arg);
+
 void
 grilio_channel_remove_handler(
     GRilIoChannel* channel,
@@ -242,6 +367,34 @@ grilio_channel_send_request_full(
     GDestroyNotify destroy,
     void* user_data);
 
+/* Since 1.0.28 */
+guint
+grilio_channel_send_request_bytes(
+    GRilIoChannel* channel,
+    GRilIoRequest* req,
+    guint code,
+    GRilIoChannelResponseBytesFunc response,
+    GDestroyNotify destroy,
+    void* user_data);
+
+/*
+ * The response data are passed to the fragment callback (possibly in
+ * several pieces if the response is larger than what the transport is
+ * willing to buffer), after which the response callback is invoked with
+ * no data. Timeout and cancellation only invoke the response callback.
+ *
+ * Since 1.0.28
+ */
+guint
+grilio_channel_send_request_stream(
+    GRilIoChannel* channel,
+    GRilIoRequest* req,
+    guint code,
+    GRilIoChannelFragmentFunc fragment,
+    GRilIoChannelResponseFunc response,
+    GDestroyNotify destroy,
+    void* user_data);
+
 gboolean
 grilio_channel_retry_request(
     GRilIoChannel* channel,
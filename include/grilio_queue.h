@@ -64,6 +64,27 @@ grilio_queue_send_request_full(
     GDestroyNotify destroy,
     void* user_data);
 
+/* Since 1.0.28 */
+guint
+grilio_queue_send_request_bytes(
+    GRilIoQueue* queue,
+    GRilIoRequest* req,
+    guint code,
+    GRilIoChannelResponseBytesFunc response,
+    GDestroyNotify destroy,
+    void* user_data);
+
+/* Since 1.0.28 */
+guint
+grilio_queue_send_request_stream(
+    GRilIoQueue* queue,
+    GRilIoRequest* req,
+    guint code,
+    GRilIoChannelFragmentFunc fragment,
+    GRilIoChannelResponseFunc response,
+    GDestroyNotify destroy,
+    void* user_data);
+
 gboolean
 grilio_queue_cancel_request(
     GRilIoQueue* queue,
@@ -75,6 +96,31 @@ grilio_queue_cancel_all(
     GRilIoQueue* queue,
     gboolean notify);
 
+/*
+ * Priority of the requests submitted via this queue which don't have
+ * their own (see grilio_request_set_priority). GRILIO_PRIORITY_DEFAULT
+ * is the same as GRILIO_PRIORITY_NORMAL.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_queue_set_priority(
+    GRilIoQueue* queue,
+    GRILIO_PRIORITY priority);
+
+/*
+ * Requests submitted via this queue get attached to an identical
+ * request (same code and payload) which is already queued or waiting
+ * for response, rather than being sent again. See
+ * grilio_channel_set_deduplicate for details.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_queue_set_deduplicate(
+    GRilIoQueue* queue,
+    gboolean deduplicate);
+
 GRILIO_TRANSACTION_STATE
 grilio_queue_transaction_start(
     GRilIoQueue* queue);
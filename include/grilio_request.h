@@ -118,6 +118,18 @@ grilio_request_set_retry_func(
     GRilIoRequest* request,
     GRilIoRequestRetryFunc retry);
 
+/* Since 1.0.28 */
+void
+grilio_request_set_replay(
+    GRilIoRequest* request,
+    GRILIO_REPLAY replay);
+
+/* Since 1.0.28 */
+void
+grilio_request_set_priority(
+    GRilIoRequest* request,
+    GRILIO_PRIORITY priority);
+
 int
 grilio_request_retry_count(
     GRilIoRequest* request);
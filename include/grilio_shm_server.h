@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GRILIO_SHM_SERVER_H
+#define GRILIO_SHM_SERVER_H
+
+#include "grilio_types.h"
+
+G_BEGIN_DECLS
+
+/*
+ * The other end of grilio_transport_shm_new(), e.g. for a local proxy
+ * sitting in front of rild. Requests are passed to the packet callback
+ * as they are sent by the client (code, serial and data, no length).
+ * Whatever is passed to grilio_shm_server_send() is delivered to the
+ * client as a complete RIL packet (again, without the length prefix).
+ * The first thing the server is expected to send is normally
+ * RIL_UNSOL_RIL_CONNECTED.
+ *
+ * The server may be freed from the disconnected callback but not from
+ * the other ones.
+ *
+ * Since 1.0.28
+ */
+
+typedef struct grilio_shm_server GRilIoShmServer;
+
+typedef
+void
+(*GRilIoShmServerFunc)(
+    GRilIoShmServer* server,
+    void* user_data);
+
+typedef
+void
+(*GRilIoShmServerPacketFunc)(
+    GRilIoShmServer* server,
+    const void* data,
+    guint len,
+    void* user_data);
+
+typedef struct grilio_shm_server_callbacks {
+    GRilIoShmServerFunc connected;
+    GRilIoShmServerPacketFunc packet;
+    GRilIoShmServerFunc disconnected;
+} GRilIoShmServerCallbacks;
+
+GRilIoShmServer*
+grilio_shm_server_new(
+    int fd,
+    gboolean can_close,
+    const GRilIoShmServerCallbacks* callbacks,
+    void* user_data);
+
+void
+grilio_shm_server_free(
+    GRilIoShmServer* server);
+
+/* NULL until connected or if the client hasn't subscribed */
+const char*
+grilio_shm_server_subscription(
+    GRilIoShmServer* server);
+
+/* The packet is queued if there's no room in the ring */
+gboolean
+grilio_shm_server_send(
+    GRilIoShmServer* server,
+    const void* data,
+    guint len);
+
+G_END_DECLS
+
+#endif /* GRILIO_SHM_SERVER_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -80,6 +80,352 @@ grilio_transport_socket_new_path(
     const char* path,
     const char* subscription);
 
+/*
+ * Connects to the socket asynchronously and keeps reconnecting, with
+ * exponentially growing delay, whenever the connection fails or gets
+ * lost. The connected signal is emitted for each new connection, after
+ * RIL_UNSOL_RIL_CONNECTED has been received. Shutdown stops reconnects.
+ *
+ * Since 1.0.28
+ */
+GRilIoTransport*
+grilio_transport_reconnect_new(
+    const char* path,
+    const char* subscription);
+
+/*
+ * Delay before the first reconnect attempt (doubled after each failed
+ * attempt but never exceeding max_ms). By default, it's 250 ms growing
+ * up to 10 seconds.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_transport_reconnect_set_delay(
+    GRilIoTransport* transport,
+    guint min_ms,
+    guint max_ms);
+
+/*
+ * Same as grilio_transport_socket_new but talks to the socket directly,
+ * without GIOChannel in between.
+ *
+ * Since 1.0.28
+ */
+GRilIoTransport*
+grilio_transport_fd_new(
+    int fd,
+    const char* sub,
+    gboolean can_close);
+
+/*
+ * By default, the socket transport reads and dispatches one packet per
+ * main loop wakeup. Non-zero max_packets makes it read as much data as
+ * is available and dispatch up to max_packets complete packets per
+ * wakeup (the rest is dispatched from an idle callback). Zero restores
+ * the default behaviour.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_transport_socket_set_read_batch(
+    GRilIoTransport* transport,
+    guint max_packets);
+
+/*
+ * The maximum number of requests that the socket transport accepts
+ * before the previous ones have been written. Several queued requests
+ * get written with a single system call. The default is 1.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_transport_socket_set_send_window(
+    GRilIoTransport* transport,
+    guint window);
+
+/*
+ * Same as grilio_transport_set_max_packet_len but only works for the
+ * socket transport.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_transport_socket_set_max_packet_len(
+    GRilIoTransport* transport,
+    guint max_len);
+
+/*
+ * Kernel socket buffer sizes (SO_RCVBUF and SO_SNDBUF). Non-positive
+ * values are left unchanged. Note that Linux doubles the requested size
+ * and reports the doubled value back.
+ *
+ * Since 1.0.28
+ */
+gboolean
+grilio_transport_socket_set_buffer_size(
+    GRilIoTransport* transport,
+    int rcvbuf,
+    int sndbuf);
+
+gboolean
+grilio_transport_socket_get_buffer_size(
+    GRilIoTransport* transport,
+    int* rcvbuf,
+    int* sndbuf);
+
+/*
+ * I/O counters maintained by the socket transport. Each read or write
+ * call is a system call. The read backlog is the largest number of
+ * packets handled on a single wakeup, the write backlog is the largest
+ * number of requests waiting to be written at once.
+ *
+ * Since 1.0.28
+ */
+typedef struct grilio_transport_socket_stats {
+    guint64 read_calls;
+    guint64 read_bytes;
+    guint64 read_packets;
+    guint64 read_eagain;
+    guint64 write_calls;
+    guint64 write_bytes;
+    guint64 write_packets;
+    guint64 write_partial;
+    guint64 write_eagain;
+    guint max_read_backlog;
+    guint max_write_backlog;
+} GRilIoTransportSocketStats;
+
+gboolean
+grilio_transport_socket_get_stats(
+    GRilIoTransport* transport,
+    GRilIoTransportSocketStats* stats);
+
+void
+grilio_transport_socket_reset_stats(
+    GRilIoTransport* transport);
+
+/*
+ * RIL protocol over SOCK_SEQPACKET socket. Each message is one packet,
+ * without the length prefix. Only makes sense when both ends are under
+ * our control (e.g. rild replacements and proxies).
+ *
+ * Since 1.0.28
+ */
+GRilIoTransport*
+grilio_transport_seqpacket_new(
+    int fd,
+    const char* sub,
+    gboolean can_close);
+
+/*
+ * Exchanges RIL packets with a cooperating local process through a pair
+ * of rings in shared memory. The socket is only used to hand over the
+ * memory and the wakeup descriptors (along with the subscription) and
+ * to detect disconnects. The other side is expected to be served by
+ * grilio_shm_server_new().
+ *
+ * Since 1.0.28
+ */
+GRilIoTransport*
+grilio_transport_shm_new(
+    int fd,
+    const char* sub,
+    gboolean can_close);
+
+/*
+ * In-process transport without a file descriptor behind it, e.g. for
+ * benchmarking or for embedding a RIL implementation. Requests are
+ * passed to the callback as they are sent. Packets queued with
+ * grilio_transport_loopback_connect(), _respond() and _indicate() are
+ * delivered from an idle callback, never synchronously. The connect
+ * call emulates RIL_UNSOL_RIL_CONNECTED.
+ *
+ * Since 1.0.28
+ */
+typedef
+void
+(*GRilIoTransportLoopbackFunc)(
+    GRilIoTransport* transport,
+    guint code,
+    guint serial,
+    const void* data,
+    guint len,
+    void* user_data);
+
+GRilIoTransport*
+grilio_transport_loopback_new(
+    GRilIoTransportLoopbackFunc request,
+    void* user_data);
+
+gboolean
+grilio_transport_loopback_connect(
+    GRilIoTransport* transport,
+    guint ril_version);
+
+gboolean
+grilio_transport_loopback_respond(
+    GRilIoTransport* transport,
+    guint serial,
+    int status,
+    const void* data,
+    guint len);
+
+gboolean
+grilio_transport_loopback_indicate(
+    GRilIoTransport* transport,
+    guint code,
+    const void* data,
+    guint len);
+
+/*
+ * Appends every packet seen by the transport (requests, responses and
+ * indications, with monotonic timestamps) to a capture file. Writes are
+ * buffered and flushed when enough data has accumulated or once a
+ * second. Starting a new capture stops the previous one.
+ *
+ * Since 1.0.28
+ */
+gboolean
+grilio_transport_capture_start(
+    GRilIoTransport* transport,
+    const char* path);
+
+void
+grilio_transport_capture_stop(
+    GRilIoTransport* transport);
+
+/*
+ * Plays back the (first session of the) capture file. Indications are
+ * delivered according to the recorded timestamps if realtime is TRUE,
+ * otherwise as fast as possible. Responses are matched with requests
+ * by code and order, and get delivered no earlier than the request has
+ * been sent. Requests without recorded response fail.
+ *
+ * Since 1.0.28
+ */
+GRilIoTransport*
+grilio_transport_playback_new(
+    const char* path,
+    gboolean realtime);
+
+/*
+ * Wraps another transport and injects faults into it, for load testing.
+ * Responses to requests with the given code (zero sets the default) get
+ * delayed by a random number of milliseconds uniformly distributed
+ * between min_ms and max_ms. The rates are probabilities (0 to 1) of
+ * a response being dropped, a response being delivered after the next
+ * one, and a request failing with a write error. The PRNG is seeded
+ * with the given seed, which makes the faults reproducible.
+ *
+ * Since 1.0.28
+ */
+GRilIoTransport*
+grilio_transport_fault_new(
+    GRilIoTransport* transport,
+    guint32 seed);
+
+void
+grilio_transport_fault_set_latency(
+    GRilIoTransport* transport,
+    guint code,
+    guint min_ms,
+    guint max_ms);
+
+void
+grilio_transport_fault_set_drop_rate(
+    GRilIoTransport* transport,
+    gdouble rate);
+
+void
+grilio_transport_fault_set_reorder_rate(
+    GRilIoTransport* transport,
+    gdouble rate);
+
+void
+grilio_transport_fault_set_write_error_rate(
+    GRilIoTransport* transport,
+    gdouble rate);
+
+/*
+ * Transport driven by io_uring. Falls back to grilio_transport_socket_new
+ * if io_uring (Linux 6.0 or newer) isn't available at run time or hasn't
+ * been compiled in. By default it's only compiled in if the kernel headers
+ * are recent enough, IO_URING=0 or IO_URING=1 overrides the check.
+ *
+ * Since 1.0.28
+ */
+GRilIoTransport*
+grilio_transport_uring_new(
+    int fd,
+    const char* sub,
+    gboolean can_close);
+
+/*
+ * Transport which reads and writes the socket on a dedicated thread.
+ * Packets and requests are handed over between that thread and the
+ * thread running the default main context without locking.
+ *
+ * Since 1.0.28
+ */
+GRilIoTransport*
+grilio_transport_thread_new(
+    int fd,
+    const char* sub,
+    gboolean can_close);
+
+/*
+ * Pins the I/O thread to the specified CPU. Returns FALSE if the
+ * transport is not a thread transport or the call fails.
+ *
+ * Since 1.0.28
+ */
+gboolean
+grilio_transport_thread_set_affinity(
+    GRilIoTransport* transport,
+    int cpu);
+
+/*
+ * Sets scheduling policy (SCHED_OTHER, SCHED_FIFO etc.) and priority
+ * of the I/O thread. Returns FALSE if the transport is not a thread
+ * transport or the call fails (e.g. due to insufficient privileges).
+ *
+ * Since 1.0.28
+ */
+gboolean
+grilio_transport_thread_set_priority(
+    GRilIoTransport* transport,
+    int policy,
+    int priority);
+
+/*
+ * Receive buffers are shared by all transports. Released buffers are
+ * kept for reuse as long as the total amount of memory held by the pool
+ * doesn't exceed the high-water mark, and get deallocated after staying
+ * unused for longer than the idle timeout. Zero idle timeout keeps them
+ * around indefinitely.
+ *
+ * Since 1.0.28
+ */
+typedef struct grilio_transport_pool_stats {
+    gsize bytes_held;       /* Allocated by the pool, including in use */
+    gsize bytes_in_use;     /* Being used by transports or referenced */
+    guint buffers_held;
+    guint buffers_in_use;
+} GRilIoTransportPoolStats;
+
+void
+grilio_transport_pool_get_stats(
+    GRilIoTransportPoolStats* stats);
+
+void
+grilio_transport_pool_set_high_water_mark(
+    gsize bytes);
+
+void
+grilio_transport_pool_set_idle_timeout(
+    guint ms);
+
 GRilIoTransport*
 grilio_transport_ref(
     GRilIoTransport* transport);
@@ -93,6 +439,22 @@ grilio_transport_shutdown(
     GRilIoTransport* transport,
     gboolean flush);
 
+/*
+ * Packets longer than 32K are normally treated as a protocol error.
+ * Zero restores the default. The socket transport never buffers the
+ * packets longer than 32K in their entirety, responses are passed to
+ * the channel in fragments (see grilio_channel_send_request_stream) and
+ * other packets are reassembled. The fd, thread, uring and seqpacket
+ * transports buffer the entire packet. The shared memory transport is
+ * limited by the size of the ring and ignores this setting.
+ *
+ * Since 1.0.28
+ */
+void
+grilio_transport_set_max_packet_len(
+    GRilIoTransport* transport,
+    guint max_len);
+
 G_END_DECLS
 
 #endif /* GRILIO_TRANSPORT_H */
@@ -46,9 +46,9 @@ typedef struct grilio_transport_class {
     GRILIO_SEND_STATUS (*send)(GRilIoTransport* transport,
         GRilIoRequest* req, guint code);
     void (*shutdown)(GRilIoTransport* transport, gboolean flush);
+    guint (*send_window)(GRilIoTransport* transport); /* Since 1.0.28 */
 
     /* Padding for future expansion */
-    void (*_reserved1)(void);
     void (*_reserved2)(void);
     void (*_reserved3)(void);
     void (*_reserved4)(void);
@@ -88,6 +88,18 @@ grilio_transport_signal_response(
     const void* data,
     guint len);
 
+/* Since 1.0.28 */
+void
+grilio_transport_signal_fragment(
+    GRilIoTransport* transport,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    guint offset,
+    guint total,
+    const void* data,
+    guint len);
+
 void
 grilio_transport_signal_indication(
     GRilIoTransport* transport,
@@ -106,6 +118,48 @@ grilio_transport_signal_write_error(
     GRilIoTransport* transport,
     const GError* error);
 
+/*
+ * Parses a complete RIL packet (without the length prefix) and emits
+ * the appropriate signal. Handles RIL_UNSOL_RIL_CONNECTED too. Returns
+ * FALSE and sets the error if the packet is malformed.
+ *
+ * Since 1.0.28
+ */
+gboolean
+grilio_transport_handle_packet(
+    GRilIoTransport* transport,
+    const void* packet,
+    guint len,
+    GError** error);
+
+/*
+ * Packets longer than this are a protocol error. Longer than 32K ones
+ * don't have to be buffered in their entirety, they can be passed to
+ * grilio_transport_handle_fragment in pieces.
+ *
+ * Since 1.0.28
+ */
+guint
+grilio_transport_max_packet_len(
+    GRilIoTransport* transport);
+
+/*
+ * Handles a piece of the packet too large to be buffered in its entirety
+ * (offset and total exclude the length prefix). Responses are passed to
+ * the channel piece by piece, provided that the first fragment contains
+ * the entire response header. Other packets are reassembled.
+ *
+ * Since 1.0.28
+ */
+gboolean
+grilio_transport_handle_fragment(
+    GRilIoTransport* transport,
+    guint offset,
+    guint total,
+    const void* data,
+    guint len,
+    GError** error);
+
 G_END_DECLS
 
 #endif /* GRILIO_TRANSPORT_IMPL_H */
@@ -63,6 +63,35 @@ typedef enum grilio_packet_type {
     GRILIO_PACKET_UNSOL_ACK_EXP
 } GRILIO_PACKET_TYPE;
 
+/*
+ * What happens to requests which have been sent but not replied to
+ * when the connection gets lost. By default they keep waiting for the
+ * response (which will never arrive) until they time out.
+ *
+ * Since 1.0.28
+ */
+typedef enum grilio_replay {
+    GRILIO_REPLAY_DEFAULT = -1, /* Request follows the channel policy */
+    GRILIO_REPLAY_WAIT,         /* Wait for the timeout (default) */
+    GRILIO_REPLAY_FAIL,         /* Complete with GRILIO_STATUS_DISCONNECTED */
+    GRILIO_REPLAY_RESUBMIT      /* Idempotent, send again after reconnect */
+} GRILIO_REPLAY;
+
+/*
+ * Requests with higher priority get sent first. Requests of the same
+ * priority are sent in the order they were submitted. Requests that
+ * have been waiting long enough get promoted so that low priority
+ * traffic doesn't starve (see grilio_channel_set_priority_aging).
+ *
+ * Since 1.0.28
+ */
+typedef enum grilio_priority {
+    GRILIO_PRIORITY_DEFAULT = -1, /* Request follows the queue priority */
+    GRILIO_PRIORITY_LOW,
+    GRILIO_PRIORITY_NORMAL,       /* Default */
+    GRILIO_PRIORITY_HIGH
+} GRILIO_PRIORITY;
+
 #define GRILIO_TIMEOUT_NONE     (0)     /* Infinite timeout */
 #define GRILIO_TIMEOUT_DEFAULT  (-1)
 
@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "grilio_buffer.h"
+#include "grilio_log.h"
+
+#include <string.h>
+
+#define GRILIO_BUFFER_CLASSES (4)
+#define GRILIO_BUFFER_NO_CLASS (-1)
+#define GRILIO_BUFFER_DEFAULT_HIGH_WATER_MARK (0x40000)
+#define GRILIO_BUFFER_DEFAULT_IDLE_TIMEOUT_MS (10000)
+
+typedef struct grilio_buffer_pool {
+    gsize high_water_mark;
+    guint idle_timeout_ms;
+    guint shrink_id;
+    GMutex mutex;
+    GRilIoBuffer* free[GRILIO_BUFFER_CLASSES];
+    gsize bytes_held;
+    gsize bytes_in_use;
+    guint buffers_held;
+    guint buffers_in_use;
+} GRilIoBufferPool;
+
+/* The last class is large enough for the largest RIL packet */
+static const gsize grilio_buffer_class_size[GRILIO_BUFFER_CLASSES] = {
+    0x1000, 0x2000, 0x4000, 0x8100
+};
+
+static GRilIoBufferPool grilio_buffer_pool = {
+    GRILIO_BUFFER_DEFAULT_HIGH_WATER_MARK,
+    GRILIO_BUFFER_DEFAULT_IDLE_TIMEOUT_MS
+};
+
+/*==========================================================================*
+ * Pool
+ *==========================================================================*/
+
+static
+gint
+grilio_buffer_size_class(
+    gsize size)
+{
+    guint i;
+
+    for (i = 0; i < GRILIO_BUFFER_CLASSES; i++) {
+        if (size <= grilio_buffer_class_size[i]) {
+            return i;
+        }
+    }
+    return GRILIO_BUFFER_NO_CLASS;
+}
+
+/* Must be called under lock. Returns the list of buffers to deallocate */
+static
+GRilIoBuffer*
+grilio_buffer_pool_trim_locked(
+    GRilIoBufferPool* pool,
+    gint64 idle_since)
+{
+    GRilIoBuffer* dead = NULL;
+    guint i;
+
+    /* Drop the largest buffers first */
+    for (i = GRILIO_BUFFER_CLASSES; i > 0; i--) {
+        GRilIoBuffer** ptr = pool->free + (i - 1);
+
+        while (*ptr) {
+            GRilIoBuffer* buf = *ptr;
+
+            if (buf->released <= idle_since ||
+                pool->bytes_held > pool->high_water_mark) {
+                *ptr = buf->next;
+                buf->next = dead;
+                dead = buf;
+                pool->bytes_held -= buf->size;
+                pool->buffers_held--;
+            } else {
+                ptr = &buf->next;
+            }
+        }
+    }
+    return dead;
+}
+
+static
+void
+grilio_buffer_free_list(
+    GRilIoBuffer* buf)
+{
+    while (buf) {
+        GRilIoBuffer* next = buf->next;
+
+        g_free(buf);
+        buf = next;
+    }
+}
+
+static
+gboolean
+grilio_buffer_pool_has_free_locked(
+    GRilIoBufferPool* pool)
+{
+    guint i;
+
+    for (i = 0; i < GRILIO_BUFFER_CLASSES; i++) {
+        if (pool->free[i]) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static
+gboolean
+grilio_buffer_pool_shrink(
+    gpointer user_data)
+{
+    GRilIoBufferPool* pool = user_data;
+    GRilIoBuffer* dead;
+    gboolean more;
+
+    g_mutex_lock(&pool->mutex);
+    dead = grilio_buffer_pool_trim_locked(pool, g_get_monotonic_time() -
+        (gint64)pool->idle_timeout_ms * 1000);
+    more = grilio_buffer_pool_has_free_locked(pool);
+    if (!more) {
+        pool->shrink_id = 0;
+    }
+    g_mutex_unlock(&pool->mutex);
+    grilio_buffer_free_list(dead);
+    return more ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+/* Must be called under lock */
+static
+void
+grilio_buffer_pool_schedule_shrink_locked(
+    GRilIoBufferPool* pool)
+{
+    if (!pool->shrink_id && pool->idle_timeout_ms) {
+        pool->shrink_id = g_timeout_add(pool->idle_timeout_ms,
+            grilio_buffer_pool_shrink, pool);
+    }
+}
+
+static
+void
+grilio_buffer_pool_release(
+    GRilIoBufferPool* pool,
+    GRilIoBuffer* buf)
+{
+    g_mutex_lock(&pool->mutex);
+    pool->bytes_in_use -= buf->size;
+    pool->buffers_in_use--;
+    if (buf->size_class != GRILIO_BUFFER_NO_CLASS &&
+        pool->bytes_held <= pool->high_water_mark) {
+        /* Keep it for reuse */
+        buf->released = g_get_monotonic_time();
+        buf->next = pool->free[buf->size_class];
+        pool->free[buf->size_class] = buf;
+        grilio_buffer_pool_schedule_shrink_locked(pool);
+        buf = NULL;
+    } else {
+        pool->bytes_held -= buf->size;
+        pool->buffers_held--;
+    }
+    g_mutex_unlock(&pool->mutex);
+    g_free(buf);
+}
+
+void
+grilio_buffer_pool_get_stats(
+    GRilIoTransportPoolStats* stats)
+{
+    GRilIoBufferPool* pool = &grilio_buffer_pool;
+
+    g_mutex_lock(&pool->mutex);
+    stats->bytes_held = pool->bytes_held;
+    stats->bytes_in_use = pool->bytes_in_use;
+    stats->buffers_held = pool->buffers_held;
+    stats->buffers_in_use = pool->buffers_in_use;
+    g_mutex_unlock(&pool->mutex);
+}
+
+void
+grilio_buffer_pool_set_high_water_mark(
+    gsize bytes)
+{
+    GRilIoBufferPool* pool = &grilio_buffer_pool;
+    GRilIoBuffer* dead;
+
+    g_mutex_lock(&pool->mutex);
+    pool->high_water_mark = bytes;
+    dead = grilio_buffer_pool_trim_locked(pool, 0);
+    g_mutex_unlock(&pool->mutex);
+    grilio_buffer_free_list(dead);
+}
+
+void
+grilio_buffer_pool_set_idle_timeout(
+    guint ms)
+{
+    GRilIoBufferPool* pool = &grilio_buffer_pool;
+
+    g_mutex_lock(&pool->mutex);
+    if (pool->idle_timeout_ms != ms) {
+        pool->idle_timeout_ms = ms;
+        if (pool->shrink_id) {
+            g_source_remove(pool->shrink_id);
+            pool->shrink_id = 0;
+        }
+        if (grilio_buffer_pool_has_free_locked(pool)) {
+            grilio_buffer_pool_schedule_shrink_locked(pool);
+        }
+    }
+    g_mutex_unlock(&pool->mutex);
+}
+
+/*==========================================================================*
+ * Buffer
+ *==========================================================================*/
+
+GRilIoBuffer*
+grilio_buffer_new(
+    gsize min_size)
+{
+    GRilIoBufferPool* pool = &grilio_buffer_pool;
+    const gint size_class = grilio_buffer_size_class(min_size);
+    const gsize size = (size_class == GRILIO_BUFFER_NO_CLASS) ? min_size :
+        grilio_buffer_class_size[size_class];
+    GRilIoBuffer* buf = NULL;
+
+    g_mutex_lock(&pool->mutex);
+    if (size_class != GRILIO_BUFFER_NO_CLASS) {
+        buf = pool->free[size_class];
+        if (buf) {
+            pool->free[size_class] = buf->next;
+        }
+    }
+    if (!buf) {
+        pool->bytes_held += size;
+        pool->buffers_held++;
+    }
+    pool->bytes_in_use += size;
+    pool->buffers_in_use++;
+    g_mutex_unlock(&pool->mutex);
+
+    if (!buf) {
+        buf = g_malloc(sizeof(GRilIoBuffer) + size);
+        buf->size_class = size_class;
+        buf->size = size;
+    }
+    buf->refcount = 1;
+    buf->next = NULL;
+    return buf;
+}
+
+GRilIoBuffer*
+grilio_buffer_ref(
+    GRilIoBuffer* buf)
+{
+    if (G_LIKELY(buf)) {
+        GASSERT(buf->refcount > 0);
+        g_atomic_int_inc(&buf->refcount);
+    }
+    return buf;
+}
+
+void
+grilio_buffer_unref(
+    GRilIoBuffer* buf)
+{
+    if (G_LIKELY(buf)) {
+        GASSERT(buf->refcount > 0);
+        if (g_atomic_int_dec_and_test(&buf->refcount)) {
+            grilio_buffer_pool_release(&grilio_buffer_pool, buf);
+        }
+    }
+}
+
+static
+void
+grilio_buffer_unref_proc(
+    gpointer buf)
+{
+    grilio_buffer_unref(buf);
+}
+
+gboolean
+grilio_buffer_shared(
+    GRilIoBuffer* buf)
+{
+    return g_atomic_int_get(&buf->refcount) > 1;
+}
+
+/*
+ * Returns the buffer (either the same one or a new one) which can hold
+ * at least need bytes, with the unhandled data (between start and end)
+ * moved to the beginning of the buffer. Switches to another buffer if
+ * this one is too small, still referenced by someone else or belongs
+ * to a larger size class than necessary. start and end may be NULL if
+ * there's no unhandled data.
+ */
+GRilIoBuffer*
+grilio_buffer_reserve(
+    GRilIoBuffer* buf,
+    gsize* start,
+    gsize* end,
+    gsize need)
+{
+    const gsize offset = start ? *start : 0;
+    const gsize avail = end ? (*end - offset) : 0;
+
+    need = MAX(need, avail);
+    if (!buf || buf->size < need || grilio_buffer_shared(buf) ||
+        buf->size_class != grilio_buffer_size_class(need)) {
+        GRilIoBuffer* prev = buf;
+
+        buf = grilio_buffer_new(need);
+        if (avail) {
+            memcpy(GRILIO_BUFFER_DATA(buf), GRILIO_BUFFER_DATA(prev) +
+                offset, avail);
+        }
+        grilio_buffer_unref(prev);
+    } else if (offset && avail) {
+        memmove(GRILIO_BUFFER_DATA(buf), GRILIO_BUFFER_DATA(buf) +
+            offset, avail);
+    }
+    if (start) *start = 0;
+    if (end) *end = avail;
+    return buf;
+}
+
+GBytes*
+grilio_buffer_slice(
+    GRilIoBuffer* buf,
+    const void* data,
+    gsize len)
+{
+    GASSERT((const gchar*)data >= GRILIO_BUFFER_DATA(buf));
+    GASSERT((const gchar*)data + len <= GRILIO_BUFFER_DATA(buf) + buf->size);
+    return g_bytes_new_with_free_func(data, len, grilio_buffer_unref_proc,
+        grilio_buffer_ref(buf));
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef GRILIO_BUFFER_H
+#define GRILIO_BUFFER_H
+
+#include "grilio_transport.h"
+
+/*
+ * Reference counted receive buffer. Slices handed out as GBytes keep
+ * the whole buffer alive, the transport has to switch to another buffer
+ * before overwriting the data which may still be referenced.
+ *
+ * Buffers come from the pool shared by all transports. The pool rounds
+ * the requested size up to one of a few size classes and keeps released
+ * buffers around for reuse, until the total amount of memory held by the
+ * pool exceeds the high-water mark or the buffer stays unused for longer
+ * than the idle timeout.
+ */
+
+typedef struct grilio_buffer GRilIoBuffer;
+
+struct grilio_buffer {
+    gint refcount;
+    gint size_class;
+    gsize size;
+    GRilIoBuffer* next;
+    gint64 released;
+    /* Data follow */
+};
+
+#define GRILIO_BUFFER_DATA(buf) ((gchar*)((buf) + 1))
+
+GRilIoBuffer*
+grilio_buffer_new(
+    gsize min_size);
+
+GRilIoBuffer*
+grilio_buffer_ref(
+    GRilIoBuffer* buf);
+
+void
+grilio_buffer_unref(
+    GRilIoBuffer* buf);
+
+gboolean
+grilio_buffer_shared(
+    GRilIoBuffer* buf);
+
+GRilIoBuffer*
+grilio_buffer_reserve(
+    GRilIoBuffer* buf,
+    gsize* start,
+    gsize* end,
+    gsize need);
+
+GBytes*
+grilio_buffer_slice(
+    GRilIoBuffer* buf,
+    const void* data,
+    gsize len);
+
+void
+grilio_buffer_pool_get_stats(
+    GRilIoTransportPoolStats* stats);
+
+void
+grilio_buffer_pool_set_high_water_mark(
+    gsize bytes);
+
+void
+grilio_buffer_pool_set_idle_timeout(
+    guint ms);
+
+#endif /* GRILIO_BUFFER_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "grilio_capture.h"
+#include "grilio_log.h"
+
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define GRILIO_CAPTURE_MAGIC (0x50414352) /* "RCAP" */
+#define GRILIO_CAPTURE_VERSION (1)
+
+/* Records are buffered until this much has accumulated... */
+#define GRILIO_CAPTURE_FLUSH_SIZE (0x10000)
+/* ... or for this many seconds, whatever happens first */
+#define GRILIO_CAPTURE_FLUSH_SEC (1)
+
+typedef struct grilio_capture_file_header {
+    guint32 magic;
+    guint32 version;
+} GRilIoCaptureFileHeader;
+
+typedef struct grilio_capture_record_header {
+    guint32 len;
+    guint32 type;
+    guint32 code;
+    guint32 serial;
+    guint32 time_lo;
+    guint32 time_hi;
+} GRilIoCaptureRecordHeader;
+
+struct grilio_capture {
+    int fd;
+    gint64 start;
+    guint flush_id;
+    GByteArray* buf;
+};
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+gboolean
+grilio_capture_flush_timeout(
+    gpointer user_data)
+{
+    GRilIoCapture* self = user_data;
+
+    self->flush_id = 0;
+    grilio_capture_flush(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+grilio_capture_append(
+    GRilIoCapture* self,
+    const void* data,
+    guint len)
+{
+    if (len) {
+        g_byte_array_append(self->buf, data, len);
+    }
+}
+
+/*==========================================================================*
+ * Writer
+ *==========================================================================*/
+
+GRilIoCapture*
+grilio_capture_open(
+    const char* path,
+    GError** error)
+{
+    const int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+        0644);
+
+    if (fd >= 0) {
+        GRilIoCapture* self = g_slice_new0(GRilIoCapture);
+        struct stat st;
+
+        self->fd = fd;
+        self->buf = g_byte_array_sized_new(GRILIO_CAPTURE_FLUSH_SIZE);
+        self->start = g_get_monotonic_time();
+        if (!fstat(fd, &st) && !st.st_size) {
+            GRilIoCaptureFileHeader header;
+
+            header.magic = GUINT32_TO_LE(GRILIO_CAPTURE_MAGIC);
+            header.version = GUINT32_TO_LE(GRILIO_CAPTURE_VERSION);
+            grilio_capture_append(self, &header, sizeof(header));
+        }
+        grilio_capture_write(self, GRILIO_CAPTURE_START, 0, 0, NULL, 0);
+        return self;
+    } else {
+        const int err = errno;
+
+        GERR("Can't open %s: %s", path, g_strerror(err));
+        g_propagate_error(error, g_error_new_literal(G_IO_ERROR,
+            g_io_error_from_errno(err), g_strerror(err)));
+        return NULL;
+    }
+}
+
+void
+grilio_capture_write(
+    GRilIoCapture* self,
+    GRILIO_CAPTURE_TYPE type,
+    guint code,
+    guint serial,
+    const void* data,
+    guint len)
+{
+    if (G_LIKELY(self) && self->fd >= 0) {
+        const guint64 time = g_get_monotonic_time() - self->start;
+        GRilIoCaptureRecordHeader header;
+
+        header.len = GUINT32_TO_LE(len);
+        header.type = GUINT32_TO_LE(type);
+        header.code = GUINT32_TO_LE(code);
+        header.serial = GUINT32_TO_LE(serial);
+        header.time_lo = GUINT32_TO_LE((guint32)time);
+        header.time_hi = GUINT32_TO_LE((guint32)(time >> 32));
+        grilio_capture_append(self, &header, sizeof(header));
+        grilio_capture_append(self, data, len);
+        if (self->buf->len >= GRILIO_CAPTURE_FLUSH_SIZE) {
+            grilio_capture_flush(self);
+        } else if (!self->flush_id) {
+            self->flush_id = g_timeout_add_seconds(GRILIO_CAPTURE_FLUSH_SEC,
+                grilio_capture_flush_timeout, self);
+        }
+    }
+}
+
+void
+grilio_capture_flush(
+    GRilIoCapture* self)
+{
+    if (G_LIKELY(self) && self->fd >= 0) {
+        GByteArray* buf = self->buf;
+        guint pos = 0;
+
+        while (pos < buf->len) {
+            const gssize n = write(self->fd, buf->data + pos, buf->len - pos);
+
+            if (n > 0) {
+                pos += n;
+            } else if (n < 0 && errno != EINTR) {
+                /* Give up on the first error */
+                GERR("Capture write failed: %s", g_strerror(errno));
+                close(self->fd);
+                self->fd = -1;
+                break;
+            }
+        }
+        g_byte_array_set_size(buf, 0);
+    }
+}
+
+void
+grilio_capture_free(
+    GRilIoCapture* self)
+{
+    if (G_LIKELY(self)) {
+        grilio_capture_flush(self);
+        if (self->flush_id) {
+            g_source_remove(self->flush_id);
+        }
+        if (self->fd >= 0) {
+            close(self->fd);
+        }
+        g_byte_array_free(self->buf, TRUE);
+        g_slice_free(GRilIoCapture, self);
+    }
+}
+
+/*==========================================================================*
+ * Reader
+ *==========================================================================*/
+
+gsize
+grilio_capture_check(
+    const void* data,
+    gsize size)
+{
+    GRilIoCaptureFileHeader header;
+
+    if (size >= sizeof(header)) {
+        memcpy(&header, data, sizeof(header));
+        if (GUINT32_FROM_LE(header.magic) == GRILIO_CAPTURE_MAGIC &&
+            GUINT32_FROM_LE(header.version) == GRILIO_CAPTURE_VERSION) {
+            return sizeof(header);
+        }
+    }
+    return 0;
+}
+
+gboolean
+grilio_capture_next(
+    const void* data,
+    gsize size,
+    gsize* pos,
+    GRilIoCaptureRecord* record)
+{
+    GRilIoCaptureRecordHeader header;
+
+    /* Incomplete record at the end is ignored */
+    if (*pos + sizeof(header) <= size) {
+        const guint8* ptr = (const guint8*)data + *pos;
+        guint len;
+
+        memcpy(&header, ptr, sizeof(header));
+        len = GUINT32_FROM_LE(header.len);
+        if (*pos + sizeof(header) + len <= size) {
+            record->type = GUINT32_FROM_LE(header.type);
+            record->code = GUINT32_FROM_LE(header.code);
+            record->serial = GUINT32_FROM_LE(header.serial);
+            record->time = (gint64)(GUINT32_FROM_LE(header.time_lo) |
+                (((guint64)GUINT32_FROM_LE(header.time_hi)) << 32));
+            record->data = ptr + sizeof(header);
+            record->len = len;
+            *pos += sizeof(header) + len;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
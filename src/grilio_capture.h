@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GRILIO_CAPTURE_H
+#define GRILIO_CAPTURE_H
+
+#include "grilio_types.h"
+
+/*
+ * Capture file is a header followed by records, each record being
+ * a fixed size header followed by the data. All numbers are little
+ * endian. Nothing is ever rewritten, a new capture session appends
+ * a START record and the records that follow it have their time
+ * counted from that point.
+ */
+
+typedef enum grilio_capture_type {
+    GRILIO_CAPTURE_START,       /* Beginning of the session */
+    GRILIO_CAPTURE_REQUEST,     /* Outgoing request (payload only) */
+    GRILIO_CAPTURE_PACKET,      /* Incoming packet (without length) */
+    GRILIO_CAPTURE_FRAGMENT     /* code is total length, serial offset */
+} GRILIO_CAPTURE_TYPE;
+
+typedef struct grilio_capture_record {
+    GRILIO_CAPTURE_TYPE type;
+    guint code;
+    guint serial;
+    gint64 time;                /* Microseconds since START */
+    const void* data;
+    guint len;
+} GRilIoCaptureRecord;
+
+typedef struct grilio_capture GRilIoCapture;
+
+/* Writer */
+
+GRilIoCapture*
+grilio_capture_open(
+    const char* path,
+    GError** error);
+
+void
+grilio_capture_write(
+    GRilIoCapture* capture,
+    GRILIO_CAPTURE_TYPE type,
+    guint code,
+    guint serial,
+    const void* data,
+    guint len);
+
+void
+grilio_capture_flush(
+    GRilIoCapture* capture);
+
+void
+grilio_capture_free(
+    GRilIoCapture* capture);
+
+/* Reader */
+
+gsize
+grilio_capture_check(
+    const void* data,
+    gsize size);
+
+gboolean
+grilio_capture_next(
+    const void* data,
+    gsize size,
+    gsize* pos,
+    GRilIoCaptureRecord* record);
+
+#endif /* GRILIO_CAPTURE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
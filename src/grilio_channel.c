@@ -32,9 +32,12 @@
 
 #include "grilio_p.h"
 #include "grilio_parser.h"
+#include "grilio_request_table.h"
+#include "grilio_timer_heap.h"
 #include "grilio_transport_p.h"
 #include "grilio_log.h"
 
+#include <gutil_macros.h>
 #include <gutil_misc.h>
 
 #define GRILIO_MAX_PACKET_LEN (0x8000)
@@ -47,6 +50,13 @@ typedef struct grilio_channel_event GrilIoChannelEvent;
  * submitted and we don't want to get stuck forever. */
 #define GRILIO_DEFAULT_PENDING_TIMEOUT_MS (30000)
 
+/* Queued requests get promoted to the next priority level after
+ * waiting this long, so that low priority ones don't starve. */
+#define GRILIO_DEFAULT_PRIORITY_AGING_MS (1000)
+
+/* Where the adaptive window starts if there's no upper limit */
+#define GRILIO_DEFAULT_ADAPTIVE_WINDOW (8)
+
 /* Miliseconds to microseconds */
 #define MICROSEC(ms) (((gint64)(ms)) * 1000)
 
@@ -60,6 +70,7 @@ enum grilio_transport_events {
     TRANSPORT_EVENT_DISCONNECTED,
     TRANSPORT_EVENT_REQUEST_SENT,
     TRANSPORT_EVENT_RESPONSE,
+    TRANSPORT_EVENT_FRAGMENT,
     TRANSPORT_EVENT_INDICATION,
     TRANSPORT_EVENT_READ_ERROR,
     TRANSPORT_EVENT_WRITE_ERROR,
@@ -70,17 +81,31 @@ enum grilio_transport_events {
 struct grilio_channel_priv {
     GRilIoTransport* transport;
     gulong transport_event_ids[TRANSPORT_EVENT_COUNT];
-    GRilIoRequest* send_req;
+    GPtrArray* send_reqs; /* Being sent (limited by the send window) */
     guint last_req_id;
     guint last_logger_id;
-    GHashTable* req_table;
-    GHashTable* pending;
+    GRilIoRequestTable* req_table; /* Registered and pending requests */
+    GRilIoRequest* first_pending_req;
+    GRilIoRequest* last_pending_req;
+    GRilIoRequestList retry_reqs; /* Waiting to be retried */
+    guint pending_count;
     gboolean last_pending;
     int pending_timeout;
-    guint pending_timeout_id;
-    gint64 next_pending_deadline;
+
+    /* Flow control (zero window means no limit) */
+    guint max_pending;
+    guint window;
+    guint window_acked;
+    gboolean window_closed;
+    gint64 window_latency;
+    gint64 window_decreased;
+    GRILIO_REPLAY replay;
     GSList* log_list;
 
+    /* Deduplication (identical requests share the same leader) */
+    gboolean deduplicate;
+    GHashTable* dedup;
+
     /* Serialization */
     guint last_block_id;
     GHashTable* block_ids;
@@ -88,17 +113,21 @@ struct grilio_channel_priv {
     GRilIoQueue* owner;
     GSList* owner_queue;
 
-    /* Timeouts */
+    /* Request, pending and retry timeouts */
     int timeout;
-    guint timeout_id;
+    GSource* timer;
+    gint64 timer_slack;
     gint64 next_deadline;
+    GRilIoTimerHeap* timers;
 
-    /* Retry queue (sorted) */
-    GRilIoRequest* retry_req;
+    /* Send queue (FIFO per priority level) */
+    GRilIoRequest* first_req[GRILIO_PRIORITY_COUNT];
+    GRilIoRequest* last_req[GRILIO_PRIORITY_COUNT];
+    GRilIoRequestList internal_reqs;
+    gint64 priority_aging;
 
-    /* Send queue */
-    GRilIoRequest* first_req;
-    GRilIoRequest* last_req;
+    /* Fragmented response being reassembled */
+    GByteArray* fragments;
 
     /* Injected events */
     gboolean processing_injects;
@@ -121,6 +150,7 @@ enum grilio_channel_signal {
     SIGNAL_EOF,
     SIGNAL_OWNER,
     SIGNAL_PENDING,
+    SIGNAL_WINDOW,
     SIGNAL_COUNT
 };
 
@@ -130,6 +160,7 @@ enum grilio_channel_signal {
 #define SIGNAL_EOF_NAME         "grilio-eof"
 #define SIGNAL_OWNER_NAME       "grilio-owner"
 #define SIGNAL_PENDING_NAME     "grilio-pending"
+#define SIGNAL_WINDOW_NAME      "grilio-window"
 
 #define SIGNAL_UNSOL_EVENT_DETAIL_FORMAT        "%x"
 #define SIGNAL_UNSOL_EVENT_DETAIL_MAX_LENGTH    (8)
@@ -160,11 +191,6 @@ void
 grilio_channel_reset_timeout(
     GRilIoChannel* self);
 
-static
-void
-grilio_channel_reset_pending_timeout(
-    GRilIoChannel* self);
-
 static
 void
 grilio_channel_schedule_write(
@@ -298,530 +324,1242 @@ grilio_channel_logger_free1(
 
 static
 guint
-grilio_channel_generate_id(
-    GHashTable* table,
-    guint* id)
+grilio_channel_generate_req_id(
+    GRilIoChannelPriv* priv)
 {
+    guint* id = &priv->last_req_id;
+
     (*id)++;
-    while (!(*id) || g_hash_table_contains(table, GINT_TO_POINTER((*id)))) {
+    while (!(*id) || grilio_request_table_lookup(priv->req_table, *id)) {
         (*id)++;
     }
     return (*id);
 }
 
-static
-guint
-grilio_channel_generate_req_id(
-    GRilIoChannelPriv* priv)
-{
-    return grilio_channel_generate_id(priv->req_table, &priv->last_req_id);
-}
-
 static
 guint
 grilio_channel_generate_block_id(
     GRilIoChannelPriv* priv)
 {
-    return grilio_channel_generate_id(priv->block_ids, &priv->last_block_id);
-}
-
-static
-gboolean
-grilio_channel_serialized(
-    GRilIoChannelPriv* priv)
-{
-    return priv->block_ids && g_hash_table_size(priv->block_ids);
-}
+    guint* id = &priv->last_block_id;
 
-static
-void
-grilio_channel_update_pending(
-    GRilIoChannel* self)
-{
-    const gboolean has_pending = grilio_channel_has_pending_requests(self);
-    GRilIoChannelPriv* priv = self->priv;
-    if (priv->last_pending != has_pending) {
-        priv->last_pending = has_pending;
-        g_signal_emit(self, grilio_channel_signals[SIGNAL_PENDING], 0);
+    (*id)++;
+    while (!(*id) || g_hash_table_contains(priv->block_ids,
+        GINT_TO_POINTER(*id))) {
+        (*id)++;
     }
+    return (*id);
 }
 
 static
-void
-grilio_channel_queue_request(
+gint64
+grilio_channel_pending_deadline(
     GRilIoChannelPriv* priv,
     GRilIoRequest* req)
 {
-    GASSERT(!req->next);
-    GASSERT(req->status == GRILIO_REQUEST_NEW ||
-            req->status == GRILIO_REQUEST_RETRY);
-    req->status = GRILIO_REQUEST_QUEUED;
-    if (priv->last_req) {
-        priv->last_req->next = req;
-        priv->last_req = req;
-    } else {
-        GASSERT(!priv->first_req);
-        priv->first_req = priv->last_req = req;
-    }
-    GVERBOSE("Queued %srequest %u (%08x/%08x)", LOG_PREFIX(priv),
-        req->code, req->id, req->current_id);
+    const int req_timeout = (req->timeout > 0) ? req->timeout :
+        priv->pending_timeout;
+    GASSERT(req->submitted);
+    return req->submitted + MICROSEC(req_timeout);
 }
 
+/*
+ * Each request has a single entry in the timer heap, which expires at
+ * the earliest of its deadlines. That's either the request timeout (or
+ * the time to retry it) or the pending timeout, whichever comes first.
+ */
 static
 void
-grilio_channel_requeue_request(
-    GRilIoChannel* self,
+grilio_channel_update_timer(
+    GRilIoChannelPriv* priv,
     GRilIoRequest* req)
 {
-    GRilIoChannelPriv* priv = self->priv;
-
-    GASSERT(!g_hash_table_contains(priv->req_table,
-        GINT_TO_POINTER(req->id)));
-    GASSERT(!g_hash_table_contains(priv->req_table,
-        GINT_TO_POINTER(req->current_id)));
-    GASSERT(!g_hash_table_contains(priv->pending,
-        GINT_TO_POINTER(req->current_id)));
-
-    /* Generate new request id. The first one is kept around because
-     * it was returned to the caller. */
-    req->current_id = grilio_channel_generate_req_id(priv);
-    GASSERT(req->id != req->current_id);
-
-    req->deadline = 0;
-    req->retry_count++;
+    gint64 deadline = 0;
 
-    /* Stick both public and private ids into the table (for cancel) */
-    g_hash_table_insert(priv->req_table,
-        GINT_TO_POINTER(req->id),
-        grilio_request_ref(req));
-    g_hash_table_insert(priv->req_table,
-        GINT_TO_POINTER(req->current_id),
-        grilio_request_ref(req));
+    if (req->deadline && ((req->flags & GRILIO_REQUEST_FLAG_REGISTERED) ||
+        req->status == GRILIO_REQUEST_RETRY)) {
+        deadline = req->deadline;
+    }
+    if (req->flags & GRILIO_REQUEST_FLAG_PENDING) {
+        const gint64 t = grilio_channel_pending_deadline(priv, req);
 
-    GVERBOSE("Queued retry #%d for request %08x", req->retry_count, req->id);
-    grilio_channel_queue_request(priv, req);
-    grilio_channel_schedule_write(self);
+        if (!deadline || deadline > t) {
+            deadline = t;
+        }
+    }
+    if (deadline) {
+        grilio_timer_heap_set(priv->timers, &req->timer, deadline);
+    } else {
+        grilio_timer_heap_remove(priv->timers, &req->timer);
+    }
 }
 
+/*
+ * Requests waiting to be retried are not in the request table. They
+ * are linked to each other via queued_next/queued_prev, which are not
+ * used while the request is neither queued nor attached to another one.
+ */
 static
 GRilIoRequest*
-grilio_channel_dequeue_request(
-    GRilIoChannel* self,
-    gboolean internal_only)
+grilio_channel_lookup_retry(
+    GRilIoChannelPriv* priv,
+    guint id)
 {
-    GRilIoChannelPriv* priv = self->priv;
-    GRilIoRequest* req = priv->first_req;
-    GRilIoRequest* prev = NULL;
-
-    if (req && !(req->flags & GRILIO_REQUEST_FLAG_INTERNAL)) {
-        if (internal_only) {
-            /* This one is not */
-            req = NULL;
-        } else {
-            /* Handle the special (serialized) cases */
-            if (priv->owner) {
-                if (g_hash_table_size(priv->pending)) {
-                    GHashTableIter iter;
-                    gpointer key, value;
-                    g_hash_table_iter_init(&iter, priv->pending);
-                    while (g_hash_table_iter_next(&iter, &key, &value)) {
-                        GRilIoRequest* pending = value;
-                        if (pending->queue != priv->owner) {
-                            /* This request is not associated with the queue
-                             * which owns the channel. Wait until all such
-                             * requests complete, before we start submiting
-                             * requests associated with the owner queue. */
-                            req = NULL;
-                            break;
-                        }
-                    }
-                }
-                /* If a transaction is in progress, pick the first request
-                 * that belongs to the transaction */
-                while (req && req->queue != priv->owner) {
-                    prev = req;
-                    req = req->next;
-                }
-            } else if (grilio_channel_serialized(priv) ||
-                       (req->flags & GRILIO_REQUEST_FLAG_BLOCKING)) {
-                if (g_hash_table_size(priv->pending)) {
-                    /* We need to wait for the currently pending request(s)
-                     * to complete or time out before we can submit a blocking
-                     * request. */
-                    req = NULL;
-                }
-            }
-        }
-    }
+    GRilIoRequest* req;
 
-    if (!req) {
-        /* Check if we have any internal requests queued */
-        req = priv->first_req;
-        while (req && !(req->flags & GRILIO_REQUEST_FLAG_INTERNAL)) {
-            prev = req;
-            req = req->next;
+    for (req = priv->retry_reqs.first; req; req = req->queued_next) {
+        GASSERT(req->status == GRILIO_REQUEST_RETRY);
+        if (req->id == id) {
+            return req;
         }
     }
+    return NULL;
+}
 
-    if (req) {
-        if (prev) {
-            prev->next = req->next;
-        } else {
-            priv->first_req = req->next;
-        }
-        if (req->next) {
-            req->next = NULL;
-            GASSERT(priv->last_req);
-            GASSERT(priv->last_req != req);
-        } else {
-            GASSERT(priv->last_req == req);
-            priv->last_req = prev;
-        }
-        GASSERT(req->status == GRILIO_REQUEST_QUEUED);
-        req->status = GRILIO_REQUEST_SENDING;
-        req->submitted = g_get_monotonic_time();
+/*
+ * The request table holds a single reference to each request it
+ * contains. Registered requests (the ones which can be looked up and
+ * cancelled by id) are stored under both public and current id.
+ * Pending requests are stored under their current id, which keeps
+ * the id from being reused until the response arrives even if the
+ * request has been cancelled. Pending requests are also linked to
+ * each other.
+ */
 
-        GVERBOSE("Sending %srequest %u (%08x/%08x)", LOG_PREFIX(priv),
-            req->code, req->id, req->current_id);
+#define GRILIO_REQUEST_FLAGS_INDEXED \
+    (GRILIO_REQUEST_FLAG_REGISTERED | GRILIO_REQUEST_FLAG_PENDING)
 
-        /* Keep track of pending requests, except for those which
-         * don't expect any reply */
-        if (!(req->flags & GRILIO_REQUEST_FLAG_NO_REPLY)) {
-            g_hash_table_insert(priv->pending,
-                GINT_TO_POINTER(req->current_id),
-                grilio_request_ref(req));
-            grilio_channel_reset_pending_timeout(self);
-            grilio_channel_update_pending(self);
-        }
+static
+void
+grilio_channel_index_request(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
+{
+    if (!(req->flags & GRILIO_REQUEST_FLAGS_INDEXED)) {
+        grilio_request_ref(req);
+        grilio_request_table_insert(priv->req_table, req->current_id, req);
     }
+}
 
-    return req;
+static
+void
+grilio_channel_unindex_request(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
+{
+    if (!(req->flags & GRILIO_REQUEST_FLAGS_INDEXED)) {
+        grilio_request_table_remove(priv->req_table, req->current_id);
+        grilio_request_unref(req);
+    }
 }
 
 static
 void
-grilio_channel_remove_request(
+grilio_channel_register_request(
     GRilIoChannelPriv* priv,
     GRilIoRequest* req)
 {
-    grilio_queue_remove(req);
-    g_hash_table_remove(priv->req_table, GINT_TO_POINTER(req->current_id));
+    GASSERT(!(req->flags & GRILIO_REQUEST_FLAG_REGISTERED));
+    grilio_channel_index_request(priv, req);
+    req->flags |= GRILIO_REQUEST_FLAG_REGISTERED;
     if (req->id != req->current_id) {
-        g_hash_table_remove(priv->req_table, GINT_TO_POINTER(req->id));
+        grilio_request_table_insert(priv->req_table, req->id, req);
     }
 }
 
 static
 void
-grilio_channel_handle_error(
-    GRilIoTransport* transport,
-    const GError* error,
-    void* user_data)
+grilio_channel_unregister_request(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
 {
-    GRilIoChannel* self = GRILIO_CHANNEL(user_data);
-    GRilIoChannelPriv* priv = self->priv;
+    if (req->flags & GRILIO_REQUEST_FLAG_REGISTERED) {
+        req->flags &= ~GRILIO_REQUEST_FLAG_REGISTERED;
+        if (req->flags & GRILIO_REQUEST_FLAG_SHARED) {
+            /* Identical requests can no longer attach to this one */
+            req->flags &= ~GRILIO_REQUEST_FLAG_SHARED;
+            GASSERT(g_hash_table_lookup(priv->dedup, req) == req);
+            g_hash_table_remove(priv->dedup, req);
+        }
+        if (req->id != req->current_id) {
+            grilio_request_table_remove(priv->req_table, req->id);
+        }
+        grilio_channel_update_timer(priv, req);
+        /* May release the last reference */
+        grilio_channel_unindex_request(priv, req);
+    }
+}
 
-    grilio_transport_shutdown(priv->transport, FALSE);
-    g_signal_emit(self, grilio_channel_signals[SIGNAL_ERROR], 0, error);
+static
+GRilIoRequest*
+grilio_channel_lookup_request(
+    GRilIoChannelPriv* priv,
+    guint id)
+{
+    GRilIoRequest* req = grilio_request_table_lookup(priv->req_table, id);
+
+    return (req && (req->flags & GRILIO_REQUEST_FLAG_REGISTERED)) ?
+        req : NULL;
 }
 
 static
-void
-grilio_channel_handle_connected(
-    GRilIoTransport* transport,
-    void* user_data)
+GRilIoRequest*
+grilio_channel_lookup_public(
+    GRilIoChannelPriv* priv,
+    guint id)
 {
-    GRilIoChannel* self = GRILIO_CHANNEL(user_data);
+    GRilIoRequest* req = grilio_channel_lookup_request(priv, id);
 
-    self->connected = TRUE;
-    self->ril_version = transport->ril_version +
-        grilio_transport_version_offset(transport);
-    GVERBOSE("Public RIL version %u", self->ril_version);
-    g_signal_emit(self, grilio_channel_signals[SIGNAL_CONNECTED], 0);
-    grilio_channel_process_injects(self);
-    grilio_channel_schedule_write(self);
+    /* The id which the request took over from a cancelled leader
+     * belongs to the caller which has cancelled it */
+    return (req && (req->id == id ||
+        !(req->flags & GRILIO_REQUEST_FLAG_HANDED_OVER))) ? req : NULL;
 }
 
 static
-void
-grilio_channel_handle_disconnected(
-    GRilIoTransport* transport,
-    void* user_data)
+GRilIoRequest*
+grilio_channel_lookup_pending(
+    GRilIoChannelPriv* priv,
+    guint id)
 {
-    GRilIoChannel* self = GRILIO_CHANNEL(user_data);
+    GRilIoRequest* req = grilio_request_table_lookup(priv->req_table, id);
 
-    self->connected = FALSE;
-    g_signal_emit(self, grilio_channel_signals[SIGNAL_EOF], 0);
+    return (req && (req->flags & GRILIO_REQUEST_FLAG_PENDING) &&
+        req->current_id == id) ? req : NULL;
 }
 
 static
 void
-grilio_channel_schedule_retry(
+grilio_channel_add_pending(
     GRilIoChannelPriv* priv,
     GRilIoRequest* req)
 {
-    GASSERT(!req->next);
-    req->deadline = g_get_monotonic_time() + MICROSEC(req->retry_period);
-    req->status = GRILIO_REQUEST_RETRY;
-
-    /* Remove the request from the request table while it's waiting
-     * for its turn to retry. It means that it gets completed during
-     * this time, we will miss the reply. */
-    grilio_request_ref(req);
-    g_hash_table_remove(priv->req_table, GINT_TO_POINTER(req->current_id));
-    if (req->id != req->current_id) {
-        g_hash_table_remove(priv->req_table, GINT_TO_POINTER(req->id));
-    }
-
-    GVERBOSE("Retry #%d for request %08x in %u ms", req->retry_count+1,
-        req->id, req->retry_period);
-
-    /* Keep the retry queue sorted by deadline */
-    if (priv->retry_req && priv->retry_req->deadline < req->deadline) {
-        GRilIoRequest* prev = priv->retry_req;
-        GRilIoRequest* next = prev->next;
-        while (next && next->deadline < req->deadline) {
-            prev = next;
-            next = prev->next;
-        }
-        prev->next = req;
-        req->next = next;
+    GASSERT(!(req->flags & GRILIO_REQUEST_FLAG_PENDING));
+    grilio_channel_index_request(priv, req);
+    req->flags |= GRILIO_REQUEST_FLAG_PENDING;
+    req->pending_next = NULL;
+    req->pending_prev = priv->last_pending_req;
+    if (priv->last_pending_req) {
+        priv->last_pending_req->pending_next = req;
     } else {
-        req->next = priv->retry_req;
-        priv->retry_req = req;
+        priv->first_pending_req = req;
     }
+    priv->last_pending_req = req;
+    priv->pending_count++;
+    if (req->queue) {
+        req->queue->pending_count++;
+    }
+    grilio_channel_update_timer(priv, req);
 }
 
 static
-gint64
-grilio_channel_pending_deadline(
+void
+grilio_channel_remove_pending(
     GRilIoChannelPriv* priv,
     GRilIoRequest* req)
 {
-    const int req_timeout = (req->timeout > 0) ? req->timeout :
-        priv->pending_timeout;
-    GASSERT(req->submitted);
-    return req->submitted + MICROSEC(req_timeout);
+    GASSERT(req->flags & GRILIO_REQUEST_FLAG_PENDING);
+    GASSERT(priv->pending_count > 0);
+    if (req->pending_prev) {
+        req->pending_prev->pending_next = req->pending_next;
+    } else {
+        priv->first_pending_req = req->pending_next;
+    }
+    if (req->pending_next) {
+        req->pending_next->pending_prev = req->pending_prev;
+    } else {
+        priv->last_pending_req = req->pending_prev;
+    }
+    req->pending_prev = req->pending_next = NULL;
+    req->flags &= ~GRILIO_REQUEST_FLAG_PENDING;
+    priv->pending_count--;
+    if (req->queue) {
+        GASSERT(req->queue->pending_count > 0);
+        req->queue->pending_count--;
+    }
+    grilio_channel_update_timer(priv, req);
+    /* May release the last reference */
+    grilio_channel_unindex_request(priv, req);
 }
 
 static
 gboolean
-grilio_channel_pending_timeout(
-    gpointer user_data)
+grilio_channel_serialized(
+    GRilIoChannelPriv* priv)
 {
-    GRilIoChannel* self = GRILIO_CHANNEL(user_data);
-    GRilIoChannelPriv* priv = self->priv;
-    const gint64 now = g_get_monotonic_time();
-    GHashTableIter iter;
-    gpointer value;
+    return priv->block_ids && g_hash_table_size(priv->block_ids);
+}
 
-    priv->pending_timeout_id = 0;
-    g_hash_table_iter_init(&iter, priv->pending);
-    while (g_hash_table_iter_next(&iter, NULL, &value)) {
-        GRilIoRequest* req = value;
-        const gint64 t = grilio_channel_pending_deadline(priv, req);
-        if (t <= now) {
-            GDEBUG("Pending %srequest %u (%08x/%08x) expired",
-                LOG_PREFIX(priv), req->code, req->id, req->current_id);
-            if (req == priv->block_req) {
-                /* Let the life continue */
-                grilio_request_unref(priv->block_req);
-                priv->block_req = NULL;
-            }
-            g_hash_table_iter_remove(&iter);
-        }
-    }
+static
+guint
+grilio_channel_window_size(
+    GRilIoChannelPriv* priv)
+{
+    return priv->window_latency ? priv->window : priv->max_pending;
+}
 
-    grilio_channel_reset_pending_timeout(self);
-    grilio_channel_schedule_write(self);
-    grilio_channel_update_pending(self);
-    return G_SOURCE_REMOVE;
+static
+gboolean
+grilio_channel_window_full(
+    GRilIoChannelPriv* priv)
+{
+    const guint size = grilio_channel_window_size(priv);
+
+    return size && priv->pending_count >= size;
 }
 
 static
 void
-grilio_channel_reset_pending_timeout(
+grilio_channel_update_window(
     GRilIoChannel* self)
 {
     GRilIoChannelPriv* priv = self->priv;
-    if (g_hash_table_size(priv->pending)) {
-        GHashTableIter iter;
-        const gint64 now = g_get_monotonic_time();
-        gint64 deadline = 0;
-        gpointer value;
-
-        /* Calculate the new deadline */
-        g_hash_table_iter_init(&iter, priv->pending);
-        while (g_hash_table_iter_next(&iter, NULL, &value)) {
-            GRilIoRequest* req = value;
-            const gint64 t = grilio_channel_pending_deadline(priv, req);
-            if (!deadline || deadline > t) {
-                deadline = t;
-            }
-        }
+    const gboolean closed = grilio_channel_window_full(priv);
 
-        if (priv->next_pending_deadline != deadline) {
-           /* Reset the timer */
-            if (priv->pending_timeout_id) {
-                g_source_remove(priv->pending_timeout_id);
+    if (priv->window_closed != closed) {
+        priv->window_closed = closed;
+        GVERBOSE("%swindow %s (%u/%u)", LOG_PREFIX(priv), closed ?
+            "closed" : "open", priv->pending_count,
+            grilio_channel_window_size(priv));
+        g_signal_emit(self, grilio_channel_signals[SIGNAL_WINDOW], 0);
+    }
+}
+
+static
+void
+grilio_channel_window_feedback(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req,
+    gboolean congested)
+{
+    if (priv->window_latency) {
+        if (congested) {
+            /* Multiplicative decrease, not more often than once per
+             * round trip, i.e. the requests which have been sent before
+             * the last decrease don't count. */
+            if (req->submitted > priv->window_decreased) {
+                priv->window = MAX(priv->window / 2, 1);
+                priv->window_acked = 0;
+                priv->window_decreased = g_get_monotonic_time();
+                GDEBUG("%swindow shrinks to %u", LOG_PREFIX(priv),
+                    priv->window);
             }
-            priv->next_pending_deadline = deadline;
-            if (deadline > now) {
-                priv->pending_timeout_id =
-                    g_timeout_add(((deadline - now) + 999)/1000,
-                        grilio_channel_pending_timeout, self);
-            } else {
-                priv->pending_timeout_id =
-                    g_idle_add(grilio_channel_pending_timeout, self);
+        } else if (!priv->max_pending || priv->window < priv->max_pending) {
+            /* Additive increase, by one per window's worth of responses */
+            if (++priv->window_acked >= priv->window) {
+                priv->window++;
+                priv->window_acked = 0;
+                GVERBOSE("%swindow grows to %u", LOG_PREFIX(priv),
+                    priv->window);
+            }
+        }
+    }
+}
+
+static
+void
+grilio_channel_update_pending(
+    GRilIoChannel* self)
+{
+    const gboolean has_pending = grilio_channel_has_pending_requests(self);
+    GRilIoChannelPriv* priv = self->priv;
+    if (priv->last_pending != has_pending) {
+        priv->last_pending = has_pending;
+        g_signal_emit(self, grilio_channel_signals[SIGNAL_PENDING], 0);
+    }
+    grilio_channel_update_window(self);
+}
+
+static
+GRilIoRequestList*
+grilio_channel_queued_list(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
+{
+    /* Internal requests never belong to a queue */
+    return (req->flags & GRILIO_REQUEST_FLAG_INTERNAL) ? &priv->internal_reqs :
+        req->queue ? &req->queue->queued : NULL;
+}
+
+static
+GRILIO_PRIORITY
+grilio_channel_request_priority(
+    GRilIoRequest* req)
+{
+    if (req->flags & GRILIO_REQUEST_FLAG_INTERNAL) {
+        return GRILIO_PRIORITY_HIGH;
+    } else if (req->priority != GRILIO_PRIORITY_DEFAULT) {
+        return req->priority;
+    } else if (req->queue) {
+        return req->queue->priority;
+    } else {
+        return GRILIO_PRIORITY_NORMAL;
+    }
+}
+
+static
+void
+grilio_channel_queue_request(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
+{
+    GRilIoRequestList* list = grilio_channel_queued_list(priv, req);
+    const GRILIO_PRIORITY p = grilio_channel_request_priority(req);
+
+    GASSERT(!req->next);
+    GASSERT(!req->prev);
+    GASSERT(req->status == GRILIO_REQUEST_NEW ||
+            req->status == GRILIO_REQUEST_RETRY);
+    req->status = GRILIO_REQUEST_QUEUED;
+    req->queued_priority = p;
+    req->enqueued = g_get_monotonic_time();
+    if (priv->last_req[p]) {
+        req->prev = priv->last_req[p];
+        priv->last_req[p]->next = req;
+        priv->last_req[p] = req;
+    } else {
+        GASSERT(!priv->first_req[p]);
+        priv->first_req[p] = priv->last_req[p] = req;
+    }
+    if (list) {
+        grilio_request_list_append(list, req);
+    }
+    GVERBOSE("Queued %srequest %u (%08x/%08x)", LOG_PREFIX(priv),
+        req->code, req->id, req->current_id);
+}
+
+static
+void
+grilio_channel_queue_request_first(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
+{
+    GRilIoRequestList* list = grilio_channel_queued_list(priv, req);
+    const GRILIO_PRIORITY p = grilio_channel_request_priority(req);
+    GRilIoRequest* first = priv->first_req[p];
+
+    GASSERT(!req->next);
+    GASSERT(!req->prev);
+    req->status = GRILIO_REQUEST_QUEUED;
+    req->queued_priority = p;
+    /* Keep the head of the queue the oldest one */
+    if (first) {
+        req->enqueued = first->enqueued;
+        req->next = first;
+        first->prev = req;
+    } else {
+        req->enqueued = g_get_monotonic_time();
+        priv->last_req[p] = req;
+    }
+    priv->first_req[p] = req;
+    if (list) {
+        grilio_request_list_prepend(list, req);
+    }
+}
+
+static
+void
+grilio_channel_queue_request_before(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req,
+    GRilIoRequest* next)
+{
+    GRilIoRequestList* list = grilio_channel_queued_list(priv, req);
+    const GRILIO_PRIORITY p = next->queued_priority;
+
+    /* Takes the place of another request in the send queue */
+    GASSERT(!req->next);
+    GASSERT(!req->prev);
+    GASSERT(next->status == GRILIO_REQUEST_QUEUED);
+    req->status = GRILIO_REQUEST_QUEUED;
+    req->queued_priority = p;
+    req->enqueued = next->enqueued;
+    req->next = next;
+    req->prev = next->prev;
+    if (next->prev) {
+        next->prev->next = req;
+    } else {
+        GASSERT(priv->first_req[p] == next);
+        priv->first_req[p] = req;
+    }
+    next->prev = req;
+    if (list) {
+        GRilIoRequest* pos;
+
+        /* Keep the list in submission order too */
+        if (list == grilio_channel_queued_list(priv, next)) {
+            pos = next;
+        } else {
+            pos = list->first;
+            while (pos && pos->enqueued <= req->enqueued) {
+                pos = pos->queued_next;
             }
         }
+        grilio_request_list_insert_before(list, req, pos);
+    }
+}
+
+static
+void
+grilio_channel_unqueue_request(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
+{
+    GRilIoRequestList* list = grilio_channel_queued_list(priv, req);
+
+    GASSERT(req->status == GRILIO_REQUEST_QUEUED);
+    if (list) {
+        grilio_request_list_remove(list, req);
+    }
+    if (req->prev) {
+        req->prev->next = req->next;
+    } else {
+        GASSERT(priv->first_req[req->queued_priority] == req);
+        priv->first_req[req->queued_priority] = req->next;
+    }
+    if (req->next) {
+        req->next->prev = req->prev;
     } else {
-        /* No more pending requests, cancel the timeout */
-        if (priv->pending_timeout_id) {
-            g_source_remove(priv->pending_timeout_id);
-            priv->pending_timeout_id = 0;
+        GASSERT(priv->last_req[req->queued_priority] == req);
+        priv->last_req[req->queued_priority] = req->prev;
+    }
+    req->next = req->prev = NULL;
+}
+
+static
+GRilIoRequest*
+grilio_channel_first_queued(
+    GRilIoChannelPriv* priv)
+{
+    GRilIoRequest* first = NULL;
+    gint64 first_level = -1;
+    gint64 now = 0;
+    int p;
+
+    /* Each level is FIFO, only the heads need to be looked at. Those
+     * which have been waiting for too long get promoted. On a tie, the
+     * higher priority wins. */
+    for (p = GRILIO_PRIORITY_HIGH; p >= GRILIO_PRIORITY_LOW; p--) {
+        GRilIoRequest* req = priv->first_req[p];
+
+        if (req) {
+            gint64 level = p;
+
+            if (priv->priority_aging) {
+                if (!now) now = g_get_monotonic_time();
+                level += (now - req->enqueued) / priv->priority_aging;
+            }
+            if (level > first_level) {
+                first = req;
+                first_level = level;
+            }
+        }
+    }
+    return first;
+}
+
+static
+void
+grilio_channel_requeue_request(
+    GRilIoChannel* self,
+    GRilIoRequest* req)
+{
+    GRilIoChannelPriv* priv = self->priv;
+
+    GASSERT(!(req->flags & GRILIO_REQUEST_FLAGS_INDEXED));
+    GASSERT(req->status == GRILIO_REQUEST_RETRY);
+    grilio_request_list_remove(&priv->retry_reqs, req);
+
+    /* Generate new request id. The first one is kept around because
+     * it was returned to the caller. */
+    req->current_id = grilio_channel_generate_req_id(priv);
+    req->flags &= ~GRILIO_REQUEST_FLAG_HANDED_OVER;
+    GASSERT(req->id != req->current_id);
+
+    req->deadline = 0;
+    req->retry_count++;
+
+    /* Both public and private ids go into the table (for cancel) */
+    grilio_channel_register_request(priv, req);
+
+    GVERBOSE("Queued retry #%d for request %08x", req->retry_count, req->id);
+    grilio_channel_queue_request(priv, req);
+    grilio_channel_update_timer(priv, req);
+    grilio_channel_schedule_write(self);
+}
+
+static
+GRilIoRequest*
+grilio_channel_dequeue_request(
+    GRilIoChannel* self,
+    gboolean internal_only)
+{
+    GRilIoChannelPriv* priv = self->priv;
+    GRilIoRequest* req = grilio_channel_first_queued(priv);
+
+    if (req && !(req->flags & GRILIO_REQUEST_FLAG_INTERNAL)) {
+        if (internal_only) {
+            /* This one is not */
+            req = NULL;
+        } else {
+            /* Handle the special (serialized) cases */
+            if (priv->owner) {
+                GASSERT(priv->pending_count >= priv->owner->pending_count);
+                if (priv->pending_count > priv->owner->pending_count) {
+                    /* Some pending requests are not associated with the
+                     * queue which owns the channel. Wait until all such
+                     * requests complete, before we start submiting
+                     * requests associated with the owner queue. */
+                    req = NULL;
+                } else {
+                    /* If a transaction is in progress, pick the first
+                     * request that belongs to the transaction */
+                    req = priv->owner->queued.first;
+                }
+            } else if (grilio_channel_serialized(priv) ||
+                       (req->flags & GRILIO_REQUEST_FLAG_BLOCKING)) {
+                if (priv->pending_count) {
+                    /* We need to wait for the currently pending request(s)
+                     * to complete or time out before we can submit a blocking
+                     * request. */
+                    req = NULL;
+                }
+            }
+        }
+    }
+
+    if (!req) {
+        /* Check if we have any internal requests queued */
+        req = priv->internal_reqs.first;
+    }
+
+    if (req) {
+        grilio_channel_unqueue_request(priv, req);
+        req->status = GRILIO_REQUEST_SENDING;
+        req->submitted = g_get_monotonic_time();
+
+        GVERBOSE("Sending %srequest %u (%08x/%08x)", LOG_PREFIX(priv),
+            req->code, req->id, req->current_id);
+
+        /* Keep track of pending requests, except for those which
+         * don't expect any reply */
+        if (!(req->flags & GRILIO_REQUEST_FLAG_NO_REPLY)) {
+            grilio_channel_add_pending(priv, req);
+            grilio_channel_reset_timeout(self);
+            grilio_channel_update_pending(self);
+        }
+    }
+
+    return req;
+}
+
+static
+void
+grilio_channel_remove_request(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
+{
+    grilio_queue_remove(req);
+    grilio_channel_unregister_request(priv, req);
+}
+
+static
+void
+grilio_channel_complete_request(
+    GRilIoChannel* self,
+    GRilIoRequest* req,
+    int status,
+    const void* data,
+    guint len)
+{
+    if (req->fragment && data && len) {
+        /* Streaming requests receive all the data as fragments */
+        req->fragment(self, status, 0, len, data, len, req->user_data);
+        data = NULL;
+        len = 0;
+    }
+    if (req->response_bytes) {
+        /* No bytes if the request has timed out or has been cancelled */
+        GBytes* bytes = data ? grilio_transport_packet_bytes
+            (self->priv->transport, data, len) : NULL;
+
+        req->response_bytes(self, status, bytes, req->user_data);
+        if (bytes) {
+            g_bytes_unref(bytes);
         }
+    } else if (req->response) {
+        req->response(self, status, data, len, req->user_data);
     }
 }
 
+/*
+ * Deduplication. A request which can be shared is put to the dedup
+ * table while it's registered. Identical requests submitted during
+ * that time don't get queued, they are attached to the one from the
+ * table (the leader) and receive the same response. The attached
+ * requests stay registered (under their own ids) and the leader holds
+ * a reference to each of them.
+ */
+
+static
+guint
+grilio_channel_dedup_hash(
+    gconstpointer key)
+{
+    GRilIoRequest* req = (GRilIoRequest*)key;
+    const guchar* data = grilio_request_data(req);
+    const guint len = grilio_request_size(req);
+    guint i, h = req->code;
+
+    for (i = 0; i < len; i++) {
+        h = h * 31 + data[i];
+    }
+    return h;
+}
+
 static
 gboolean
-grilio_channel_timeout(
-    gpointer user_data)
+grilio_channel_dedup_equal(
+    gconstpointer a,
+    gconstpointer b)
+{
+    GRilIoRequest* r1 = (GRilIoRequest*)a;
+    GRilIoRequest* r2 = (GRilIoRequest*)b;
+    const guint len = grilio_request_size(r1);
+
+    return r1->code == r2->code && len == grilio_request_size(r2) &&
+        (!len || !memcmp(grilio_request_data(r1),
+        grilio_request_data(r2), len));
+}
+
+static
+gboolean
+grilio_channel_can_share(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
+{
+    /* Blocking and streaming requests are never shared, neither are
+     * those which nobody is waiting for */
+    return (priv->deduplicate || (req->queue && req->queue->deduplicate)) &&
+        !(req->flags & (GRILIO_REQUEST_FLAG_BLOCKING |
+        GRILIO_REQUEST_FLAG_INTERNAL)) && !req->fragment &&
+        (req->response || req->response_bytes);
+}
+
+static
+GRilIoRequest*
+grilio_channel_find_leader(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
+{
+    GRilIoRequest* leader = g_hash_table_lookup(priv->dedup, req);
+
+    /* A request held back by the transaction may never be sent until
+     * the transaction is finished, and that may never happen if the
+     * owner is waiting for the response */
+    if (leader && priv->owner && leader->status == GRILIO_REQUEST_QUEUED &&
+        leader->queue != priv->owner) {
+        return NULL;
+    }
+    return leader;
+}
+
+static
+void
+grilio_channel_detach_request(
+    GRilIoRequest* req)
+{
+    GRilIoRequest* leader = req->leader;
+
+    /* Releases the references held by the leader, the caller makes
+     * sure that the requests don't get deallocated */
+    if (leader) {
+        grilio_request_list_remove(&leader->attached, req);
+        req->leader = NULL;
+        grilio_request_unref(req);
+    }
+    while (req->attached.first) {
+        grilio_channel_detach_request(req->attached.first);
+    }
+}
+
+static
+void
+grilio_channel_complete_attached(
+    GRilIoChannel* self,
+    GRilIoRequest* leader,
+    int status,
+    const void* data,
+    guint len)
+{
+    GRilIoChannelPriv* priv = self->priv;
+    GRilIoRequest* req;
+
+    /* Callbacks may cancel the remaining attached requests */
+    while ((req = leader->attached.first) != NULL) {
+        GVERBOSE("Completing %srequest %u (%08x) with %08x", LOG_PREFIX(priv),
+            req->code, req->id, leader->current_id);
+        grilio_request_list_remove(&leader->attached, req);
+        req->leader = NULL;
+        grilio_channel_remove_request(priv, req);
+        req->status = GRILIO_REQUEST_DONE;
+        grilio_channel_complete_request(self, req, status, data, len);
+        grilio_request_unref(req);
+    }
+}
+
+static
+void
+grilio_channel_hand_over(
+    GRilIoChannel* self,
+    GRilIoRequest* req,
+    gboolean notify)
+{
+    GRilIoChannelPriv* priv = self->priv;
+    GRilIoRequest* next = req->attached.first;
+    GRilIoRequest* link;
+    gboolean shared = FALSE;
+
+    /*
+     * The leader is being cancelled but the requests attached to it
+     * still want the response. The first one of them takes over,
+     * whatever state the leader is in. The reference which the leader
+     * holds to it gets passed to the queue (or the retry timer).
+     */
+    GDEBUG("Cancelled %srequest %u (%08x/%08x), %08x takes over",
+        LOG_PREFIX(priv), req->code, req->id, req->current_id, next->id);
+    grilio_request_ref(req);
+    grilio_request_list_remove(&req->attached, next);
+    next->leader = NULL;
+    while ((link = req->attached.first) != NULL) {
+        grilio_request_list_remove(&req->attached, link);
+        grilio_request_list_append(&next->attached, link);
+        link->leader = next;
+    }
+    if (req->flags & GRILIO_REQUEST_FLAG_SHARED) {
+        req->flags &= ~GRILIO_REQUEST_FLAG_SHARED;
+        g_hash_table_remove(priv->dedup, req);
+        shared = TRUE;
+    }
+
+    switch (req->status) {
+    case GRILIO_REQUEST_QUEUED:
+        grilio_channel_queue_request_before(priv, next, req);
+        grilio_channel_remove_request(priv, req);
+        grilio_channel_unqueue_request(priv, req);
+        /* Release the reference held by the queue */
+        grilio_request_unref(req);
+        break;
+    case GRILIO_REQUEST_SENDING:
+    case GRILIO_REQUEST_SENT:
+        {
+            const gboolean pending = (req->flags &
+                GRILIO_REQUEST_FLAG_PENDING) != 0;
+
+            /* The response is going to arrive with the leader's id */
+            if (pending) {
+                grilio_channel_remove_pending(priv, req);
+            }
+            grilio_channel_remove_request(priv, req);
+            grilio_channel_unregister_request(priv, next);
+            next->current_id = req->current_id;
+            next->flags |= GRILIO_REQUEST_FLAG_HANDED_OVER;
+            next->submitted = req->submitted;
+            next->deadline = req->deadline;
+            next->retry_count = req->retry_count;
+            next->status = GRILIO_REQUEST_SENT;
+            grilio_channel_register_request(priv, next);
+            if (pending) {
+                grilio_channel_add_pending(priv, next);
+            } else {
+                grilio_channel_update_timer(priv, next);
+            }
+            if (priv->block_req == req) {
+                grilio_request_unref(priv->block_req);
+                priv->block_req = grilio_request_ref(next);
+            }
+            /* The table holds a reference to it now */
+            grilio_request_unref(next);
+        }
+        break;
+    case GRILIO_REQUEST_RETRY:
+        grilio_channel_unregister_request(priv, next);
+        grilio_request_list_remove(&priv->retry_reqs, req);
+        grilio_request_list_append(&priv->retry_reqs, next);
+        next->status = GRILIO_REQUEST_RETRY;
+        next->deadline = req->deadline;
+        next->retry_count = req->retry_count;
+        grilio_channel_update_timer(priv, next);
+        req->status = GRILIO_REQUEST_CANCELLED;
+        grilio_channel_update_timer(priv, req);
+        grilio_channel_remove_request(priv, req);
+        /* Release the retry reference */
+        grilio_request_unref(req);
+        break;
+    default:
+        GASSERT(FALSE);
+        break;
+    }
+
+    req->status = GRILIO_REQUEST_CANCELLED;
+    if (shared && (next->flags & GRILIO_REQUEST_FLAG_REGISTERED)) {
+        next->flags |= GRILIO_REQUEST_FLAG_SHARED;
+        g_hash_table_insert(priv->dedup, next, next);
+    }
+    if (notify) {
+        grilio_channel_complete_request(self, req,
+            GRILIO_STATUS_CANCELLED, NULL, 0);
+    }
+    grilio_request_unref(req);
+    grilio_channel_reset_timeout(self);
+    grilio_channel_schedule_write(self);
+}
+
+static
+void
+grilio_channel_handle_error(
+    GRilIoTransport* transport,
+    const GError* error,
+    void* user_data)
 {
     GRilIoChannel* self = GRILIO_CHANNEL(user_data);
     GRilIoChannelPriv* priv = self->priv;
-    GRilIoRequest* expired = NULL;
-    const gint64 now = g_get_monotonic_time();
-    gboolean pending_expired = FALSE;
-    GHashTableIter iter;
-    gpointer key, value;
 
-    priv->timeout_id = 0;
-    priv->next_deadline = 0;
+    grilio_transport_shutdown(priv->transport, FALSE);
+    g_signal_emit(self, grilio_channel_signals[SIGNAL_ERROR], 0, error);
+}
 
-    /* Expired requests */
-    g_hash_table_iter_init(&iter, priv->req_table);
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        GRilIoRequest* req = value;
-        if (key == GINT_TO_POINTER(req->current_id) &&
-            req->deadline && req->deadline <= now) {
-            GASSERT(!req->next);
-            req->next = expired;
-            req->deadline = 0;
-            GDEBUG("%s%srequest %u (%08x/%08x) timed out",
-                (priv->block_req == req) ? "Blocking " : "",
-                LOG_PREFIX(priv), req->code, req->id, req->current_id);
+static
+void
+grilio_channel_handle_connected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    GRilIoChannel* self = GRILIO_CHANNEL(user_data);
+
+    self->connected = TRUE;
+    self->ril_version = transport->ril_version +
+        grilio_transport_version_offset(transport);
+    GVERBOSE("Public RIL version %u", self->ril_version);
+    g_signal_emit(self, grilio_channel_signals[SIGNAL_CONNECTED], 0);
+    grilio_channel_process_injects(self);
+    grilio_channel_schedule_write(self);
+}
+
+static
+void
+grilio_channel_requeue_send_reqs(
+    GRilIoChannel* self)
+{
+    GRilIoChannelPriv* priv = self->priv;
+    GPtrArray* reqs = priv->send_reqs;
+    guint i;
+
+    /*
+     * Requests which haven't been completely written will be sent again
+     * if the transport reconnects. Put them back to the head of the queue
+     * preserving their order. The reference held by send_reqs is passed
+     * to the queue.
+     */
+    for (i = reqs->len; i > 0; i--) {
+        GRilIoRequest* req = g_ptr_array_index(reqs, i - 1);
+
+        reqs->pdata[i - 1] = NULL;
+        if (req->status == GRILIO_REQUEST_SENDING) {
+            GVERBOSE("Requeuing %srequest %u (%08x/%08x)", LOG_PREFIX(priv),
+                req->code, req->id, req->current_id);
+            if (req->flags & GRILIO_REQUEST_FLAG_PENDING) {
+                grilio_channel_remove_pending(priv, req);
+            }
             if (priv->block_req == req) {
-                expired = priv->block_req;
+                grilio_request_unref(priv->block_req);
                 priv->block_req = NULL;
-            } else {
-                expired = grilio_request_ref(req);
             }
+            req->submitted = 0;
+            req->deadline = 0;
+            grilio_channel_queue_request_first(priv, req);
+            grilio_channel_update_timer(priv, req);
+        } else {
+            grilio_request_unref(req);
         }
     }
+    g_ptr_array_set_size(reqs, 0);
+    grilio_channel_reset_timeout(self);
+    grilio_channel_update_pending(self);
+}
 
-    while (expired) {
-        GRilIoRequest* req = expired;
-        expired = req->next;
-        req->next = NULL;
-        if (g_hash_table_remove(priv->pending,
-            GINT_TO_POINTER(req->current_id))) {
-            grilio_channel_update_pending(self);
-            pending_expired = TRUE;
+static
+void
+grilio_channel_replay_pending(
+    GRilIoChannel* self)
+{
+    GRilIoChannelPriv* priv = self->priv;
+    GRilIoRequest* resubmit = NULL;
+    GRilIoRequest* failed = NULL;
+    GRilIoRequest* link = priv->first_pending_req;
+
+    /*
+     * The responses to the pending requests are never going to arrive.
+     * Unless they are supposed to wait for the timeout, idempotent ones
+     * go back to the head of the queue (in the order they were sent)
+     * and get resubmitted when RIL_UNSOL_RIL_CONNECTED arrives over the
+     * new connection. The rest get completed right away.
+     */
+    while (link) {
+        GRilIoRequest* req = link;
+        const GRILIO_REPLAY replay = (req->replay == GRILIO_REPLAY_DEFAULT) ?
+            priv->replay : req->replay;
+
+        link = req->pending_next;
+        if (replay == GRILIO_REPLAY_WAIT) {
+            continue;
         }
-        g_hash_table_remove(priv->req_table, GINT_TO_POINTER(req->id));
-        if (grilio_request_can_retry(req)) {
-            grilio_channel_schedule_retry(priv, req);
-        } else {
-            grilio_channel_remove_request(priv, req);
-            req->status = GRILIO_REQUEST_DONE;
-            if (req->response) {
-                req->response(self, GRILIO_STATUS_TIMEOUT, NULL, 0,
-                    req->user_data);
+
+        /* This reference is released below */
+        grilio_request_ref(req);
+        grilio_channel_remove_pending(priv, req);
+        if (priv->block_req == req) {
+            grilio_request_unref(priv->block_req);
+            priv->block_req = NULL;
+        }
+        GASSERT(!req->next);
+        if (req->status != GRILIO_REQUEST_SENT) {
+            /* Cancelled */
+            grilio_request_unref(req);
+        } else if (replay == GRILIO_REPLAY_RESUBMIT) {
+            GRilIoRequest* prev = NULL;
+            GRilIoRequest* next = resubmit;
+
+            /* Newest first, they get pushed to the head of the queue */
+            while (next && next->submitted > req->submitted) {
+                prev = next;
+                next = next->next;
             }
+            req->next = next;
+            if (prev) {
+                prev->next = req;
+            } else {
+                resubmit = req;
+            }
+        } else {
+            req->next = failed;
+            failed = req;
         }
+    }
+
+    while (resubmit) {
+        GRilIoRequest* req = resubmit;
+
+        resubmit = req->next;
+        req->next = NULL;
+        GVERBOSE("Resubmitting %srequest %u (%08x/%08x)",
+            LOG_PREFIX(priv), req->code, req->id, req->current_id);
+        req->submitted = 0;
+        req->deadline = 0;
+        grilio_channel_queue_request_first(priv, req);
+        grilio_channel_update_timer(priv, req);
+    }
+
+    grilio_channel_reset_timeout(self);
+    grilio_channel_update_pending(self);
+
+    while (failed) {
+        GRilIoRequest* req = failed;
+
+        failed = req->next;
+        req->next = NULL;
+        GDEBUG("%srequest %u (%08x/%08x) failed", LOG_PREFIX(priv),
+            req->code, req->id, req->current_id);
+        grilio_channel_remove_request(priv, req);
+        req->status = GRILIO_REQUEST_DONE;
+        grilio_channel_complete_request(self, req,
+            GRILIO_STATUS_DISCONNECTED, NULL, 0);
+        grilio_channel_complete_attached(self, req,
+            GRILIO_STATUS_DISCONNECTED, NULL, 0);
         grilio_request_unref(req);
     }
+}
+
+static
+void
+grilio_channel_handle_disconnected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    GRilIoChannel* self = GRILIO_CHANNEL(user_data);
+
+    self->connected = FALSE;
+    grilio_channel_requeue_send_reqs(self);
+    grilio_channel_replay_pending(self);
+    g_signal_emit(self, grilio_channel_signals[SIGNAL_EOF], 0);
+}
+
+static
+void
+grilio_channel_schedule_retry(
+    GRilIoChannelPriv* priv,
+    GRilIoRequest* req)
+{
+    GASSERT(!req->next);
+    GASSERT(!req->leader);
+    req->deadline = g_get_monotonic_time() + MICROSEC(req->retry_period);
+    req->status = GRILIO_REQUEST_RETRY;
+    grilio_request_list_append(&priv->retry_reqs, req);
+
+    /* Remove the request from the request table while it's waiting
+     * for its turn to retry. It means that it gets completed during
+     * this time, we will miss the reply. */
+    grilio_request_ref(req);
+    grilio_channel_unregister_request(priv, req);
+    grilio_channel_update_timer(priv, req);
+
+    GVERBOSE("Retry #%d for request %08x in %u ms", req->retry_count+1,
+        req->id, req->retry_period);
+}
+
+static
+gboolean
+grilio_channel_timeout(
+    gpointer user_data)
+{
+    GRilIoChannel* self = GRILIO_CHANNEL(user_data);
+    GRilIoChannelPriv* priv = self->priv;
+    const gint64 now = g_get_monotonic_time();
+    GRilIoTimerHeapEntry* entry;
+    GPtrArray* expired = NULL;
+    guint i;
+
+    priv->next_deadline = 0;
+
+    /* Pull expired timers out of the heap (in deadline order) */
+    while ((entry = grilio_timer_heap_peek(priv->timers)) != NULL &&
+        entry->deadline <= now) {
+        GRilIoRequest* req = G_CAST(entry, GRilIoRequest, timer);
 
-    /* Expired retry timeouts */
-    if (priv->retry_req && priv->retry_req->deadline <= now) {
-        /* Slip expired timeout to preserve the order */
-        GRilIoRequest* last = priv->retry_req;
-        while (last->next && last->next->deadline <= now) {
-            last = last->next;
+        grilio_timer_heap_remove(priv->timers, entry);
+        if (!expired) {
+            expired = g_ptr_array_new_with_free_func
+                (grilio_request_unref_proc);
         }
-        expired = priv->retry_req;
-        priv->retry_req = last->next;
-        last->next = NULL;
+        g_ptr_array_add(expired, grilio_request_ref(req));
     }
 
-    while (expired) {
-        GRilIoRequest* req = expired;
-        expired = req->next;
-        req->next = NULL;
-        grilio_channel_requeue_request(self, req);
+    for (i = 0; expired && i < expired->len; i++) {
+        GRilIoRequest* req = g_ptr_array_index(expired, i);
+
+        if (req->status == GRILIO_REQUEST_RETRY) {
+            /* Time to retry, the retry reference goes to the queue */
+            grilio_channel_requeue_request(self, req);
+            continue;
+        }
+
+        if ((req->flags & GRILIO_REQUEST_FLAG_REGISTERED) &&
+            req->deadline && req->deadline <= now) {
+            GDEBUG("%s%srequest %u (%08x/%08x) timed out",
+                (priv->block_req == req) ? "Blocking " : "",
+                LOG_PREFIX(priv), req->code, req->id, req->current_id);
+            grilio_channel_window_feedback(priv, req, TRUE);
+            req->deadline = 0;
+            if (priv->block_req == req) {
+                grilio_request_unref(priv->block_req);
+                priv->block_req = NULL;
+            }
+            if (req->flags & GRILIO_REQUEST_FLAG_PENDING) {
+                grilio_channel_remove_pending(priv, req);
+                grilio_channel_update_pending(self);
+            }
+            if (grilio_request_can_retry(req)) {
+                grilio_channel_schedule_retry(priv, req);
+            } else {
+                grilio_channel_remove_request(priv, req);
+                req->status = GRILIO_REQUEST_DONE;
+                grilio_channel_complete_request(self, req,
+                    GRILIO_STATUS_TIMEOUT, NULL, 0);
+                grilio_channel_complete_attached(self, req,
+                    GRILIO_STATUS_TIMEOUT, NULL, 0);
+            }
+        } else if ((req->flags & GRILIO_REQUEST_FLAG_PENDING) &&
+            grilio_channel_pending_deadline(priv, req) <= now) {
+            GDEBUG("Pending %srequest %u (%08x/%08x) expired",
+                LOG_PREFIX(priv), req->code, req->id, req->current_id);
+            grilio_channel_window_feedback(priv, req, TRUE);
+            if (req == priv->block_req) {
+                /* Let the life continue */
+                grilio_request_unref(priv->block_req);
+                priv->block_req = NULL;
+            }
+            grilio_channel_remove_pending(priv, req);
+        }
+
+        /* Re-arm the timer if there's another deadline ahead */
+        grilio_channel_update_timer(priv, req);
     }
 
-    if (pending_expired) {
-        grilio_channel_reset_pending_timeout(self);
+    if (expired) {
+        g_ptr_array_free(expired, TRUE);
     }
     grilio_channel_reset_timeout(self);
     grilio_channel_schedule_write(self);
     grilio_channel_update_pending(self);
-    return G_SOURCE_REMOVE;
+    return G_SOURCE_CONTINUE;
+}
+
+static
+void
+grilio_channel_reset_timeout(
+    GRilIoChannel* self)
+{
+    GRilIoChannelPriv* priv = self->priv;
+    GRilIoTimerHeapEntry* next = grilio_timer_heap_peek(priv->timers);
+
+    /* The earliest deadline is always at the top of the heap */
+    if (next) {
+        const gint64 deadline = next->deadline;
+
+        /* The wakeup which is already scheduled within the slack
+         * interval after the deadline is good enough */
+        if (!priv->next_deadline || priv->next_deadline < deadline ||
+            priv->next_deadline > deadline + priv->timer_slack) {
+            priv->next_deadline = deadline + priv->timer_slack;
+            g_source_set_ready_time(priv->timer, priv->next_deadline);
+        }
+    } else if (priv->next_deadline) {
+        priv->next_deadline = 0;
+        g_source_set_ready_time(priv->timer, -1);
+    }
+}
+
+static
+gboolean
+grilio_channel_timer_dispatch(
+    GSource* source,
+    GSourceFunc callback,
+    gpointer user_data)
+{
+    /* The callback re-arms the timer if necessary */
+    g_source_set_ready_time(source, -1);
+    return callback(user_data);
 }
 
 static
-void
-grilio_channel_reset_timeout(
+GSource*
+grilio_channel_timer_new(
     GRilIoChannel* self)
 {
-    GRilIoChannelPriv* priv = self->priv;
-    GHashTableIter iter;
-    const gint64 now = g_get_monotonic_time();
-    gint64 deadline = 0;
-    gpointer value;
-
-    if (priv->block_req && priv->block_req->deadline) {
-        deadline = priv->block_req->deadline;
-    }
+    static GSourceFuncs grilio_channel_timer_funcs = {
+        NULL,   /* prepare */
+        NULL,   /* check */
+        grilio_channel_timer_dispatch,
+        NULL    /* finalize */
+    };
 
-    /* This loop shouldn't impact the performance because the hash table
-     * typically contains very few entries */
-    g_hash_table_iter_init(&iter, priv->req_table);
-    while (g_hash_table_iter_next(&iter, NULL, &value)) {
-        GRilIoRequest* req = value;
-        if (req->deadline) {
-            if (!deadline || deadline > req->deadline) {
-                deadline = req->deadline;
-            }
-        }
-    }
-
-    /* Retry requests are sorted */
-    if (priv->retry_req) {
-        if (!deadline || deadline > priv->retry_req->deadline) {
-            deadline = priv->retry_req->deadline;
-        }
-    }
+    /* One timer per channel, never removed until the channel is gone */
+    GSource* source = g_source_new(&grilio_channel_timer_funcs,
+        sizeof(GSource));
 
-    if (deadline) {
-        if (!priv->next_deadline || priv->next_deadline > deadline) {
-            if (priv->timeout_id) {
-                g_source_remove(priv->timeout_id);
-            }
-            priv->next_deadline = deadline;
-            priv->timeout_id = (deadline <= now) ?
-                g_idle_add(grilio_channel_timeout, self) :
-                g_timeout_add(((deadline - now) + 999)/1000,
-                    grilio_channel_timeout, self);
-        }
-    } else if (priv->timeout_id) {
-        g_source_remove(priv->timeout_id);
-        priv->timeout_id = 0;
-        priv->next_deadline = 0;
-    }
+    g_source_set_callback(source, grilio_channel_timeout, self, NULL);
+    g_source_attach(source, NULL);
+    return source;
 }
 
 static
@@ -844,10 +1582,26 @@ grilio_channel_request_sent(
         grilio_request_data(req), grilio_request_size(req));
 
     /* Submit the next request(s) */
-    if (priv->send_req == req) {
-        priv->send_req = NULL;
-        grilio_request_unref(req);
+    g_ptr_array_remove(priv->send_reqs, req);
+}
+
+static
+GRilIoRequest*
+grilio_channel_find_send_req(
+    GRilIoChannelPriv* priv,
+    guint id)
+{
+    guint i;
+
+    /* This array is tiny */
+    for (i = 0; i < priv->send_reqs->len; i++) {
+        GRilIoRequest* req = g_ptr_array_index(priv->send_reqs, i);
+
+        if (req->id == id) {
+            return req;
+        }
     }
+    return NULL;
 }
 
 static
@@ -864,26 +1618,31 @@ grilio_channel_send_next_request(
         return FALSE;
     }
 
-    if (priv->send_req) {
-        /* Request is being sent */
+    if (priv->send_reqs->len >=
+        grilio_transport_send_window(priv->transport)) {
+        /* Request(s) are being sent */
         return FALSE;
     }
 
-    req = priv->send_req;
-
-    if (priv->block_req && !req) {
+    if (priv->block_req) {
         /* Try to dequeue an internal request */
-        req = priv->send_req = grilio_channel_dequeue_request(self, TRUE);
+        req = grilio_channel_dequeue_request(self, TRUE);
         if (!req) {
             GVERBOSE("%s waiting for request %08x to complete", self->name,
                 priv->block_req->current_id);
             return FALSE;
         }
-    }
-
-    if (!req) {
+    } else if (grilio_channel_window_full(priv)) {
+        /* Internal requests expect no reply and don't count */
+        req = grilio_channel_dequeue_request(self, TRUE);
+        if (!req) {
+            GVERBOSE("%s has %u requests pending", self->name,
+                priv->pending_count);
+            return FALSE;
+        }
+    } else {
         /* Nothing stops us from dequeueing any request */
-        req = priv->send_req = grilio_channel_dequeue_request(self, FALSE);
+        req = grilio_channel_dequeue_request(self, FALSE);
         if (!req) {
             /* There is nothing to send, remove the watch */
             GVERBOSE("%s has nothing to send", self->name);
@@ -891,6 +1650,8 @@ grilio_channel_send_next_request(
         }
     }
 
+    g_ptr_array_add(priv->send_reqs, req);
+
     req_timeout = req->timeout;
     if (req_timeout == GRILIO_TIMEOUT_DEFAULT && priv->timeout > 0) {
         req_timeout = priv->timeout;
@@ -905,7 +1666,8 @@ grilio_channel_send_next_request(
 
     /* If there's no response callback and no need to retry, remove it
      * from the queue as well */
-    if (!req->response && !grilio_request_can_retry(req)) {
+    if (!req->response && !req->response_bytes && !req->fragment &&
+        !grilio_request_can_retry(req)) {
         grilio_queue_remove(req);
         if (!priv->block_req) {
             req_timeout = 0;
@@ -915,18 +1677,21 @@ grilio_channel_send_next_request(
     if (req_timeout > 0) {
         /* This request has a timeout */
         req->deadline = g_get_monotonic_time() + MICROSEC(req_timeout);
-        if (!priv->next_deadline || req->deadline < priv->next_deadline) {
-            grilio_channel_reset_timeout(self);
-        }
+        grilio_channel_update_timer(priv, req);
+        grilio_channel_reset_timeout(self);
     }
 
-    if (grilio_transport_send(priv->transport, req, req->code) ==
-        GRILIO_SEND_OK) {
+    switch (grilio_transport_send(priv->transport, req, req->code)) {
+    case GRILIO_SEND_OK:
         grilio_channel_request_sent(self, req);
         return TRUE;
-    } else {
-        return FALSE;
+    case GRILIO_SEND_PENDING:
+        /* There may be room for more */
+        return TRUE;
+    case GRILIO_SEND_ERROR:
+        break;
     }
+    return FALSE;
 }
 
 static
@@ -949,7 +1714,6 @@ grilio_channel_retry_request(
 {
     if (G_LIKELY(self && id)) {
         GRilIoChannelPriv* priv = self->priv;
-        GRilIoRequest* prev = NULL;
         GRilIoRequest* req;
 
         if (priv->block_req && priv->block_req->id == id) {
@@ -958,37 +1722,26 @@ grilio_channel_retry_request(
             return FALSE;
         }
 
-        /* This queue is typically empty or quite small */
-        for (req = priv->first_req; req; req = req->next) {
-            if (req->id == id) {
-                /* Already queued */
+        /* Requests sitting in the retry queue must not be in the table */
+        req = grilio_channel_lookup_public(priv, id);
+        if (req) {
+            if (req->status == GRILIO_REQUEST_QUEUED) {
                 GVERBOSE("Request %08x is already queued", id);
                 return TRUE;
+            } else {
+                /* Just been sent, no reply yet */
+                GVERBOSE("Request %08x is in progress", id);
+                return FALSE;
             }
         }
 
-        /* Requests sitting in the retry queue must not be in the table */
-        if (g_hash_table_lookup(priv->req_table, GINT_TO_POINTER(id))) {
-            /* Just been sent, no reply yet */
-            GVERBOSE("Request %08x is in progress", id);
-            return FALSE;
-        }
-
         /* Check the retry queue then */
-        for (req = priv->retry_req; req; req = req->next) {
-            if (req->id == id) {
-                GDEBUG("Retrying request %08x", id);
-                if (prev) {
-                    prev->next = req->next;
-                } else {
-                    priv->retry_req = req->next;
-                }
-                req->next = NULL;
-                grilio_channel_requeue_request(self, req);
-                grilio_channel_reset_timeout(self);
-                return TRUE;
-            }
-            prev = req;
+        req = grilio_channel_lookup_retry(priv, id);
+        if (req) {
+            GDEBUG("Retrying request %08x", id);
+            grilio_channel_requeue_request(self, req);
+            grilio_channel_reset_timeout(self);
+            return TRUE;
         }
 
         /* Probably an invalid request id */
@@ -1005,7 +1758,8 @@ grilio_channel_schedule_write(
     if (self->connected) {
         while (grilio_channel_send_next_request(self));
 #if GUTIL_LOG_VERBOSE
-        if (!self->priv->send_req && !self->priv->first_req) {
+        if (!self->priv->send_reqs->len &&
+            !grilio_channel_first_queued(self->priv)) {
             GVERBOSE("%squeue empty", LOG_PREFIX(self->priv));
         }
 #endif
@@ -1023,8 +1777,7 @@ grilio_channel_queue_ack(
     req->code = RIL_RESPONSE_ACKNOWLEDGEMENT;
     /* These packets are not subject to serialization and expect no reply */
     req->flags |= GRILIO_REQUEST_FLAG_INTERNAL | GRILIO_REQUEST_FLAG_NO_REPLY;
-    g_hash_table_insert(priv->req_table, GINT_TO_POINTER(req->id),
-        grilio_request_ref(req));
+    grilio_channel_register_request(priv, req);
     grilio_channel_queue_request(priv, req);
 }
 
@@ -1041,8 +1794,8 @@ grilio_channel_handle_response(
 {
     GRilIoChannel* self = GRILIO_CHANNEL(user_data);
     GRilIoChannelPriv* priv = self->priv;
-    const void* key = GINT_TO_POINTER(id);
-    GRilIoRequest* req = g_hash_table_lookup(priv->req_table, key);
+    GRilIoRequest* req = grilio_channel_lookup_request(priv, id);
+    GRilIoRequest* pending = grilio_channel_lookup_pending(priv, id);
     GRILIO_PACKET_TYPE ptype;
 
     switch (type) {
@@ -1062,10 +1815,18 @@ grilio_channel_handle_response(
     }
         
     /* Remove this id from the list of pending requests */
-    if (g_hash_table_remove(priv->pending, key)) {
+    if (pending) {
+        if (priv->window_latency) {
+            /* Slow responses shrink the adaptive window */
+            grilio_channel_window_feedback(priv, pending,
+                g_get_monotonic_time() - pending->submitted >
+                priv->window_latency);
+        }
         /* Reset submit time */
-        if (req) req->submitted = 0;
-        grilio_channel_reset_pending_timeout(self);
+        pending->submitted = 0;
+        /* This may deallocate the request if it has been cancelled */
+        grilio_channel_remove_pending(priv, pending);
+        grilio_channel_reset_timeout(self);
     }
 
     /* Logger receives everything except the length */
@@ -1082,7 +1843,8 @@ grilio_channel_handle_response(
     if (req && req->status == GRILIO_REQUEST_SENT) {
         GASSERT(req->current_id == id);
         /* Temporary increment the ref count to compensate for
-         * g_hash_table_remove possibly unreferencing the request */
+         * grilio_channel_remove_request possibly unreferencing
+         * the request */
         grilio_request_ref(req);
         if (grilio_request_can_retry(req) &&
             req->retry(req, status, resp, len, req->user_data)) {
@@ -1092,9 +1854,8 @@ grilio_channel_handle_response(
         } else {
             grilio_channel_remove_request(priv, req);
             req->status = GRILIO_REQUEST_DONE;
-            if (req->response) {
-                req->response(self, status, resp, len, req->user_data);
-            }
+            grilio_channel_complete_request(self, req, status, resp, len);
+            grilio_channel_complete_attached(self, req, status, resp, len);
         }
 
         /* Release temporary reference */
@@ -1106,6 +1867,60 @@ grilio_channel_handle_response(
     grilio_channel_update_pending(self);
 }
 
+static
+void
+grilio_channel_handle_fragment(
+    GRilIoTransport* transport,
+    GRILIO_RESPONSE_TYPE type,
+    guint id,
+    int status,
+    guint offset,
+    guint total,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    GRilIoChannel* self = GRILIO_CHANNEL(user_data);
+    GRilIoChannelPriv* priv = self->priv;
+    GRilIoRequest* req = grilio_channel_lookup_request(priv, id);
+    const gboolean last = (offset + len == total);
+
+    if (!req || req->status != GRILIO_REQUEST_SENT || req->current_id != id) {
+        /* Nobody is interested in the data */
+        if (last) {
+            grilio_channel_handle_response(transport, type, id, status,
+                NULL, 0, self);
+        }
+    } else if (req->fragment) {
+        /* The request may get cancelled by the callback */
+        req->fragment(self, status, offset, total, data, len, req->user_data);
+        if (last) {
+            grilio_channel_handle_response(transport, type, id, status,
+                NULL, 0, self);
+        }
+    } else {
+        /* The caller expects the response in one piece */
+        if (!offset) {
+            if (priv->fragments) {
+                g_byte_array_set_size(priv->fragments, 0);
+            } else {
+                priv->fragments = g_byte_array_sized_new(total);
+            }
+        }
+        if (priv->fragments && priv->fragments->len == offset) {
+            g_byte_array_append(priv->fragments, data, len);
+            if (last) {
+                GByteArray* resp = priv->fragments;
+
+                priv->fragments = NULL;
+                grilio_channel_handle_response(transport, type, id, status,
+                    resp->data, resp->len, self);
+                g_byte_array_free(resp, TRUE);
+            }
+        }
+    }
+}
+
 static
 void
 grilio_channel_emit_unsol_event(
@@ -1266,6 +2081,9 @@ grilio_channel_new(
         priv->transport_event_ids[TRANSPORT_EVENT_RESPONSE] =
             grilio_transport_add_response_handler(transport,
                 grilio_channel_handle_response, self);
+        priv->transport_event_ids[TRANSPORT_EVENT_FRAGMENT] =
+            grilio_transport_add_fragment_handler(transport,
+                grilio_channel_handle_fragment, self);
         priv->transport_event_ids[TRANSPORT_EVENT_INDICATION] =
             grilio_transport_add_indication_handler(transport,
                 grilio_channel_handle_indication, self);
@@ -1342,6 +2160,105 @@ grilio_channel_set_name(
     }
 }
 
+void
+grilio_channel_set_timer_slack(
+    GRilIoChannel* self,
+    int ms)
+{
+    if (G_LIKELY(self)) {
+        GRilIoChannelPriv* priv = self->priv;
+
+        priv->timer_slack = MICROSEC(MAX(ms, 0));
+        grilio_channel_reset_timeout(self);
+    }
+}
+
+void
+grilio_channel_set_priority_aging(
+    GRilIoChannel* self,
+    int ms)
+{
+    if (G_LIKELY(self)) {
+        self->priv->priority_aging = MICROSEC(MAX(ms, 0));
+    }
+}
+
+void
+grilio_channel_set_max_pending(
+    GRilIoChannel* self,
+    guint max)
+{
+    if (G_LIKELY(self)) {
+        GRilIoChannelPriv* priv = self->priv;
+
+        priv->max_pending = max;
+        if (max && priv->window > max) {
+            priv->window = max;
+        }
+        grilio_channel_update_window(self);
+        grilio_channel_schedule_write(self);
+    }
+}
+
+void
+grilio_channel_set_adaptive_window(
+    GRilIoChannel* self,
+    int latency_ms)
+{
+    if (G_LIKELY(self)) {
+        GRilIoChannelPriv* priv = self->priv;
+
+        if (latency_ms > 0) {
+            if (!priv->window_latency) {
+                priv->window = priv->max_pending ? priv->max_pending :
+                    GRILIO_DEFAULT_ADAPTIVE_WINDOW;
+                priv->window_acked = 0;
+                priv->window_decreased = 0;
+            }
+            priv->window_latency = MICROSEC(latency_ms);
+        } else {
+            priv->window_latency = 0;
+        }
+        grilio_channel_update_window(self);
+        grilio_channel_schedule_write(self);
+    }
+}
+
+guint
+grilio_channel_pending_window(
+    GRilIoChannel* self)
+{
+    return G_LIKELY(self) ? grilio_channel_window_size(self->priv) : 0;
+}
+
+gboolean
+grilio_channel_window_is_open(
+    GRilIoChannel* self)
+{
+    return G_LIKELY(self) && !grilio_channel_window_full(self->priv);
+}
+
+void
+grilio_channel_set_replay(
+    GRilIoChannel* self,
+    GRILIO_REPLAY replay)
+{
+    if (G_LIKELY(self)) {
+        self->priv->replay = (replay == GRILIO_REPLAY_DEFAULT) ?
+            GRILIO_REPLAY_WAIT : replay;
+    }
+}
+
+void
+grilio_channel_set_deduplicate(
+    GRilIoChannel* self,
+    gboolean deduplicate)
+{
+    if (G_LIKELY(self)) {
+        self->priv->deduplicate = deduplicate;
+    }
+}
+
 guint
 grilio_channel_serialize(
     GRilIoChannel* self)
@@ -1386,7 +2303,7 @@ gboolean
 grilio_channel_has_pending_requests(
     GRilIoChannel* self)
 {
-    return G_LIKELY(self) && g_hash_table_size(self->priv->pending) > 0;
+    return G_LIKELY(self) && self->priv->pending_count > 0;
 }
 
 gulong
@@ -1464,6 +2381,16 @@ grilio_channel_add_pending_changed_handler(
         SIGNAL_PENDING_NAME, G_CALLBACK(func), arg) : 0;
 }
 
+gulong
+grilio_channel_add_window_changed_handler(
+    GRilIoChannel* self,
+    GRilIoChannelEventFunc func,
+    void* arg)
+{
+    return (G_LIKELY(self) && G_LIKELY(func)) ? g_signal_connect(self,
+        SIGNAL_WINDOW_NAME, G_CALLBACK(func), arg) : 0;
+}
+
 void
 grilio_channel_remove_handler(
     GRilIoChannel* self,
@@ -1532,12 +2459,15 @@ grilio_channel_send_request(
     return grilio_channel_send_request_full(self, req, code, NULL, NULL, NULL);
 }
 
+static
 guint
-grilio_channel_send_request_full(
+grilio_channel_submit_request(
     GRilIoChannel* self,
     GRilIoRequest* req,
     guint code,
     GRilIoChannelResponseFunc response,
+    GRilIoChannelResponseBytesFunc response_bytes,
+    GRilIoChannelFragmentFunc fragment,
     GDestroyNotify destroy,
     void* user_data)
 {
@@ -1549,11 +2479,29 @@ grilio_channel_send_request_full(
         req->id = req->current_id = id;
         req->code = code;
         req->response = response;
+        req->response_bytes = response_bytes;
+        req->fragment = fragment;
         req->destroy = destroy;
         req->user_data = user_data;
-        g_hash_table_insert(priv->req_table,
-            GINT_TO_POINTER(req->id),
-            grilio_request_ref(req));
+        grilio_channel_register_request(priv, req);
+        if (grilio_channel_can_share(priv, req)) {
+            GRilIoRequest* leader = grilio_channel_find_leader(priv, req);
+
+            if (leader) {
+                /* The leader holds the reference */
+                GDEBUG("%srequest %u (%08x) attached to %08x",
+                    LOG_PREFIX(priv), code, id, leader->id);
+                req->status = GRILIO_REQUEST_SENT;
+                req->leader = leader;
+                grilio_request_list_append(&leader->attached,
+                    grilio_request_ref(req));
+                grilio_request_unref(internal_req);
+                return id;
+            } else if (!g_hash_table_contains(priv->dedup, req)) {
+                req->flags |= GRILIO_REQUEST_FLAG_SHARED;
+                g_hash_table_insert(priv->dedup, req, req);
+            }
+        }
         grilio_channel_queue_request(priv, grilio_request_ref(req));
         grilio_channel_schedule_write(self);
         grilio_request_unref(internal_req);
@@ -1562,6 +2510,46 @@ grilio_channel_send_request_full(
     return 0;
 }
 
+guint
+grilio_channel_send_request_full(
+    GRilIoChannel* self,
+    GRilIoRequest* req,
+    guint code,
+    GRilIoChannelResponseFunc response,
+    GDestroyNotify destroy,
+    void* user_data)
+{
+    return grilio_channel_submit_request(self, req, code, response, NULL,
+        NULL, destroy, user_data);
+}
+
+guint
+grilio_channel_send_request_bytes(
+    GRilIoChannel* self,
+    GRilIoRequest* req,
+    guint code,
+    GRilIoChannelResponseBytesFunc response,
+    GDestroyNotify destroy,
+    void* user_data)
+{
+    return grilio_channel_submit_request(self, req, code, NULL, response,
+        NULL, destroy, user_data);
+}
+
+guint
+grilio_channel_send_request_stream(
+    GRilIoChannel* self,
+    GRilIoRequest* req,
+    guint code,
+    GRilIoChannelFragmentFunc fragment,
+    GRilIoChannelResponseFunc response,
+    GDestroyNotify destroy,
+    void* user_data)
+{
+    return grilio_channel_submit_request(self, req, code, response, NULL,
+        fragment, destroy, user_data);
+}
+
 void
 grilio_channel_set_pending_timeout(
     GRilIoChannel* self,
@@ -1569,11 +2557,15 @@ grilio_channel_set_pending_timeout(
 {
     if (G_LIKELY(self) && ms > 0) {
         GRilIoChannelPriv* priv = self->priv;
-        if (priv->pending_timeout < ms) {
-            priv->pending_timeout = ms;
-            grilio_channel_reset_pending_timeout(self);
-        } else {
+
+        if (priv->pending_timeout != ms) {
+            GRilIoRequest* req;
+
             priv->pending_timeout = ms;
+            for (req = priv->first_pending_req; req; req = req->pending_next) {
+                grilio_channel_update_timer(priv, req);
+            }
+            grilio_channel_reset_timeout(self);
         }
     }
 }
@@ -1666,19 +2658,16 @@ grilio_channel_get_request(
     GRilIoRequest* req = NULL;
     if (G_LIKELY(self && id)) {
         GRilIoChannelPriv* priv = self->priv;
-        if (priv->send_req && priv->send_req->id == id) {
-            req = priv->send_req;
+        req = grilio_channel_find_send_req(priv, id);
+        if (req) {
+            /* Being sent */
         } else if (priv->block_req && priv->block_req->id == id) {
             req = priv->block_req;
         } else {
-            req = g_hash_table_lookup(priv->req_table, GINT_TO_POINTER(id));
+            /* Queued requests are in the table too */
+            req = grilio_channel_lookup_public(priv, id);
             if (!req) {
-                req = priv->first_req;
-                while (req && req->id != id) req = req->next;
-                if (!req) {
-                    req = priv->retry_req;
-                    while (req && req->id != id) req = req->next;
-                }
+                req = grilio_channel_lookup_retry(priv, id);
             }
         }
     }
@@ -1694,7 +2683,28 @@ grilio_channel_cancel_request(
     if (G_LIKELY(self && id)) {
         GRilIoChannelPriv* priv = self->priv;
         GRilIoRequest* block_req = NULL;
-        GRilIoRequest* req;
+        GRilIoRequest* req = grilio_channel_get_request(self, id);
+
+        if (req && req->leader) {
+            /* Attached to another request which stays where it is */
+            GDEBUG("Detached %srequest %u (%08x) from %08x",
+                LOG_PREFIX(priv), req->code, req->id, req->leader->id);
+            grilio_request_list_remove(&req->leader->attached, req);
+            req->leader = NULL;
+            grilio_channel_remove_request(priv, req);
+            req->status = GRILIO_REQUEST_CANCELLED;
+            if (notify) {
+                grilio_channel_complete_request(self, req,
+                    GRILIO_STATUS_CANCELLED, NULL, 0);
+            }
+            /* Release the reference held by the leader */
+            grilio_request_unref(req);
+            return TRUE;
+        } else if (req && req->attached.first &&
+            req->status != GRILIO_REQUEST_CANCELLED) {
+            grilio_channel_hand_over(self, req, notify);
+            return TRUE;
+        }
 
         if (priv->block_req && priv->block_req->id == id) {
             /* Don't release the reference or change the status yet. However
@@ -1703,15 +2713,15 @@ grilio_channel_cancel_request(
             priv->block_req = NULL;
         }
 
-        if (priv->send_req && priv->send_req->id == id) {
-            /* Current request will be unreferenced after it's sent */
-            req = priv->send_req;
+        req = grilio_channel_find_send_req(priv, id);
+        if (req) {
+            /* This request will be unreferenced after it's sent */
             if (req->status != GRILIO_REQUEST_CANCELLED) {
                 req->status = GRILIO_REQUEST_CANCELLED;
                 grilio_channel_remove_request(priv, req);
-                if (notify && req->response) {
-                    req->response(self, GRILIO_STATUS_CANCELLED, NULL, 0,
-                        req->user_data);
+                if (notify) {
+                    grilio_channel_complete_request(self, req,
+                        GRILIO_STATUS_CANCELLED, NULL, 0);
                 }
                 grilio_request_unref(block_req);
                 grilio_channel_schedule_write(self);
@@ -1720,50 +2730,35 @@ grilio_channel_cancel_request(
                 grilio_request_unref(block_req);
                 return FALSE;
             }
-        } else {
-            GRilIoRequest* prev = NULL;
-            for (req = priv->first_req; req; req = req->next) {
-                if (req->id == id) {
-                    GDEBUG("Cancelled %srequest %u (%08x/%08x)",
-                        LOG_PREFIX(priv), req->code, req->id, req->current_id);
-                    if (prev) {
-                        prev->next = req->next;
-                    } else {
-                        priv->first_req = req->next;
-                    }
-                    if (req->next) {
-                        req->next = NULL;
-                    } else {
-                        priv->last_req = prev;
-                    }
-                    grilio_channel_remove_request(priv, req);
-                    req->status = GRILIO_REQUEST_CANCELLED;
-                    if (notify && req->response) {
-                        req->response(self, GRILIO_STATUS_CANCELLED, NULL, 0,
-                            req->user_data);
-                    }
-                    grilio_request_unref(req);
-                    grilio_request_unref(block_req);
-                    grilio_channel_schedule_write(self);
-                    return TRUE;
-                }
-                prev = req;
-            }
         }
 
-        /* Request not found but it could've been already sent and be setting
-         * in the hashtable waiting for response */
-        req = g_hash_table_lookup(priv->req_table, GINT_TO_POINTER(id));
-        if (req) {
-            /* We need this extra temporary reference because the hash table
-             * may be holding the last one, i.e. removing request from 
-             * hash table may deallocate the request */
+        /* Queued requests and those which have already been sent and are
+         * sitting in the table waiting for response */
+        req = grilio_channel_lookup_public(priv, id);
+        if (req && req->status == GRILIO_REQUEST_QUEUED) {
+            GDEBUG("Cancelled %srequest %u (%08x/%08x)",
+                LOG_PREFIX(priv), req->code, req->id, req->current_id);
+            grilio_channel_unqueue_request(priv, req);
+            grilio_channel_remove_request(priv, req);
+            req->status = GRILIO_REQUEST_CANCELLED;
+            if (notify) {
+                grilio_channel_complete_request(self, req,
+                    GRILIO_STATUS_CANCELLED, NULL, 0);
+            }
+            grilio_request_unref(req);
+            grilio_request_unref(block_req);
+            grilio_channel_schedule_write(self);
+            return TRUE;
+        } else if (req) {
+            /* We need this extra temporary reference because the table
+             * may be holding the last one, i.e. removing request from
+             * the table may deallocate the request */
             grilio_request_ref(req);
             grilio_channel_remove_request(priv, req);
             req->status = GRILIO_REQUEST_CANCELLED;
-            if (notify && req->response) {
-                req->response(self, GRILIO_STATUS_CANCELLED, NULL, 0,
-                    req->user_data);
+            if (notify) {
+                grilio_channel_complete_request(self, req,
+                    GRILIO_STATUS_CANCELLED, NULL, 0);
             }
             grilio_request_unref(req);
             grilio_request_unref(block_req);
@@ -1772,30 +2767,23 @@ grilio_channel_cancel_request(
             return TRUE;
         } else {
             /* The last place where it could be is the retry queue */
-            GRilIoRequest* prev = NULL;
-            for (req = priv->retry_req; req; req = req->next) {
-                if (req->id == id) {
-                    GDEBUG("Cancelled %srequest %u (%08x/%08x)",
-                        LOG_PREFIX(priv), req->code, req->id, req->current_id);
-                    if (prev) {
-                        prev->next = req->next;
-                    } else {
-                        priv->retry_req = req->next;
-                    }
-                    req->next = NULL;
-                    req->status = GRILIO_REQUEST_CANCELLED;
-                    grilio_channel_remove_request(priv, req);
-                    if (notify && req->response) {
-                        req->response(self, GRILIO_STATUS_CANCELLED, NULL, 0,
-                            req->user_data);
-                    }
-                    grilio_request_unref(req);
-                    grilio_request_unref(block_req);
-                    grilio_channel_reset_timeout(self);
-                    grilio_channel_schedule_write(self);
-                    return TRUE;
+            req = grilio_channel_lookup_retry(priv, id);
+            if (req) {
+                GDEBUG("Cancelled %srequest %u (%08x/%08x)",
+                    LOG_PREFIX(priv), req->code, req->id, req->current_id);
+                grilio_request_list_remove(&priv->retry_reqs, req);
+                req->status = GRILIO_REQUEST_CANCELLED;
+                grilio_channel_update_timer(priv, req);
+                grilio_channel_remove_request(priv, req);
+                if (notify) {
+                    grilio_channel_complete_request(self, req,
+                        GRILIO_STATUS_CANCELLED, NULL, 0);
                 }
-                prev = req;
+                grilio_request_unref(req);
+                grilio_request_unref(block_req);
+                grilio_channel_reset_timeout(self);
+                grilio_channel_schedule_write(self);
+                return TRUE;
             }
         }
 
@@ -1811,8 +2799,8 @@ grilio_channel_id_sort_func(
     gconstpointer a,
     gconstpointer b)
 {
-    const guint id1 = GPOINTER_TO_INT(a);
-    const guint id2 = GPOINTER_TO_INT(b);
+    const guint id1 = *(const guint*)a;
+    const guint id2 = *(const guint*)b;
     return (id1 < id2) ? -1 : (id1 > id2) ? 1 : 0;
 }
 
@@ -1824,8 +2812,10 @@ grilio_channel_cancel_all(
     if (G_LIKELY(self)) {
         GRilIoChannelPriv* priv = self->priv;
         GRilIoRequest* block_req = NULL;
+        GRilIoRequestTableIter iter;
         GRilIoRequest* req;
-        GList* ids;
+        GArray* ids;
+        guint i, id;
 
         if (priv->block_req) {
             /* Don't release the reference or change the status yet.
@@ -1835,81 +2825,80 @@ grilio_channel_cancel_all(
             priv->block_req = NULL;
         }
 
-        if (priv->send_req) {
-            /* Current request will be unreferenced after it's sent */
-            req = priv->send_req;
+        /* Requests being sent will be unreferenced after they are sent */
+        for (i = 0; i < priv->send_reqs->len; i++) {
+            req = g_ptr_array_index(priv->send_reqs, i);
+            /* Attached requests get cancelled on their own */
+            grilio_channel_detach_request(req);
             if (req->status != GRILIO_REQUEST_CANCELLED) {
                 req->status = GRILIO_REQUEST_CANCELLED;
                 grilio_channel_remove_request(priv, req);
-                if (notify && req->response) {
-                    req->response(self, GRILIO_STATUS_CANCELLED, NULL, 0,
-                        req->user_data);
+                if (notify) {
+                    grilio_channel_complete_request(self, req,
+                        GRILIO_STATUS_CANCELLED, NULL, 0);
                 }
             }
         }
         /* Cancel queued requests */
-        while (priv->first_req) {
-            req = priv->first_req;
+        while ((req = grilio_channel_first_queued(priv)) != NULL) {
             GDEBUG("Cancelled %srequest %u (%08x/%08x)", LOG_PREFIX(priv),
                 req->code, req->id, req->current_id);
+            grilio_channel_detach_request(req);
             grilio_channel_remove_request(priv, req);
-            priv->first_req = req->next;
-            if (req->next) {
-                req->next = NULL;
-            } else {
-                GASSERT(priv->last_req == req);
-                priv->last_req = NULL;
-            }
+            grilio_channel_unqueue_request(priv, req);
             req->status = GRILIO_REQUEST_CANCELLED;
-            if (notify && req->response) {
-                req->response(self, GRILIO_STATUS_CANCELLED, NULL, 0,
-                    req->user_data);
+            if (notify) {
+                grilio_channel_complete_request(self, req,
+                    GRILIO_STATUS_CANCELLED, NULL, 0);
             }
             grilio_request_unref(req);
         }
         /* Cancel the requests that we have sent which but haven't been
          * replied yet */
-        ids = g_list_sort(g_hash_table_get_keys(priv->req_table),
-            grilio_channel_id_sort_func);
-        if (ids) {
-            GList* link = ids;
-            while (link) {
-                req = g_hash_table_lookup(priv->req_table, link->data);
+        ids = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+            grilio_request_table_size(priv->req_table));
+        grilio_request_table_iter_init(&iter, priv->req_table);
+        while (grilio_request_table_iter_next(&iter, &id, &req)) {
+            if (req->flags & GRILIO_REQUEST_FLAG_REGISTERED) {
+                g_array_append_val(ids, id);
+            }
+        }
+        if (ids->len) {
+            g_array_sort(ids, grilio_channel_id_sort_func);
+            for (i = 0; i < ids->len; i++) {
+                req = grilio_channel_lookup_request(priv,
+                    g_array_index(ids, guint, i));
                 if (req) {
                     grilio_request_ref(req);
+                    grilio_channel_detach_request(req);
                     grilio_channel_remove_request(priv, req);
                     req->status = GRILIO_REQUEST_CANCELLED;
-                    if (notify && req->response) {
-                        req->response(self, GRILIO_STATUS_CANCELLED, NULL, 0,
-                            req->user_data);
+                    if (notify) {
+                        grilio_channel_complete_request(self, req,
+                            GRILIO_STATUS_CANCELLED, NULL, 0);
                     }
                     grilio_request_unref(req);
                 }
-                link = link->next;
             }
-            g_list_free(ids);
         }
+        g_array_free(ids, TRUE);
         /* And the retry queue */
-        while (priv->retry_req) {
-            req = priv->retry_req;
+        while ((req = priv->retry_reqs.first) != NULL) {
             GDEBUG("Cancelled %srequest %u (%08x/%08x)", LOG_PREFIX(priv),
                 req->code, req->id, req->current_id);
-            grilio_channel_remove_request(priv, req);
-            priv->retry_req = req->next;
-            req->next = NULL;
+            grilio_request_list_remove(&priv->retry_reqs, req);
+            grilio_channel_detach_request(req);
             req->status = GRILIO_REQUEST_CANCELLED;
-            if (notify && req->response) {
-                req->response(self, GRILIO_STATUS_CANCELLED, NULL, 0,
-                    req->user_data);
+            grilio_channel_update_timer(priv, req);
+            grilio_channel_remove_request(priv, req);
+            if (notify) {
+                grilio_channel_complete_request(self, req,
+                    GRILIO_STATUS_CANCELLED, NULL, 0);
             }
             grilio_request_unref(req);
         }
-        /* We no longer need the timer */
-        if (priv->timeout_id) {
-            g_source_remove(priv->timeout_id);
-            priv->timeout_id = 0;
-            priv->next_deadline = 0;
-        }
+        /* Only the pending timeouts may be left */
+        grilio_channel_reset_timeout(self);
 
         /* Unreference the blocking request */
         GASSERT(!block_req || block_req->status == GRILIO_REQUEST_CANCELLED);
@@ -1931,16 +2920,15 @@ grilio_channel_drop_request(
 {
     if (G_LIKELY(self)) {
         GRilIoChannelPriv* priv = self->priv;
-        gpointer key = GINT_TO_POINTER(id);
         GRilIoRequest* req;
         grilio_channel_cancel_request(self, id, FALSE);
-        req = g_hash_table_lookup(priv->pending, key);
+        req = grilio_channel_lookup_pending(priv, id);
         if (req) {
             GDEBUG("Dropped pending %srequest %u (%08x/%08x)",
                 LOG_PREFIX(priv), req->code, req->id, req->current_id);
             req->submitted = 0;
-            g_hash_table_remove(priv->pending, key);
-            grilio_channel_reset_pending_timeout(self);
+            grilio_channel_remove_pending(priv, req);
+            grilio_channel_reset_timeout(self);
             grilio_channel_schedule_write(self);
             grilio_channel_update_pending(self);
         }
@@ -2002,12 +2990,17 @@ grilio_channel_init(
 {
     GRilIoChannelPriv* priv = G_TYPE_INSTANCE_GET_PRIVATE(self,
         GRILIO_CHANNEL_TYPE, GRilIoChannelPriv);
-    priv->req_table = g_hash_table_new_full(g_direct_hash, g_direct_equal,
-        NULL, grilio_request_unref_proc);
-    priv->pending = g_hash_table_new_full(g_direct_hash, g_direct_equal,
-        NULL, grilio_request_unref_proc);
+    priv->req_table = grilio_request_table_new();
+    priv->timers = grilio_timer_heap_new();
+    priv->timer = grilio_channel_timer_new(self);
+    priv->dedup = g_hash_table_new(grilio_channel_dedup_hash,
+        grilio_channel_dedup_equal);
+    priv->send_reqs = g_ptr_array_new_with_free_func
+        (grilio_request_unref_proc);
     priv->timeout = GRILIO_TIMEOUT_NONE;
     priv->pending_timeout = GRILIO_DEFAULT_PENDING_TIMEOUT_MS;
+    priv->priority_aging = MICROSEC(GRILIO_DEFAULT_PRIORITY_AGING_MS);
+    priv->replay = GRILIO_REPLAY_WAIT;
 
     self->priv = priv;
     self->name = "RIL";
@@ -2027,10 +3020,7 @@ grilio_channel_dispose(
 
     grilio_channel_shutdown(self, FALSE);
     grilio_channel_cancel_all(self, TRUE);
-    if (priv->send_req) {
-        grilio_request_unref(priv->send_req);
-        priv->send_req = NULL;
-    }
+    g_ptr_array_set_size(priv->send_reqs, 0);
     if (priv->block_ids) {
         g_hash_table_destroy(priv->block_ids);
         priv->block_ids = NULL;
@@ -2055,14 +3045,24 @@ grilio_channel_finalize(
     GASSERT(!priv->first_inject);
     GASSERT(!priv->last_inject);
     GASSERT(!priv->process_injects_id);
-    GASSERT(!priv->timeout_id);
     GASSERT(!priv->block_ids);
-    if (priv->pending_timeout_id) {
-        g_source_remove(priv->pending_timeout_id);
-    }
-    g_hash_table_destroy(priv->req_table);
-    g_hash_table_destroy(priv->pending);
+    g_source_destroy(priv->timer);
+    g_source_unref(priv->timer);
+    while (priv->first_pending_req) {
+        grilio_channel_remove_pending(priv, priv->first_pending_req);
+    }
+    GASSERT(!grilio_request_table_size(priv->req_table));
+    GASSERT(!grilio_timer_heap_count(priv->timers));
+    GASSERT(!priv->retry_reqs.first);
+    GASSERT(!g_hash_table_size(priv->dedup));
+    g_hash_table_destroy(priv->dedup);
+    grilio_request_table_free(priv->req_table);
+    grilio_timer_heap_free(priv->timers);
+    g_ptr_array_free(priv->send_reqs, TRUE);
     g_slist_free_full(priv->log_list, grilio_channel_logger_free1);
+    if (priv->fragments) {
+        g_byte_array_free(priv->fragments, TRUE);
+    }
     grilio_transport_remove_all_handlers(priv->transport,
         priv->transport_event_ids);
     grilio_transport_unref(priv->transport);
@@ -2102,6 +3102,9 @@ grilio_channel_class_init(
     grilio_channel_signals[SIGNAL_PENDING] =
         g_signal_new(SIGNAL_PENDING_NAME, G_OBJECT_CLASS_TYPE(klass),
             G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+    grilio_channel_signals[SIGNAL_WINDOW] =
+        g_signal_new(SIGNAL_WINDOW_NAME, G_OBJECT_CLASS_TYPE(klass),
+            G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
 }
 
 /*
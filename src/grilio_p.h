@@ -36,6 +36,7 @@
 #include "grilio_request.h"
 #include "grilio_channel.h"
 #include "grilio_queue.h"
+#include "grilio_timer_heap.h"
 
 /* Byte order of the RIL payload (native?) */
 #define GUINT32_FROM_RIL(x) (x) /* GUINT32_FROM_LE(x) ? */
@@ -51,6 +52,10 @@
 #define RIL_RESPONSE_ACKNOWLEDGEMENT (800)
 #define RIL_UNSOL_RIL_CONNECTED (1034)
 #define RIL_E_SUCCESS (0)
+#define RIL_E_GENERIC_FAILURE (2)
+
+/* Number of priority levels (the channel keeps a send queue per level) */
+#define GRILIO_PRIORITY_COUNT (GRILIO_PRIORITY_HIGH + 1)
 
 /* Packet types (first word of the payload) */
 typedef enum ril_packet_type {
@@ -61,6 +66,12 @@ typedef enum ril_packet_type {
     RIL_PACKET_TYPE_UNSOLICITED_ACK_EXP = 4
 } RIL_PACKET_TYPE;
 
+/* Doubly linked list of requests (via queued_next/queued_prev) */
+typedef struct grilio_request_list {
+    GRilIoRequest* first;
+    GRilIoRequest* last;
+} GRilIoRequestList;
+
 /*
  * 12 bytes are reserved for the packet header:
  *
@@ -76,16 +87,31 @@ struct grilio_request {
     guint current_id;
     gint64 deadline;
     gint64 submitted;
+    gint64 enqueued;
+    GRilIoTimerHeapEntry timer;
     GRILIO_REQUEST_STATUS status;
+    GRILIO_REPLAY replay;
+    GRILIO_PRIORITY priority;
+    GRILIO_PRIORITY queued_priority;
     int max_retries;
     int retry_count;
     guint retry_period;
     GByteArray* bytes;
     GRilIoRequest* next;
+    GRilIoRequest* prev;
     GRilIoRequest* qnext;
+    GRilIoRequest* qprev;
+    GRilIoRequest* pending_prev;
+    GRilIoRequest* pending_next;
+    GRilIoRequest* queued_prev;   /* Also links attached and retry ones */
+    GRilIoRequest* queued_next;
+    GRilIoRequest* leader;        /* The one that's actually being sent */
+    GRilIoRequestList attached;   /* Identical requests riding along */
     GRilIoQueue* queue;
     GRilIoRequestRetryFunc retry;
     GRilIoChannelResponseFunc response;
+    GRilIoChannelResponseBytesFunc response_bytes;
+    GRilIoChannelFragmentFunc fragment;
     GDestroyNotify destroy;
     void* user_data;
     gboolean flags;
@@ -93,12 +119,54 @@ struct grilio_request {
 #define GRILIO_REQUEST_FLAG_BLOCKING    (0x01)
 #define GRILIO_REQUEST_FLAG_INTERNAL    (0x02)
 #define GRILIO_REQUEST_FLAG_NO_REPLY    (0x04)
+#define GRILIO_REQUEST_FLAG_REGISTERED  (0x08) /* In the request table */
+#define GRILIO_REQUEST_FLAG_PENDING     (0x10) /* Waiting for response */
+#define GRILIO_REQUEST_FLAG_SHARED      (0x20) /* In the dedup table */
+#define GRILIO_REQUEST_FLAG_HANDED_OVER (0x40) /* Sent with someone's id */
+};
+
+/*
+ * Each queue keeps its own list of requests waiting in the channel's
+ * send queue (in the same order) and the number of its requests which
+ * have been sent and are waiting for response. The channel uses those
+ * to pick the next request of the transaction owner without scanning.
+ */
+struct grilio_queue {
+    gint refcount;
+    GRilIoChannel* channel;
+    GRilIoRequest* first_req;
+    GRilIoRequest* last_req;
+    GRilIoRequestList queued;
+    guint pending_count;
+    GRILIO_PRIORITY priority;
+    gboolean deduplicate;
 };
 
 void
 grilio_request_unref_proc(
     gpointer data);
 
+void
+grilio_request_list_append(
+    GRilIoRequestList* list,
+    GRilIoRequest* req);
+
+void
+grilio_request_list_prepend(
+    GRilIoRequestList* list,
+    GRilIoRequest* req);
+
+void
+grilio_request_list_insert_before(
+    GRilIoRequestList* list,
+    GRilIoRequest* req,
+    GRilIoRequest* next);
+
+void
+grilio_request_list_remove(
+    GRilIoRequestList* list,
+    GRilIoRequest* req);
+
 void
 grilio_queue_remove(
     GRilIoRequest* req);
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2015-2017 Jolla Ltd.
+ * Copyright (C) 2015-2019 Jolla Ltd.
  * Contact: Slava Monich <slava.monich@jolla.com>
  *
  * You may use this file under the terms of BSD license as follows:
@@ -35,13 +35,6 @@
 
 #include <gutil_macros.h>
 
-struct grilio_queue {
-    gint refcount;
-    GRilIoChannel* channel;
-    GRilIoRequest* first_req;
-    GRilIoRequest* last_req;
-};
-
 GRilIoQueue*
 grilio_queue_new(
     GRilIoChannel* channel)
@@ -50,6 +43,7 @@ grilio_queue_new(
         GRilIoQueue* queue = g_slice_new0(GRilIoQueue);
         g_atomic_int_set(&queue->refcount, 1);
         queue->channel = grilio_channel_ref(channel);
+        queue->priority = GRILIO_PRIORITY_NORMAL;
         return queue;
     }
     return NULL;
@@ -64,7 +58,10 @@ grilio_queue_free(
     GRilIoRequest* req = self->first_req;
     while (req) {
         GRilIoRequest* next = req->qnext;
-        req->qnext = NULL;
+        req->qnext = req->qprev = NULL;
+        if (req->status == GRILIO_REQUEST_QUEUED) {
+            req->queued_next = req->queued_prev = NULL;
+        }
         req->queue = NULL;
         req = next;
     }
@@ -105,6 +102,7 @@ grilio_queue_add(
     GASSERT(!req->queue);
     req->queue = self;
     if (self->last_req) {
+        req->qprev = self->last_req;
         self->last_req->qnext = req;
         self->last_req = req;
     } else {
@@ -117,29 +115,29 @@ void
 grilio_queue_remove(
     GRilIoRequest* req)
 {
-    /* Normally, the first request is getting removed from the queue
-     * except for the rare cases when request is being cancelled, which
-     * is not something we need to optimize for. */
     GRilIoQueue* queue = req->queue;
     if (queue) {
-        GRilIoRequest* ptr;
-        GRilIoRequest* prev = NULL;
-        for (ptr = queue->first_req; ptr; ptr = ptr->qnext) {
-            if (ptr == req) {
-                if (prev) {
-                    prev->qnext = req->qnext;
-                } else {
-                    queue->first_req = req->qnext;
-                }
-                if (req->qnext) {
-                    req->qnext = NULL;
-                } else {
-                    queue->last_req = prev;
-                }
-                req->queue = NULL;
-                break;
-            }
-            prev = ptr;
+        if (req->qprev) {
+            req->qprev->qnext = req->qnext;
+        } else {
+            GASSERT(queue->first_req == req);
+            queue->first_req = req->qnext;
+        }
+        if (req->qnext) {
+            req->qnext->qprev = req->qprev;
+        } else {
+            GASSERT(queue->last_req == req);
+            queue->last_req = req->qprev;
+        }
+        req->qnext = req->qprev = NULL;
+        req->queue = NULL;
+        /* Update the channel's view of this queue */
+        if (req->status == GRILIO_REQUEST_QUEUED) {
+            grilio_request_list_remove(&queue->queued, req);
+        }
+        if (req->flags & GRILIO_REQUEST_FLAG_PENDING) {
+            GASSERT(queue->pending_count > 0);
+            queue->pending_count--;
         }
     }
 }
@@ -177,6 +175,55 @@ grilio_queue_send_request_full(
     return 0;
 }
 
+guint
+grilio_queue_send_request_bytes(
+    GRilIoQueue* self,
+    GRilIoRequest* req,
+    guint code,
+    GRilIoChannelResponseBytesFunc response,
+    GDestroyNotify destroy,
+    void* user_data)
+{
+    if (G_LIKELY(self && (!req || req->status == GRILIO_REQUEST_NEW))) {
+        guint id;
+        GRilIoRequest* internal_req = NULL;
+        if (!req) req = internal_req = grilio_request_new();
+        grilio_queue_add(self, req);
+        id = grilio_channel_send_request_bytes(self->channel, req, code,
+            response, destroy, user_data);
+        /* grilio_channel_send_request_bytes has no reason to fail */
+        GASSERT(id);
+        grilio_request_unref(internal_req);
+        return id;
+    }
+    return 0;
+}
+
+guint
+grilio_queue_send_request_stream(
+    GRilIoQueue* self,
+    GRilIoRequest* req,
+    guint code,
+    GRilIoChannelFragmentFunc fragment,
+    GRilIoChannelResponseFunc response,
+    GDestroyNotify destroy,
+    void* user_data)
+{
+    if (G_LIKELY(self && (!req || req->status == GRILIO_REQUEST_NEW))) {
+        guint id;
+        GRilIoRequest* internal_req = NULL;
+        if (!req) req = internal_req = grilio_request_new();
+        grilio_queue_add(self, req);
+        id = grilio_channel_send_request_stream(self->channel, req, code,
+            fragment, response, destroy, user_data);
+        /* grilio_channel_send_request_stream has no reason to fail */
+        GASSERT(id);
+        grilio_request_unref(internal_req);
+        return id;
+    }
+    return 0;
+}
+
 gboolean
 grilio_queue_cancel_request(
     GRilIoQueue* self,
@@ -202,19 +249,37 @@ grilio_queue_cancel_all(
     if (G_LIKELY(self)) {
         while (self->first_req) {
             GRilIoRequest* req = self->first_req;
-            self->first_req = req->qnext;
-            if (req->qnext) {
-                req->qnext = NULL;
-            } else {
-                GASSERT(self->last_req == req);
-                self->last_req = NULL;
-            }
-            req->queue = NULL;
+            grilio_queue_remove(req);
             grilio_channel_cancel_request(self->channel, req->id, notify);
         }
     }
 }
 
+void
+grilio_queue_set_priority(
+    GRilIoQueue* self,
+    GRILIO_PRIORITY priority)
+{
+    if (G_LIKELY(self)) {
+        if (priority == GRILIO_PRIORITY_DEFAULT) {
+            self->priority = GRILIO_PRIORITY_NORMAL;
+        } else if (priority >= GRILIO_PRIORITY_LOW &&
+            priority <= GRILIO_PRIORITY_HIGH) {
+            self->priority = priority;
+        }
+    }
+}
+
+void
+grilio_queue_set_deduplicate(
+    GRilIoQueue* self,
+    gboolean deduplicate)
+{
+    if (G_LIKELY(self)) {
+        self->deduplicate = deduplicate;
+    }
+}
+
 GRILIO_TRANSACTION_STATE
 grilio_queue_transaction_start(
     GRilIoQueue* self)
@@ -62,6 +62,8 @@ grilio_request_sized_new(
     g_atomic_int_set(&req->refcount, 1);
     req->timeout = GRILIO_TIMEOUT_DEFAULT;
     req->retry = grilio_request_default_retry;
+    req->replay = GRILIO_REPLAY_DEFAULT;
+    req->priority = GRILIO_PRIORITY_DEFAULT;
     if (size) {
         req->bytes = g_byte_array_sized_new(size);
     }
@@ -116,7 +118,13 @@ grilio_request_free(
     GRilIoRequest* req)
 {
     GASSERT(!req->next);
+    GASSERT(!req->prev);
     GASSERT(!req->qnext);
+    GASSERT(!req->qprev);
+    GASSERT(!req->queued_next);
+    GASSERT(!req->queued_prev);
+    GASSERT(!req->leader);
+    GASSERT(!req->attached.first);
     GASSERT(!req->queue);
     if (req->destroy) {
         req->destroy(req->user_data);
@@ -196,6 +204,27 @@ grilio_request_set_retry_func(
     }
 }
 
+void
+grilio_request_set_replay(
+    GRilIoRequest* req,
+    GRILIO_REPLAY replay)
+{
+    if (G_LIKELY(req)) {
+        req->replay = replay;
+    }
+}
+
+void
+grilio_request_set_priority(
+    GRilIoRequest* req,
+    GRILIO_PRIORITY priority)
+{
+    if (G_LIKELY(req) && priority >= GRILIO_PRIORITY_DEFAULT &&
+        priority <= GRILIO_PRIORITY_HIGH) {
+        req->priority = priority;
+    }
+}
+
 int
 grilio_request_retry_count(
     GRilIoRequest* req)
@@ -231,6 +260,83 @@ grilio_request_unref_proc(
     grilio_request_unref(data);
 }
 
+void
+grilio_request_list_append(
+    GRilIoRequestList* list,
+    GRilIoRequest* req)
+{
+    GASSERT(!req->queued_next);
+    GASSERT(!req->queued_prev);
+    if (list->last) {
+        req->queued_prev = list->last;
+        list->last->queued_next = req;
+        list->last = req;
+    } else {
+        GASSERT(!list->first);
+        list->first = list->last = req;
+    }
+}
+
+void
+grilio_request_list_prepend(
+    GRilIoRequestList* list,
+    GRilIoRequest* req)
+{
+    GASSERT(!req->queued_next);
+    GASSERT(!req->queued_prev);
+    if (list->first) {
+        req->queued_next = list->first;
+        list->first->queued_prev = req;
+        list->first = req;
+    } else {
+        GASSERT(!list->last);
+        list->first = list->last = req;
+    }
+}
+
+void
+grilio_request_list_insert_before(
+    GRilIoRequestList* list,
+    GRilIoRequest* req,
+    GRilIoRequest* next)
+{
+    GASSERT(!req->queued_next);
+    GASSERT(!req->queued_prev);
+    if (next) {
+        req->queued_next = next;
+        req->queued_prev = next->queued_prev;
+        if (next->queued_prev) {
+            next->queued_prev->queued_next = req;
+        } else {
+            GASSERT(list->first == next);
+            list->first = req;
+        }
+        next->queued_prev = req;
+    } else {
+        grilio_request_list_append(list, req);
+    }
+}
+
+void
+grilio_request_list_remove(
+    GRilIoRequestList* list,
+    GRilIoRequest* req)
+{
+    if (req->queued_prev) {
+        req->queued_prev->queued_next = req->queued_next;
+    } else {
+        GASSERT(list->first == req);
+        list->first = req->queued_next;
+    }
+    if (req->queued_next) {
+        req->queued_next->queued_prev = req->queued_prev;
+    } else {
+        GASSERT(list->last == req);
+        list->last = req->queued_prev;
+    }
+    req->queued_prev = req->queued_next = NULL;
+}
+
 void
 grilio_request_append_byte(
     GRilIoRequest* req,
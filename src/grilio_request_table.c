@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "grilio_request_table.h"
+#include "grilio_log.h"
+
+/*
+ * Linear probing with backward shift deletion, so there are no
+ * tombstones and lookups never get slower over time. Serials are
+ * allocated sequentially, the low bits alone spread them evenly.
+ * The load factor is kept between 1/8 and 1/2.
+ */
+
+#define TABLE_MIN_SIZE (16)
+#define TABLE_SLOT(table,id) ((id) & (table)->mask)
+
+typedef struct grilio_request_table_slot {
+    guint id;
+    GRilIoRequest* req;
+} GRilIoRequestTableSlot;
+
+struct grilio_request_table {
+    GRilIoRequestTableSlot* slots;
+    guint mask;
+    guint count;
+};
+
+static
+void
+grilio_request_table_resize(
+    GRilIoRequestTable* table,
+    guint size)
+{
+    GRilIoRequestTableSlot* old = table->slots;
+    const guint n = table->mask + 1;
+    guint i;
+
+    table->slots = g_new0(GRilIoRequestTableSlot, size);
+    table->mask = size - 1;
+    for (i = 0; i < n; i++) {
+        if (old[i].id) {
+            guint pos = TABLE_SLOT(table, old[i].id);
+
+            while (table->slots[pos].id) {
+                pos = (pos + 1) & table->mask;
+            }
+            table->slots[pos] = old[i];
+        }
+    }
+    g_free(old);
+}
+
+GRilIoRequestTable*
+grilio_request_table_new(
+    void)
+{
+    GRilIoRequestTable* table = g_new0(GRilIoRequestTable, 1);
+
+    table->slots = g_new0(GRilIoRequestTableSlot, TABLE_MIN_SIZE);
+    table->mask = TABLE_MIN_SIZE - 1;
+    return table;
+}
+
+void
+grilio_request_table_free(
+    GRilIoRequestTable* table)
+{
+    if (G_LIKELY(table)) {
+        g_free(table->slots);
+        g_free(table);
+    }
+}
+
+guint
+grilio_request_table_size(
+    GRilIoRequestTable* table)
+{
+    return G_LIKELY(table) ? table->count : 0;
+}
+
+GRilIoRequest*
+grilio_request_table_lookup(
+    GRilIoRequestTable* table,
+    guint id)
+{
+    if (G_LIKELY(table) && G_LIKELY(id)) {
+        guint pos = TABLE_SLOT(table, id);
+
+        while (table->slots[pos].id) {
+            if (table->slots[pos].id == id) {
+                return table->slots[pos].req;
+            }
+            pos = (pos + 1) & table->mask;
+        }
+    }
+    return NULL;
+}
+
+void
+grilio_request_table_insert(
+    GRilIoRequestTable* table,
+    guint id,
+    GRilIoRequest* req)
+{
+    if (G_LIKELY(table) && G_LIKELY(id) && G_LIKELY(req)) {
+        guint pos;
+
+        if (2 * (table->count + 1) > table->mask + 1) {
+            grilio_request_table_resize(table, 2 * (table->mask + 1));
+        }
+        pos = TABLE_SLOT(table, id);
+        while (table->slots[pos].id) {
+            if (table->slots[pos].id == id) {
+                /* Replace the existing entry */
+                table->slots[pos].req = req;
+                return;
+            }
+            pos = (pos + 1) & table->mask;
+        }
+        table->slots[pos].id = id;
+        table->slots[pos].req = req;
+        table->count++;
+    }
+}
+
+GRilIoRequest*
+grilio_request_table_remove(
+    GRilIoRequestTable* table,
+    guint id)
+{
+    if (G_LIKELY(table) && G_LIKELY(id)) {
+        GRilIoRequestTableSlot* slots = table->slots;
+        const guint mask = table->mask;
+        guint pos = TABLE_SLOT(table, id);
+
+        while (slots[pos].id) {
+            if (slots[pos].id == id) {
+                GRilIoRequest* req = slots[pos].req;
+                guint hole = pos;
+
+                /* Pull back the entries which would become unreachable */
+                for (;;) {
+                    guint home;
+
+                    pos = (pos + 1) & mask;
+                    if (!slots[pos].id) {
+                        break;
+                    }
+                    home = TABLE_SLOT(table, slots[pos].id);
+                    if (((pos - home) & mask) >= ((pos - hole) & mask)) {
+                        slots[hole] = slots[pos];
+                        hole = pos;
+                    }
+                }
+                slots[hole].id = 0;
+                slots[hole].req = NULL;
+                table->count--;
+                if (mask + 1 > TABLE_MIN_SIZE && 8 * table->count < mask + 1) {
+                    grilio_request_table_resize(table, (mask + 1) / 2);
+                }
+                return req;
+            }
+            pos = (pos + 1) & mask;
+        }
+    }
+    return NULL;
+}
+
+void
+grilio_request_table_iter_init(
+    GRilIoRequestTableIter* iter,
+    GRilIoRequestTable* table)
+{
+    iter->table = table;
+    iter->pos = 0;
+}
+
+gboolean
+grilio_request_table_iter_next(
+    GRilIoRequestTableIter* iter,
+    guint* id,
+    GRilIoRequest** req)
+{
+    GRilIoRequestTable* table = iter->table;
+
+    if (G_LIKELY(table)) {
+        const guint n = table->mask + 1;
+
+        while (iter->pos < n) {
+            const GRilIoRequestTableSlot* slot = table->slots + (iter->pos++);
+
+            if (slot->id) {
+                if (id) *id = slot->id;
+                if (req) *req = slot->req;
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GRILIO_REQUEST_TABLE_H
+#define GRILIO_REQUEST_TABLE_H
+
+#include "grilio_types.h"
+
+/*
+ * Open addressing table mapping request serials to requests. Doesn't
+ * reference the requests it contains, that's up to the caller. Zero
+ * is not a valid key. The iterator must not be used across changes
+ * to the table.
+ */
+
+typedef struct grilio_request_table GRilIoRequestTable;
+
+typedef struct grilio_request_table_iter {
+    GRilIoRequestTable* table;
+    guint pos;
+} GRilIoRequestTableIter;
+
+GRilIoRequestTable*
+grilio_request_table_new(
+    void);
+
+void
+grilio_request_table_free(
+    GRilIoRequestTable* table);
+
+guint
+grilio_request_table_size(
+    GRilIoRequestTable* table);
+
+GRilIoRequest*
+grilio_request_table_lookup(
+    GRilIoRequestTable* table,
+    guint id);
+
+void
+grilio_request_table_insert(
+    GRilIoRequestTable* table,
+    guint id,
+    GRilIoRequest* req);
+
+GRilIoRequest*
+grilio_request_table_remove(
+    GRilIoRequestTable* table,
+    guint id);
+
+void
+grilio_request_table_iter_init(
+    GRilIoRequestTableIter* iter,
+    GRilIoRequestTable* table);
+
+gboolean
+grilio_request_table_iter_next(
+    GRilIoRequestTableIter* iter,
+    guint* id,
+    GRilIoRequest** req);
+
+#endif /* GRILIO_REQUEST_TABLE_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
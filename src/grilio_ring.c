@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "grilio_ring.h"
+#include "grilio_log.h"
+
+/* Keep producer and consumer indices in separate cache lines */
+#define RING_CACHE_LINE (64)
+
+struct grilio_ring {
+    gpointer* data;
+    guint mask;
+    gint head; /* Written by consumer */
+    char pad[RING_CACHE_LINE - sizeof(gint)];
+    gint tail; /* Written by producer */
+};
+
+GRilIoRing*
+grilio_ring_new(
+    guint size)
+{
+    GRilIoRing* ring = g_new0(GRilIoRing, 1);
+    guint n = 1;
+
+    /* Round the size up to the power of 2 */
+    while (n < size) n <<= 1;
+    ring->mask = n - 1;
+    ring->data = g_new(gpointer, n);
+    return ring;
+}
+
+void
+grilio_ring_free(
+    GRilIoRing* ring,
+    GDestroyNotify destroy)
+{
+    if (G_LIKELY(ring)) {
+        if (destroy) {
+            gpointer data;
+
+            while ((data = grilio_ring_pop(ring)) != NULL) {
+                destroy(data);
+            }
+        }
+        g_free(ring->data);
+        g_free(ring);
+    }
+}
+
+guint
+grilio_ring_size(
+    GRilIoRing* ring)
+{
+    return ring->mask + 1;
+}
+
+gboolean
+grilio_ring_push(
+    GRilIoRing* ring,
+    gpointer data)
+{
+    const guint tail = (guint)ring->tail;
+    const guint head = (guint)g_atomic_int_get(&ring->head);
+
+    GASSERT(data);
+    if ((tail - head) <= ring->mask) {
+        ring->data[tail & ring->mask] = data;
+        /* Publish the slot after it has been filled */
+        g_atomic_int_set(&ring->tail, (gint)(tail + 1));
+        return TRUE;
+    }
+    return FALSE;
+}
+
+gpointer
+grilio_ring_peek(
+    GRilIoRing* ring)
+{
+    const guint head = (guint)ring->head;
+    const guint tail = (guint)g_atomic_int_get(&ring->tail);
+
+    return (head != tail) ? ring->data[head & ring->mask] : NULL;
+}
+
+gpointer
+grilio_ring_pop(
+    GRilIoRing* ring)
+{
+    const guint head = (guint)ring->head;
+    const guint tail = (guint)g_atomic_int_get(&ring->tail);
+
+    if (head != tail) {
+        gpointer data = ring->data[head & ring->mask];
+
+        /* Release the slot after it has been read */
+        g_atomic_int_set(&ring->head, (gint)(head + 1));
+        return data;
+    }
+    return NULL;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
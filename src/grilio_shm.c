@@ -0,0 +1,549 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE /* memfd_create */
+
+#include "grilio_shm.h"
+#include "grilio_transport_p.h"
+#include "grilio_log.h"
+
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define GRILIO_SHM_MAGIC (0x534c4952) /* "RILS" */
+#define GRILIO_SHM_VERSION (1)
+#define GRILIO_SHM_RING_SIZE (0x10000) /* Must be a power of 2 */
+#define GRILIO_SHM_CACHE_LINE (64)
+#define GRILIO_SHM_ALIGN(len) (((len) + 3) & ~3)
+
+/* Handshake message, followed by the memfd and two eventfds */
+typedef struct grilio_shm_hello {
+    guint32 magic;
+    guint32 version;
+    guint32 ring_size;
+    guint32 flags;
+
+#define GRILIO_SHM_HELLO_FLAG_SUB (0x01)
+
+    char sub[RIL_SUB_LEN];
+} GRilIoShmHello;
+
+enum grilio_shm_hello_fds {
+    HELLO_FD_MEM,
+    HELLO_FD_CONNECT_EVENT,
+    HELLO_FD_ACCEPT_EVENT,
+    HELLO_FD_COUNT
+};
+
+/* Shared memory layout */
+typedef struct grilio_shm_header {
+    guint32 magic;
+    guint32 version;
+    guint32 ring_size;
+    char pad[GRILIO_SHM_CACHE_LINE - 3 * sizeof(guint32)];
+} GRilIoShmHeader;
+
+/* Keep producer and consumer fields in separate cache lines */
+typedef struct grilio_shm_ring {
+    gint head;          /* Written by producer */
+    gint consumer_wait; /* Set by consumer, cleared by producer */
+    char pad1[GRILIO_SHM_CACHE_LINE - 2 * sizeof(gint)];
+    gint tail;          /* Written by consumer */
+    gint producer_wait; /* Set by producer, cleared by consumer */
+    char pad2[GRILIO_SHM_CACHE_LINE - 2 * sizeof(gint)];
+} GRilIoShmRing;
+
+#define GRILIO_SHM_RING_DATA(ring) (((guint8*)(ring)) + sizeof(GRilIoShmRing))
+#define GRILIO_SHM_MAP_SIZE(size) \
+    (sizeof(GRilIoShmHeader) + 2 * (sizeof(GRilIoShmRing) + (size)))
+
+struct grilio_shm {
+    void* map;
+    gsize map_size;
+    guint32 size;
+    guint32 mask;
+    GRilIoShmRing* in;
+    GRilIoShmRing* out;
+    int wait_fd;    /* Ours */
+    int wake_fd;    /* Peer's */
+    guint pop_size;
+    GByteArray* scratch;
+};
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+grilio_shm_wakeup(
+    int efd)
+{
+    const guint64 one = 1;
+
+    /* Only fails if the counter overflows, which is fine */
+    if (write(efd, &one, sizeof(one)) < 0) {
+        GVERBOSE("eventfd write failed: %s", strerror(errno));
+    }
+}
+
+static
+void
+grilio_shm_close(
+    int* fds,
+    int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+}
+
+static
+GRilIoShm*
+grilio_shm_new(
+    void* map,
+    guint32 ring_size,
+    gboolean connect,
+    int connect_fd,
+    int accept_fd)
+{
+    GRilIoShm* shm = g_slice_new0(GRilIoShm);
+    GRilIoShmRing* req_ring = (GRilIoShmRing*)(((guint8*)map) +
+        sizeof(GRilIoShmHeader));
+    GRilIoShmRing* resp_ring = (GRilIoShmRing*)(GRILIO_SHM_RING_DATA
+        (req_ring) + ring_size);
+
+    shm->map = map;
+    shm->map_size = GRILIO_SHM_MAP_SIZE(ring_size);
+    shm->size = ring_size;
+    shm->mask = ring_size - 1;
+    if (connect) {
+        shm->out = req_ring;
+        shm->in = resp_ring;
+        shm->wait_fd = connect_fd;
+        shm->wake_fd = accept_fd;
+    } else {
+        shm->out = resp_ring;
+        shm->in = req_ring;
+        shm->wait_fd = accept_fd;
+        shm->wake_fd = connect_fd;
+    }
+    shm->scratch = g_byte_array_new();
+    return shm;
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoShm*
+grilio_shm_connect(
+    int sock,
+    const char* sub,
+    GError** error)
+{
+    const gsize map_size = GRILIO_SHM_MAP_SIZE(GRILIO_SHM_RING_SIZE);
+    int fds[HELLO_FD_COUNT];
+    void* map = MAP_FAILED;
+    int i;
+
+    for (i = 0; i < HELLO_FD_COUNT; i++) {
+        fds[i] = -1;
+    }
+
+    fds[HELLO_FD_MEM] = memfd_create("grilio-shm",
+        MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fds[HELLO_FD_MEM] >= 0 &&
+        ftruncate(fds[HELLO_FD_MEM], map_size) == 0 &&
+        /* The peer doesn't have to worry about the size changing */
+        fcntl(fds[HELLO_FD_MEM], F_ADD_SEALS, F_SEAL_SHRINK |
+            F_SEAL_GROW | F_SEAL_SEAL) == 0 &&
+        (map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+            fds[HELLO_FD_MEM], 0)) != MAP_FAILED &&
+        (fds[HELLO_FD_CONNECT_EVENT] =
+            eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) >= 0 &&
+        (fds[HELLO_FD_ACCEPT_EVENT] =
+            eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) >= 0) {
+        GRilIoShmHeader* header = map;
+        GRilIoShmRing* ring = (GRilIoShmRing*)(header + 1);
+        union {
+            struct cmsghdr cmsg;
+            char buf[CMSG_SPACE(sizeof(fds))];
+        } control;
+        GRilIoShmHello hello;
+        struct msghdr msg;
+        struct iovec iov;
+        gssize sent;
+
+        /* Both consumers start idle (the memory is zeroed) */
+        header->magic = GRILIO_SHM_MAGIC;
+        header->version = GRILIO_SHM_VERSION;
+        header->ring_size = GRILIO_SHM_RING_SIZE;
+        ring->consumer_wait = TRUE;
+        ring = (GRilIoShmRing*)(GRILIO_SHM_RING_DATA(ring) +
+            GRILIO_SHM_RING_SIZE);
+        ring->consumer_wait = TRUE;
+
+        memset(&hello, 0, sizeof(hello));
+        hello.magic = GRILIO_SHM_MAGIC;
+        hello.version = GRILIO_SHM_VERSION;
+        hello.ring_size = GRILIO_SHM_RING_SIZE;
+        if (sub) {
+            hello.flags |= GRILIO_SHM_HELLO_FLAG_SUB;
+            memcpy(hello.sub, sub, RIL_SUB_LEN);
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        memset(&control, 0, sizeof(control));
+        iov.iov_base = &hello;
+        iov.iov_len = sizeof(hello);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        control.cmsg.cmsg_level = SOL_SOCKET;
+        control.cmsg.cmsg_type = SCM_RIGHTS;
+        control.cmsg.cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(&control.cmsg), fds, sizeof(fds));
+
+        do {
+            sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        } while (sent < 0 && errno == EINTR);
+
+        if (sent == sizeof(hello)) {
+            /* The mapping keeps the memory alive */
+            close(fds[HELLO_FD_MEM]);
+            return grilio_shm_new(map, GRILIO_SHM_RING_SIZE, TRUE,
+                fds[HELLO_FD_CONNECT_EVENT], fds[HELLO_FD_ACCEPT_EVENT]);
+        }
+        if (sent >= 0) {
+            errno = EMSGSIZE;
+        }
+    }
+
+    if (error) {
+        *error = grilio_transport_errno_error(errno);
+    }
+    if (map != MAP_FAILED) {
+        munmap(map, map_size);
+    }
+    grilio_shm_close(fds, HELLO_FD_COUNT);
+    return NULL;
+}
+
+GRilIoShm*
+grilio_shm_accept(
+    int sock,
+    char* sub,
+    GError** error)
+{
+    int fds[HELLO_FD_COUNT];
+    int err = EPROTO;
+    union {
+        struct cmsghdr cmsg;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    GRilIoShmHello hello;
+    struct msghdr msg;
+    struct iovec iov;
+    gssize received;
+    int i;
+
+    for (i = 0; i < HELLO_FD_COUNT; i++) {
+        fds[i] = -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&hello, 0, sizeof(hello));
+    iov.iov_base = &hello;
+    iov.iov_len = sizeof(hello);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    do {
+        received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+
+    if (received < 0) {
+        err = errno;
+    } else {
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_RIGHTS) {
+            const gsize n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+
+            memcpy(fds, CMSG_DATA(cmsg), MIN(n, HELLO_FD_COUNT) *
+                sizeof(int));
+            if (n > HELLO_FD_COUNT) {
+                /* Close the extra ones */
+                int* extra = (int*)CMSG_DATA(cmsg) + HELLO_FD_COUNT;
+
+                grilio_shm_close(extra, n - HELLO_FD_COUNT);
+            }
+        }
+
+        if (received == sizeof(hello) && !(msg.msg_flags & MSG_CTRUNC) &&
+            hello.magic == GRILIO_SHM_MAGIC &&
+            hello.version == GRILIO_SHM_VERSION &&
+            hello.ring_size >= 0x1000 && hello.ring_size <= 0x1000000 &&
+            !(hello.ring_size & (hello.ring_size - 1)) &&
+            fds[HELLO_FD_MEM] >= 0 &&
+            fds[HELLO_FD_CONNECT_EVENT] >= 0 &&
+            fds[HELLO_FD_ACCEPT_EVENT] >= 0) {
+            const gsize map_size = GRILIO_SHM_MAP_SIZE(hello.ring_size);
+            struct stat st;
+
+            if (fstat(fds[HELLO_FD_MEM], &st) == 0 &&
+                st.st_size >= (off_t)map_size) {
+                void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fds[HELLO_FD_MEM], 0);
+
+                if (map != MAP_FAILED) {
+                    const GRilIoShmHeader* header = map;
+
+                    if (header->magic == GRILIO_SHM_MAGIC &&
+                        header->ring_size == hello.ring_size) {
+                        if (hello.flags & GRILIO_SHM_HELLO_FLAG_SUB) {
+                            memcpy(sub, hello.sub, RIL_SUB_LEN);
+                        } else {
+                            memset(sub, 0, RIL_SUB_LEN);
+                        }
+                        close(fds[HELLO_FD_MEM]);
+                        return grilio_shm_new(map, hello.ring_size, FALSE,
+                            fds[HELLO_FD_CONNECT_EVENT],
+                            fds[HELLO_FD_ACCEPT_EVENT]);
+                    }
+                    munmap(map, map_size);
+                } else {
+                    err = errno;
+                }
+            }
+        } else if (!received) {
+            err = ECONNRESET;
+        }
+    }
+
+    if (error) {
+        *error = grilio_transport_errno_error(err);
+    }
+    grilio_shm_close(fds, HELLO_FD_COUNT);
+    return NULL;
+}
+
+void
+grilio_shm_free(
+    GRilIoShm* shm)
+{
+    if (shm) {
+        munmap(shm->map, shm->map_size);
+        close(shm->wait_fd);
+        close(shm->wake_fd);
+        g_byte_array_free(shm->scratch, TRUE);
+        g_slice_free(GRilIoShm, shm);
+    }
+}
+
+int
+grilio_shm_event_fd(
+    GRilIoShm* shm)
+{
+    return shm->wait_fd;
+}
+
+void
+grilio_shm_clear_event(
+    GRilIoShm* shm)
+{
+    guint64 count;
+
+    if (read(shm->wait_fd, &count, sizeof(count)) < 0) {
+        GVERBOSE("eventfd read failed: %s", strerror(errno));
+    }
+}
+
+guint
+grilio_shm_max_packet_len(
+    GRilIoShm* shm)
+{
+    return shm->size - 4;
+}
+
+gboolean
+grilio_shm_write(
+    GRilIoShm* shm,
+    const struct iovec* iov,
+    int n)
+{
+    GRilIoShmRing* ring = shm->out;
+    guint8* data = GRILIO_SHM_RING_DATA(ring);
+    const guint32 head = (guint32)ring->head;
+    guint32 tail = (guint32)g_atomic_int_get(&ring->tail);
+    guint32 pos, len = 0, need;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        len += iov[i].iov_len;
+    }
+
+    need = 4 + GRILIO_SHM_ALIGN(len);
+    GASSERT(len <= grilio_shm_max_packet_len(shm));
+    if (shm->size - (head - tail) < need) {
+        /* Ask the consumer to wake us up and check again */
+        g_atomic_int_set(&ring->producer_wait, TRUE);
+        tail = (guint32)g_atomic_int_get(&ring->tail);
+        if (shm->size - (head - tail) < need) {
+            return FALSE;
+        }
+        g_atomic_int_set(&ring->producer_wait, FALSE);
+    }
+
+    /* Records are 4-byte aligned, the length never wraps */
+    memcpy(data + (head & shm->mask), &len, 4);
+    pos = (head + 4) & shm->mask;
+    for (i = 0; i < n; i++) {
+        const guint8* src = iov[i].iov_base;
+        guint32 left = iov[i].iov_len;
+
+        while (left) {
+            const guint32 chunk = MIN(left, shm->size - pos);
+
+            memcpy(data + pos, src, chunk);
+            src += chunk;
+            left -= chunk;
+            pos = (pos + chunk) & shm->mask;
+        }
+    }
+
+    /* Publish the record after it has been filled */
+    g_atomic_int_set(&ring->head, (gint)(head + need));
+    if (g_atomic_int_compare_and_exchange(&ring->consumer_wait, TRUE,
+        FALSE)) {
+        grilio_shm_wakeup(shm->wake_fd);
+    }
+    return TRUE;
+}
+
+const void*
+grilio_shm_peek(
+    GRilIoShm* shm,
+    guint* out_len,
+    GError** error)
+{
+    GRilIoShmRing* ring = shm->in;
+    const guint8* data = GRILIO_SHM_RING_DATA(ring);
+    const guint32 tail = (guint32)ring->tail;
+    const guint32 avail = (guint32)g_atomic_int_get(&ring->head) - tail;
+    guint32 len, start;
+
+    if (!avail) {
+        return NULL;
+    }
+
+    /* Don't trust the other side too much */
+    if (avail >= 4 && avail <= shm->size && !(avail & 3)) {
+        memcpy(&len, data + (tail & shm->mask), 4);
+        if (len <= grilio_shm_max_packet_len(shm) &&
+            4 + GRILIO_SHM_ALIGN(len) <= avail) {
+            shm->pop_size = 4 + GRILIO_SHM_ALIGN(len);
+            *out_len = len;
+            start = (tail + 4) & shm->mask;
+            if (start + len <= shm->size) {
+                /* Contiguous (the usual case) */
+                return data + start;
+            } else {
+                const guint32 n1 = shm->size - start;
+
+                g_byte_array_set_size(shm->scratch, len);
+                memcpy(shm->scratch->data, data + start, n1);
+                memcpy(shm->scratch->data + n1, data, len - n1);
+                return shm->scratch->data;
+            }
+        }
+    }
+
+    g_propagate_error(error, g_error_new_literal(G_IO_ERROR,
+        G_IO_ERROR_INVALID_DATA, "Shared memory ring is broken"));
+    return NULL;
+}
+
+void
+grilio_shm_pop(
+    GRilIoShm* shm)
+{
+    GRilIoShmRing* ring = shm->in;
+
+    GASSERT(shm->pop_size);
+    g_atomic_int_set(&ring->tail, (gint)((guint32)ring->tail +
+        shm->pop_size));
+    shm->pop_size = 0;
+    if (g_atomic_int_compare_and_exchange(&ring->producer_wait, TRUE,
+        FALSE)) {
+        grilio_shm_wakeup(shm->wake_fd);
+    }
+}
+
+gboolean
+grilio_shm_idle(
+    GRilIoShm* shm)
+{
+    GRilIoShmRing* ring = shm->in;
+
+    /* Raise the flag and check again, the producer may have missed it */
+    g_atomic_int_set(&ring->consumer_wait, TRUE);
+    if (g_atomic_int_get(&ring->head) != ring->tail) {
+        g_atomic_int_set(&ring->consumer_wait, FALSE);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GRILIO_SHM_H
+#define GRILIO_SHM_H
+
+#include "grilio_types.h"
+
+#include <sys/uio.h>
+
+/*
+ * Pair of single producer/single consumer byte rings in a memfd shared
+ * between two processes. The connecting side creates the memory region
+ * and two eventfds and passes them to the peer over a unix socket, along
+ * with the subscription. The first ring carries requests, the second one
+ * everything else.
+ *
+ * Each record is a native 32-bit length followed by the packet (without
+ * the RIL length prefix) padded to 4 bytes. The consumer raises a flag
+ * in the ring before it goes to sleep, the producer only writes the
+ * eventfd if that flag is set. The same is done in the other direction
+ * when the producer runs out of space.
+ */
+
+typedef struct grilio_shm GRilIoShm;
+
+/* Connecting side */
+GRilIoShm*
+grilio_shm_connect(
+    int sock,
+    const char* sub,
+    GError** error);
+
+/* Accepting side, sub receives RIL_SUB_LEN chars or gets zeroed */
+GRilIoShm*
+grilio_shm_accept(
+    int sock,
+    char* sub,
+    GError** error);
+
+void
+grilio_shm_free(
+    GRilIoShm* shm);
+
+/* Our eventfd, becomes readable when there's something to do */
+int
+grilio_shm_event_fd(
+    GRilIoShm* shm);
+
+void
+grilio_shm_clear_event(
+    GRilIoShm* shm);
+
+guint
+grilio_shm_max_packet_len(
+    GRilIoShm* shm);
+
+/* Producer side. Writes the whole packet or nothing */
+gboolean
+grilio_shm_write(
+    GRilIoShm* shm,
+    const struct iovec* iov,
+    int n);
+
+/*
+ * Consumer side. The packet returned by grilio_shm_peek stays valid
+ * until grilio_shm_pop is called. NULL means that there's nothing to
+ * read (or the ring is broken, in which case the error is set).
+ * grilio_shm_idle returns FALSE if more data has arrived after the
+ * last peek, otherwise the peer will wake us up.
+ */
+const void*
+grilio_shm_peek(
+    GRilIoShm* shm,
+    guint* len,
+    GError** error);
+
+void
+grilio_shm_pop(
+    GRilIoShm* shm);
+
+gboolean
+grilio_shm_idle(
+    GRilIoShm* shm);
+
+#endif /* GRILIO_SHM_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "grilio_shm_server.h"
+#include "grilio_shm.h"
+#include "grilio_transport_p.h"
+
+#define GLOG_MODULE_NAME grilio_shm_server_log
+#include <gutil_log.h>
+
+#include <glib-unix.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/* Log module */
+GLOG_MODULE_DEFINE2("grilio-shm-server", GRILIO_LOG_MODULE);
+
+struct grilio_shm_server {
+    int fd;
+    gboolean can_close;
+    GRilIoShm* shm;
+    guint fd_watch_id;
+    guint event_watch_id;
+    gboolean disconnected;
+    char sub[RIL_SUB_LEN + 1];
+    GQueue backlog; /* GBytes waiting for room in the ring */
+    GRilIoShmServerCallbacks cb;
+    void* user_data;
+};
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+grilio_shm_server_shutdown_io(
+    GRilIoShmServer* self)
+{
+    if (self->fd_watch_id) {
+        g_source_remove(self->fd_watch_id);
+        self->fd_watch_id = 0;
+    }
+    if (self->event_watch_id) {
+        g_source_remove(self->event_watch_id);
+        self->event_watch_id = 0;
+    }
+    if (self->fd >= 0) {
+        shutdown(self->fd, SHUT_RDWR);
+        if (self->can_close) {
+            close(self->fd);
+        }
+        self->fd = -1;
+    }
+}
+
+static
+void
+grilio_shm_server_disconnected(
+    GRilIoShmServer* self)
+{
+    grilio_shm_server_shutdown_io(self);
+    if (!self->disconnected) {
+        self->disconnected = TRUE;
+        GDEBUG("Client disconnected");
+        /* This one may free the server, must be the last thing we do */
+        if (self->cb.disconnected) {
+            self->cb.disconnected(self, self->user_data);
+        }
+    }
+}
+
+static
+gboolean
+grilio_shm_server_write(
+    GRilIoShmServer* self,
+    const void* data,
+    guint len)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void*)data;
+    iov.iov_len = len;
+    return grilio_shm_write(self->shm, &iov, 1);
+}
+
+static
+void
+grilio_shm_server_flush(
+    GRilIoShmServer* self)
+{
+    GBytes* bytes;
+
+    while ((bytes = g_queue_peek_head(&self->backlog)) != NULL) {
+        gsize len;
+        const void* data = g_bytes_get_data(bytes, &len);
+
+        if (len > grilio_shm_max_packet_len(self->shm)) {
+            /* Queued before we knew the ring size */
+            GWARN("Dropping %u byte packet", (guint)len);
+            g_bytes_unref(g_queue_pop_head(&self->backlog));
+        } else if (grilio_shm_server_write(self, data, len)) {
+            g_bytes_unref(g_queue_pop_head(&self->backlog));
+        } else {
+            break;
+        }
+    }
+}
+
+static
+gboolean
+grilio_shm_server_read(
+    GRilIoShmServer* self)
+{
+    do {
+        GError* error = NULL;
+        const void* packet;
+        guint len;
+
+        while ((packet = grilio_shm_peek(self->shm, &len, &error)) != NULL) {
+            if (self->cb.packet) {
+                self->cb.packet(self, packet, len, self->user_data);
+            }
+            grilio_shm_pop(self->shm);
+        }
+        if (error) {
+            GERR("%s", GERRMSG(error));
+            g_error_free(error);
+            return FALSE;
+        }
+    } while (!grilio_shm_idle(self->shm));
+    return TRUE;
+}
+
+static
+gboolean
+grilio_shm_server_event_callback(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    GRilIoShmServer* self = user_data;
+
+    grilio_shm_clear_event(self->shm);
+    grilio_shm_server_flush(self);
+    if (!grilio_shm_server_read(self)) {
+        self->event_watch_id = 0;
+        grilio_shm_server_disconnected(self);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static
+gboolean
+grilio_shm_server_fd_callback(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    GRilIoShmServer* self = user_data;
+
+    if (!self->shm) {
+        GError* error = NULL;
+
+        /* The first thing that arrives is the handshake */
+        self->shm = grilio_shm_accept(fd, self->sub, &error);
+        if (self->shm) {
+            const int flags = fcntl(fd, F_GETFL);
+
+            if (flags >= 0) {
+                fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+            }
+            GDEBUG("Client connected%s%s", self->sub[0] ? ", sub " : "",
+                self->sub);
+            self->event_watch_id = g_unix_fd_add(grilio_shm_event_fd
+                (self->shm), G_IO_IN, grilio_shm_server_event_callback,
+                self);
+            grilio_shm_server_flush(self);
+            if (self->cb.connected) {
+                self->cb.connected(self, self->user_data);
+            }
+
+            /* The client may have been quick */
+            if (self->fd >= 0 && !grilio_shm_server_read(self)) {
+                self->fd_watch_id = 0;
+                grilio_shm_server_disconnected(self);
+                return G_SOURCE_REMOVE;
+            }
+            return G_SOURCE_CONTINUE;
+        }
+        GERR("Shared memory handshake failed: %s", GERRMSG(error));
+        g_error_free(error);
+    } else {
+        char buf[16];
+        gssize n;
+
+        /* Nothing else is supposed to arrive over the socket */
+        do {
+            n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        } while (n > 0 || (n < 0 && errno == EINTR));
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+            !(condition & (G_IO_HUP | G_IO_ERR))) {
+            return G_SOURCE_CONTINUE;
+        }
+    }
+
+    /* Zero source id to avoid removing it twice */
+    self->fd_watch_id = 0;
+    grilio_shm_server_disconnected(self);
+    return G_SOURCE_REMOVE;
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoShmServer*
+grilio_shm_server_new(
+    int fd,
+    gboolean can_close,
+    const GRilIoShmServerCallbacks* callbacks,
+    void* user_data)
+{
+    if (G_LIKELY(fd >= 0)) {
+        GRilIoShmServer* self = g_slice_new0(GRilIoShmServer);
+
+        self->fd = fd;
+        self->can_close = can_close;
+        if (callbacks) {
+            self->cb = *callbacks;
+        }
+        self->user_data = user_data;
+        g_queue_init(&self->backlog);
+        self->fd_watch_id = g_unix_fd_add(fd, G_IO_IN | G_IO_HUP | G_IO_ERR,
+            grilio_shm_server_fd_callback, self);
+        return self;
+    }
+    return NULL;
+}
+
+void
+grilio_shm_server_free(
+    GRilIoShmServer* self)
+{
+    if (G_LIKELY(self)) {
+        grilio_shm_server_shutdown_io(self);
+        g_queue_foreach(&self->backlog, (GFunc)g_bytes_unref, NULL);
+        g_queue_clear(&self->backlog);
+        grilio_shm_free(self->shm);
+        g_slice_free(GRilIoShmServer, self);
+    }
+}
+
+const char*
+grilio_shm_server_subscription(
+    GRilIoShmServer* self)
+{
+    return (G_LIKELY(self) && self->sub[0]) ? self->sub : NULL;
+}
+
+gboolean
+grilio_shm_server_send(
+    GRilIoShmServer* self,
+    const void* data,
+    guint len)
+{
+    if (G_LIKELY(self) && (data || !len) && !self->disconnected &&
+        (!self->shm || len <= grilio_shm_max_packet_len(self->shm))) {
+        if (!self->shm || !g_queue_is_empty(&self->backlog) ||
+            !grilio_shm_server_write(self, data, len)) {
+            /* Will be sent when there's room */
+            g_queue_push_tail(&self->backlog, g_bytes_new(data, len));
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "grilio_timer_heap.h"
+#include "grilio_log.h"
+
+#define HEAP_MIN_SIZE (16)
+
+/* Entries are stored at [1..count], the slot 0 is unused */
+struct grilio_timer_heap {
+    GRilIoTimerHeapEntry** entries;
+    guint count;
+    guint size;
+};
+
+static
+void
+grilio_timer_heap_place(
+    GRilIoTimerHeap* heap,
+    GRilIoTimerHeapEntry* entry,
+    guint i)
+{
+    heap->entries[i] = entry;
+    entry->index = i;
+}
+
+static
+void
+grilio_timer_heap_sift_up(
+    GRilIoTimerHeap* heap,
+    guint i)
+{
+    GRilIoTimerHeapEntry* entry = heap->entries[i];
+
+    while (i > 1) {
+        GRilIoTimerHeapEntry* parent = heap->entries[i / 2];
+
+        if (parent->deadline <= entry->deadline) {
+            break;
+        }
+        grilio_timer_heap_place(heap, parent, i);
+        i /= 2;
+    }
+    grilio_timer_heap_place(heap, entry, i);
+}
+
+static
+void
+grilio_timer_heap_sift_down(
+    GRilIoTimerHeap* heap,
+    guint i)
+{
+    GRilIoTimerHeapEntry* entry = heap->entries[i];
+
+    for (;;) {
+        guint child = 2 * i;
+
+        if (child > heap->count) {
+            break;
+        }
+        if (child < heap->count && heap->entries[child + 1]->deadline <
+            heap->entries[child]->deadline) {
+            child++;
+        }
+        if (entry->deadline <= heap->entries[child]->deadline) {
+            break;
+        }
+        grilio_timer_heap_place(heap, heap->entries[child], i);
+        i = child;
+    }
+    grilio_timer_heap_place(heap, entry, i);
+}
+
+GRilIoTimerHeap*
+grilio_timer_heap_new(
+    void)
+{
+    GRilIoTimerHeap* heap = g_new0(GRilIoTimerHeap, 1);
+
+    heap->size = HEAP_MIN_SIZE;
+    heap->entries = g_new(GRilIoTimerHeapEntry*, heap->size);
+    return heap;
+}
+
+void
+grilio_timer_heap_free(
+    GRilIoTimerHeap* heap)
+{
+    if (G_LIKELY(heap)) {
+        guint i;
+
+        for (i = 1; i <= heap->count; i++) {
+            heap->entries[i]->index = 0;
+        }
+        g_free(heap->entries);
+        g_free(heap);
+    }
+}
+
+guint
+grilio_timer_heap_count(
+    GRilIoTimerHeap* heap)
+{
+    return G_LIKELY(heap) ? heap->count : 0;
+}
+
+GRilIoTimerHeapEntry*
+grilio_timer_heap_peek(
+    GRilIoTimerHeap* heap)
+{
+    return (G_LIKELY(heap) && heap->count) ? heap->entries[1] : NULL;
+}
+
+void
+grilio_timer_heap_set(
+    GRilIoTimerHeap* heap,
+    GRilIoTimerHeapEntry* entry,
+    gint64 deadline)
+{
+    if (G_LIKELY(heap) && G_LIKELY(entry)) {
+        if (entry->index) {
+            /* Already in the heap, move it up or down */
+            const gint64 prev = entry->deadline;
+
+            GASSERT(heap->entries[entry->index] == entry);
+            entry->deadline = deadline;
+            if (deadline < prev) {
+                grilio_timer_heap_sift_up(heap, entry->index);
+            } else if (deadline > prev) {
+                grilio_timer_heap_sift_down(heap, entry->index);
+            }
+        } else {
+            if (heap->count + 1 >= heap->size) {
+                heap->size *= 2;
+                heap->entries = g_renew(GRilIoTimerHeapEntry*,
+                    heap->entries, heap->size);
+            }
+            entry->deadline = deadline;
+            heap->entries[++heap->count] = entry;
+            grilio_timer_heap_sift_up(heap, heap->count);
+        }
+    }
+}
+
+void
+grilio_timer_heap_remove(
+    GRilIoTimerHeap* heap,
+    GRilIoTimerHeapEntry* entry)
+{
+    if (G_LIKELY(heap) && G_LIKELY(entry) && entry->index) {
+        const guint i = entry->index;
+        GRilIoTimerHeapEntry* last = heap->entries[heap->count--];
+
+        GASSERT(heap->entries[i] == entry);
+        entry->index = 0;
+        if (last != entry) {
+            /* Fill the hole with the last entry */
+            const gint64 deadline = entry->deadline;
+
+            grilio_timer_heap_place(heap, last, i);
+            if (last->deadline < deadline) {
+                grilio_timer_heap_sift_up(heap, i);
+            } else {
+                grilio_timer_heap_sift_down(heap, i);
+            }
+        }
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GRILIO_TIMER_HEAP_H
+#define GRILIO_TIMER_HEAP_H
+
+#include "grilio_types.h"
+
+/*
+ * Binary min-heap of deadlines. Entries are embedded into the objects
+ * they belong to, the heap doesn't allocate anything per entry. Zero
+ * index means that the entry is not in the heap.
+ */
+
+typedef struct grilio_timer_heap GRilIoTimerHeap;
+
+typedef struct grilio_timer_heap_entry {
+    gint64 deadline;
+    guint index;
+} GRilIoTimerHeapEntry;
+
+GRilIoTimerHeap*
+grilio_timer_heap_new(
+    void);
+
+void
+grilio_timer_heap_free(
+    GRilIoTimerHeap* heap);
+
+guint
+grilio_timer_heap_count(
+    GRilIoTimerHeap* heap);
+
+GRilIoTimerHeapEntry*
+grilio_timer_heap_peek(
+    GRilIoTimerHeap* heap);
+
+void
+grilio_timer_heap_set(
+    GRilIoTimerHeap* heap,
+    GRilIoTimerHeapEntry* entry,
+    gint64 deadline);
+
+void
+grilio_timer_heap_remove(
+    GRilIoTimerHeap* heap,
+    GRilIoTimerHeapEntry* entry);
+
+#endif /* GRILIO_TIMER_HEAP_H */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -32,13 +32,36 @@
 
 #include "grilio_transport_impl.h"
 #include "grilio_transport_p.h"
+#include "grilio_buffer.h"
+#include "grilio_capture.h"
+#include "grilio_parser.h"
 #include "grilio_log.h"
+#include "grilio_p.h"
 
 #include <gutil_misc.h>
 
+#include <gio/gio.h>
+
+#define RIL_MIN_HEADER_SIZE RIL_ACK_HEADER_SIZE
+
 struct grilio_transport_priv {
     char* name;
     char* log_prefix;
+    GRilIoBuffer* packet_buf; /* Backs the packet being handled */
+    GRilIoCapture* capture;
+    gboolean disconnected;
+    guint max_packet_len; /* Read from the I/O thread too */
+
+    /* Write error waiting to be reported */
+    guint write_error_id;
+    GError* write_error;
+
+    /* Fragmented packet */
+    gboolean frag_response;
+    GRILIO_RESPONSE_TYPE frag_type;
+    guint frag_serial;
+    int frag_status;
+    GByteArray* frag_packet; /* Packets other than responses */
 };
 
 G_DEFINE_ABSTRACT_TYPE(GRilIoTransport, grilio_transport, G_TYPE_OBJECT)
@@ -50,6 +73,7 @@ enum grilio_transport_signal {
     SIGNAL_DISCONNECTED,
     SIGNAL_REQUEST_SENT,
     SIGNAL_RESPONSE,
+    SIGNAL_FRAGMENT,
     SIGNAL_INDICATION,
     SIGNAL_READ_ERROR,
     SIGNAL_WRITE_ERROR,
@@ -60,6 +84,7 @@ enum grilio_transport_signal {
 #define SIGNAL_DISCONNECTED_NAME    "grilio-transport-disconnected"
 #define SIGNAL_REQUEST_SENT_NAME    "grilio-transport-request-sent"
 #define SIGNAL_RESPONSE_NAME        "grilio-transport-response"
+#define SIGNAL_FRAGMENT_NAME        "grilio-transport-fragment"
 #define SIGNAL_INDICATION_NAME      "grilio-transport-indication"
 #define SIGNAL_READ_ERROR_NAME      "grilio-transport-read-error"
 #define SIGNAL_WRITE_ERROR_NAME     "grilio-transport-write-error"
@@ -74,6 +99,8 @@ void
 grilio_transport_signal_connected(
     GRilIoTransport* self)
 {
+    /* Wrappers may get connected again, DISCONNECTED is once per connection */
+    self->priv->disconnected = FALSE;
     g_signal_emit(self, grilio_transport_signals[SIGNAL_CONNECTED], 0);
 }
 
@@ -105,6 +132,21 @@ grilio_transport_signal_response(
         type, serial, status, data, len);
 }
 
+void
+grilio_transport_signal_fragment(
+    GRilIoTransport* self,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    guint offset,
+    guint total,
+    const void* data,
+    guint len)
+{
+    g_signal_emit(self, grilio_transport_signals[SIGNAL_FRAGMENT], 0,
+        type, serial, status, offset, total, data, len);
+}
+
 void
 grilio_transport_signal_indication(
     GRilIoTransport* self,
@@ -133,6 +175,386 @@ grilio_transport_signal_write_error(
     g_signal_emit(self, grilio_transport_signals[SIGNAL_WRITE_ERROR], 0, error);
 }
 
+static
+gboolean
+grilio_transport_write_error_cb(
+    gpointer user_data)
+{
+    GRilIoTransport* self = GRILIO_TRANSPORT(user_data);
+    GRilIoTransportPriv* priv = self->priv;
+    GError* error = priv->write_error;
+
+    GASSERT(priv->write_error_id);
+    priv->write_error_id = 0;
+    priv->write_error = NULL;
+    grilio_transport_signal_write_error(self, error);
+    grilio_transport_disconnected(self);
+    g_error_free(error);
+    return G_SOURCE_REMOVE;
+}
+
+GError*
+grilio_transport_errno_error(
+    int err)
+{
+    return g_error_new_literal(G_IO_ERROR, g_io_error_from_errno(err),
+        g_strerror(err));
+}
+
+gsize
+grilio_transport_advance(
+    guint* pos,
+    guint total,
+    gsize bytes_written)
+{
+    const gsize n = MIN(total - *pos, bytes_written);
+
+    *pos += n;
+    return bytes_written - n;
+}
+
+void
+grilio_transport_disconnected(
+    GRilIoTransport* self)
+{
+    GRilIoTransportPriv* priv = self->priv;
+
+    self->connected = FALSE;
+    if (!priv->disconnected) {
+        priv->disconnected = TRUE;
+        grilio_transport_signal_disconnected(self);
+    }
+}
+
+void
+grilio_transport_handle_write_error(
+    GRilIoTransport* self,
+    GError* error)
+{
+    GRilIoTransportPriv* priv = self->priv;
+
+    GERR("%swrite failed: %s", self->log_prefix, GERRMSG(error));
+    if (priv->write_error) {
+        g_error_free(priv->write_error);
+    }
+
+    /* grilio_transport_write_error_cb will free the error */
+    priv->write_error = error;
+    if (!priv->write_error_id) {
+        priv->write_error_id = g_idle_add(grilio_transport_write_error_cb,
+            self);
+    }
+}
+
+static
+gboolean
+grilio_transport_handle_response(
+    GRilIoTransport* self,
+    GRILIO_RESPONSE_TYPE type,
+    const void* packet,
+    guint len,
+    GError** error)
+{
+    if (len >= RIL_RESPONSE_HEADER_SIZE) {
+        const guint32* buf = packet;
+        const guint offset = RIL_RESPONSE_HEADER_SIZE;
+
+        grilio_transport_signal_response(self, type,
+            GUINT32_FROM_RIL(buf[1]) /* id */,
+            GUINT32_FROM_RIL(buf[2]) /* status */,
+            (const guint8*)packet + offset, len - offset);
+        return TRUE;
+    } else {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+            "Response too short (%u bytes)", len);
+        return FALSE;
+    }
+}
+
+static
+void
+grilio_transport_handle_connected(
+    GRilIoTransport* self,
+    const void* data,
+    guint len)
+{
+    GRilIoParser parser;
+    guint num = 0;
+
+    GASSERT(!self->connected);
+    grilio_parser_init(&parser, data, len);
+    if (grilio_parser_get_uint32(&parser, &num) && num == 1 &&
+        grilio_parser_get_uint32(&parser, &self->ril_version)) {
+        GDEBUG("Connected, RIL version %u", self->ril_version);
+        self->connected = TRUE;
+        grilio_transport_signal_connected(self);
+    } else {
+        /* Terminate the connection? */
+        GERR("Failed to parse RIL_UNSOL_RIL_CONNECTED");
+    }
+}
+
+static
+void
+grilio_transport_handle_indication(
+    GRilIoTransport* self,
+    GRILIO_INDICATION_TYPE type,
+    const void* packet,
+    guint len)
+{
+    /* The caller has checked the length */
+    const guint32* buf = packet;
+    const guint32 code = GUINT32_FROM_RIL(buf[1]);
+    const guint offset = RIL_UNSOL_HEADER_SIZE;
+    const guint8* data = (const guint8*)packet + offset;
+
+    grilio_transport_signal_indication(self, type, code, data, len - offset);
+
+    /* Handle RIL_UNSOL_RIL_CONNECTED */
+    if (code == RIL_UNSOL_RIL_CONNECTED) {
+        grilio_transport_handle_connected(self, data, len - offset);
+    }
+}
+
+static
+void
+grilio_transport_capture_packet(
+    GRilIoTransport* self,
+    const void* packet,
+    guint len)
+{
+    guint code = 0, serial = 0;
+
+    if (len >= RIL_MIN_HEADER_SIZE) {
+        const guint32* buf = packet;
+
+        switch (GUINT32_FROM_RIL(buf[0])) {
+        case RIL_PACKET_TYPE_UNSOLICITED:
+        case RIL_PACKET_TYPE_UNSOLICITED_ACK_EXP:
+            code = GUINT32_FROM_RIL(buf[1]);
+            break;
+        default:
+            serial = GUINT32_FROM_RIL(buf[1]);
+            break;
+        }
+    }
+    grilio_capture_write(self->priv->capture, GRILIO_CAPTURE_PACKET,
+        code, serial, packet, len);
+}
+
+static
+gboolean
+grilio_transport_dispatch_packet(
+    GRilIoTransport* self,
+    const void* packet,
+    guint len,
+    GError** error)
+{
+    if (len >= RIL_MIN_HEADER_SIZE) {
+        const guint32* buf = packet;
+        const RIL_PACKET_TYPE type = GUINT32_FROM_RIL(buf[0]);
+
+        switch (type) {
+        case RIL_PACKET_TYPE_SOLICITED:
+            return grilio_transport_handle_response(self,
+                GRILIO_RESPONSE_SOLICITED, packet, len, error);
+        case RIL_PACKET_TYPE_SOLICITED_ACK:
+            grilio_transport_signal_response(self,
+                GRILIO_RESPONSE_SOLICITED_ACK, GUINT32_FROM_RIL(buf[1]),
+                RIL_E_SUCCESS, NULL, 0);
+            return TRUE;
+        case RIL_PACKET_TYPE_SOLICITED_ACK_EXP:
+            return grilio_transport_handle_response(self,
+                GRILIO_RESPONSE_SOLICITED_ACK_EXP, packet, len, error);
+        case RIL_PACKET_TYPE_UNSOLICITED:
+            grilio_transport_handle_indication(self,
+                GRILIO_INDICATION_UNSOLICITED, packet, len);
+            return TRUE;
+        case RIL_PACKET_TYPE_UNSOLICITED_ACK_EXP:
+            grilio_transport_handle_indication(self,
+                GRILIO_INDICATION_UNSOLICITED_ACK_EXP, packet, len);
+            return TRUE;
+        default:
+            /* Ignore unknown packets */
+            GWARN("Unexpected packet type id %d", type);
+            return TRUE;
+        }
+    } else {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+            "Packet too short (%u bytes)", len);
+        return FALSE;
+    }
+}
+
+gboolean
+grilio_transport_handle_packet(
+    GRilIoTransport* self,
+    const void* packet,
+    guint len,
+    GError** error)
+{
+    if (G_UNLIKELY(self->priv->capture)) {
+        grilio_transport_capture_packet(self, packet, len);
+    }
+    return grilio_transport_dispatch_packet(self, packet, len, error);
+}
+
+gboolean
+grilio_transport_handle_fragment(
+    GRilIoTransport* self,
+    guint offset,
+    guint total,
+    const void* data,
+    guint len,
+    GError** error)
+{
+    GRilIoTransportPriv* priv = self->priv;
+    const guint hdr = RIL_RESPONSE_HEADER_SIZE;
+
+    GASSERT(offset + len <= total);
+    if (G_UNLIKELY(priv->capture)) {
+        grilio_capture_write(priv->capture, GRILIO_CAPTURE_FRAGMENT,
+            total, offset, data, len);
+    }
+    if (!offset) {
+        const guint32* buf = data;
+
+        /* Start of a new packet */
+        priv->frag_response = FALSE;
+        if (priv->frag_packet) {
+            g_byte_array_free(priv->frag_packet, TRUE);
+            priv->frag_packet = NULL;
+        }
+
+        if (len >= hdr && total > hdr) {
+            switch (GUINT32_FROM_RIL(buf[0])) {
+            case RIL_PACKET_TYPE_SOLICITED:
+                priv->frag_response = TRUE;
+                priv->frag_type = GRILIO_RESPONSE_SOLICITED;
+                break;
+            case RIL_PACKET_TYPE_SOLICITED_ACK_EXP:
+                priv->frag_response = TRUE;
+                priv->frag_type = GRILIO_RESPONSE_SOLICITED_ACK_EXP;
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (priv->frag_response) {
+            /* Strip the header from the first fragment */
+            priv->frag_serial = GUINT32_FROM_RIL(buf[1]);
+            priv->frag_status = GUINT32_FROM_RIL(buf[2]);
+            offset = hdr;
+            data = (const guint8*)data + hdr;
+            len -= hdr;
+        } else {
+            /* Other packets are reassembled */
+            priv->frag_packet = g_byte_array_sized_new(total);
+        }
+    }
+
+    if (priv->frag_response) {
+        const gboolean last = (offset + len == total);
+
+        grilio_transport_signal_fragment(self, priv->frag_type,
+            priv->frag_serial, priv->frag_status, offset - hdr,
+            total - hdr, data, len);
+        if (last) {
+            priv->frag_response = FALSE;
+        }
+        return TRUE;
+    } else if (priv->frag_packet && priv->frag_packet->len == offset) {
+        GByteArray* packet = priv->frag_packet;
+
+        g_byte_array_append(packet, data, len);
+        if (packet->len == total) {
+            gboolean ok;
+
+            priv->frag_packet = NULL;
+            ok = grilio_transport_dispatch_packet(self, packet->data,
+                packet->len, error);
+            g_byte_array_free(packet, TRUE);
+            return ok;
+        }
+        return TRUE;
+    } else {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+            "Unexpected fragment (%u bytes at %u)", len, offset);
+        return FALSE;
+    }
+}
+
+gboolean
+grilio_transport_handle_packet_buffer(
+    GRilIoTransport* self,
+    GRilIoBuffer* buf,
+    const void* packet,
+    guint len,
+    GError** error)
+{
+    GRilIoTransportPriv* priv = self->priv;
+    GRilIoBuffer* prev = priv->packet_buf;
+    gboolean ok;
+
+    /* Signal handlers may take slices of the buffer */
+    priv->packet_buf = buf;
+    ok = grilio_transport_handle_packet(self, packet, len, error);
+    priv->packet_buf = prev;
+    return ok;
+}
+
+GRilIoBuffer*
+grilio_transport_packet_buffer(
+    GRilIoTransport* self)
+{
+    return G_LIKELY(self) ? self->priv->packet_buf : NULL;
+}
+
+void
+grilio_transport_signal_response_buffer(
+    GRilIoTransport* self,
+    GRilIoBuffer* buf,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    const void* data,
+    guint len)
+{
+    GRilIoTransportPriv* priv = self->priv;
+    GRilIoBuffer* prev = priv->packet_buf;
+
+    priv->packet_buf = buf;
+    grilio_transport_signal_response(self, type, serial, status, data, len);
+    priv->packet_buf = prev;
+}
+
+GBytes*
+grilio_transport_packet_bytes(
+    GRilIoTransport* self,
+    const void* data,
+    guint len)
+{
+    if (G_LIKELY(self)) {
+        GRilIoBuffer* buf = self->priv->packet_buf;
+
+        if (buf && len && (const gchar*)data >= GRILIO_BUFFER_DATA(buf) &&
+            (const gchar*)data + len <= GRILIO_BUFFER_DATA(buf) + buf->size) {
+            return grilio_buffer_slice(buf, data, len);
+        }
+    }
+    /* Transport doesn't support zero-copy, fall back to copying */
+    return g_bytes_new(data, len);
+}
+
+guint
+grilio_transport_max_packet_len(
+    GRilIoTransport* self)
+{
+    return G_LIKELY(self) ? (guint)
+        g_atomic_int_get(&self->priv->max_packet_len) : RIL_MAX_PACKET_LEN;
+}
+
 /*==========================================================================*
  * API
  *==========================================================================*/
@@ -158,6 +580,29 @@ grilio_transport_unref(
     }
 }
 
+void
+grilio_transport_pool_get_stats(
+    GRilIoTransportPoolStats* stats)
+{
+    if (G_LIKELY(stats)) {
+        grilio_buffer_pool_get_stats(stats);
+    }
+}
+
+void
+grilio_transport_pool_set_high_water_mark(
+    gsize bytes)
+{
+    grilio_buffer_pool_set_high_water_mark(bytes);
+}
+
+void
+grilio_transport_pool_set_idle_timeout(
+    guint ms)
+{
+    grilio_buffer_pool_set_idle_timeout(ms);
+}
+
 guint
 grilio_transport_version_offset(
     GRilIoTransport* self)
@@ -170,6 +615,20 @@ grilio_transport_version_offset(
     return 0;
 }
 
+guint
+grilio_transport_send_window(
+    GRilIoTransport* self)
+{
+    if (G_LIKELY(self)) {
+        GRilIoTransportClass* klass = GRILIO_TRANSPORT_GET_CLASS(self);
+
+        if (klass->send_window) {
+            return MAX(klass->send_window(self), 1);
+        }
+    }
+    return 1;
+}
+
 void
 grilio_transport_set_name(
     GRilIoTransport* self,
@@ -198,8 +657,15 @@ grilio_transport_send(
 {
     if (G_LIKELY(self) && G_LIKELY(req)) {
         GRilIoTransportClass* klass = GRILIO_TRANSPORT_GET_CLASS(self);
+        GRilIoTransportPriv* priv = self->priv;
+        const GRILIO_SEND_STATUS status = klass->send(self, req, code);
 
-        return klass->send(self, req, code);
+        if (G_UNLIKELY(priv->capture) && status != GRILIO_SEND_ERROR) {
+            grilio_capture_write(priv->capture, GRILIO_CAPTURE_REQUEST, code,
+                grilio_request_serial(req), grilio_request_data(req),
+                grilio_request_size(req));
+        }
+        return status;
     }
     return GRILIO_SEND_ERROR;
 }
@@ -216,6 +682,47 @@ grilio_transport_shutdown(
     }
 }
 
+void
+grilio_transport_set_max_packet_len(
+    GRilIoTransport* self,
+    guint max_len)
+{
+    if (G_LIKELY(self)) {
+        g_atomic_int_set(&self->priv->max_packet_len,
+            max_len ? max_len : RIL_MAX_PACKET_LEN);
+    }
+}
+
+gboolean
+grilio_transport_capture_start(
+    GRilIoTransport* self,
+    const char* path)
+{
+    if (G_LIKELY(self) && G_LIKELY(path)) {
+        GRilIoTransportPriv* priv = self->priv;
+        GRilIoCapture* capture = grilio_capture_open(path, NULL);
+
+        if (capture) {
+            grilio_capture_free(priv->capture);
+            priv->capture = capture;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void
+grilio_transport_capture_stop(
+    GRilIoTransport* self)
+{
+    if (G_LIKELY(self)) {
+        GRilIoTransportPriv* priv = self->priv;
+
+        grilio_capture_free(priv->capture);
+        priv->capture = NULL;
+    }
+}
+
 gulong
 grilio_transport_add_connected_handler(
     GRilIoTransport* self,
@@ -256,6 +763,16 @@ grilio_transport_add_response_handler(
         SIGNAL_RESPONSE_NAME, G_CALLBACK(func), user_data) : 0;
 }
 
+gulong
+grilio_transport_add_fragment_handler(
+    GRilIoTransport* self,
+    GRilIoTransportFragmentFunc func,
+    void* user_data)
+{
+    return (G_LIKELY(self) && G_LIKELY(func)) ? g_signal_connect(self,
+        SIGNAL_FRAGMENT_NAME, G_CALLBACK(func), user_data) : 0;
+}
+
 gulong
 grilio_transport_add_indication_handler(
     GRilIoTransport* self,
@@ -318,6 +835,7 @@ grilio_transport_init(
         GRILIO_TYPE_TRANSPORT, GRilIoTransportPriv);
 
     self->priv = priv;
+    priv->max_packet_len = RIL_MAX_PACKET_LEN;
     self->name = "RIL";
     self->log_prefix = "RIL ";
 }
@@ -330,6 +848,16 @@ grilio_transport_finalize(
     GRilIoTransport* self = GRILIO_TRANSPORT(object);
     GRilIoTransportPriv* priv = self->priv;
 
+    if (priv->write_error_id) {
+        g_source_remove(priv->write_error_id);
+    }
+    if (priv->write_error) {
+        g_error_free(priv->write_error);
+    }
+    if (priv->frag_packet) {
+        g_byte_array_free(priv->frag_packet, TRUE);
+    }
+    grilio_capture_free(priv->capture);
     g_free(priv->name);
     g_free(priv->log_prefix);
     G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
@@ -356,6 +884,11 @@ grilio_transport_class_init(
         g_signal_new(SIGNAL_RESPONSE_NAME, G_OBJECT_CLASS_TYPE(klass),
             G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 5,
             G_TYPE_INT, G_TYPE_UINT, G_TYPE_INT, G_TYPE_POINTER, G_TYPE_UINT);
+    grilio_transport_signals[SIGNAL_FRAGMENT] =
+        g_signal_new(SIGNAL_FRAGMENT_NAME, G_OBJECT_CLASS_TYPE(klass),
+            G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 7,
+            G_TYPE_INT, G_TYPE_UINT, G_TYPE_INT, G_TYPE_UINT, G_TYPE_UINT,
+            G_TYPE_POINTER, G_TYPE_UINT);
     grilio_transport_signals[SIGNAL_INDICATION] =
         g_signal_new(SIGNAL_INDICATION_NAME, G_OBJECT_CLASS_TYPE(klass),
             G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 4,
@@ -0,0 +1,586 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Wraps another transport and makes it look slow and unreliable, for
+ * exercising timeouts and retries. Responses may be delayed (uniformly
+ * distributed per-code latency), swapped with the next response, or
+ * dropped. Requests may fail with a write error. All decisions are made
+ * by a PRNG seeded by the caller, so the same sequence of events yields
+ * the same faults. Indications and response fragments pass through as
+ * is.
+ */
+
+#include "grilio_transport_p.h"
+#include "grilio_transport_impl.h"
+#include "grilio_p.h"
+
+#define GLOG_MODULE_NAME grilio_transport_fault_log
+#include <gutil_log.h>
+
+#include <gio/gio.h>
+
+/* Log module */
+GLOG_MODULE_DEFINE2("grilio-fault", GRILIO_LOG_MODULE);
+
+/* Response held for reordering is released after this long anyway */
+#define FAULT_REORDER_MAX_HOLD_MS (1000)
+
+enum grilio_transport_fault_events {
+    TARGET_EVENT_CONNECTED,
+    TARGET_EVENT_DISCONNECTED,
+    TARGET_EVENT_REQUEST_SENT,
+    TARGET_EVENT_RESPONSE,
+    TARGET_EVENT_FRAGMENT,
+    TARGET_EVENT_INDICATION,
+    TARGET_EVENT_READ_ERROR,
+    TARGET_EVENT_WRITE_ERROR,
+    TARGET_EVENT_COUNT
+};
+
+typedef struct grilio_transport_fault_latency {
+    guint min_ms;
+    guint max_ms;
+} GRilIoTransportFaultLatency;
+
+typedef struct grilio_transport_fault GRilIoTransportFault;
+
+typedef struct grilio_transport_fault_packet {
+    GRilIoTransportFault* owner;
+    guint timer_id;
+    GRILIO_RESPONSE_TYPE type;
+    guint serial;
+    int status;
+    GBytes* data;
+    GRilIoBuffer* buf; /* Backs the data, if the target has one */
+} GRilIoTransportFaultPacket;
+
+typedef GRilIoTransportClass GRilIoTransportFaultClass;
+struct grilio_transport_fault {
+    GRilIoTransport parent;
+    GRilIoTransport* target;
+    gulong target_event_ids[TARGET_EVENT_COUNT];
+    GRand* rand;
+    GRilIoTransportFaultLatency latency;    /* Default */
+    GHashTable* code_latency;               /* Code => latency */
+    GHashTable* codes;                      /* Serial => code */
+    GSList* delayed;                        /* GRilIoTransportFaultPacket */
+    GRilIoTransportFaultPacket* held;
+    gdouble drop_rate;
+    gdouble reorder_rate;
+    gdouble write_error_rate;
+};
+
+G_DEFINE_TYPE(GRilIoTransportFault, grilio_transport_fault,
+    GRILIO_TYPE_TRANSPORT)
+
+#define PARENT_CLASS grilio_transport_fault_parent_class
+#define GRILIO_TYPE_TRANSPORT_FAULT (grilio_transport_fault_get_type())
+#define GRILIO_TRANSPORT_FAULT(obj) \
+    G_TYPE_CHECK_INSTANCE_CAST((obj), GRILIO_TYPE_TRANSPORT_FAULT, \
+    GRilIoTransportFault)
+#define GRILIO_IS_TRANSPORT_FAULT(obj) \
+    G_TYPE_CHECK_INSTANCE_TYPE((obj), GRILIO_TYPE_TRANSPORT_FAULT)
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+gboolean
+grilio_transport_fault_chance(
+    GRilIoTransportFault* self,
+    gdouble rate)
+{
+    /* Don't touch the PRNG unless the fault is enabled */
+    return rate > 0 && g_rand_double(self->rand) < rate;
+}
+
+static
+void
+grilio_transport_fault_packet_free(
+    GRilIoTransportFaultPacket* packet)
+{
+    if (packet->timer_id) {
+        g_source_remove(packet->timer_id);
+    }
+    g_bytes_unref(packet->data);
+    grilio_buffer_unref(packet->buf);
+    g_slice_free(GRilIoTransportFaultPacket, packet);
+}
+
+static
+void
+grilio_transport_fault_packet_free1(
+    gpointer packet)
+{
+    grilio_transport_fault_packet_free(packet);
+}
+
+static
+void
+grilio_transport_fault_emit(
+    GRilIoTransportFault* self,
+    GRilIoTransportFaultPacket* packet)
+{
+    gsize len;
+    const void* data = g_bytes_get_data(packet->data, &len);
+
+    grilio_transport_signal_response_buffer(&self->parent, packet->buf,
+        packet->type, packet->serial, packet->status, data, len);
+    grilio_transport_fault_packet_free(packet);
+}
+
+static
+gboolean
+grilio_transport_fault_release_held(
+    gpointer user_data)
+{
+    GRilIoTransportFault* self = GRILIO_TRANSPORT_FAULT(user_data);
+    GRilIoTransportFaultPacket* held = self->held;
+
+    held->timer_id = 0;
+    self->held = NULL;
+    grilio_transport_fault_emit(self, held);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+grilio_transport_fault_deliver(
+    GRilIoTransportFault* self,
+    GRilIoTransportFaultPacket* packet)
+{
+    GRilIoTransportFaultPacket* held = self->held;
+
+    g_object_ref(self);
+    if (held) {
+        /* The held one goes after this one */
+        self->held = NULL;
+        grilio_transport_fault_emit(self, packet);
+        grilio_transport_fault_emit(self, held);
+    } else if (grilio_transport_fault_chance(self, self->reorder_rate)) {
+        GDEBUG("%sholding response %u", self->parent.log_prefix,
+            packet->serial);
+        self->held = packet;
+        packet->timer_id = g_timeout_add(FAULT_REORDER_MAX_HOLD_MS,
+            grilio_transport_fault_release_held, self);
+    } else {
+        grilio_transport_fault_emit(self, packet);
+    }
+    g_object_unref(self);
+}
+
+static
+gboolean
+grilio_transport_fault_delay_done(
+    gpointer user_data)
+{
+    GRilIoTransportFaultPacket* packet = user_data;
+    GRilIoTransportFault* self = packet->owner;
+
+    packet->timer_id = 0;
+    self->delayed = g_slist_remove(self->delayed, packet);
+    grilio_transport_fault_deliver(self, packet);
+    return G_SOURCE_REMOVE;
+}
+
+static
+guint
+grilio_transport_fault_delay(
+    GRilIoTransportFault* self,
+    guint code)
+{
+    const GRilIoTransportFaultLatency* latency = code ?
+        g_hash_table_lookup(self->code_latency, GUINT_TO_POINTER(code)) :
+        NULL;
+
+    if (!latency) {
+        latency = &self->latency;
+    }
+    if (latency->max_ms > latency->min_ms) {
+        return latency->min_ms + g_rand_int_range(self->rand, 0,
+            latency->max_ms - latency->min_ms + 1);
+    } else {
+        return latency->min_ms;
+    }
+}
+
+static
+void
+grilio_transport_fault_clear(
+    GRilIoTransportFault* self)
+{
+    g_slist_free_full(self->delayed, grilio_transport_fault_packet_free1);
+    self->delayed = NULL;
+    if (self->held) {
+        grilio_transport_fault_packet_free(self->held);
+        self->held = NULL;
+    }
+    g_hash_table_remove_all(self->codes);
+}
+
+static
+void
+grilio_transport_fault_target_connected(
+    GRilIoTransport* target,
+    void* user_data)
+{
+    GRilIoTransport* transport = GRILIO_TRANSPORT(user_data);
+
+    transport->ril_version = target->ril_version;
+    transport->connected = TRUE;
+    grilio_transport_signal_connected(transport);
+}
+
+static
+void
+grilio_transport_fault_target_disconnected(
+    GRilIoTransport* target,
+    void* user_data)
+{
+    GRilIoTransportFault* self = GRILIO_TRANSPORT_FAULT(user_data);
+    GRilIoTransport* transport = &self->parent;
+
+    grilio_transport_fault_clear(self);
+    grilio_transport_disconnected(transport);
+}
+
+static
+void
+grilio_transport_fault_target_request_sent(
+    GRilIoTransport* target,
+    GRilIoRequest* req,
+    void* user_data)
+{
+    grilio_transport_signal_request_sent(GRILIO_TRANSPORT(user_data), req);
+}
+
+static
+void
+grilio_transport_fault_target_response(
+    GRilIoTransport* target,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    GRilIoTransportFault* self = GRILIO_TRANSPORT_FAULT(user_data);
+    gpointer key = GUINT_TO_POINTER(serial);
+    const guint code = GPOINTER_TO_UINT(g_hash_table_lookup(self->codes,
+        key));
+
+    if (type != GRILIO_RESPONSE_SOLICITED_ACK) {
+        g_hash_table_remove(self->codes, key);
+    }
+    if (grilio_transport_fault_chance(self, self->drop_rate)) {
+        GDEBUG("%sdropping response %u", self->parent.log_prefix, serial);
+    } else {
+        GRilIoTransportFaultPacket* packet =
+            g_slice_new0(GRilIoTransportFaultPacket);
+        const guint delay = grilio_transport_fault_delay(self, code);
+
+        packet->owner = self;
+        packet->type = type;
+        packet->serial = serial;
+        packet->status = status;
+        /* Slice of the target's receive buffer, unless it doesn't have one */
+        packet->buf = grilio_buffer_ref
+            (grilio_transport_packet_buffer(target));
+        packet->data = grilio_transport_packet_bytes(target, data, len);
+        if (delay) {
+            packet->timer_id = g_timeout_add(delay,
+                grilio_transport_fault_delay_done, packet);
+            self->delayed = g_slist_append(self->delayed, packet);
+        } else {
+            grilio_transport_fault_deliver(self, packet);
+        }
+    }
+}
+
+static
+void
+grilio_transport_fault_target_fragment(
+    GRilIoTransport* target,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    guint offset,
+    guint total,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    grilio_transport_signal_fragment(GRILIO_TRANSPORT(user_data), type,
+        serial, status, offset, total, data, len);
+}
+
+static
+void
+grilio_transport_fault_target_indication(
+    GRilIoTransport* target,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    grilio_transport_signal_indication(GRILIO_TRANSPORT(user_data), type,
+        code, data, len);
+}
+
+static
+void
+grilio_transport_fault_target_read_error(
+    GRilIoTransport* target,
+    const GError* error,
+    void* user_data)
+{
+    grilio_transport_signal_read_error(GRILIO_TRANSPORT(user_data), error);
+}
+
+static
+void
+grilio_transport_fault_target_write_error(
+    GRilIoTransport* target,
+    const GError* error,
+    void* user_data)
+{
+    grilio_transport_signal_write_error(GRILIO_TRANSPORT(user_data), error);
+}
+
+/*==========================================================================*
+ * Methods
+ *==========================================================================*/
+
+static
+GRILIO_SEND_STATUS
+grilio_transport_fault_send(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    guint code)
+{
+    GRilIoTransportFault* self = GRILIO_TRANSPORT_FAULT(transport);
+
+    if (grilio_transport_fault_chance(self, self->write_error_rate)) {
+        GError* error = g_error_new_literal(G_IO_ERROR,
+            G_IO_ERROR_BROKEN_PIPE, "Injected write error");
+
+        GDEBUG("%sfailing request %u", transport->log_prefix, code);
+        grilio_transport_handle_write_error(transport, error);
+        return GRILIO_SEND_ERROR;
+    } else {
+        const GRILIO_SEND_STATUS status = grilio_transport_send(self->target,
+            req, code);
+
+        if (status != GRILIO_SEND_ERROR) {
+            g_hash_table_insert(self->codes, GUINT_TO_POINTER
+                (grilio_request_serial(req)), GUINT_TO_POINTER(code));
+        }
+        return status;
+    }
+}
+
+static
+guint
+grilio_transport_fault_send_window(
+    GRilIoTransport* transport)
+{
+    GRilIoTransportFault* self = GRILIO_TRANSPORT_FAULT(transport);
+
+    return grilio_transport_send_window(self->target);
+}
+
+static
+void
+grilio_transport_fault_shutdown(
+    GRilIoTransport* transport,
+    gboolean flush)
+{
+    GRilIoTransportFault* self = GRILIO_TRANSPORT_FAULT(transport);
+
+    grilio_transport_fault_clear(self);
+    grilio_transport_shutdown(self->target, flush);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoTransport*
+grilio_transport_fault_new(
+    GRilIoTransport* target,
+    guint32 seed)
+{
+    if (G_LIKELY(target)) {
+        GRilIoTransportFault* self = g_object_new
+            (GRILIO_TYPE_TRANSPORT_FAULT, NULL);
+        GRilIoTransport* transport = &self->parent;
+        gulong* ids = self->target_event_ids;
+
+        self->target = grilio_transport_ref(target);
+        self->rand = g_rand_new_with_seed(seed);
+        transport->connected = target->connected;
+        transport->ril_version = target->ril_version;
+        ids[TARGET_EVENT_CONNECTED] =
+            grilio_transport_add_connected_handler(target,
+                grilio_transport_fault_target_connected, self);
+        ids[TARGET_EVENT_DISCONNECTED] =
+            grilio_transport_add_disconnected_handler(target,
+                grilio_transport_fault_target_disconnected, self);
+        ids[TARGET_EVENT_REQUEST_SENT] =
+            grilio_transport_add_request_sent_handler(target,
+                grilio_transport_fault_target_request_sent, self);
+        ids[TARGET_EVENT_RESPONSE] =
+            grilio_transport_add_response_handler(target,
+                grilio_transport_fault_target_response, self);
+        ids[TARGET_EVENT_FRAGMENT] =
+            grilio_transport_add_fragment_handler(target,
+                grilio_transport_fault_target_fragment, self);
+        ids[TARGET_EVENT_INDICATION] =
+            grilio_transport_add_indication_handler(target,
+                grilio_transport_fault_target_indication, self);
+        ids[TARGET_EVENT_READ_ERROR] =
+            grilio_transport_add_read_error_handler(target,
+                grilio_transport_fault_target_read_error, self);
+        ids[TARGET_EVENT_WRITE_ERROR] =
+            grilio_transport_add_write_error_handler(target,
+                grilio_transport_fault_target_write_error, self);
+        return transport;
+    }
+    return NULL;
+}
+
+void
+grilio_transport_fault_set_latency(
+    GRilIoTransport* transport,
+    guint code,
+    guint min_ms,
+    guint max_ms)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_FAULT(transport))) {
+        GRilIoTransportFault* self = GRILIO_TRANSPORT_FAULT(transport);
+        GRilIoTransportFaultLatency* latency;
+
+        if (code) {
+            latency = g_new(GRilIoTransportFaultLatency, 1);
+            g_hash_table_replace(self->code_latency, GUINT_TO_POINTER(code),
+                latency);
+        } else {
+            latency = &self->latency;
+        }
+        latency->min_ms = min_ms;
+        latency->max_ms = MAX(max_ms, min_ms);
+    }
+}
+
+void
+grilio_transport_fault_set_drop_rate(
+    GRilIoTransport* transport,
+    gdouble rate)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_FAULT(transport))) {
+        GRILIO_TRANSPORT_FAULT(transport)->drop_rate = rate;
+    }
+}
+
+void
+grilio_transport_fault_set_reorder_rate(
+    GRilIoTransport* transport,
+    gdouble rate)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_FAULT(transport))) {
+        GRILIO_TRANSPORT_FAULT(transport)->reorder_rate = rate;
+    }
+}
+
+void
+grilio_transport_fault_set_write_error_rate(
+    GRilIoTransport* transport,
+    gdouble rate)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_FAULT(transport))) {
+        GRILIO_TRANSPORT_FAULT(transport)->write_error_rate = rate;
+    }
+}
+
+/*==========================================================================*
+ * Internals
+ *==========================================================================*/
+
+static
+void
+grilio_transport_fault_init(
+    GRilIoTransportFault* self)
+{
+    self->code_latency = g_hash_table_new_full(g_direct_hash,
+        g_direct_equal, NULL, g_free);
+    self->codes = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+static
+void
+grilio_transport_fault_finalize(
+    GObject* object)
+{
+    GRilIoTransportFault* self = GRILIO_TRANSPORT_FAULT(object);
+
+    grilio_transport_fault_clear(self);
+    grilio_transport_remove_all_handlers(self->target,
+        self->target_event_ids);
+    grilio_transport_unref(self->target);
+    g_hash_table_destroy(self->code_latency);
+    g_hash_table_destroy(self->codes);
+    g_rand_free(self->rand);
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
+static
+void
+grilio_transport_fault_class_init(
+    GRilIoTransportFaultClass* klass)
+{
+    klass->send = grilio_transport_fault_send;
+    klass->shutdown = grilio_transport_fault_shutdown;
+    klass->send_window = grilio_transport_fault_send_window;
+    G_OBJECT_CLASS(klass)->finalize = grilio_transport_fault_finalize;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,579 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Same wire protocol as grilio_transport_socket.c but without GIOChannel.
+ * The descriptor is polled with g_unix_fd_add_full() and accessed with
+ * recv() and writev() directly. Everything that's available is read in
+ * one go and all complete packets are dispatched before returning to
+ * the main loop.
+ */
+
+#include "grilio_transport_p.h"
+#include "grilio_transport_impl.h"
+#include "grilio_buffer.h"
+#include "grilio_p.h"
+
+#define GLOG_MODULE_NAME grilio_transport_fd_log
+#include <gutil_log.h>
+
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* Log module */
+GLOG_MODULE_DEFINE2("grilio-fd", GRILIO_LOG_MODULE);
+
+/* Initial size of the receive buffer (grows as needed) */
+#define RIL_READ_BUF_SIZE (0x1000)
+
+typedef GRilIoTransportClass GRilIoTransportFdClass;
+typedef struct grilio_transport_fd {
+    GRilIoTransport parent;
+    int fd;
+    gboolean can_close;
+    guint read_source_id;
+    guint write_source_id;
+
+    /* Subscription */
+    gchar sub[RIL_SUB_LEN];
+    guint sub_pos;
+
+    /* Send */
+    guint32 send_header[3]; /* Including length */
+    guint send_header_pos;
+    guint send_pos;
+    GRilIoRequest* send_req;
+
+    /* Receive */
+    GRilIoBuffer* read_buf;
+    gsize read_start;
+    gsize read_end;
+} GRilIoTransportFd;
+
+G_DEFINE_TYPE(GRilIoTransportFd, grilio_transport_fd, GRILIO_TYPE_TRANSPORT)
+
+#define PARENT_CLASS grilio_transport_fd_parent_class
+#define GRILIO_TYPE_TRANSPORT_FD (grilio_transport_fd_get_type())
+#define GRILIO_TRANSPORT_FD(obj) \
+    G_TYPE_CHECK_INSTANCE_CAST((obj), GRILIO_TYPE_TRANSPORT_FD, \
+    GRilIoTransportFd)
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+grilio_transport_fd_shutdown_io(
+    GRilIoTransportFd* self)
+{
+    if (self->read_source_id) {
+        g_source_remove(self->read_source_id);
+        self->read_source_id = 0;
+    }
+    if (self->write_source_id) {
+        g_source_remove(self->write_source_id);
+        self->write_source_id = 0;
+    }
+    if (self->fd >= 0) {
+        /* Make sure that the other side notices */
+        shutdown(self->fd, SHUT_RDWR);
+        if (self->can_close) {
+            close(self->fd);
+        }
+        self->fd = -1;
+    }
+}
+
+/*==========================================================================*
+ * Read
+ *==========================================================================*/
+
+static
+void
+grilio_transport_fd_handle_read_error(
+    GRilIoTransportFd* self,
+    GError* error)
+{
+    GRilIoTransport* transport = &self->parent;
+
+    GERR("%sread failed: %s", transport->log_prefix, GERRMSG(error));
+
+    /*
+     * Zero source id to avoid removing it twice. This one is going to be
+     * freed when we return FALSE from the callback.
+     */
+    self->read_source_id = 0;
+    grilio_transport_shutdown(transport, FALSE);
+    grilio_transport_signal_read_error(transport, error);
+    g_error_free(error);
+}
+
+static
+void
+grilio_transport_fd_handle_eof(
+    GRilIoTransportFd* self)
+{
+    GRilIoTransport* transport = &self->parent;
+
+    GERR("%shangup", transport->log_prefix);
+
+    /*
+     * Zero source id to avoid removing it twice. This one is going to be
+     * freed when we return FALSE from the callback.
+     */
+    self->read_source_id = 0;
+    grilio_transport_shutdown(transport, FALSE);
+}
+
+static
+gboolean
+grilio_transport_fd_dispatch(
+    GRilIoTransportFd* self)
+{
+    while (self->fd >= 0) {
+        const gsize avail = self->read_end - self->read_start;
+        GError* error = NULL;
+        const gchar* packet;
+        guint32 len;
+
+        if (avail < 4) {
+            /* Need more bytes */
+            break;
+        }
+
+        memcpy(&len, GRILIO_BUFFER_DATA(self->read_buf) +
+            self->read_start, 4);
+        len = GUINT32_FROM_BE(len);
+        if (len > grilio_transport_max_packet_len(&self->parent)) {
+            /* Message is too long or stream is broken */
+            grilio_transport_fd_handle_read_error(self,
+                g_error_new(G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "Packet too long (%u bytes)", len));
+            return FALSE;
+        } else if ((avail - 4) < len) {
+            /* Need more bytes */
+            break;
+        }
+
+        /* Packet handlers expect the data to be properly aligned */
+        if ((self->read_start + 4) & 3) {
+            self->read_buf = grilio_buffer_reserve(self->read_buf,
+                &self->read_start, &self->read_end, RIL_READ_BUF_SIZE);
+        }
+
+        packet = GRILIO_BUFFER_DATA(self->read_buf) + self->read_start + 4;
+        self->read_start += len + 4;
+        if (!grilio_transport_handle_packet_buffer(&self->parent,
+            self->read_buf, packet, len, &error)) {
+            grilio_transport_fd_handle_read_error(self, error);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static
+gboolean
+grilio_transport_fd_read(
+    GRilIoTransportFd* self)
+{
+    gsize avail = self->read_end - self->read_start;
+    gsize need = RIL_READ_BUF_SIZE;
+    gssize bytes_read;
+
+    /* Whatever is left in the buffer is a part of the packet */
+    if (avail >= 4) {
+        guint32 len;
+
+        memcpy(&len, GRILIO_BUFFER_DATA(self->read_buf) +
+            self->read_start, 4);
+        need = MAX(GUINT32_FROM_BE(len) + 4, need);
+    }
+
+    /*
+     * Move the partial packet to the beginning of the buffer and make
+     * sure that the entire packet fits.
+     */
+    self->read_buf = grilio_buffer_reserve(self->read_buf,
+        &self->read_start, &self->read_end, need);
+
+    do {
+        bytes_read = recv(self->fd, GRILIO_BUFFER_DATA(self->read_buf) +
+            self->read_end, self->read_buf->size - self->read_end,
+            MSG_DONTWAIT);
+    } while (bytes_read < 0 && errno == EINTR);
+
+    if (bytes_read > 0) {
+        self->read_end += bytes_read;
+        GASSERT(self->read_end <= self->read_buf->size);
+        return grilio_transport_fd_dispatch(self);
+    } else if (!bytes_read) {
+        grilio_transport_fd_handle_eof(self);
+        return FALSE;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return TRUE;
+    } else {
+        grilio_transport_fd_handle_read_error(self,
+            grilio_transport_errno_error(errno));
+        return FALSE;
+    }
+}
+
+static
+gboolean
+grilio_transport_fd_read_callback(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    gboolean result;
+    GRilIoTransportFd* self = GRILIO_TRANSPORT_FD(user_data);
+
+    g_object_ref(self);
+    if (condition & G_IO_IN) {
+        result = grilio_transport_fd_read(self) ?
+            G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+    } else {
+        /* G_IO_HUP or G_IO_ERR without any data to read */
+        grilio_transport_fd_handle_eof(self);
+        result = G_SOURCE_REMOVE;
+    }
+    if (result == G_SOURCE_REMOVE) {
+        self->read_source_id = 0;
+    }
+    g_object_unref(self);
+    return result;
+}
+
+/*==========================================================================*
+ * Write
+ *==========================================================================*/
+
+static
+void
+grilio_transport_fd_handle_write_error(
+    GRilIoTransportFd* self,
+    GError* error)
+{
+    /*
+     * Zero source id to avoid removing it twice. This one is going
+     * to be freed when we return FALSE from the callback.
+     */
+    self->write_source_id = 0;
+
+    /* Don't emit DISCONNECTED signal just yet */
+    grilio_transport_fd_shutdown_io(self);
+    grilio_transport_handle_write_error(&self->parent, error);
+}
+
+static
+gboolean
+grilio_transport_fd_write(
+    GRilIoTransportFd* self,
+    GError** error)
+{
+    GRilIoTransport* transport = &self->parent;
+    GRilIoRequest* req = self->send_req;
+    const gboolean subscribed = (self->sub_pos >= RIL_SUB_LEN);
+    const guint datalen = req ? grilio_request_size(req) : 0;
+    struct iovec iov[3];
+    gsize bytes_written = 0;
+    int n = 0;
+
+    /* Subscription, header and data all go in one system call */
+    if (!subscribed) {
+        iov[n].iov_base = self->sub + self->sub_pos;
+        iov[n].iov_len = RIL_SUB_LEN - self->sub_pos;
+        n++;
+    }
+
+    if (transport->connected && req) {
+        if (self->send_header_pos < sizeof(self->send_header)) {
+            iov[n].iov_base = ((guint8*)self->send_header) +
+                self->send_header_pos;
+            iov[n].iov_len = sizeof(self->send_header) - self->send_header_pos;
+            n++;
+        }
+        if (self->send_pos < datalen) {
+            iov[n].iov_base = req->bytes->data + self->send_pos;
+            iov[n].iov_len = datalen - self->send_pos;
+            n++;
+        }
+    }
+
+    if (n > 0) {
+        gssize written;
+
+        do {
+            written = writev(self->fd, iov, n);
+        } while (written < 0 && errno == EINTR);
+
+        if (written >= 0) {
+            bytes_written = written;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            *error = grilio_transport_errno_error(errno);
+            return FALSE;
+        }
+    }
+
+    /* Figure out where we are */
+    if (!subscribed) {
+        bytes_written = grilio_transport_advance(&self->sub_pos,
+            RIL_SUB_LEN, bytes_written);
+        if (self->sub_pos < RIL_SUB_LEN) {
+            /* Will have to wait */
+            return TRUE;
+        }
+        GDEBUG("%ssubscribed for %c%c%c%c", transport->log_prefix,
+            self->sub[0], self->sub[1], self->sub[2], self->sub[3]);
+    }
+
+    if (!transport->connected) {
+        GVERBOSE("%snot connected", transport->log_prefix);
+        return FALSE;
+    }
+
+    if (!req) {
+        /* There is nothing to send, remove the source */
+        GVERBOSE("%shas nothing to send", transport->log_prefix);
+        return FALSE;
+    }
+
+    bytes_written = grilio_transport_advance(&self->send_header_pos,
+        sizeof(self->send_header), bytes_written);
+    bytes_written = grilio_transport_advance(&self->send_pos,
+        datalen, bytes_written);
+    GASSERT(!bytes_written);
+    if (self->send_pos < datalen ||
+        self->send_header_pos < sizeof(self->send_header)) {
+        /* Will have to wait */
+        return TRUE;
+    }
+
+    /* The request has been sent */
+    grilio_request_unref(req);
+    self->send_req = NULL;
+    return TRUE;
+}
+
+static
+gboolean
+grilio_transport_fd_write_callback(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    gboolean result = G_SOURCE_REMOVE;
+    GRilIoTransportFd* self = GRILIO_TRANSPORT_FD(user_data);
+    GError* error = NULL;
+
+    g_object_ref(self);
+    if (condition & G_IO_OUT) {
+        GRilIoTransport* transport = &self->parent;
+        GRilIoRequest* req = grilio_request_ref(self->send_req);
+
+        if (grilio_transport_fd_write(self, &error)) {
+            if (self->send_req || self->sub_pos < RIL_SUB_LEN) {
+                /* We have successfully written part of the packet */
+                GASSERT(!self->send_req || self->send_req == req);
+                result = G_SOURCE_CONTINUE;
+            } else if (req) {
+                grilio_transport_signal_request_sent(transport, req);
+                if (self->send_req && self->write_source_id) {
+                    /* Signal handler has submitted the next request */
+                    result = G_SOURCE_CONTINUE;
+                }
+            }
+        }
+        grilio_request_unref(req);
+    }
+    if (result == G_SOURCE_REMOVE) {
+        self->write_source_id = 0;
+    }
+    if (error) {
+        grilio_transport_fd_handle_write_error(self, error);
+    }
+    g_object_unref(self);
+    return result;
+}
+
+static
+void
+grilio_transport_fd_schedule_write(
+    GRilIoTransportFd* self)
+{
+    if (!self->write_source_id) {
+        GVERBOSE("%sscheduling write", self->parent.log_prefix);
+        self->write_source_id = g_unix_fd_add_full(G_PRIORITY_DEFAULT,
+            self->fd, G_IO_OUT, grilio_transport_fd_write_callback,
+            self, NULL);
+    }
+}
+
+/*==========================================================================*
+ * Methods
+ *==========================================================================*/
+
+static
+GRILIO_SEND_STATUS
+grilio_transport_fd_send(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    guint code)
+{
+    GRILIO_SEND_STATUS status = GRILIO_SEND_ERROR;
+    GRilIoTransportFd* self = GRILIO_TRANSPORT_FD(transport);
+
+    GASSERT(!self->send_req);
+    if (!self->send_req && req && self->fd >= 0) {
+        GError* error = NULL;
+        const guint datalen = grilio_request_size(req);
+        const guint serial = grilio_request_serial(req);
+
+        /* Length includes the header excluding the length iteslf */
+        self->send_header[0] = GINT32_TO_BE(datalen + RIL_REQUEST_HEADER_SIZE);
+        self->send_header[1] = GUINT32_TO_RIL(code);
+        self->send_header[2] = GUINT32_TO_RIL(serial);
+        self->send_req = grilio_request_ref(req);
+        self->send_header_pos = 0;
+        self->send_pos = 0;
+
+        if (grilio_transport_fd_write(self, &error)) {
+            if (!self->send_req) {
+                status = GRILIO_SEND_OK;
+            } else {
+                status = GRILIO_SEND_PENDING;
+                grilio_transport_fd_schedule_write(self);
+            }
+        }
+        if (error) {
+            grilio_transport_fd_handle_write_error(self, error);
+        }
+    }
+    return status;
+}
+
+static
+void
+grilio_transport_fd_shutdown(
+    GRilIoTransport* transport,
+    gboolean flush)
+{
+    GRilIoTransportFd* self = GRILIO_TRANSPORT_FD(transport);
+
+    grilio_transport_fd_shutdown_io(self);
+    grilio_transport_disconnected(&self->parent);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoTransport*
+grilio_transport_fd_new(
+    int fd,
+    const char* sub,
+    gboolean can_close)
+{
+    if (G_LIKELY(fd >= 0 && (!sub || strlen(sub) == RIL_SUB_LEN))) {
+        const int flags = fcntl(fd, F_GETFL);
+
+        if (flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0) {
+            GRilIoTransportFd* self = g_object_new
+                (GRILIO_TYPE_TRANSPORT_FD, NULL);
+
+            self->fd = fd;
+            self->can_close = can_close;
+            self->read_source_id = g_unix_fd_add_full(G_PRIORITY_DEFAULT,
+                fd, G_IO_IN, grilio_transport_fd_read_callback, self, NULL);
+            if (sub) {
+                memcpy(self->sub, sub, RIL_SUB_LEN);
+                grilio_transport_fd_schedule_write(self);
+            } else {
+                self->sub_pos = RIL_SUB_LEN;
+            }
+            return &self->parent;
+        }
+        GERR("Can't make fd %d non-blocking: %s", fd, strerror(errno));
+    }
+    return NULL;
+}
+
+/*==========================================================================*
+ * Internals
+ *==========================================================================*/
+
+static
+void
+grilio_transport_fd_init(
+    GRilIoTransportFd* self)
+{
+    self->fd = -1;
+}
+
+static
+void
+grilio_transport_fd_finalize(
+    GObject* object)
+{
+    GRilIoTransportFd* self = GRILIO_TRANSPORT_FD(object);
+
+    grilio_transport_fd_shutdown(&self->parent, FALSE);
+    grilio_request_unref(self->send_req);
+    grilio_buffer_unref(self->read_buf);
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
+static
+void
+grilio_transport_fd_class_init(
+    GRilIoTransportFdClass* klass)
+{
+    klass->send = grilio_transport_fd_send;
+    klass->shutdown = grilio_transport_fd_shutdown;
+    G_OBJECT_CLASS(klass)->finalize = grilio_transport_fd_finalize;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
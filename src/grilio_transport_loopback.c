@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Transport without a file descriptor. Requests are handed straight to
+ * the responder callback, responses and indications are buffered and
+ * dispatched from an idle callback. Nothing is ever delivered from
+ * inside grilio_transport_send() because the channel doesn't expect
+ * the response before the request has been sent.
+ *
+ * Packets are queued back to back in a byte array (length, packet,
+ * padding) and the two arrays get swapped on each dispatch, so there's
+ * no allocation per packet once they have grown large enough.
+ */
+
+#include "grilio_transport_impl.h"
+#include "grilio_transport_p.h"
+#include "grilio_p.h"
+
+#define GLOG_MODULE_NAME grilio_transport_loopback_log
+#include <gutil_log.h>
+
+/* Log module */
+GLOG_MODULE_DEFINE2("grilio-loopback", GRILIO_LOG_MODULE);
+
+#define LOOPBACK_ALIGN(len) (((len) + 3) & ~3)
+
+typedef GRilIoTransportClass GRilIoTransportLoopbackClass;
+typedef struct grilio_transport_loopback {
+    GRilIoTransport parent;
+    GRilIoTransportLoopbackFunc request;
+    void* user_data;
+    gboolean stopped;
+    guint dispatch_id;
+    GByteArray* queue;
+    GByteArray* dispatch;
+} GRilIoTransportLoopback;
+
+G_DEFINE_TYPE(GRilIoTransportLoopback, grilio_transport_loopback,
+    GRILIO_TYPE_TRANSPORT)
+
+#define PARENT_CLASS grilio_transport_loopback_parent_class
+#define GRILIO_TYPE_TRANSPORT_LOOPBACK (grilio_transport_loopback_get_type())
+#define GRILIO_TRANSPORT_LOOPBACK(obj) \
+    G_TYPE_CHECK_INSTANCE_CAST((obj), GRILIO_TYPE_TRANSPORT_LOOPBACK, \
+    GRilIoTransportLoopback)
+#define GRILIO_IS_TRANSPORT_LOOPBACK(obj) \
+    G_TYPE_CHECK_INSTANCE_TYPE((obj), GRILIO_TYPE_TRANSPORT_LOOPBACK)
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+gboolean
+grilio_transport_loopback_dispatch(
+    gpointer user_data)
+{
+    GRilIoTransportLoopback* self = GRILIO_TRANSPORT_LOOPBACK(user_data);
+    GRilIoTransport* transport = &self->parent;
+    GByteArray* packets = self->queue;
+    gboolean result;
+    guint pos = 0;
+
+    /* Packets queued by the handlers go to the other array */
+    g_object_ref(self);
+    self->queue = self->dispatch;
+    self->dispatch = packets;
+    while (pos < packets->len && !self->stopped) {
+        GError* error = NULL;
+        const guint8* packet = packets->data + pos + 4;
+        guint32 len;
+
+        memcpy(&len, packets->data + pos, 4);
+        pos += 4 + LOOPBACK_ALIGN(len);
+        if (!grilio_transport_handle_packet(transport, packet, len, &error)) {
+            GERR("%s%s", transport->log_prefix, GERRMSG(error));
+            grilio_transport_signal_read_error(transport, error);
+            g_error_free(error);
+        }
+    }
+    g_byte_array_set_size(packets, 0);
+
+    if (self->queue->len && !self->stopped) {
+        result = G_SOURCE_CONTINUE;
+    } else {
+        self->dispatch_id = 0;
+        result = G_SOURCE_REMOVE;
+    }
+    g_object_unref(self);
+    return result;
+}
+
+static
+gboolean
+grilio_transport_loopback_queue(
+    GRilIoTransport* transport,
+    const guint32* header,
+    guint header_len,
+    const void* data,
+    guint len)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_LOOPBACK(transport)) &&
+        (data || !len)) {
+        GRilIoTransportLoopback* self = GRILIO_TRANSPORT_LOOPBACK(transport);
+
+        if (!self->stopped) {
+            GByteArray* queue = self->queue;
+            const guint32 total = header_len + len;
+            const guint pos = queue->len;
+
+            g_byte_array_set_size(queue, pos + 4 + LOOPBACK_ALIGN(total));
+            memcpy(queue->data + pos, &total, 4);
+            memcpy(queue->data + pos + 4, header, header_len);
+            if (len) {
+                memcpy(queue->data + pos + 4 + header_len, data, len);
+            }
+            if (!self->dispatch_id) {
+                self->dispatch_id = g_idle_add(
+                    grilio_transport_loopback_dispatch, self);
+            }
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*==========================================================================*
+ * Methods
+ *==========================================================================*/
+
+static
+GRILIO_SEND_STATUS
+grilio_transport_loopback_send(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    guint code)
+{
+    GRilIoTransportLoopback* self = GRILIO_TRANSPORT_LOOPBACK(transport);
+
+    if (!self->stopped && req) {
+        if (self->request) {
+            self->request(transport, code, grilio_request_serial(req),
+                grilio_request_data(req), grilio_request_size(req),
+                self->user_data);
+        }
+        return GRILIO_SEND_OK;
+    }
+    return GRILIO_SEND_ERROR;
+}
+
+static
+void
+grilio_transport_loopback_shutdown(
+    GRilIoTransport* transport,
+    gboolean flush)
+{
+    GRilIoTransportLoopback* self = GRILIO_TRANSPORT_LOOPBACK(transport);
+
+    self->stopped = TRUE;
+    if (self->dispatch_id) {
+        g_source_remove(self->dispatch_id);
+        self->dispatch_id = 0;
+    }
+    g_byte_array_set_size(self->queue, 0);
+    grilio_transport_disconnected(transport);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoTransport*
+grilio_transport_loopback_new(
+    GRilIoTransportLoopbackFunc request,
+    void* user_data)
+{
+    GRilIoTransportLoopback* self = g_object_new
+        (GRILIO_TYPE_TRANSPORT_LOOPBACK, NULL);
+
+    self->request = request;
+    self->user_data = user_data;
+    return &self->parent;
+}
+
+gboolean
+grilio_transport_loopback_connect(
+    GRilIoTransport* transport,
+    guint ril_version)
+{
+    guint32 packet[4];
+
+    packet[0] = GUINT32_TO_RIL(RIL_PACKET_TYPE_UNSOLICITED);
+    packet[1] = GUINT32_TO_RIL(RIL_UNSOL_RIL_CONNECTED);
+    packet[2] = GUINT32_TO_RIL(1);
+    packet[3] = GUINT32_TO_RIL(ril_version);
+    return grilio_transport_loopback_queue(transport, packet,
+        sizeof(packet), NULL, 0);
+}
+
+gboolean
+grilio_transport_loopback_respond(
+    GRilIoTransport* transport,
+    guint serial,
+    int status,
+    const void* data,
+    guint len)
+{
+    guint32 header[3];
+
+    header[0] = GUINT32_TO_RIL(RIL_PACKET_TYPE_SOLICITED);
+    header[1] = GUINT32_TO_RIL(serial);
+    header[2] = GUINT32_TO_RIL(status);
+    return grilio_transport_loopback_queue(transport, header,
+        sizeof(header), data, len);
+}
+
+gboolean
+grilio_transport_loopback_indicate(
+    GRilIoTransport* transport,
+    guint code,
+    const void* data,
+    guint len)
+{
+    guint32 header[2];
+
+    header[0] = GUINT32_TO_RIL(RIL_PACKET_TYPE_UNSOLICITED);
+    header[1] = GUINT32_TO_RIL(code);
+    return grilio_transport_loopback_queue(transport, header,
+        sizeof(header), data, len);
+}
+
+/*==========================================================================*
+ * Internals
+ *==========================================================================*/
+
+static
+void
+grilio_transport_loopback_init(
+    GRilIoTransportLoopback* self)
+{
+    self->queue = g_byte_array_new();
+    self->dispatch = g_byte_array_new();
+}
+
+static
+void
+grilio_transport_loopback_finalize(
+    GObject* object)
+{
+    GRilIoTransportLoopback* self = GRILIO_TRANSPORT_LOOPBACK(object);
+
+    if (self->dispatch_id) {
+        g_source_remove(self->dispatch_id);
+    }
+    g_byte_array_unref(self->queue);
+    g_byte_array_unref(self->dispatch);
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
+static
+void
+grilio_transport_loopback_class_init(
+    GRilIoTransportLoopbackClass* klass)
+{
+    klass->send = grilio_transport_loopback_send;
+    klass->shutdown = grilio_transport_loopback_shutdown;
+    G_OBJECT_CLASS(klass)->finalize = grilio_transport_loopback_finalize;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -34,6 +34,13 @@
 #define GRILIO_TRANSPORT_PRIVATE_H
 
 #include "grilio_transport.h"
+#include "grilio_buffer.h"
+
+/* This limit is more or less arbitrary */
+#define RIL_MAX_PACKET_LEN (0x8000)
+
+/* RIL constants */
+#define RIL_SUB_LEN (4)
 
 typedef
 void
@@ -66,6 +73,20 @@ void
     guint len,
     void* user_data);
 
+/* Fragment of a response too large to be delivered in one piece */
+typedef
+void
+(*GRilIoTransportFragmentFunc)(
+    GRilIoTransport* transport,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    guint offset,
+    guint total,
+    const void* data,
+    guint len,
+    void* user_data);
+
 typedef
 void
 (*GRilIoTransportIndicationFunc)(
@@ -76,10 +97,81 @@ void
     guint len,
     void* user_data);
 
+/* Helpers shared by the implementations */
+
+GError*
+grilio_transport_errno_error(
+    int err);
+
+/* Moves pos towards total, returns the number of bytes left over */
+gsize
+grilio_transport_advance(
+    guint* pos,
+    guint total,
+    gsize bytes_written);
+
+/* Clears the connected flag, emits DISCONNECTED only once */
+void
+grilio_transport_disconnected(
+    GRilIoTransport* transport);
+
+/*
+ * Takes ownership of the error. WRITE_ERROR and DISCONNECTED signals
+ * are emitted on a fresh stack, because the handlers may release the
+ * last reference to the caller.
+ */
+void
+grilio_transport_handle_write_error(
+    GRilIoTransport* transport,
+    GError* error);
+
 guint
 grilio_transport_version_offset(
     GRilIoTransport* transport);
 
+guint
+grilio_transport_send_window(
+    GRilIoTransport* transport);
+
+/* Same as grilio_transport_handle_packet, packet points into buf */
+gboolean
+grilio_transport_handle_packet_buffer(
+    GRilIoTransport* transport,
+    GRilIoBuffer* buf,
+    const void* packet,
+    guint len,
+    GError** error);
+
+/* The buffer backing the packet being handled, NULL if none */
+GRilIoBuffer*
+grilio_transport_packet_buffer(
+    GRilIoTransport* transport);
+
+/*
+ * Used by the wrappers to re-emit the response received by another
+ * transport, buf is that transport's grilio_transport_packet_buffer.
+ * Response handlers can then slice the data instead of copying it.
+ */
+void
+grilio_transport_signal_response_buffer(
+    GRilIoTransport* transport,
+    GRilIoBuffer* buf,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    const void* data,
+    guint len);
+
+/*
+ * Only makes sense while the packet is being handled. Returns a slice
+ * of the receive buffer if the data belong to it or a copy otherwise.
+ */
+GBytes*
+grilio_transport_packet_bytes(
+    GRilIoTransport* transport,
+    const void* data,
+    guint len);
+
 void
 grilio_transport_set_name(
     GRilIoTransport* transport,
@@ -115,6 +207,12 @@ grilio_transport_add_response_handler(
     GRilIoTransportResponseFunc func,
     void* user_data);
 
+gulong
+grilio_transport_add_fragment_handler(
+    GRilIoTransport* transport,
+    GRilIoTransportFragmentFunc func,
+    void* user_data);
+
 gulong
 grilio_transport_add_indication_handler(
     GRilIoTransport* transport,
@@ -0,0 +1,492 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Plays back a capture file written by grilio_transport_capture_start().
+ * Indications are delivered along the recorded timeline. Responses are
+ * matched with the requests by code: the n-th live request with a given
+ * code gets the response to the n-th recorded request with that code,
+ * with the serial rewritten. If the timeline gets to the response before
+ * the request has been sent, the response is kept until it's asked for.
+ * Requests which have no recorded counterpart fail.
+ */
+
+#include "grilio_transport_impl.h"
+#include "grilio_transport_p.h"
+#include "grilio_capture.h"
+#include "grilio_p.h"
+
+#define GLOG_MODULE_NAME grilio_transport_playback_log
+#include <gutil_log.h>
+
+/* Log module */
+GLOG_MODULE_DEFINE2("grilio-playback", GRILIO_LOG_MODULE);
+
+typedef GRilIoTransportClass GRilIoTransportPlaybackClass;
+typedef struct grilio_transport_playback {
+    GRilIoTransport parent;
+    gboolean realtime;
+    gboolean stopped;
+    gchar* contents;
+    gsize size;
+    gsize pos;                  /* Next record */
+    gint64 base;                /* Monotonic time of the START record */
+    guint play_id;
+    guint ready_id;
+    GByteArray* frag;           /* Fragmented packet being reassembled */
+    GHashTable* requests;       /* Code => GQueue of recorded serials */
+    GHashTable* serials;        /* Recorded serial => live serial */
+    GHashTable* parked;         /* Recorded serial => GBytes */
+    GQueue ready;               /* GBytes to be delivered ASAP */
+} GRilIoTransportPlayback;
+
+G_DEFINE_TYPE(GRilIoTransportPlayback, grilio_transport_playback,
+    GRILIO_TYPE_TRANSPORT)
+
+#define PARENT_CLASS grilio_transport_playback_parent_class
+#define GRILIO_TYPE_TRANSPORT_PLAYBACK (grilio_transport_playback_get_type())
+#define GRILIO_TRANSPORT_PLAYBACK(obj) \
+    G_TYPE_CHECK_INSTANCE_CAST((obj), GRILIO_TYPE_TRANSPORT_PLAYBACK, \
+    GRilIoTransportPlayback)
+
+static
+gboolean
+grilio_transport_playback_play(
+    gpointer user_data);
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+grilio_transport_playback_handle(
+    GRilIoTransportPlayback* self,
+    const void* packet,
+    guint len)
+{
+    GRilIoTransport* transport = &self->parent;
+    GError* error = NULL;
+
+    if (!grilio_transport_handle_packet(transport, packet, len, &error)) {
+        GERR("%s%s", transport->log_prefix, GERRMSG(error));
+        grilio_transport_signal_read_error(transport, error);
+        g_error_free(error);
+    }
+}
+
+static
+gboolean
+grilio_transport_playback_dispatch_ready(
+    gpointer user_data)
+{
+    GRilIoTransportPlayback* self = GRILIO_TRANSPORT_PLAYBACK(user_data);
+    GBytes* bytes;
+
+    g_object_ref(self);
+    self->ready_id = 0;
+    while (!self->stopped && (bytes = g_queue_pop_head(&self->ready))) {
+        gsize len;
+        const void* packet = g_bytes_get_data(bytes, &len);
+
+        grilio_transport_playback_handle(self, packet, len);
+        g_bytes_unref(bytes);
+    }
+    g_object_unref(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+grilio_transport_playback_push_ready(
+    GRilIoTransportPlayback* self,
+    GBytes* bytes)
+{
+    g_queue_push_tail(&self->ready, bytes);
+    if (!self->ready_id) {
+        self->ready_id = g_idle_add(grilio_transport_playback_dispatch_ready,
+            self);
+    }
+}
+
+static
+GBytes*
+grilio_transport_playback_rewrite(
+    const void* packet,
+    guint len,
+    guint serial)
+{
+    guint8* data = g_memdup(packet, len);
+    const guint32 id = GUINT32_TO_RIL(serial);
+
+    memcpy(data + 4, &id, 4);
+    return g_bytes_new_take(data, len);
+}
+
+static
+void
+grilio_transport_playback_packet(
+    GRilIoTransportPlayback* self,
+    const void* packet,
+    guint len)
+{
+    const guint32* buf = packet;
+
+    if (len >= RIL_ACK_HEADER_SIZE) {
+        const RIL_PACKET_TYPE type = GUINT32_FROM_RIL(buf[0]);
+        const guint recorded = GUINT32_FROM_RIL(buf[1]);
+        gpointer key = GUINT_TO_POINTER(recorded);
+        gpointer value;
+
+        switch (type) {
+        case RIL_PACKET_TYPE_SOLICITED:
+        case RIL_PACKET_TYPE_SOLICITED_ACK_EXP:
+            if (g_hash_table_lookup_extended(self->serials, key,
+                NULL, &value)) {
+                GBytes* bytes = grilio_transport_playback_rewrite(packet,
+                    len, GPOINTER_TO_UINT(value));
+
+                g_hash_table_remove(self->serials, key);
+                grilio_transport_playback_handle(self,
+                    g_bytes_get_data(bytes, NULL), len);
+                g_bytes_unref(bytes);
+            } else {
+                /* Wait for the request */
+                g_hash_table_insert(self->parked, key,
+                    g_bytes_new(packet, len));
+            }
+            return;
+        case RIL_PACKET_TYPE_SOLICITED_ACK:
+            /* Only makes sense if the request has been sent */
+            if (g_hash_table_lookup_extended(self->serials, key,
+                NULL, &value)) {
+                GBytes* bytes = grilio_transport_playback_rewrite(packet,
+                    len, GPOINTER_TO_UINT(value));
+
+                grilio_transport_playback_handle(self,
+                    g_bytes_get_data(bytes, NULL), len);
+                g_bytes_unref(bytes);
+            }
+            return;
+        default:
+            break;
+        }
+    }
+    grilio_transport_playback_handle(self, packet, len);
+}
+
+static
+void
+grilio_transport_playback_schedule(
+    GRilIoTransportPlayback* self,
+    guint ms)
+{
+    GASSERT(!self->play_id);
+    self->play_id = ms ?
+        g_timeout_add(ms, grilio_transport_playback_play, self) :
+        g_idle_add(grilio_transport_playback_play, self);
+}
+
+/* Returns TRUE if a packet has been played */
+static
+gboolean
+grilio_transport_playback_record(
+    GRilIoTransportPlayback* self,
+    const GRilIoCaptureRecord* rec)
+{
+    GByteArray* frag = self->frag;
+
+    switch (rec->type) {
+    case GRILIO_CAPTURE_PACKET:
+        grilio_transport_playback_packet(self, rec->data, rec->len);
+        return TRUE;
+    case GRILIO_CAPTURE_FRAGMENT:
+        /* code is the total length, serial is the offset */
+        if (!rec->serial) {
+            g_byte_array_set_size(frag, 0);
+        }
+        if (frag->len == rec->serial) {
+            g_byte_array_append(frag, rec->data, rec->len);
+            if (frag->len == rec->code) {
+                grilio_transport_playback_packet(self, frag->data, frag->len);
+                g_byte_array_set_size(frag, 0);
+                return TRUE;
+            }
+        }
+        return FALSE;
+    case GRILIO_CAPTURE_START:
+    case GRILIO_CAPTURE_REQUEST:
+        break;
+    }
+    return FALSE;
+}
+
+static
+gboolean
+grilio_transport_playback_play(
+    gpointer user_data)
+{
+    GRilIoTransportPlayback* self = GRILIO_TRANSPORT_PLAYBACK(user_data);
+    GRilIoCaptureRecord rec;
+    gsize next = self->pos;
+
+    g_object_ref(self);
+    self->play_id = 0;
+    while (!self->stopped && grilio_capture_next(self->contents, self->size,
+        &next, &rec)) {
+        if (rec.type == GRILIO_CAPTURE_START) {
+            if (self->base) {
+                /* Only the first session is played back */
+                GDEBUG("End of capture");
+                break;
+            }
+            self->base = g_get_monotonic_time();
+        } else if (self->realtime) {
+            const gint64 delay = self->base + rec.time - g_get_monotonic_time();
+
+            if (delay >= 1000) {
+                grilio_transport_playback_schedule(self, delay / 1000);
+                break;
+            }
+        }
+        self->pos = next;
+        if (grilio_transport_playback_record(self, &rec) &&
+            !self->realtime && !self->stopped) {
+            /* One packet per main loop iteration */
+            grilio_transport_playback_schedule(self, 0);
+            break;
+        }
+    }
+    g_object_unref(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+gboolean
+grilio_transport_playback_load(
+    GRilIoTransportPlayback* self,
+    const char* path)
+{
+    GError* error = NULL;
+
+    if (g_file_get_contents(path, &self->contents, &self->size, &error)) {
+        gsize pos = grilio_capture_check(self->contents, self->size);
+
+        if (pos) {
+            GRilIoCaptureRecord rec;
+            gboolean started = FALSE;
+
+            /* Index the first session's requests by code */
+            self->pos = pos;
+            while (grilio_capture_next(self->contents, self->size, &pos,
+                &rec)) {
+                if (rec.type == GRILIO_CAPTURE_START) {
+                    if (started) {
+                        break;
+                    }
+                    started = TRUE;
+                } else if (rec.type == GRILIO_CAPTURE_REQUEST) {
+                    gpointer key = GUINT_TO_POINTER(rec.code);
+                    GQueue* q = g_hash_table_lookup(self->requests, key);
+
+                    if (!q) {
+                        q = g_queue_new();
+                        g_hash_table_insert(self->requests, key, q);
+                    }
+                    g_queue_push_tail(q, GUINT_TO_POINTER(rec.serial));
+                }
+            }
+            return TRUE;
+        } else {
+            GERR("%s is not a RIL capture file", path);
+        }
+    } else {
+        GERR("%s", GERRMSG(error));
+        g_error_free(error);
+    }
+    return FALSE;
+}
+
+/*==========================================================================*
+ * Methods
+ *==========================================================================*/
+
+static
+GRILIO_SEND_STATUS
+grilio_transport_playback_send(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    guint code)
+{
+    GRilIoTransportPlayback* self = GRILIO_TRANSPORT_PLAYBACK(transport);
+
+    if (!self->stopped) {
+        const guint serial = grilio_request_serial(req);
+        GQueue* q = g_hash_table_lookup(self->requests,
+            GUINT_TO_POINTER(code));
+
+        if (q && !g_queue_is_empty(q)) {
+            gpointer key = g_queue_pop_head(q);
+            GBytes* bytes;
+
+            if (g_hash_table_lookup_extended(self->parked, key,
+                NULL, (gpointer*)&bytes)) {
+                gsize len;
+                const void* packet = g_bytes_get_data(bytes, &len);
+
+                /* The timeline has already got there */
+                grilio_transport_playback_push_ready(self,
+                    grilio_transport_playback_rewrite(packet, len, serial));
+                g_hash_table_remove(self->parked, key);
+            } else {
+                g_hash_table_insert(self->serials, key,
+                    GUINT_TO_POINTER(serial));
+            }
+        } else {
+            guint32 packet[3];
+
+            GWARN("%sNo recorded response for request %u", transport->
+                log_prefix, code);
+            packet[0] = GUINT32_TO_RIL(RIL_PACKET_TYPE_SOLICITED);
+            packet[1] = GUINT32_TO_RIL(serial);
+            packet[2] = GUINT32_TO_RIL(RIL_E_GENERIC_FAILURE);
+            grilio_transport_playback_push_ready(self,
+                g_bytes_new(packet, sizeof(packet)));
+        }
+        return GRILIO_SEND_OK;
+    }
+    return GRILIO_SEND_ERROR;
+}
+
+static
+void
+grilio_transport_playback_shutdown(
+    GRilIoTransport* transport,
+    gboolean flush)
+{
+    GRilIoTransportPlayback* self = GRILIO_TRANSPORT_PLAYBACK(transport);
+
+    self->stopped = TRUE;
+    if (self->play_id) {
+        g_source_remove(self->play_id);
+        self->play_id = 0;
+    }
+    if (self->ready_id) {
+        g_source_remove(self->ready_id);
+        self->ready_id = 0;
+    }
+    grilio_transport_disconnected(transport);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoTransport*
+grilio_transport_playback_new(
+    const char* path,
+    gboolean realtime)
+{
+    if (G_LIKELY(path)) {
+        GRilIoTransportPlayback* self = g_object_new
+            (GRILIO_TYPE_TRANSPORT_PLAYBACK, NULL);
+
+        if (grilio_transport_playback_load(self, path)) {
+            self->realtime = realtime;
+            grilio_transport_playback_schedule(self, 0);
+            return &self->parent;
+        }
+        g_object_unref(self);
+    }
+    return NULL;
+}
+
+/*==========================================================================*
+ * Internals
+ *==========================================================================*/
+
+static
+void
+grilio_transport_playback_init(
+    GRilIoTransportPlayback* self)
+{
+    self->frag = g_byte_array_new();
+    self->requests = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        NULL, (GDestroyNotify)g_queue_free);
+    self->serials = g_hash_table_new(g_direct_hash, g_direct_equal);
+    self->parked = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+        NULL, (GDestroyNotify)g_bytes_unref);
+    g_queue_init(&self->ready);
+}
+
+static
+void
+grilio_transport_playback_finalize(
+    GObject* object)
+{
+    GRilIoTransportPlayback* self = GRILIO_TRANSPORT_PLAYBACK(object);
+    GBytes* bytes;
+
+    if (self->play_id) {
+        g_source_remove(self->play_id);
+    }
+    if (self->ready_id) {
+        g_source_remove(self->ready_id);
+    }
+    while ((bytes = g_queue_pop_head(&self->ready)) != NULL) {
+        g_bytes_unref(bytes);
+    }
+    g_hash_table_destroy(self->requests);
+    g_hash_table_destroy(self->serials);
+    g_hash_table_destroy(self->parked);
+    g_byte_array_free(self->frag, TRUE);
+    g_free(self->contents);
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
+static
+void
+grilio_transport_playback_class_init(
+    GRilIoTransportPlaybackClass* klass)
+{
+    klass->send = grilio_transport_playback_send;
+    klass->shutdown = grilio_transport_playback_shutdown;
+    G_OBJECT_CLASS(klass)->finalize = grilio_transport_playback_finalize;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
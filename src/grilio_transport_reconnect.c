@@ -0,0 +1,543 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Connects to the RIL socket without blocking and reconnects (with
+ * exponentially growing delay) after the connection gets lost. The I/O
+ * itself is done by the socket transport which is re-created for each
+ * connection. Read and write errors only break the current connection,
+ * they are not propagated to the channel which would otherwise shut
+ * the whole thing down.
+ */
+
+#include "grilio_transport_p.h"
+#include "grilio_transport_impl.h"
+#include "grilio_p.h"
+
+#define GLOG_MODULE_NAME grilio_transport_reconnect_log
+#include <gutil_log.h>
+
+#include <glib-unix.h>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Log module */
+GLOG_MODULE_DEFINE2("grilio-reconnect", GRILIO_LOG_MODULE);
+
+#define RECONNECT_DEFAULT_MIN_DELAY_MS (250)
+#define RECONNECT_DEFAULT_MAX_DELAY_MS (10000)
+
+enum grilio_transport_reconnect_events {
+    SOCKET_EVENT_CONNECTED,
+    SOCKET_EVENT_DISCONNECTED,
+    SOCKET_EVENT_REQUEST_SENT,
+    SOCKET_EVENT_RESPONSE,
+    SOCKET_EVENT_FRAGMENT,
+    SOCKET_EVENT_INDICATION,
+    SOCKET_EVENT_READ_ERROR,
+    SOCKET_EVENT_WRITE_ERROR,
+    SOCKET_EVENT_COUNT
+};
+
+typedef GRilIoTransportClass GRilIoTransportReconnectClass;
+typedef struct grilio_transport_reconnect {
+    GRilIoTransport parent;
+    char* path;
+    char* sub;
+    gboolean stopped;
+    int connect_fd;
+    guint connect_watch_id;
+    guint retry_id;
+    guint min_delay;
+    guint max_delay;
+    guint delay;
+    GRilIoTransport* socket;
+    GRilIoTransport* dead_socket;
+    gulong socket_event_ids[SOCKET_EVENT_COUNT];
+} GRilIoTransportReconnect;
+
+G_DEFINE_TYPE(GRilIoTransportReconnect, grilio_transport_reconnect,
+    GRILIO_TYPE_TRANSPORT)
+
+#define PARENT_CLASS grilio_transport_reconnect_parent_class
+#define GRILIO_TYPE_TRANSPORT_RECONNECT \
+    (grilio_transport_reconnect_get_type())
+#define GRILIO_TRANSPORT_RECONNECT(obj) \
+    G_TYPE_CHECK_INSTANCE_CAST((obj), GRILIO_TYPE_TRANSPORT_RECONNECT, \
+    GRilIoTransportReconnect)
+#define GRILIO_IS_TRANSPORT_RECONNECT(obj) \
+    G_TYPE_CHECK_INSTANCE_TYPE((obj), GRILIO_TYPE_TRANSPORT_RECONNECT)
+
+static
+void
+grilio_transport_reconnect_connect(
+    GRilIoTransportReconnect* self);
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+grilio_transport_reconnect_drop_dead_socket(
+    GRilIoTransportReconnect* self)
+{
+    if (self->dead_socket) {
+        grilio_transport_unref(self->dead_socket);
+        self->dead_socket = NULL;
+    }
+}
+
+static
+void
+grilio_transport_reconnect_cancel_connect(
+    GRilIoTransportReconnect* self)
+{
+    if (self->connect_watch_id) {
+        g_source_remove(self->connect_watch_id);
+        self->connect_watch_id = 0;
+    }
+    if (self->connect_fd >= 0) {
+        close(self->connect_fd);
+        self->connect_fd = -1;
+    }
+}
+
+static
+void
+grilio_transport_reconnect_release_socket(
+    GRilIoTransportReconnect* self)
+{
+    GRilIoTransport* socket = self->socket;
+
+    if (socket) {
+        /*
+         * We may be invoked by the socket's signal handler, keep the
+         * reference until the next connection attempt (or finalize).
+         */
+        self->socket = NULL;
+        grilio_transport_remove_all_handlers(socket, self->socket_event_ids);
+        grilio_transport_shutdown(socket, FALSE);
+        grilio_transport_reconnect_drop_dead_socket(self);
+        self->dead_socket = socket;
+    }
+}
+
+static
+gboolean
+grilio_transport_reconnect_retry_cb(
+    gpointer user_data)
+{
+    GRilIoTransportReconnect* self = GRILIO_TRANSPORT_RECONNECT(user_data);
+
+    GASSERT(self->retry_id);
+    self->retry_id = 0;
+    grilio_transport_reconnect_connect(self);
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+grilio_transport_reconnect_schedule(
+    GRilIoTransportReconnect* self)
+{
+    GRilIoTransport* transport = &self->parent;
+
+    if (!self->stopped && !self->retry_id) {
+        GDEBUG("%sreconnecting in %u ms", transport->log_prefix, self->delay);
+        self->retry_id = g_timeout_add(self->delay,
+            grilio_transport_reconnect_retry_cb, self);
+
+        /* Exponential backoff */
+        self->delay = MIN(self->delay * 2, self->max_delay);
+    }
+}
+
+static
+void
+grilio_transport_reconnect_lost(
+    GRilIoTransportReconnect* self)
+{
+    GRilIoTransport* transport = &self->parent;
+
+    grilio_transport_reconnect_release_socket(self);
+    if (transport->connected) {
+        transport->connected = FALSE;
+        grilio_transport_signal_disconnected(transport);
+    }
+    grilio_transport_reconnect_schedule(self);
+}
+
+static
+void
+grilio_transport_reconnect_socket_connected(
+    GRilIoTransport* socket,
+    void* user_data)
+{
+    GRilIoTransportReconnect* self = GRILIO_TRANSPORT_RECONNECT(user_data);
+    GRilIoTransport* transport = &self->parent;
+
+    /* Handshake has completed, reset the backoff */
+    self->delay = self->min_delay;
+    transport->ril_version = socket->ril_version;
+    transport->connected = TRUE;
+    grilio_transport_signal_connected(transport);
+}
+
+static
+void
+grilio_transport_reconnect_socket_disconnected(
+    GRilIoTransport* socket,
+    void* user_data)
+{
+    GRilIoTransportReconnect* self = GRILIO_TRANSPORT_RECONNECT(user_data);
+
+    GDEBUG("%sconnection lost", self->parent.log_prefix);
+    grilio_transport_reconnect_lost(self);
+}
+
+static
+void
+grilio_transport_reconnect_socket_request_sent(
+    GRilIoTransport* socket,
+    GRilIoRequest* req,
+    void* user_data)
+{
+    grilio_transport_signal_request_sent(GRILIO_TRANSPORT(user_data), req);
+}
+
+static
+void
+grilio_transport_reconnect_socket_response(
+    GRilIoTransport* socket,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    grilio_transport_signal_response_buffer(GRILIO_TRANSPORT(user_data),
+        grilio_transport_packet_buffer(socket), type, serial, status,
+        data, len);
+}
+
+static
+void
+grilio_transport_reconnect_socket_fragment(
+    GRilIoTransport* socket,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    guint offset,
+    guint total,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    grilio_transport_signal_fragment(GRILIO_TRANSPORT(user_data), type,
+        serial, status, offset, total, data, len);
+}
+
+static
+void
+grilio_transport_reconnect_socket_indication(
+    GRilIoTransport* socket,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    grilio_transport_signal_indication(GRILIO_TRANSPORT(user_data), type,
+        code, data, len);
+}
+
+static
+void
+grilio_transport_reconnect_socket_error(
+    GRilIoTransport* socket,
+    const GError* error,
+    void* user_data)
+{
+    GRilIoTransportReconnect* self = GRILIO_TRANSPORT_RECONNECT(user_data);
+
+    /* Not fatal, we will reconnect */
+    GWARN("%s%s", self->parent.log_prefix, GERRMSG(error));
+    grilio_transport_reconnect_lost(self);
+}
+
+static
+void
+grilio_transport_reconnect_connected(
+    GRilIoTransportReconnect* self,
+    int fd)
+{
+    GRilIoTransport* transport = &self->parent;
+    GRilIoTransport* socket = grilio_transport_socket_new(fd, self->sub, TRUE);
+
+    if (socket) {
+        gulong* ids = self->socket_event_ids;
+
+        GDEBUG("%sconnected to %s", transport->log_prefix, self->path);
+        grilio_transport_set_name(socket, transport->name);
+        self->socket = socket;
+        ids[SOCKET_EVENT_CONNECTED] =
+            grilio_transport_add_connected_handler(socket,
+                grilio_transport_reconnect_socket_connected, self);
+        ids[SOCKET_EVENT_DISCONNECTED] =
+            grilio_transport_add_disconnected_handler(socket,
+                grilio_transport_reconnect_socket_disconnected, self);
+        ids[SOCKET_EVENT_REQUEST_SENT] =
+            grilio_transport_add_request_sent_handler(socket,
+                grilio_transport_reconnect_socket_request_sent, self);
+        ids[SOCKET_EVENT_RESPONSE] =
+            grilio_transport_add_response_handler(socket,
+                grilio_transport_reconnect_socket_response, self);
+        ids[SOCKET_EVENT_FRAGMENT] =
+            grilio_transport_add_fragment_handler(socket,
+                grilio_transport_reconnect_socket_fragment, self);
+        ids[SOCKET_EVENT_INDICATION] =
+            grilio_transport_add_indication_handler(socket,
+                grilio_transport_reconnect_socket_indication, self);
+        ids[SOCKET_EVENT_READ_ERROR] =
+            grilio_transport_add_read_error_handler(socket,
+                grilio_transport_reconnect_socket_error, self);
+        ids[SOCKET_EVENT_WRITE_ERROR] =
+            grilio_transport_add_write_error_handler(socket,
+                grilio_transport_reconnect_socket_error, self);
+    } else {
+        close(fd);
+        grilio_transport_reconnect_schedule(self);
+    }
+}
+
+static
+gboolean
+grilio_transport_reconnect_connect_cb(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    GRilIoTransportReconnect* self = GRILIO_TRANSPORT_RECONNECT(user_data);
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    GASSERT(self->connect_fd == fd);
+    self->connect_watch_id = 0;
+    self->connect_fd = -1;
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+        err = errno;
+    }
+    if (err) {
+        GDEBUG("%sconnect failed: %s", self->parent.log_prefix,
+            strerror(err));
+        close(fd);
+        grilio_transport_reconnect_schedule(self);
+    } else {
+        grilio_transport_reconnect_connected(self, fd);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+grilio_transport_reconnect_connect(
+    GRilIoTransportReconnect* self)
+{
+    GRilIoTransport* transport = &self->parent;
+    int fd;
+
+    GASSERT(!self->socket);
+    GASSERT(self->connect_fd < 0);
+    grilio_transport_reconnect_drop_dead_socket(self);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+        struct sockaddr_un addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, self->path, sizeof(addr.sun_path) - 1);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            grilio_transport_reconnect_connected(self, fd);
+        } else if (errno == EINPROGRESS) {
+            /* Wait for the outcome */
+            self->connect_fd = fd;
+            self->connect_watch_id = g_unix_fd_add(fd, G_IO_OUT,
+                grilio_transport_reconnect_connect_cb, self);
+        } else {
+            /* EAGAIN means that the backlog is full, try again later */
+            GDEBUG("%sfailed to connect to %s: %s", transport->log_prefix,
+                self->path, strerror(errno));
+            close(fd);
+            grilio_transport_reconnect_schedule(self);
+        }
+    } else {
+        GERR("Can't create unix socket: %s", strerror(errno));
+        grilio_transport_reconnect_schedule(self);
+    }
+}
+
+/*==========================================================================*
+ * Methods
+ *==========================================================================*/
+
+static
+GRILIO_SEND_STATUS
+grilio_transport_reconnect_send(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    guint code)
+{
+    GRilIoTransportReconnect* self = GRILIO_TRANSPORT_RECONNECT(transport);
+
+    return self->socket ? grilio_transport_send(self->socket, req, code) :
+        GRILIO_SEND_ERROR;
+}
+
+static
+guint
+grilio_transport_reconnect_send_window(
+    GRilIoTransport* transport)
+{
+    GRilIoTransportReconnect* self = GRILIO_TRANSPORT_RECONNECT(transport);
+
+    return grilio_transport_send_window(self->socket);
+}
+
+static
+void
+grilio_transport_reconnect_shutdown(
+    GRilIoTransport* transport,
+    gboolean flush)
+{
+    GRilIoTransportReconnect* self = GRILIO_TRANSPORT_RECONNECT(transport);
+
+    /* This one is final */
+    self->stopped = TRUE;
+    if (self->retry_id) {
+        g_source_remove(self->retry_id);
+        self->retry_id = 0;
+    }
+    grilio_transport_reconnect_cancel_connect(self);
+    if (self->socket && flush) {
+        grilio_transport_shutdown(self->socket, TRUE);
+    }
+    grilio_transport_reconnect_lost(self);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoTransport*
+grilio_transport_reconnect_new(
+    const char* path,
+    const char* sub)
+{
+    if (G_LIKELY(path && (!sub || strlen(sub) == RIL_SUB_LEN))) {
+        GRilIoTransportReconnect* self = g_object_new
+            (GRILIO_TYPE_TRANSPORT_RECONNECT, NULL);
+
+        self->path = g_strdup(path);
+        self->sub = g_strdup(sub);
+        grilio_transport_reconnect_connect(self);
+        return &self->parent;
+    }
+    return NULL;
+}
+
+void
+grilio_transport_reconnect_set_delay(
+    GRilIoTransport* transport,
+    guint min_ms,
+    guint max_ms)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_RECONNECT(transport))) {
+        GRilIoTransportReconnect* self =
+            GRILIO_TRANSPORT_RECONNECT(transport);
+
+        self->min_delay = MAX(min_ms, 1);
+        self->max_delay = MAX(max_ms, self->min_delay);
+        self->delay = self->min_delay;
+    }
+}
+
+/*==========================================================================*
+ * Internals
+ *==========================================================================*/
+
+static
+void
+grilio_transport_reconnect_init(
+    GRilIoTransportReconnect* self)
+{
+    self->connect_fd = -1;
+    self->min_delay = self->delay = RECONNECT_DEFAULT_MIN_DELAY_MS;
+    self->max_delay = RECONNECT_DEFAULT_MAX_DELAY_MS;
+}
+
+static
+void
+grilio_transport_reconnect_finalize(
+    GObject* object)
+{
+    GRilIoTransportReconnect* self = GRILIO_TRANSPORT_RECONNECT(object);
+
+    grilio_transport_reconnect_shutdown(&self->parent, FALSE);
+    grilio_transport_reconnect_drop_dead_socket(self);
+    g_free(self->path);
+    g_free(self->sub);
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
+static
+void
+grilio_transport_reconnect_class_init(
+    GRilIoTransportReconnectClass* klass)
+{
+    klass->send = grilio_transport_reconnect_send;
+    klass->shutdown = grilio_transport_reconnect_shutdown;
+    klass->send_window = grilio_transport_reconnect_send_window;
+    G_OBJECT_CLASS(klass)->finalize = grilio_transport_reconnect_finalize;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,526 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * RIL protocol over SOCK_SEQPACKET. Message boundaries are preserved by
+ * the socket, so there's no length prefix and no reassembly - each
+ * message is exactly one RIL packet. The subscription (if any) is sent
+ * as a separate 4-byte message. Incoming packets are pulled in batches
+ * with recvmmsg().
+ */
+
+#define _GNU_SOURCE /* recvmmsg, sendmmsg */
+
+#include "grilio_transport_impl.h"
+#include "grilio_transport_p.h"
+#include "grilio_buffer.h"
+#include "grilio_p.h"
+
+#define GLOG_MODULE_NAME grilio_transport_seqpacket_log
+#include <gutil_log.h>
+
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* Log module */
+GLOG_MODULE_DEFINE2("grilio-seqpacket", GRILIO_LOG_MODULE);
+
+/* Number of packets received with one system call */
+#define RIL_RECV_BATCH (8)
+
+typedef GRilIoTransportClass GRilIoTransportSeqpacketClass;
+typedef struct grilio_transport_seqpacket {
+    GRilIoTransport parent;
+    int fd;
+    gboolean can_close;
+    guint read_source_id;
+    guint write_source_id;
+
+    /* Subscription */
+    gchar sub[RIL_SUB_LEN];
+    gboolean subscribed;
+
+    /* Send */
+    guint32 send_header[2]; /* Code and serial, no length */
+    GRilIoRequest* send_req;
+
+    /* Receive */
+    GRilIoBuffer* recv_buf[RIL_RECV_BATCH];
+    struct iovec recv_iov[RIL_RECV_BATCH];
+    struct mmsghdr recv_msg[RIL_RECV_BATCH];
+} GRilIoTransportSeqpacket;
+
+G_DEFINE_TYPE(GRilIoTransportSeqpacket, grilio_transport_seqpacket,
+    GRILIO_TYPE_TRANSPORT)
+
+#define PARENT_CLASS grilio_transport_seqpacket_parent_class
+#define GRILIO_TYPE_TRANSPORT_SEQPACKET \
+    (grilio_transport_seqpacket_get_type())
+#define GRILIO_TRANSPORT_SEQPACKET(obj) \
+    G_TYPE_CHECK_INSTANCE_CAST((obj), GRILIO_TYPE_TRANSPORT_SEQPACKET, \
+    GRilIoTransportSeqpacket)
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+grilio_transport_seqpacket_shutdown_io(
+    GRilIoTransportSeqpacket* self)
+{
+    if (self->read_source_id) {
+        g_source_remove(self->read_source_id);
+        self->read_source_id = 0;
+    }
+    if (self->write_source_id) {
+        g_source_remove(self->write_source_id);
+        self->write_source_id = 0;
+    }
+    if (self->fd >= 0) {
+        /* Make sure that the other side notices */
+        shutdown(self->fd, SHUT_RDWR);
+        if (self->can_close) {
+            close(self->fd);
+        }
+        self->fd = -1;
+    }
+}
+
+/*==========================================================================*
+ * Read
+ *==========================================================================*/
+
+static
+void
+grilio_transport_seqpacket_handle_read_error(
+    GRilIoTransportSeqpacket* self,
+    GError* error)
+{
+    GRilIoTransport* transport = &self->parent;
+
+    GERR("%sread failed: %s", transport->log_prefix, GERRMSG(error));
+
+    /*
+     * Zero source id to avoid removing it twice. This one is going to be
+     * freed when we return FALSE from the callback.
+     */
+    self->read_source_id = 0;
+    grilio_transport_shutdown(transport, FALSE);
+    grilio_transport_signal_read_error(transport, error);
+    g_error_free(error);
+}
+
+static
+void
+grilio_transport_seqpacket_handle_eof(
+    GRilIoTransportSeqpacket* self)
+{
+    GRilIoTransport* transport = &self->parent;
+
+    GERR("%shangup", transport->log_prefix);
+
+    /*
+     * Zero source id to avoid removing it twice. This one is going to be
+     * freed when we return FALSE from the callback.
+     */
+    self->read_source_id = 0;
+    grilio_transport_shutdown(transport, FALSE);
+}
+
+static
+gboolean
+grilio_transport_seqpacket_read(
+    GRilIoTransportSeqpacket* self)
+{
+    const guint max_len = grilio_transport_max_packet_len(&self->parent);
+    int i, n;
+
+    for (i = 0; i < RIL_RECV_BATCH; i++) {
+        struct msghdr* msg = &self->recv_msg[i].msg_hdr;
+
+        /* Switches to another buffer if the last packet is still in use */
+        self->recv_buf[i] = grilio_buffer_reserve(self->recv_buf[i],
+            NULL, NULL, max_len);
+        memset(msg, 0, sizeof(*msg));
+        self->recv_iov[i].iov_base = GRILIO_BUFFER_DATA(self->recv_buf[i]);
+        self->recv_iov[i].iov_len = max_len;
+        msg->msg_iov = self->recv_iov + i;
+        msg->msg_iovlen = 1;
+        self->recv_msg[i].msg_len = 0;
+    }
+
+    /* MSG_TRUNC makes msg_len the real length of the packet */
+    do {
+        n = recvmmsg(self->fd, self->recv_msg, RIL_RECV_BATCH,
+            MSG_DONTWAIT | MSG_TRUNC, NULL);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return TRUE;
+        }
+        grilio_transport_seqpacket_handle_read_error(self,
+            grilio_transport_errno_error(errno));
+        return FALSE;
+    }
+
+    for (i = 0; i < n && self->fd >= 0; i++) {
+        const guint len = self->recv_msg[i].msg_len;
+        GError* error = NULL;
+
+        if (!len) {
+            /* Empty message means that the other side has hung up */
+            grilio_transport_seqpacket_handle_eof(self);
+            return FALSE;
+        } else if (len > max_len) {
+            grilio_transport_seqpacket_handle_read_error(self,
+                g_error_new(G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "Packet too long (%u bytes)", len));
+            return FALSE;
+        } else if (!grilio_transport_handle_packet_buffer(&self->parent,
+            self->recv_buf[i], self->recv_iov[i].iov_base, len, &error)) {
+            grilio_transport_seqpacket_handle_read_error(self, error);
+            return FALSE;
+        }
+    }
+
+    /* Zero messages also means EOF */
+    if (!n) {
+        grilio_transport_seqpacket_handle_eof(self);
+        return FALSE;
+    }
+    return self->fd >= 0;
+}
+
+static
+gboolean
+grilio_transport_seqpacket_read_callback(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    gboolean result;
+    GRilIoTransportSeqpacket* self = GRILIO_TRANSPORT_SEQPACKET(user_data);
+
+    g_object_ref(self);
+    if (condition & G_IO_IN) {
+        result = grilio_transport_seqpacket_read(self) ?
+            G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+    } else {
+        /* G_IO_HUP or G_IO_ERR without any data to read */
+        grilio_transport_seqpacket_handle_eof(self);
+        result = G_SOURCE_REMOVE;
+    }
+    if (result == G_SOURCE_REMOVE) {
+        self->read_source_id = 0;
+    }
+    g_object_unref(self);
+    return result;
+}
+
+/*==========================================================================*
+ * Write
+ *==========================================================================*/
+
+static
+void
+grilio_transport_seqpacket_handle_write_error(
+    GRilIoTransportSeqpacket* self,
+    GError* error)
+{
+    /*
+     * Zero source id to avoid removing it twice. This one is going
+     * to be freed when we return FALSE from the callback.
+     */
+    self->write_source_id = 0;
+
+    /* Don't emit DISCONNECTED signal just yet */
+    grilio_transport_seqpacket_shutdown_io(self);
+    grilio_transport_handle_write_error(&self->parent, error);
+}
+
+static
+gboolean
+grilio_transport_seqpacket_write(
+    GRilIoTransportSeqpacket* self,
+    GError** error)
+{
+    GRilIoTransport* transport = &self->parent;
+    GRilIoRequest* req = self->send_req;
+    struct iovec iov[3];
+    struct mmsghdr msg[2];
+    int i, n = 0, sent;
+
+    /* Subscription and request go in one system call */
+    memset(msg, 0, sizeof(msg));
+    if (!self->subscribed) {
+        iov[0].iov_base = self->sub;
+        iov[0].iov_len = RIL_SUB_LEN;
+        msg[n].msg_hdr.msg_iov = iov;
+        msg[n].msg_hdr.msg_iovlen = 1;
+        n++;
+    }
+    if (transport->connected && req) {
+        iov[1].iov_base = self->send_header;
+        iov[1].iov_len = sizeof(self->send_header);
+        iov[2].iov_base = req->bytes->data;
+        iov[2].iov_len = grilio_request_size(req);
+        msg[n].msg_hdr.msg_iov = iov + 1;
+        msg[n].msg_hdr.msg_iovlen = 2;
+        n++;
+    }
+
+    if (!n) {
+        /* There is nothing to send, remove the source */
+        GVERBOSE("%shas nothing to send", transport->log_prefix);
+        return FALSE;
+    }
+
+    do {
+        sent = sendmmsg(self->fd, msg, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            /* Will have to wait */
+            return TRUE;
+        }
+        *error = grilio_transport_errno_error(errno);
+        return FALSE;
+    }
+
+    /* Messages are sent atomically, either completely or not at all */
+    for (i = 0; i < sent; i++) {
+        if (msg[i].msg_hdr.msg_iov == iov) {
+            self->subscribed = TRUE;
+            GDEBUG("%ssubscribed for %c%c%c%c", transport->log_prefix,
+                self->sub[0], self->sub[1], self->sub[2], self->sub[3]);
+        } else {
+            grilio_request_unref(self->send_req);
+            self->send_req = NULL;
+        }
+    }
+    return TRUE;
+}
+
+static
+gboolean
+grilio_transport_seqpacket_write_callback(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    gboolean result = G_SOURCE_REMOVE;
+    GRilIoTransportSeqpacket* self = GRILIO_TRANSPORT_SEQPACKET(user_data);
+    GError* error = NULL;
+
+    g_object_ref(self);
+    if (condition & G_IO_OUT) {
+        GRilIoTransport* transport = &self->parent;
+        GRilIoRequest* req = grilio_request_ref(self->send_req);
+
+        if (grilio_transport_seqpacket_write(self, &error)) {
+            if (!self->subscribed || (self->send_req &&
+                transport->connected)) {
+                /* Still waiting for the socket to become writable */
+                result = G_SOURCE_CONTINUE;
+            } else if (req && !self->send_req) {
+                grilio_transport_signal_request_sent(transport, req);
+                if (self->send_req && self->write_source_id) {
+                    /* Signal handler has submitted the next request */
+                    result = G_SOURCE_CONTINUE;
+                }
+            }
+        }
+        grilio_request_unref(req);
+    }
+    if (result == G_SOURCE_REMOVE) {
+        self->write_source_id = 0;
+    }
+    if (error) {
+        grilio_transport_seqpacket_handle_write_error(self, error);
+    }
+    g_object_unref(self);
+    return result;
+}
+
+static
+void
+grilio_transport_seqpacket_schedule_write(
+    GRilIoTransportSeqpacket* self)
+{
+    if (!self->write_source_id) {
+        GVERBOSE("%sscheduling write", self->parent.log_prefix);
+        self->write_source_id = g_unix_fd_add_full(G_PRIORITY_DEFAULT,
+            self->fd, G_IO_OUT, grilio_transport_seqpacket_write_callback,
+            self, NULL);
+    }
+}
+
+/*==========================================================================*
+ * Methods
+ *==========================================================================*/
+
+static
+GRILIO_SEND_STATUS
+grilio_transport_seqpacket_send(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    guint code)
+{
+    GRILIO_SEND_STATUS status = GRILIO_SEND_ERROR;
+    GRilIoTransportSeqpacket* self = GRILIO_TRANSPORT_SEQPACKET(transport);
+
+    GASSERT(!self->send_req);
+    if (!self->send_req && req && self->fd >= 0) {
+        GError* error = NULL;
+
+        self->send_header[0] = GUINT32_TO_RIL(code);
+        self->send_header[1] = GUINT32_TO_RIL(grilio_request_serial(req));
+        self->send_req = grilio_request_ref(req);
+        if (grilio_transport_seqpacket_write(self, &error)) {
+            if (!self->send_req) {
+                status = GRILIO_SEND_OK;
+            } else {
+                status = GRILIO_SEND_PENDING;
+                grilio_transport_seqpacket_schedule_write(self);
+            }
+        }
+        if (error) {
+            grilio_transport_seqpacket_handle_write_error(self, error);
+        }
+    }
+    return status;
+}
+
+static
+void
+grilio_transport_seqpacket_shutdown(
+    GRilIoTransport* transport,
+    gboolean flush)
+{
+    GRilIoTransportSeqpacket* self = GRILIO_TRANSPORT_SEQPACKET(transport);
+
+    grilio_transport_seqpacket_shutdown_io(self);
+    grilio_transport_disconnected(&self->parent);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoTransport*
+grilio_transport_seqpacket_new(
+    int fd,
+    const char* sub,
+    gboolean can_close)
+{
+    if (G_LIKELY(fd >= 0 && (!sub || strlen(sub) == RIL_SUB_LEN))) {
+        int type = 0;
+        socklen_t optlen = sizeof(type);
+
+        if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &optlen) < 0 ||
+            type != SOCK_SEQPACKET) {
+            GERR("fd %d is not a SOCK_SEQPACKET socket", fd);
+        } else {
+            GRilIoTransportSeqpacket* self = g_object_new
+                (GRILIO_TYPE_TRANSPORT_SEQPACKET, NULL);
+
+            self->fd = fd;
+            self->can_close = can_close;
+            self->read_source_id = g_unix_fd_add_full(G_PRIORITY_DEFAULT,
+                fd, G_IO_IN, grilio_transport_seqpacket_read_callback,
+                self, NULL);
+            if (sub) {
+                memcpy(self->sub, sub, RIL_SUB_LEN);
+                grilio_transport_seqpacket_schedule_write(self);
+            } else {
+                self->subscribed = TRUE;
+            }
+            return &self->parent;
+        }
+    }
+    return NULL;
+}
+
+/*==========================================================================*
+ * Internals
+ *==========================================================================*/
+
+static
+void
+grilio_transport_seqpacket_init(
+    GRilIoTransportSeqpacket* self)
+{
+    self->fd = -1;
+}
+
+static
+void
+grilio_transport_seqpacket_finalize(
+    GObject* object)
+{
+    GRilIoTransportSeqpacket* self = GRILIO_TRANSPORT_SEQPACKET(object);
+    int i;
+
+    grilio_transport_seqpacket_shutdown(&self->parent, FALSE);
+    grilio_request_unref(self->send_req);
+    for (i = 0; i < RIL_RECV_BATCH; i++) {
+        grilio_buffer_unref(self->recv_buf[i]);
+    }
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
+static
+void
+grilio_transport_seqpacket_class_init(
+    GRilIoTransportSeqpacketClass* klass)
+{
+    klass->send = grilio_transport_seqpacket_send;
+    klass->shutdown = grilio_transport_seqpacket_shutdown;
+    G_OBJECT_CLASS(klass)->finalize = grilio_transport_seqpacket_finalize;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * RIL packets travel through a pair of rings in shared memory (see
+ * grilio_shm.h), the unix socket is only used for the initial handshake
+ * and to detect the other side going away. Intended for cooperating
+ * processes on the same machine, e.g. a client talking to a local proxy
+ * which uses grilio_shm_server_new() on its end.
+ */
+
+#include "grilio_transport_impl.h"
+#include "grilio_transport_p.h"
+#include "grilio_shm.h"
+#include "grilio_p.h"
+
+#define GLOG_MODULE_NAME grilio_transport_shm_log
+#include <gutil_log.h>
+
+#include <glib-unix.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/* Log module */
+GLOG_MODULE_DEFINE2("grilio-shm", GRILIO_LOG_MODULE);
+
+typedef GRilIoTransportClass GRilIoTransportShmClass;
+typedef struct grilio_transport_shm {
+    GRilIoTransport parent;
+    int fd;
+    gboolean can_close;
+    GRilIoShm* shm;
+    guint fd_watch_id;
+    guint event_watch_id;
+
+    /* Waiting for room in the ring */
+    GRilIoRequest* send_req;
+    guint send_code;
+} GRilIoTransportShm;
+
+G_DEFINE_TYPE(GRilIoTransportShm, grilio_transport_shm, GRILIO_TYPE_TRANSPORT)
+
+#define PARENT_CLASS grilio_transport_shm_parent_class
+#define GRILIO_TYPE_TRANSPORT_SHM (grilio_transport_shm_get_type())
+#define GRILIO_TRANSPORT_SHM(obj) \
+    G_TYPE_CHECK_INSTANCE_CAST((obj), GRILIO_TYPE_TRANSPORT_SHM, \
+    GRilIoTransportShm)
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+grilio_transport_shm_shutdown_io(
+    GRilIoTransportShm* self)
+{
+    /* The memory stays mapped until the object is finalized */
+    if (self->fd_watch_id) {
+        g_source_remove(self->fd_watch_id);
+        self->fd_watch_id = 0;
+    }
+    if (self->event_watch_id) {
+        g_source_remove(self->event_watch_id);
+        self->event_watch_id = 0;
+    }
+    if (self->fd >= 0) {
+        /* Make sure that the other side notices */
+        shutdown(self->fd, SHUT_RDWR);
+        if (self->can_close) {
+            close(self->fd);
+        }
+        self->fd = -1;
+    }
+    if (self->send_req) {
+        grilio_request_unref(self->send_req);
+        self->send_req = NULL;
+    }
+}
+
+static
+gboolean
+grilio_transport_shm_write(
+    GRilIoTransportShm* self,
+    GRilIoRequest* req,
+    guint code)
+{
+    guint32 header[2];
+    struct iovec iov[2];
+
+    header[0] = GUINT32_TO_RIL(code);
+    header[1] = GUINT32_TO_RIL(grilio_request_serial(req));
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void*)grilio_request_data(req);
+    iov[1].iov_len = grilio_request_size(req);
+    return grilio_shm_write(self->shm, iov, 2);
+}
+
+static
+void
+grilio_transport_shm_handle_read_error(
+    GRilIoTransportShm* self,
+    GError* error)
+{
+    GRilIoTransport* transport = &self->parent;
+
+    GERR("%sread failed: %s", transport->log_prefix, GERRMSG(error));
+    grilio_transport_shutdown(transport, FALSE);
+    grilio_transport_signal_read_error(transport, error);
+    g_error_free(error);
+}
+
+static
+void
+grilio_transport_shm_read(
+    GRilIoTransportShm* self)
+{
+    do {
+        GError* error = NULL;
+        const void* packet;
+        guint len;
+
+        while ((packet = grilio_shm_peek(self->shm, &len, &error)) != NULL) {
+            const gboolean ok = grilio_transport_handle_packet(&self->parent,
+                packet, len, &error);
+
+            grilio_shm_pop(self->shm);
+            if (!ok) {
+                break;
+            } else if (self->fd < 0) {
+                /* Handler has shut us down */
+                return;
+            }
+        }
+        if (error) {
+            grilio_transport_shm_handle_read_error(self, error);
+            return;
+        }
+    } while (!grilio_shm_idle(self->shm));
+}
+
+static
+gboolean
+grilio_transport_shm_event_callback(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    GRilIoTransportShm* self = GRILIO_TRANSPORT_SHM(user_data);
+    GRilIoTransport* transport = &self->parent;
+    gboolean result;
+
+    g_object_ref(self);
+    grilio_shm_clear_event(self->shm);
+
+    /* There may be room for the pending request now */
+    if (self->send_req && grilio_transport_shm_write(self, self->send_req,
+        self->send_code)) {
+        GRilIoRequest* req = self->send_req;
+
+        self->send_req = NULL;
+        grilio_transport_signal_request_sent(transport, req);
+        grilio_request_unref(req);
+    }
+
+    if (self->fd >= 0) {
+        grilio_transport_shm_read(self);
+    }
+
+    /* The source is removed by grilio_transport_shm_shutdown_io */
+    result = self->event_watch_id ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+    g_object_unref(self);
+    return result;
+}
+
+static
+gboolean
+grilio_transport_shm_fd_callback(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    GRilIoTransportShm* self = GRILIO_TRANSPORT_SHM(user_data);
+    GRilIoTransport* transport = &self->parent;
+    char buf[16];
+    gssize n;
+
+    /* Nothing is supposed to arrive over the socket */
+    do {
+        n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    } while (n > 0 || (n < 0 && errno == EINTR));
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+        !(condition & (G_IO_HUP | G_IO_ERR))) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    GERR("%shangup", transport->log_prefix);
+
+    /* Zero source id to avoid removing it twice */
+    self->fd_watch_id = 0;
+    grilio_transport_shutdown(transport, FALSE);
+    return G_SOURCE_REMOVE;
+}
+
+/*==========================================================================*
+ * Methods
+ *==========================================================================*/
+
+static
+GRILIO_SEND_STATUS
+grilio_transport_shm_send(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    guint code)
+{
+    GRilIoTransportShm* self = GRILIO_TRANSPORT_SHM(transport);
+
+    GASSERT(!self->send_req);
+    if (!self->send_req && req && self->fd >= 0) {
+        const guint len = RIL_REQUEST_HEADER_SIZE + grilio_request_size(req);
+
+        if (len > grilio_shm_max_packet_len(self->shm)) {
+            GERR("%srequest too long (%u bytes)", transport->log_prefix, len);
+        } else if (grilio_transport_shm_write(self, req, code)) {
+            return GRILIO_SEND_OK;
+        } else {
+            /* The ring is full, wait for the consumer to wake us up */
+            self->send_req = grilio_request_ref(req);
+            self->send_code = code;
+            return GRILIO_SEND_PENDING;
+        }
+    }
+    return GRILIO_SEND_ERROR;
+}
+
+static
+void
+grilio_transport_shm_shutdown(
+    GRilIoTransport* transport,
+    gboolean flush)
+{
+    GRilIoTransportShm* self = GRILIO_TRANSPORT_SHM(transport);
+
+    grilio_transport_shm_shutdown_io(self);
+    grilio_transport_disconnected(&self->parent);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoTransport*
+grilio_transport_shm_new(
+    int fd,
+    const char* sub,
+    gboolean can_close)
+{
+    if (G_LIKELY(fd >= 0 && (!sub || strlen(sub) == RIL_SUB_LEN))) {
+        GError* error = NULL;
+        GRilIoShm* shm = grilio_shm_connect(fd, sub, &error);
+        const int flags = fcntl(fd, F_GETFL);
+
+        if (shm && flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0) {
+            GRilIoTransportShm* self = g_object_new
+                (GRILIO_TYPE_TRANSPORT_SHM, NULL);
+
+            self->fd = fd;
+            self->can_close = can_close;
+            self->shm = shm;
+            self->fd_watch_id = g_unix_fd_add_full(G_PRIORITY_DEFAULT, fd,
+                G_IO_IN | G_IO_HUP | G_IO_ERR,
+                grilio_transport_shm_fd_callback, self, NULL);
+            self->event_watch_id = g_unix_fd_add_full(G_PRIORITY_DEFAULT,
+                grilio_shm_event_fd(shm), G_IO_IN,
+                grilio_transport_shm_event_callback, self, NULL);
+            return &self->parent;
+        }
+        if (error) {
+            GERR("Shared memory handshake failed: %s", GERRMSG(error));
+            g_error_free(error);
+        } else {
+            GERR("Can't make fd %d non-blocking: %s", fd, strerror(errno));
+        }
+        grilio_shm_free(shm);
+    }
+    return NULL;
+}
+
+/*==========================================================================*
+ * Internals
+ *==========================================================================*/
+
+static
+void
+grilio_transport_shm_init(
+    GRilIoTransportShm* self)
+{
+    self->fd = -1;
+}
+
+static
+void
+grilio_transport_shm_finalize(
+    GObject* object)
+{
+    GRilIoTransportShm* self = GRILIO_TRANSPORT_SHM(object);
+
+    grilio_transport_shm_shutdown(&self->parent, FALSE);
+    grilio_shm_free(self->shm);
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
+static
+void
+grilio_transport_shm_class_init(
+    GRilIoTransportShmClass* klass)
+{
+    klass->send = grilio_transport_shm_send;
+    klass->shutdown = grilio_transport_shm_shutdown;
+    G_OBJECT_CLASS(klass)->finalize = grilio_transport_shm_finalize;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -31,8 +31,9 @@
  */
 
 #include "grilio_transport_impl.h"
+#include "grilio_transport_p.h"
+#include "grilio_buffer.h"
 #include "grilio_p.h"
-#include "grilio_parser.h"
 
 #define GLOG_MODULE_NAME grilio_transport_socket_log
 #include <gutil_log.h>
@@ -42,17 +43,25 @@
 #include <gio/gio.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 
 /* Log module */
 GLOG_MODULE_DEFINE2("grilio-socket", GRILIO_LOG_MODULE);
 
-/* This limit is more or less arbitrary */
-#define RIL_MAX_PACKET_LEN (0x8000)
+/* Larger packets (if allowed) are read and delivered in chunks */
+#define RIL_STREAM_CHUNK (0x4000)
 
-/* RIL constants */
-#define RIL_SUB_LEN (4)
-#define RIL_MIN_HEADER_SIZE RIL_ACK_HEADER_SIZE
+/* Initial size of the read-ahead buffer (grows as needed) */
+#define RIL_READ_AHEAD_SIZE (0x1000)
+
+/* Maximum number of buffers passed to a single writev() call */
+#define RIL_MAX_IOV (64)
+
+typedef struct grilio_transport_socket_packet {
+    GRilIoRequest* req;
+    guint32 header[3]; /* Including length */
+} GRilIoTransportSocketPacket;
 
 typedef GRilIoTransportClass GRilIoTransportSocketClass;
 typedef struct grilio_transport_socket {
@@ -60,27 +69,43 @@ typedef struct grilio_transport_socket {
     GIOChannel* io_channel;
     guint read_watch_id;
     guint write_watch_id;
-    guint write_error_id;
-    GError* write_error;
-    gboolean disconnected;
 
     /* Subscription */
     gchar sub[RIL_SUB_LEN];
     guint sub_pos;
 
-    /* Send */
-    guint8 send_header[RIL_REQUEST_HEADER_SIZE + 4]; /* Including length */
+    /* Send queue (header and data positions refer to the first packet) */
+    GRilIoTransportSocketPacket* send_queue;
+    guint send_queue_alloc;
+    guint send_count;
+    guint send_window;
     guint send_header_pos;
     guint send_pos;
-    GRilIoRequest* send_req;
 
     /* Receive */
     gchar read_len_buf[4];
     guint read_len_pos;
     guint read_len;
     guint read_buf_pos;
-    guint read_buf_alloc;
-    gchar* read_buf;
+    GRilIoBuffer* read_buf;
+    GRilIoBuffer* read_data_buf;
+    const gchar* read_data; /* Packet being handled */
+
+    /* Batched receive */
+    guint read_batch;
+    guint read_idle_id;
+    GRilIoBuffer* read_ahead;
+    gsize read_ahead_start;
+    gsize read_ahead_end;
+
+    /* Streamed receive */
+    guint stream_len;   /* Non-zero while streaming */
+    guint stream_pos;   /* Bytes delivered so far */
+    guint stream_fill;  /* Bytes waiting in stream_buf */
+    GRilIoBuffer* stream_buf;
+
+    /* I/O counters */
+    GRilIoTransportSocketStats stats;
 } GRilIoTransportSocket;
 
 G_DEFINE_TYPE(GRilIoTransportSocket, grilio_transport_socket,
@@ -91,6 +116,8 @@ G_DEFINE_TYPE(GRilIoTransportSocket, grilio_transport_socket,
 #define GRILIO_TRANSPORT_SOCKET(obj) \
     G_TYPE_CHECK_INSTANCE_CAST((obj), GRILIO_TYPE_TRANSPORT_SOCKET, \
     GRilIoTransportSocket)
+#define GRILIO_IS_TRANSPORT_SOCKET(obj) \
+    G_TYPE_CHECK_INSTANCE_TYPE((obj), GRILIO_TYPE_TRANSPORT_SOCKET)
 
 /*==========================================================================*
  * Implementation
@@ -106,6 +133,10 @@ grilio_transport_socket_shutdown_io(
         g_source_remove(self->read_watch_id);
         self->read_watch_id = 0;
     }
+    if (self->read_idle_id) {
+        g_source_remove(self->read_idle_id);
+        self->read_idle_id = 0;
+    }
     if (self->write_watch_id) {
         g_source_remove(self->write_watch_id);
         self->write_watch_id = 0;
@@ -117,20 +148,6 @@ grilio_transport_socket_shutdown_io(
     }
 }
 
-static
-void
-grilio_transport_socket_disconnected(
-    GRilIoTransportSocket* self)
-{
-    GRilIoTransport* transport = &self->parent;
-
-    transport->connected = FALSE;
-    if (!self->disconnected) {
-        self->disconnected = TRUE;
-        grilio_transport_signal_disconnected(transport);
-    }
-}
-
 /*==========================================================================*
  * Read
  *==========================================================================*/
@@ -172,175 +189,156 @@ grilio_transport_socket_handle_eof(
     grilio_transport_shutdown(transport, FALSE);
 }
 
-static
-void
-grilio_transport_socket_signal_response(
-    GRilIoTransportSocket* self,
-    GRILIO_RESPONSE_TYPE type)
-{
-    const guint32* buf = (guint32*)self->read_buf;
-    const uint offset = RIL_RESPONSE_HEADER_SIZE;
-
-    grilio_transport_signal_response(&self->parent, type,
-        GUINT32_FROM_RIL(buf[1]) /* id */,
-        GUINT32_FROM_RIL(buf[2]) /* status */,
-        self->read_buf + offset,
-        self->read_len - offset);
-}
-
-static
 gboolean
-grilio_transport_socket_handle_solicited(
+grilio_transport_socket_handle_packet(
     GRilIoTransportSocket* self)
 {
-    if (self->read_len >= RIL_RESPONSE_HEADER_SIZE) {
-        grilio_transport_socket_signal_response(self,
-            GRILIO_RESPONSE_SOLICITED);
+    GError* error = NULL;
+
+    self->stats.read_packets++;
+    if (grilio_transport_handle_packet_buffer(&self->parent,
+        self->read_data_buf, self->read_data, self->read_len, &error)) {
         return TRUE;
     } else {
-        grilio_transport_socket_handle_read_error(self,
-            g_error_new(G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
-                "Response too short (%u bytes)", self->read_len));
+        grilio_transport_socket_handle_read_error(self, error);
         return FALSE;
     }
 }
 
 static
 gboolean
-grilio_transport_socket_handle_solicited_ack(
-    GRilIoTransportSocket* self)
+grilio_transport_socket_read_chars(
+    GRilIoTransportSocket* self,
+    gchar* buf,
+    gsize count,
+    gsize* bytes_read)
 {
-    const guint32* buf = (guint32*)self->read_buf;
+    GError* error = NULL;
+    GIOStatus status = g_io_channel_read_chars(self->io_channel, buf,
+        count, bytes_read, &error);
 
-    grilio_transport_signal_response(&self->parent,
-        GRILIO_RESPONSE_SOLICITED_ACK,
-        GUINT32_FROM_RIL(buf[1]),
-        RIL_E_SUCCESS, NULL, 0);
-    return TRUE;
+    /* The channel is unbuffered, each call is a read() */
+    self->stats.read_calls++;
+    self->stats.read_bytes += *bytes_read;
+    if (status == G_IO_STATUS_AGAIN) {
+        self->stats.read_eagain++;
+    }
+    if (error) {
+        grilio_transport_socket_handle_read_error(self, error);
+        return FALSE;
+    } else if (status == G_IO_STATUS_EOF) {
+        grilio_transport_socket_handle_eof(self);
+        return FALSE;
+    } else {
+        return TRUE;
+    }
 }
 
 static
 gboolean
-grilio_transport_socket_handle_solicited_ack_exp(
-    GRilIoTransportSocket* self)
+grilio_transport_socket_stream_start(
+    GRilIoTransportSocket* self,
+    guint len)
 {
-    if (self->read_len >= RIL_RESPONSE_HEADER_SIZE) {
-        grilio_transport_socket_signal_response(self,
-            GRILIO_RESPONSE_SOLICITED_ACK_EXP);
-        return TRUE;
-    } else {
+    if (len > grilio_transport_max_packet_len(&self->parent)) {
+        /* Message is too long or stream is broken */
         grilio_transport_socket_handle_read_error(self,
             g_error_new(G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
-                "Response too short (%u bytes)", self->read_len));
+                "Packet too long (%u bytes)", len));
         return FALSE;
+    } else {
+        GDEBUG("%sstreaming %u bytes", self->parent.log_prefix, len);
+        self->stats.read_packets++;
+        self->stream_len = len;
+        self->stream_pos = 0;
+        self->stream_fill = 0;
+        self->stream_buf = grilio_buffer_reserve(self->stream_buf,
+            NULL, NULL, RIL_STREAM_CHUNK);
+        return TRUE;
     }
 }
 
 static
-void
-grilio_transport_socket_connected(
+gboolean
+grilio_transport_socket_stream_flush(
     GRilIoTransportSocket* self)
 {
-    GRilIoTransport* transport = &self->parent;
-    GRilIoParser parser;
-    const guint off = RIL_UNSOL_HEADER_SIZE;
-    guint num = 0;
-
-    GASSERT(!transport->connected);
-    grilio_parser_init(&parser, self->read_buf + off, self->read_len - off);
-    if (grilio_parser_get_uint32(&parser, &num) && num == 1 &&
-        grilio_parser_get_uint32(&parser, &transport->ril_version)) {
-        GDEBUG("Connected, RIL version %u", transport->ril_version);
-        transport->connected = TRUE;
-        grilio_transport_signal_connected(transport);
+    const guint offset = self->stream_pos;
+    const guint total = self->stream_len;
+    const guint len = self->stream_fill;
+    GError* error = NULL;
+
+    self->stream_pos += len;
+    self->stream_fill = 0;
+    if (self->stream_pos == total) {
+        /* Done with this one */
+        self->stream_len = 0;
+    }
+    if (grilio_transport_handle_fragment(&self->parent, offset, total,
+        GRILIO_BUFFER_DATA(self->stream_buf), len, &error)) {
+        if (!self->stream_len) {
+            grilio_buffer_unref(self->stream_buf);
+            self->stream_buf = NULL;
+        }
+        return TRUE;
     } else {
-        /* Terminate the connection? */
-        GERR("Failed to parse RIL_UNSOL_RIL_CONNECTED");
+        grilio_transport_socket_handle_read_error(self, error);
+        return FALSE;
     }
 }
 
 static
-void
-grilio_transport_socket_handle_indication(
-    GRilIoTransportSocket* self,
-    GRILIO_INDICATION_TYPE type)
+gsize
+grilio_transport_socket_stream_space(
+    GRilIoTransportSocket* self)
 {
-    /* The caller has checked the length */
-    const guint32* buf = (guint32*)self->read_buf;
-    const guint32 code = GUINT32_FROM_RIL(buf[1]);
-    const uint offset = RIL_UNSOL_HEADER_SIZE;
-
-    grilio_transport_signal_indication(&self->parent, type, code,
-        self->read_buf + offset, self->read_len - offset);
-
-    /* Handle RIL_UNSOL_RIL_CONNECTED */
-    if (code == RIL_UNSOL_RIL_CONNECTED) {
-        grilio_transport_socket_connected(self);
-    }
+    return MIN(RIL_STREAM_CHUNK - self->stream_fill,
+        self->stream_len - self->stream_pos - self->stream_fill);
 }
 
+static
 gboolean
-grilio_transport_socket_handle_packet(
-    GRilIoTransportSocket* self)
+grilio_transport_socket_stream_feed(
+    GRilIoTransportSocket* self,
+    const gchar* data,
+    gsize len)
 {
-    if (self->read_len >= RIL_MIN_HEADER_SIZE) {
-        const guint32* buf = (guint32*)self->read_buf;
-        const RIL_PACKET_TYPE type = GUINT32_FROM_RIL(buf[0]);
-
-        switch (type) {
-        case RIL_PACKET_TYPE_SOLICITED:
-            return grilio_transport_socket_handle_solicited(self);
-        case RIL_PACKET_TYPE_SOLICITED_ACK:
-            return grilio_transport_socket_handle_solicited_ack(self);
-        case RIL_PACKET_TYPE_SOLICITED_ACK_EXP:
-            return grilio_transport_socket_handle_solicited_ack_exp(self);
-        case RIL_PACKET_TYPE_UNSOLICITED:
-            grilio_transport_socket_handle_indication(self,
-                GRILIO_INDICATION_UNSOLICITED);
-           return TRUE;
-        case RIL_PACKET_TYPE_UNSOLICITED_ACK_EXP:
-            grilio_transport_socket_handle_indication(self,
-                GRILIO_INDICATION_UNSOLICITED_ACK_EXP);
-           return TRUE;
-        default:
-            /* Ignore unknown packets */
-            GWARN("Unexpected packet type id %d", type);
-            return TRUE;
+    while (len > 0) {
+        const gsize n = MIN(len, grilio_transport_socket_stream_space(self));
+
+        memcpy(GRILIO_BUFFER_DATA(self->stream_buf) + self->stream_fill,
+            data, n);
+        self->stream_fill += n;
+        data += n;
+        len -= n;
+        if (!grilio_transport_socket_stream_space(self) &&
+            !grilio_transport_socket_stream_flush(self)) {
+            return FALSE;
         }
-    } else {
-        grilio_transport_socket_handle_read_error(self,
-            g_error_new(G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
-                "Packet too short (%u bytes)", self->read_len));
-        return FALSE;
     }
+    return TRUE;
 }
 
 static
 gboolean
-grilio_transport_socket_read_chars(
-    GRilIoTransportSocket* self,
-    gchar* buf,
-    gsize count,
-    gsize* bytes_read)
+grilio_transport_socket_read_stream(
+    GRilIoTransportSocket* self)
 {
-    GError* error = NULL;
-    GIOStatus status = g_io_channel_read_chars(self->io_channel, buf,
-        count, bytes_read, &error);
+    gsize bytes_read;
 
-    if (error) {
-        grilio_transport_socket_handle_read_error(self, error);
+    if (!grilio_transport_socket_read_chars(self,
+        GRILIO_BUFFER_DATA(self->stream_buf) + self->stream_fill,
+        grilio_transport_socket_stream_space(self), &bytes_read)) {
         return FALSE;
-    } else if (status == G_IO_STATUS_EOF) {
-        grilio_transport_socket_handle_eof(self);
-        return FALSE;
-    } else {
-        return TRUE;
     }
+    self->stream_fill += bytes_read;
+    return grilio_transport_socket_stream_space(self) ||
+        grilio_transport_socket_stream_flush(self);
 }
 
 static
 gboolean
-grilio_transport_socket_read(
+grilio_transport_socket_read_packet(
     GRilIoTransportSocket* self)
 {
     gsize bytes_read;
@@ -361,19 +359,21 @@ grilio_transport_socket_read(
             /* We have finished reading the length (in Big Endian) */
             const guint32* len = (guint32*)self->read_len_buf;
             self->read_len = GUINT32_FROM_BE(*len);
-            GASSERT(self->read_len <= RIL_MAX_PACKET_LEN);
-            if (self->read_len <= RIL_MAX_PACKET_LEN) {
+            if (self->read_len <= MIN(RIL_MAX_PACKET_LEN,
+                grilio_transport_max_packet_len(&self->parent))) {
                 /* Reset buffer read position */
                 self->read_buf_pos = 0;
-                /* Allocate enough space for the entire packet */
-                if (self->read_buf_alloc < self->read_len) {
-                    g_free(self->read_buf);
-                    self->read_buf_alloc = self->read_len;
-                    self->read_buf = g_malloc(self->read_buf_alloc);
-                }
+                /*
+                 * Allocate enough space for the entire packet. Don't
+                 * overwrite the buffer if it's still referenced.
+                 */
+                self->read_buf = grilio_buffer_reserve(self->read_buf,
+                    NULL, NULL, MAX(self->read_len, RIL_READ_AHEAD_SIZE));
             } else {
-                /* Message is too long or stream is broken */
-                return FALSE;
+                /* Too large to be buffered, the rest is streamed */
+                self->read_len_pos = 0;
+                return grilio_transport_socket_stream_start(self,
+                    self->read_len);
             }
         }
     }
@@ -381,7 +381,7 @@ grilio_transport_socket_read(
     /* Packet body */
     if (self->read_buf_pos < self->read_len) {
         if (!grilio_transport_socket_read_chars(self,
-            self->read_buf + self->read_buf_pos,
+            GRILIO_BUFFER_DATA(self->read_buf) + self->read_buf_pos,
             self->read_len - self->read_buf_pos, &bytes_read)) {
             return FALSE;
         }
@@ -398,9 +398,220 @@ grilio_transport_socket_read(
     self->read_len_pos = 0;
 
     /* We have finished reading the entire packet */
+    self->read_data = GRILIO_BUFFER_DATA(self->read_buf);
+    self->read_data_buf = self->read_buf;
     return grilio_transport_socket_handle_packet(self);
 }
 
+static
+void
+grilio_transport_socket_read_ahead_prepare(
+    GRilIoTransportSocket* self,
+    gsize need)
+{
+    /*
+     * Move the unhandled data to the beginning of the buffer which can
+     * hold at least need bytes. Switch to another buffer if this one is
+     * too small (or too large) or is still referenced by someone else.
+     */
+    self->read_ahead = grilio_buffer_reserve(self->read_ahead,
+        &self->read_ahead_start, &self->read_ahead_end,
+        MAX(need, RIL_READ_AHEAD_SIZE));
+}
+
+static
+gboolean
+grilio_transport_socket_batch_has_packet(
+    GRilIoTransportSocket* self)
+{
+    const gsize avail = self->read_ahead_end - self->read_ahead_start;
+
+    if (avail >= 4) {
+        guint32 len;
+
+        memcpy(&len, GRILIO_BUFFER_DATA(self->read_ahead) +
+            self->read_ahead_start, 4);
+        len = GUINT32_FROM_BE(len);
+
+        /* Oversized packet gets streamed by the next dispatch */
+        return len > MIN(RIL_MAX_PACKET_LEN,
+            grilio_transport_max_packet_len(&self->parent)) ||
+            (avail - 4) >= len;
+    }
+    return FALSE;
+}
+
+static
+gboolean
+grilio_transport_socket_batch_dispatch(
+    GRilIoTransportSocket* self,
+    guint* budget)
+{
+    while (*budget > 0 && self->io_channel) {
+        const gsize avail = self->read_ahead_end - self->read_ahead_start;
+        guint32 len;
+
+        if (avail < 4) {
+            /* Need more bytes */
+            break;
+        }
+
+        memcpy(&len, GRILIO_BUFFER_DATA(self->read_ahead) +
+            self->read_ahead_start, 4);
+        len = GUINT32_FROM_BE(len);
+        if (len > MIN(RIL_MAX_PACKET_LEN,
+            grilio_transport_max_packet_len(&self->parent))) {
+            /* Too large to be buffered, stream what we have so far */
+            const gsize n = MIN(avail - 4, len);
+
+            self->read_ahead_start += 4;
+            if (!grilio_transport_socket_stream_start(self, len) ||
+                !grilio_transport_socket_stream_feed(self,
+                GRILIO_BUFFER_DATA(self->read_ahead) +
+                self->read_ahead_start, n)) {
+                return FALSE;
+            }
+            self->read_ahead_start += n;
+            if (self->stream_len) {
+                /* The rest will be read directly from the socket */
+                break;
+            }
+            continue;
+        } else if ((avail - 4) < len) {
+            /* Need more bytes */
+            break;
+        }
+
+        /* Packet handlers expect the data to be properly aligned */
+        if ((self->read_ahead_start + 4) & 3) {
+            grilio_transport_socket_read_ahead_prepare(self, avail);
+        }
+
+        self->read_data = GRILIO_BUFFER_DATA(self->read_ahead) +
+            self->read_ahead_start + 4;
+        self->read_data_buf = self->read_ahead;
+        self->read_len = len;
+        self->read_ahead_start += len + 4;
+        (*budget)--;
+        if (!grilio_transport_socket_handle_packet(self)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static
+gboolean
+grilio_transport_socket_read_idle_cb(
+    gpointer user_data)
+{
+    gboolean result = G_SOURCE_REMOVE;
+    GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(user_data);
+    const guint read_watch_id = self->read_watch_id;
+    guint budget = MAX(self->read_batch, 1);
+
+    g_object_ref(self);
+    if (grilio_transport_socket_batch_dispatch(self, &budget)) {
+        if (self->read_idle_id &&
+            grilio_transport_socket_batch_has_packet(self)) {
+            /* Still have something to dispatch */
+            result = G_SOURCE_CONTINUE;
+        }
+    } else if (read_watch_id) {
+        /*
+         * grilio_transport_socket_handle_read_error has zeroed the
+         * watch id assuming that it's being invoked by the watch itself,
+         * which is not the case here.
+         */
+        g_source_remove(read_watch_id);
+    }
+    if (result == G_SOURCE_REMOVE) {
+        self->read_idle_id = 0;
+    }
+    g_object_unref(self);
+    return result;
+}
+
+static
+void
+grilio_transport_socket_batch_schedule(
+    GRilIoTransportSocket* self)
+{
+    if (!self->read_idle_id && self->io_channel &&
+        grilio_transport_socket_batch_has_packet(self)) {
+        /* Finish the rest on a fresh stack */
+        self->read_idle_id = g_idle_add(grilio_transport_socket_read_idle_cb,
+            self);
+    }
+}
+
+static
+gboolean
+grilio_transport_socket_read_batch(
+    GRilIoTransportSocket* self)
+{
+    guint budget = MAX(self->read_batch, 1);
+    gsize avail, need, bytes_read;
+
+    /* First dispatch what's been left from the previous read */
+    if (!grilio_transport_socket_batch_dispatch(self, &budget)) {
+        return FALSE;
+    } else if (!budget || !self->io_channel || self->stream_len) {
+        grilio_transport_socket_batch_schedule(self);
+        return TRUE;
+    }
+
+    /* Whatever is left in the buffer is a part of the packet */
+    avail = self->read_ahead_end - self->read_ahead_start;
+    if (avail >= 4) {
+        guint32 len;
+
+        memcpy(&len, GRILIO_BUFFER_DATA(self->read_ahead) +
+            self->read_ahead_start, 4);
+        need = MAX(GUINT32_FROM_BE(len) + 4, RIL_READ_AHEAD_SIZE);
+    } else {
+        need = RIL_READ_AHEAD_SIZE;
+    }
+
+    /* Make sure that the entire packet fits */
+    grilio_transport_socket_read_ahead_prepare(self, need);
+    if (!grilio_transport_socket_read_chars(self,
+        GRILIO_BUFFER_DATA(self->read_ahead) + self->read_ahead_end,
+        self->read_ahead->size - self->read_ahead_end, &bytes_read)) {
+        return FALSE;
+    }
+
+    self->read_ahead_end += bytes_read;
+    GASSERT(self->read_ahead_end <= self->read_ahead->size);
+    if (!grilio_transport_socket_batch_dispatch(self, &budget)) {
+        return FALSE;
+    }
+
+    grilio_transport_socket_batch_schedule(self);
+    return TRUE;
+}
+
+static
+gboolean
+grilio_transport_socket_read(
+    GRilIoTransportSocket* self)
+{
+    /*
+     * Switching between the modes only happens at the packet boundary.
+     * Non-zero read_len_pos means that we are in the middle of reading
+     * the packet one by one, and anything left in the read-ahead buffer
+     * has to be dispatched first.
+     */
+    if (self->stream_len) {
+        return grilio_transport_socket_read_stream(self);
+    } else if (self->read_ahead_start < self->read_ahead_end ||
+        (self->read_batch && !self->read_len_pos)) {
+        return grilio_transport_socket_read_batch(self);
+    } else {
+        return grilio_transport_socket_read_packet(self);
+    }
+}
+
 static
 gboolean
 grilio_transport_socket_read_callback(
@@ -410,6 +621,8 @@ grilio_transport_socket_read_callback(
 {
     gboolean result;
     GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(user_data);
+    const guint64 packets = self->stats.read_packets;
+    guint backlog;
 
     g_object_ref(self);
     if ((condition & G_IO_IN) && grilio_transport_socket_read(self)) {
@@ -418,6 +631,10 @@ grilio_transport_socket_read_callback(
         self->read_watch_id = 0;
         result = G_SOURCE_REMOVE;
     }
+    backlog = (guint)(self->stats.read_packets - packets);
+    if (self->stats.max_read_backlog < backlog) {
+        self->stats.max_read_backlog = backlog;
+    }
     g_object_unref(self);
     return result;
 }
@@ -426,34 +643,12 @@ grilio_transport_socket_read_callback(
  * Write
  *==========================================================================*/
 
-static
-gboolean
-grilio_transport_socket_write_error_cb(
-    gpointer user_data)
-{
-    GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(user_data);
-    GRilIoTransport* transport = &self->parent;
-    GError* error = self->write_error;
-
-    GASSERT(self->write_error_id);
-    self->write_error_id = 0;
-    self->write_error = NULL;
-    grilio_transport_signal_write_error(transport, error);
-    grilio_transport_socket_disconnected(self);
-    g_error_free(error);
-    return G_SOURCE_REMOVE;
-}
-
 static
 void
 grilio_transport_socket_handle_write_error(
     GRilIoTransportSocket* self,
     GError* error)
 {
-    GRilIoTransport* transport = &self->parent;
-
-    GERR("%swrite failed: %s", transport->log_prefix, GERRMSG(error));
-
     /*
      * Zero watch id to avoid removing it twice. This one is going
      * to be freed when we return FALSE from the callback.
@@ -462,41 +657,49 @@ grilio_transport_socket_handle_write_error(
 
     /* Don't emit DISCONNECTED signal just yet */
     grilio_transport_socket_shutdown_io(self, FALSE);
-
-    /*
-     * It's dangerous to emit write error signal right away. The signal
-     * handler may release the last reference to the caller. We should
-     * emit the signal on a fresh stack
-     */
-    if (self->write_error) {
-        g_error_free(self->write_error);
-    }
-
-    /* grilio_transport_socket_handle_write_error_cb will free the error */
-    self->write_error = error;
-    if (!self->write_error_id) {
-        self->write_error_id = g_idle_add
-            (grilio_transport_socket_write_error_cb, self);
-    }
+    grilio_transport_handle_write_error(&self->parent, error);
 }
 
 static
 gboolean
-grilio_transport_socket_write_chars(
+grilio_transport_socket_writev(
     GRilIoTransportSocket* self,
-    const void* buf,
-    gssize count,
+    const struct iovec* iov,
+    int iovcnt,
     gsize* bytes_written,
     GError** error)
 {
-    const GIOStatus status = g_io_channel_write_chars(self->io_channel,
-        buf, count, bytes_written, error);
+    const int fd = g_io_channel_unix_get_fd(self->io_channel);
+    GRilIoTransportSocketStats* stats = &self->stats;
+    gsize total = 0;
+    int i;
 
-    if (status == G_IO_STATUS_NORMAL || status == G_IO_STATUS_AGAIN) {
-        return TRUE;
-    } else {
-        GASSERT(*error);
-        return FALSE;
+    for (i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+
+    for (;;) {
+        const gssize written = writev(fd, iov, iovcnt);
+
+        stats->write_calls++;
+        if (written >= 0) {
+            *bytes_written = written;
+            stats->write_bytes += written;
+            if ((gsize)written < total) {
+                stats->write_partial++;
+            }
+            return TRUE;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            *bytes_written = 0;
+            stats->write_eagain++;
+            return TRUE;
+        } else if (errno != EINTR) {
+            const int err = errno;
+
+            g_set_error_literal(error, G_IO_ERROR, g_io_error_from_errno(err),
+                g_strerror(err));
+            return FALSE;
+        }
     }
 }
 
@@ -504,23 +707,59 @@ static
 gboolean
 grilio_transport_socket_write(
     GRilIoTransportSocket* self,
+    guint* sent,
     GError** error)
 {
     GRilIoTransport* transport = &self->parent;
-    GRilIoRequest* req = self->send_req;
-    guint datalen;
+    const gboolean subscribed = (self->sub_pos >= RIL_SUB_LEN);
+    struct iovec iov[RIL_MAX_IOV];
+    gsize bytes_written = 0;
+    int n = 0;
+
+    /* Subscription and as many queued packets as we can in one go */
+    *sent = 0;
+    if (!subscribed) {
+        iov[n].iov_base = self->sub + self->sub_pos;
+        iov[n].iov_len = RIL_SUB_LEN - self->sub_pos;
+        n++;
+    }
 
-    if (self->sub_pos < RIL_SUB_LEN) {
-        gsize bytes_written = 0;
+    if (transport->connected) {
+        guint header_pos = self->send_header_pos;
+        guint send_pos = self->send_pos;
+        guint i;
 
-        if (!grilio_transport_socket_write_chars(self,
-            self->sub + self->sub_pos,
-            RIL_SUB_LEN - self->sub_pos,
-            &bytes_written, error)) {
-            return FALSE;
+        if (self->stats.max_write_backlog < self->send_count) {
+            self->stats.max_write_backlog = self->send_count;
         }
-        self->sub_pos += bytes_written;
-        GASSERT(self->sub_pos <= RIL_SUB_LEN);
+        for (i = 0; i < self->send_count && (n + 2) <= RIL_MAX_IOV; i++) {
+            GRilIoTransportSocketPacket* packet = self->send_queue + i;
+            GRilIoRequest* req = packet->req;
+            const guint datalen = grilio_request_size(req);
+
+            if (header_pos < sizeof(packet->header)) {
+                iov[n].iov_base = ((guint8*)packet->header) + header_pos;
+                iov[n].iov_len = sizeof(packet->header) - header_pos;
+                n++;
+            }
+            if (send_pos < datalen) {
+                iov[n].iov_base = req->bytes->data + send_pos;
+                iov[n].iov_len = datalen - send_pos;
+                n++;
+            }
+            header_pos = send_pos = 0;
+        }
+    }
+
+    if (n > 0 && !grilio_transport_socket_writev(self, iov, n,
+        &bytes_written, error)) {
+        return FALSE;
+    }
+
+    /* Figure out where we are */
+    if (!subscribed) {
+        bytes_written = grilio_transport_advance(&self->sub_pos,
+            RIL_SUB_LEN, bytes_written);
         if (self->sub_pos < RIL_SUB_LEN) {
             /* Will have to wait */
             return TRUE;
@@ -534,53 +773,52 @@ grilio_transport_socket_write(
         return FALSE;
     }
 
-    if (!req) {
+    if (!self->send_count) {
         /* There is nothing to send, remove the watch */
         GVERBOSE("%shas nothing to send", transport->log_prefix);
         return FALSE;
     }
 
-    /* Send the header */
-    if (self->send_header_pos < sizeof(self->send_header)) {
-        gsize bytes_written = 0;
+    while (*sent < self->send_count) {
+        GRilIoTransportSocketPacket* packet = self->send_queue + (*sent);
+        const guint datalen = grilio_request_size(packet->req);
 
-        if (!grilio_transport_socket_write_chars(self,
-            self->send_header + self->send_header_pos,
-            sizeof(self->send_header) - self->send_header_pos,
-            &bytes_written, error)) {
-            return FALSE;
-        }
-        self->send_header_pos += bytes_written;
-        GASSERT(self->send_header_pos <= sizeof(self->send_header));
-        if (self->send_header_pos < sizeof(self->send_header)) {
+        bytes_written = grilio_transport_advance
+            (&self->send_header_pos, sizeof(packet->header), bytes_written);
+        bytes_written = grilio_transport_advance
+            (&self->send_pos, datalen, bytes_written);
+        if (self->send_header_pos < sizeof(packet->header) ||
+            self->send_pos < datalen) {
             /* Will have to wait */
-            return TRUE;
+            break;
         }
+
+        /* This one has been sent, move on to the next one */
+        self->send_header_pos = self->send_pos = 0;
+        self->stats.write_packets++;
+        (*sent)++;
     }
+    GASSERT(!bytes_written);
+    return TRUE;
+}
 
-    /* Send the data */
-    datalen = grilio_request_size(req);
-    if (self->send_pos < datalen) {
-        gsize bytes_written = 0;
+static
+void
+grilio_transport_socket_dequeue(
+    GRilIoTransportSocket* self,
+    GRilIoRequest** reqs,
+    guint count)
+{
+    guint i;
 
-        if (!grilio_transport_socket_write_chars(self,
-            req->bytes->data + self->send_pos,
-            datalen - self->send_pos,
-            &bytes_written, error)) {
-            return FALSE;
-        }
-        self->send_pos += bytes_written;
-        GASSERT(self->send_pos <= datalen);
-        if (self->send_pos < datalen) {
-            /* Will have to wait */
-            return TRUE;
-        }
+    /* The caller takes over the references */
+    GASSERT(count <= self->send_count);
+    for (i = 0; i < count; i++) {
+        reqs[i] = self->send_queue[i].req;
     }
-
-    /* The request has been sent */
-    grilio_request_unref(req);
-    self->send_req = NULL;
-    return TRUE;
+    self->send_count -= count;
+    memmove(self->send_queue, self->send_queue + count,
+        sizeof(self->send_queue[0]) * self->send_count);
 }
 
 static
@@ -597,18 +835,24 @@ grilio_transport_socket_write_callback(
     g_object_ref(self);
     if (condition & G_IO_OUT) {
         GRilIoTransport* transport = &self->parent;
-        GRilIoRequest* req = grilio_request_ref(self->send_req);
+        guint sent;
+
+        if (grilio_transport_socket_write(self, &sent, &error)) {
+            GRilIoRequest* reqs[RIL_MAX_IOV];
+            guint i;
 
-        if (grilio_transport_socket_write(self, &error)) {
-            if (self->send_req) {
-                /* We have successfully written part of the packet */
-                GASSERT(self->send_req == req);
+            /* Signal handlers may queue more requests */
+            grilio_transport_socket_dequeue(self, reqs, sent);
+            for (i = 0; i < sent; i++) {
+                grilio_transport_signal_request_sent(transport, reqs[i]);
+                grilio_request_unref(reqs[i]);
+            }
+            if (self->write_watch_id && (self->send_count ||
+                self->sub_pos < RIL_SUB_LEN)) {
+                /* We have successfully written part of the data */
                 result = G_SOURCE_CONTINUE;
-            } else if (req) {
-                grilio_transport_signal_request_sent(transport, req);
             }
         }
-        grilio_request_unref(req);
     }
     if (result == G_SOURCE_REMOVE) {
         self->write_watch_id = 0;
@@ -633,36 +877,49 @@ grilio_transport_socket_send(
 {
     GRILIO_SEND_STATUS status = GRILIO_SEND_ERROR;
     GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(transport);
+    const guint window = MAX(self->send_window, 1);
 
-    GASSERT(!self->send_req);
-    if (!self->send_req && req && self->io_channel) {
+    GASSERT(self->send_count < window);
+    if (self->send_count < window && req && self->io_channel) {
         GError* error = NULL;
-        guint32* header = (guint32*)self->send_header;
+        GRilIoTransportSocketPacket* packet;
         const guint datalen = grilio_request_size(req);
         const guint serial = grilio_request_serial(req);
+        guint sent = 0;
 
-        /* Length includes the header excluding the length iteslf */
-        header[0] = GINT32_TO_BE(datalen + RIL_REQUEST_HEADER_SIZE);
-        header[1] = GUINT32_TO_RIL(code);
-        header[2] = GUINT32_TO_RIL(serial);
-
-        self->send_req = grilio_request_ref(req);
-        self->send_header_pos = 0;
-        self->send_pos = 0;
+        if (self->send_queue_alloc <= self->send_count) {
+            self->send_queue_alloc = window;
+            self->send_queue = g_renew(GRilIoTransportSocketPacket,
+                self->send_queue, self->send_queue_alloc);
+        }
 
-        if (grilio_transport_socket_write(self, &error)) {
-            if (!self->send_req) {
+        /* Length includes the header excluding the length iteslf */
+        packet = self->send_queue + (self->send_count++);
+        packet->req = grilio_request_ref(req);
+        packet->header[0] = GINT32_TO_BE(datalen + RIL_REQUEST_HEADER_SIZE);
+        packet->header[1] = GUINT32_TO_RIL(code);
+        packet->header[2] = GUINT32_TO_RIL(serial);
+
+        if (self->send_count > 1) {
+            /* Will be written together with the ones queued earlier */
+            status = GRILIO_SEND_PENDING;
+        } else if (grilio_transport_socket_write(self, &sent, &error)) {
+            if (sent) {
+                GRilIoRequest* done;
+
+                GASSERT(sent == 1);
+                grilio_transport_socket_dequeue(self, &done, 1);
+                grilio_request_unref(done);
                 status = GRILIO_SEND_OK;
             } else {
                 status = GRILIO_SEND_PENDING;
-                if (!self->write_watch_id) {
-                    GVERBOSE("%sscheduling write", transport->log_prefix);
-                    self->write_watch_id = g_io_add_watch(self->io_channel,
-                        G_IO_OUT, grilio_transport_socket_write_callback,
-                        self);
-                }
             }
         }
+        if (status == GRILIO_SEND_PENDING && !self->write_watch_id) {
+            GVERBOSE("%sscheduling write", transport->log_prefix);
+            self->write_watch_id = g_io_add_watch(self->io_channel,
+                G_IO_OUT, grilio_transport_socket_write_callback, self);
+        }
         if (error) {
             grilio_transport_socket_handle_write_error(self, error);
         }
@@ -670,6 +927,14 @@ grilio_transport_socket_send(
     return status;
 }
 
+static
+guint
+grilio_transport_socket_send_window(
+    GRilIoTransport* transport)
+{
+    return MAX(GRILIO_TRANSPORT_SOCKET(transport)->send_window, 1);
+}
+
 static
 void
 grilio_transport_socket_shutdown(
@@ -679,7 +944,7 @@ grilio_transport_socket_shutdown(
     GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(transport);
 
     grilio_transport_socket_shutdown_io(self, flush);
-    grilio_transport_socket_disconnected(self);
+    grilio_transport_disconnected(&self->parent);
 }
 
 /*==========================================================================*
@@ -751,6 +1016,128 @@ grilio_transport_socket_new_path(
     return NULL;
 }
 
+void
+grilio_transport_socket_set_read_batch(
+    GRilIoTransport* transport,
+    guint max_packets)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_SOCKET(transport))) {
+        GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(transport);
+
+        self->read_batch = max_packets;
+    }
+}
+
+void
+grilio_transport_socket_set_max_packet_len(
+    GRilIoTransport* transport,
+    guint max_len)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_SOCKET(transport))) {
+        grilio_transport_set_max_packet_len(transport, max_len);
+    }
+}
+
+void
+grilio_transport_socket_set_send_window(
+    GRilIoTransport* transport,
+    guint window)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_SOCKET(transport))) {
+        GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(transport);
+
+        self->send_window = window;
+    }
+}
+
+gboolean
+grilio_transport_socket_set_buffer_size(
+    GRilIoTransport* transport,
+    int rcvbuf,
+    int sndbuf)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_SOCKET(transport))) {
+        GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(transport);
+
+        if (self->io_channel) {
+            const int fd = g_io_channel_unix_get_fd(self->io_channel);
+            gboolean ok = TRUE;
+
+            if (rcvbuf > 0 && setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+                &rcvbuf, sizeof(rcvbuf)) < 0) {
+                GWARN("%sSO_RCVBUF %d failed: %s", transport->log_prefix,
+                    rcvbuf, strerror(errno));
+                ok = FALSE;
+            }
+            if (sndbuf > 0 && setsockopt(fd, SOL_SOCKET, SO_SNDBUF,
+                &sndbuf, sizeof(sndbuf)) < 0) {
+                GWARN("%sSO_SNDBUF %d failed: %s", transport->log_prefix,
+                    sndbuf, strerror(errno));
+                ok = FALSE;
+            }
+            return ok;
+        }
+    }
+    return FALSE;
+}
+
+gboolean
+grilio_transport_socket_get_buffer_size(
+    GRilIoTransport* transport,
+    int* rcvbuf,
+    int* sndbuf)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_SOCKET(transport))) {
+        GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(transport);
+
+        if (self->io_channel) {
+            const int fd = g_io_channel_unix_get_fd(self->io_channel);
+            socklen_t len;
+            int val;
+
+            if (rcvbuf) {
+                len = sizeof(val);
+                if (getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &val, &len) < 0) {
+                    return FALSE;
+                }
+                *rcvbuf = val;
+            }
+            if (sndbuf) {
+                len = sizeof(val);
+                if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &val, &len) < 0) {
+                    return FALSE;
+                }
+                *sndbuf = val;
+            }
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+gboolean
+grilio_transport_socket_get_stats(
+    GRilIoTransport* transport,
+    GRilIoTransportSocketStats* stats)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_SOCKET(transport)) && G_LIKELY(stats)) {
+        *stats = GRILIO_TRANSPORT_SOCKET(transport)->stats;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+void
+grilio_transport_socket_reset_stats(
+    GRilIoTransport* transport)
+{
+    if (G_LIKELY(GRILIO_IS_TRANSPORT_SOCKET(transport))) {
+        GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(transport);
+
+        memset(&self->stats, 0, sizeof(self->stats));
+    }
+}
+
 /*==========================================================================*
  * Internals
  *==========================================================================*/
@@ -770,14 +1157,13 @@ grilio_transport_socket_finalize(
     GRilIoTransportSocket* self = GRILIO_TRANSPORT_SOCKET(object);
 
     grilio_transport_socket_shutdown(&self->parent, FALSE);
-    grilio_request_unref(self->send_req);
-    if (self->write_error_id) {
-        g_source_remove(self->write_error_id);
-    }
-    if (self->write_error) {
-        g_error_free(self->write_error);
+    while (self->send_count > 0) {
+        grilio_request_unref(self->send_queue[--(self->send_count)].req);
     }
-    g_free(self->read_buf);
+    g_free(self->send_queue);
+    grilio_buffer_unref(self->read_buf);
+    grilio_buffer_unref(self->read_ahead);
+    grilio_buffer_unref(self->stream_buf);
     G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
 }
 
@@ -788,6 +1174,7 @@ grilio_transport_socket_class_init(
 {
     klass->send = grilio_transport_socket_send;
     klass->shutdown = grilio_transport_socket_shutdown;
+    klass->send_window = grilio_transport_socket_send_window;
     G_OBJECT_CLASS(klass)->finalize = grilio_transport_socket_finalize;
 }
 
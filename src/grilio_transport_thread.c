@@ -0,0 +1,807 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Same wire protocol as grilio_transport_socket.c but all socket I/O
+ * happens on a dedicated thread. That thread does the framing and hands
+ * complete packets over to the main context via a single producer/single
+ * consumer ring. Packets stay in the (pooled) receive buffer, the ring
+ * only carries the references. Requests travel in the opposite direction
+ * the same way.
+ * The I/O thread never touches GObjects and never refs or unrefs the
+ * requests, those are owned by the main thread.
+ */
+
+#define _GNU_SOURCE /* pthread_setaffinity_np */
+
+#include "grilio_transport_impl.h"
+#include "grilio_transport_p.h"
+#include "grilio_buffer.h"
+#include "grilio_ring.h"
+#include "grilio_p.h"
+
+#define GLOG_MODULE_NAME grilio_transport_thread_log
+#include <gutil_log.h>
+
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* Log module */
+GLOG_MODULE_DEFINE2("grilio-thread", GRILIO_LOG_MODULE);
+
+/* Initial size of the receive buffer (grows as needed) */
+#define RIL_READ_BUF_SIZE (0x1000)
+
+/* Ring sizes (must be powers of 2) */
+#define RIL_SEND_RING_SIZE (64)
+#define RIL_RECV_RING_SIZE (256)
+
+typedef enum grilio_transport_thread_event_type {
+    EVENT_SEND,         /* Request to send (main => I/O) */
+    EVENT_SENT,         /* Request has been sent (I/O => main) */
+    EVENT_PACKET,       /* Incoming packet (I/O => main) */
+    EVENT_TOO_LONG,     /* Packet is too long (I/O => main) */
+    EVENT_EOF,          /* Other side has hung up (I/O => main) */
+    EVENT_READ_ERROR,   /* Read failed (I/O => main) */
+    EVENT_WRITE_ERROR   /* Write failed (I/O => main) */
+} EVENT_TYPE;
+
+typedef struct grilio_transport_thread_event {
+    EVENT_TYPE type;
+    int err;                /* errno for EVENT_READ/WRITE_ERROR */
+    guint len;              /* EVENT_PACKET and EVENT_TOO_LONG */
+    GRilIoBuffer* buf;      /* EVENT_PACKET, holds the data */
+    gsize offset;           /* EVENT_PACKET, where the data start */
+    GRilIoRequest* req;     /* EVENT_SEND and EVENT_SENT */
+    guint32 header[3];      /* EVENT_SEND (including length) */
+} GRilIoTransportThreadEvent;
+
+typedef GRilIoTransportClass GRilIoTransportThreadClass;
+typedef struct grilio_transport_thread {
+    GRilIoTransport parent;
+    int fd;
+    gboolean can_close;
+    pthread_t thread;
+    gboolean thread_running;
+    int io_event;               /* Wakes up the I/O thread */
+    int main_event;             /* Wakes up the main thread */
+    guint main_event_id;
+    GRilIoRing* send_ring;      /* main => I/O */
+    GRilIoRing* recv_ring;      /* I/O => main */
+    gint quit;                  /* Set by main */
+    gint recv_wait;             /* Set by I/O when recv_ring is full */
+
+    /* The rest is only touched by the I/O thread while it's running */
+    GRilIoTransportThreadEvent* pending; /* Didn't fit into recv_ring */
+    gboolean posted;
+    gboolean io_done;
+    gchar sub[RIL_SUB_LEN];
+    guint sub_pos;
+    guint send_header_pos;
+    guint send_pos;
+    GRilIoBuffer* read_buf;
+    gsize read_start;
+    gsize read_end;
+} GRilIoTransportThread;
+
+G_DEFINE_TYPE(GRilIoTransportThread, grilio_transport_thread,
+    GRILIO_TYPE_TRANSPORT)
+
+#define PARENT_CLASS grilio_transport_thread_parent_class
+#define GRILIO_TYPE_TRANSPORT_THREAD (grilio_transport_thread_get_type())
+#define GRILIO_TRANSPORT_THREAD(obj) \
+    G_TYPE_CHECK_INSTANCE_CAST((obj), GRILIO_TYPE_TRANSPORT_THREAD, \
+    GRilIoTransportThread)
+#define GRILIO_IS_TRANSPORT_THREAD(obj) \
+    G_TYPE_CHECK_INSTANCE_TYPE((obj), GRILIO_TYPE_TRANSPORT_THREAD)
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+GRilIoTransportThreadEvent*
+grilio_transport_thread_event_new(
+    EVENT_TYPE type)
+{
+    GRilIoTransportThreadEvent* event =
+        g_slice_new0(GRilIoTransportThreadEvent);
+
+    event->type = type;
+    return event;
+}
+
+static
+void
+grilio_transport_thread_event_free(
+    gpointer data)
+{
+    GRilIoTransportThreadEvent* event = data;
+
+    /* Must only be called on the main thread */
+    grilio_request_unref(event->req);
+    grilio_buffer_unref(event->buf);
+    g_slice_free(GRilIoTransportThreadEvent, event);
+}
+
+static
+void
+grilio_transport_thread_wakeup(
+    int efd)
+{
+    const guint64 one = 1;
+
+    /* Only fails if the counter overflows, which is fine */
+    if (write(efd, &one, sizeof(one)) < 0) {
+        GVERBOSE("eventfd write failed: %s", strerror(errno));
+    }
+}
+
+static
+void
+grilio_transport_thread_clear_event(
+    int efd)
+{
+    guint64 count;
+
+    if (read(efd, &count, sizeof(count)) < 0) {
+        GVERBOSE("eventfd read failed: %s", strerror(errno));
+    }
+}
+
+/*==========================================================================*
+ * I/O thread
+ *==========================================================================*/
+
+static
+gboolean
+grilio_transport_thread_io_post(
+    GRilIoTransportThread* self,
+    GRilIoTransportThreadEvent* event)
+{
+    GASSERT(!self->pending);
+    if (!grilio_ring_push(self->recv_ring, event)) {
+        /*
+         * The ring is full. Tell the main thread that we are waiting
+         * and check again, in case if the main thread has drained the
+         * ring before seeing the flag.
+         */
+        g_atomic_int_set(&self->recv_wait, TRUE);
+        if (!grilio_ring_push(self->recv_ring, event)) {
+            self->pending = event;
+            self->posted = TRUE; /* Make sure the main thread wakes up */
+            return FALSE;
+        }
+    }
+    self->posted = TRUE;
+    return TRUE;
+}
+
+static
+void
+grilio_transport_thread_io_error(
+    GRilIoTransportThread* self,
+    EVENT_TYPE type,
+    int err)
+{
+    GRilIoTransportThreadEvent* event =
+        grilio_transport_thread_event_new(type);
+
+    /* Nothing else is going to happen on this thread */
+    event->err = err;
+    self->io_done = TRUE;
+    grilio_transport_thread_io_post(self, event);
+}
+
+static
+void
+grilio_transport_thread_io_write(
+    GRilIoTransportThread* self)
+{
+    while (!self->io_done && !self->pending) {
+        GRilIoTransportThreadEvent* event = grilio_ring_peek(self->send_ring);
+        GRilIoRequest* req = event ? event->req : NULL;
+        const guint datalen = req ? grilio_request_size(req) : 0;
+        struct iovec iov[3];
+        gsize bytes_written;
+        gssize written;
+        int n = 0;
+
+        /* Subscription, header and data all go in one system call */
+        if (self->sub_pos < RIL_SUB_LEN) {
+            iov[n].iov_base = self->sub + self->sub_pos;
+            iov[n].iov_len = RIL_SUB_LEN - self->sub_pos;
+            n++;
+        }
+        if (req) {
+            if (self->send_header_pos < sizeof(event->header)) {
+                iov[n].iov_base = ((guint8*)event->header) +
+                    self->send_header_pos;
+                iov[n].iov_len = sizeof(event->header) -
+                    self->send_header_pos;
+                n++;
+            }
+            if (self->send_pos < datalen) {
+                iov[n].iov_base = req->bytes->data + self->send_pos;
+                iov[n].iov_len = datalen - self->send_pos;
+                n++;
+            }
+        }
+
+        if (!n) {
+            /* Nothing to write */
+            break;
+        }
+
+        do {
+            written = writev(self->fd, iov, n);
+        } while (written < 0 && errno == EINTR);
+
+        if (written < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                grilio_transport_thread_io_error(self, EVENT_WRITE_ERROR,
+                    errno);
+            }
+            break;
+        }
+
+        bytes_written = grilio_transport_advance(&self->sub_pos,
+            RIL_SUB_LEN, written);
+        if (req) {
+            bytes_written = grilio_transport_advance
+                (&self->send_header_pos, sizeof(event->header),
+                    bytes_written);
+            bytes_written = grilio_transport_advance
+                (&self->send_pos, datalen, bytes_written);
+            if (self->send_pos < datalen ||
+                self->send_header_pos < sizeof(event->header)) {
+                /* Will have to wait */
+                break;
+            }
+
+            /* Send the request back to the main thread */
+            self->send_header_pos = 0;
+            self->send_pos = 0;
+            grilio_ring_pop(self->send_ring);
+            event->type = EVENT_SENT;
+            grilio_transport_thread_io_post(self, event);
+        }
+        GASSERT(!bytes_written);
+    }
+}
+
+static
+void
+grilio_transport_thread_io_dispatch(
+    GRilIoTransportThread* self)
+{
+    while (!self->io_done && !self->pending) {
+        const gsize avail = self->read_end - self->read_start;
+        GRilIoTransportThreadEvent* event;
+        guint32 len;
+
+        if (avail < 4) {
+            /* Need more bytes */
+            break;
+        }
+
+        memcpy(&len, GRILIO_BUFFER_DATA(self->read_buf) +
+            self->read_start, 4);
+        len = GUINT32_FROM_BE(len);
+        if (len > grilio_transport_max_packet_len(&self->parent)) {
+            /* Message is too long or stream is broken */
+            event = grilio_transport_thread_event_new(EVENT_TOO_LONG);
+            event->len = len;
+            self->io_done = TRUE;
+            grilio_transport_thread_io_post(self, event);
+            break;
+        } else if ((avail - 4) < len) {
+            /* Need more bytes */
+            break;
+        }
+
+        /* Packet handlers expect the data to be properly aligned */
+        if ((self->read_start + 4) & 3) {
+            self->read_buf = grilio_buffer_reserve(self->read_buf,
+                &self->read_start, &self->read_end, RIL_READ_BUF_SIZE);
+        }
+
+        /*
+         * The event holds a reference to the buffer, which keeps this
+         * thread from reusing it until the main thread is done with
+         * the packet.
+         */
+        event = grilio_transport_thread_event_new(EVENT_PACKET);
+        event->len = len;
+        event->buf = grilio_buffer_ref(self->read_buf);
+        event->offset = self->read_start + 4;
+        self->read_start += len + 4;
+        grilio_transport_thread_io_post(self, event);
+    }
+}
+
+static
+void
+grilio_transport_thread_io_read(
+    GRilIoTransportThread* self)
+{
+    gsize avail = self->read_end - self->read_start;
+    gsize need = RIL_READ_BUF_SIZE;
+    gssize bytes_read;
+
+    /* Whatever is left in the buffer is a part of the packet */
+    if (avail >= 4) {
+        guint32 len;
+
+        memcpy(&len, GRILIO_BUFFER_DATA(self->read_buf) +
+            self->read_start, 4);
+        need = MAX(GUINT32_FROM_BE(len) + 4, need);
+    }
+
+    /*
+     * Move the partial packet to the beginning of the buffer and make
+     * sure that the entire packet fits. The buffer pool is thread-safe.
+     */
+    self->read_buf = grilio_buffer_reserve(self->read_buf,
+        &self->read_start, &self->read_end, need);
+
+    do {
+        bytes_read = recv(self->fd, GRILIO_BUFFER_DATA(self->read_buf) +
+            self->read_end, self->read_buf->size - self->read_end,
+            MSG_DONTWAIT);
+    } while (bytes_read < 0 && errno == EINTR);
+
+    if (bytes_read > 0) {
+        self->read_end += bytes_read;
+        GASSERT(self->read_end <= self->read_buf->size);
+        grilio_transport_thread_io_dispatch(self);
+    } else if (!bytes_read) {
+        self->io_done = TRUE;
+        grilio_transport_thread_io_post(self,
+            grilio_transport_thread_event_new(EVENT_EOF));
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        grilio_transport_thread_io_error(self, EVENT_READ_ERROR, errno);
+    }
+}
+
+static
+void*
+grilio_transport_thread_io_proc(
+    void* arg)
+{
+    GRilIoTransportThread* self = arg;
+
+    while (!g_atomic_int_get(&self->quit)) {
+        struct pollfd fds[2];
+        int nfds = 1;
+
+        fds[0].fd = self->io_event;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        if (!self->io_done && !self->pending) {
+            fds[1].fd = self->fd;
+            fds[1].events = POLLIN;
+            fds[1].revents = 0;
+            if (self->sub_pos < RIL_SUB_LEN ||
+                grilio_ring_peek(self->send_ring)) {
+                fds[1].events |= POLLOUT;
+            }
+            nfds++;
+        }
+
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno != EINTR) {
+                grilio_transport_thread_io_error(self, EVENT_READ_ERROR,
+                    errno);
+            }
+        } else {
+            if (fds[0].revents & POLLIN) {
+                grilio_transport_thread_clear_event(self->io_event);
+            }
+
+            /* Retry the event that didn't fit into the ring */
+            if (self->pending && grilio_ring_push(self->recv_ring,
+                self->pending)) {
+                self->pending = NULL;
+                self->posted = TRUE;
+            }
+
+            /* Finish dispatching the packets left in the buffer */
+            grilio_transport_thread_io_dispatch(self);
+
+            /* New requests may have been queued since the last poll */
+            grilio_transport_thread_io_write(self);
+            if (nfds > 1 && (fds[1].revents & (POLLIN|POLLHUP|POLLERR)) &&
+                !self->io_done && !self->pending) {
+                grilio_transport_thread_io_read(self);
+            }
+        }
+
+        if (self->posted) {
+            self->posted = FALSE;
+            grilio_transport_thread_wakeup(self->main_event);
+        }
+    }
+    return NULL;
+}
+
+/*==========================================================================*
+ * Main thread
+ *==========================================================================*/
+
+static
+void
+grilio_transport_thread_shutdown_io(
+    GRilIoTransportThread* self)
+{
+    if (self->thread_running) {
+        g_atomic_int_set(&self->quit, TRUE);
+        grilio_transport_thread_wakeup(self->io_event);
+        pthread_join(self->thread, NULL);
+        self->thread_running = FALSE;
+    }
+    if (self->main_event_id) {
+        g_source_remove(self->main_event_id);
+        self->main_event_id = 0;
+    }
+
+    /* The I/O thread is gone, release whatever it has left behind */
+    if (self->pending) {
+        grilio_transport_thread_event_free(self->pending);
+        self->pending = NULL;
+    }
+    grilio_ring_free(self->recv_ring, grilio_transport_thread_event_free);
+    grilio_ring_free(self->send_ring, grilio_transport_thread_event_free);
+    self->recv_ring = NULL;
+    self->send_ring = NULL;
+    if (self->io_event >= 0) {
+        close(self->io_event);
+        self->io_event = -1;
+    }
+    if (self->main_event >= 0) {
+        close(self->main_event);
+        self->main_event = -1;
+    }
+    if (self->fd >= 0) {
+        /* Make sure that the other side notices */
+        shutdown(self->fd, SHUT_RDWR);
+        if (self->can_close) {
+            close(self->fd);
+        }
+        self->fd = -1;
+    }
+}
+
+static
+void
+grilio_transport_thread_handle_read_error(
+    GRilIoTransportThread* self,
+    GError* error)
+{
+    GRilIoTransport* transport = &self->parent;
+
+    GERR("%sread failed: %s", transport->log_prefix, GERRMSG(error));
+    grilio_transport_shutdown(transport, FALSE);
+    grilio_transport_signal_read_error(transport, error);
+    g_error_free(error);
+}
+
+static
+void
+grilio_transport_thread_handle_event(
+    GRilIoTransportThread* self,
+    GRilIoTransportThreadEvent* event)
+{
+    GRilIoTransport* transport = &self->parent;
+    GError* error = NULL;
+
+    switch (event->type) {
+    case EVENT_PACKET:
+        if (!grilio_transport_handle_packet_buffer(transport, event->buf,
+            GRILIO_BUFFER_DATA(event->buf) + event->offset, event->len,
+            &error)) {
+            grilio_transport_thread_handle_read_error(self, error);
+        }
+        break;
+    case EVENT_SENT:
+        grilio_transport_signal_request_sent(transport, event->req);
+        break;
+    case EVENT_TOO_LONG:
+        grilio_transport_thread_handle_read_error(self,
+            g_error_new(G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Packet too long (%u bytes)", event->len));
+        break;
+    case EVENT_READ_ERROR:
+        grilio_transport_thread_handle_read_error(self,
+            grilio_transport_errno_error(event->err));
+        break;
+    case EVENT_EOF:
+        GERR("%shangup", transport->log_prefix);
+        grilio_transport_shutdown(transport, FALSE);
+        break;
+    case EVENT_WRITE_ERROR:
+        /* Don't emit DISCONNECTED signal just yet */
+        grilio_transport_thread_shutdown_io(self);
+        grilio_transport_handle_write_error(transport,
+            grilio_transport_errno_error(event->err));
+        break;
+    case EVENT_SEND:
+        GASSERT(FALSE);
+        break;
+    }
+}
+
+static
+gboolean
+grilio_transport_thread_main_event_callback(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    GRilIoTransportThread* self = GRILIO_TRANSPORT_THREAD(user_data);
+    GRilIoTransportThreadEvent* event;
+    gboolean result;
+
+    g_object_ref(self);
+    grilio_transport_thread_clear_event(fd);
+    while (self->recv_ring &&
+        (event = grilio_ring_pop(self->recv_ring)) != NULL) {
+        grilio_transport_thread_handle_event(self, event);
+        grilio_transport_thread_event_free(event);
+    }
+
+    /* Let the I/O thread know that there's room in the ring now */
+    if (self->recv_ring && g_atomic_int_get(&self->recv_wait)) {
+        g_atomic_int_set(&self->recv_wait, FALSE);
+        grilio_transport_thread_wakeup(self->io_event);
+    }
+
+    /* The source is removed by grilio_transport_thread_shutdown_io */
+    result = self->main_event_id ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+    g_object_unref(self);
+    return result;
+}
+
+/*==========================================================================*
+ * Methods
+ *==========================================================================*/
+
+static
+GRILIO_SEND_STATUS
+grilio_transport_thread_send(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    guint code)
+{
+    GRilIoTransportThread* self = GRILIO_TRANSPORT_THREAD(transport);
+
+    if (req && self->send_ring) {
+        GRilIoTransportThreadEvent* event =
+            grilio_transport_thread_event_new(EVENT_SEND);
+        const guint datalen = grilio_request_size(req);
+        const guint serial = grilio_request_serial(req);
+
+        /* Length includes the header excluding the length iteslf */
+        event->header[0] = GINT32_TO_BE(datalen + RIL_REQUEST_HEADER_SIZE);
+        event->header[1] = GUINT32_TO_RIL(code);
+        event->header[2] = GUINT32_TO_RIL(serial);
+        event->req = grilio_request_ref(req);
+        if (grilio_ring_push(self->send_ring, event)) {
+            grilio_transport_thread_wakeup(self->io_event);
+            return GRILIO_SEND_PENDING;
+        }
+        GWARN("%ssend queue is full", transport->log_prefix);
+        grilio_transport_thread_event_free(event);
+    }
+    return GRILIO_SEND_ERROR;
+}
+
+static
+guint
+grilio_transport_thread_send_window(
+    GRilIoTransport* transport)
+{
+    return RIL_SEND_RING_SIZE;
+}
+
+static
+void
+grilio_transport_thread_shutdown(
+    GRilIoTransport* transport,
+    gboolean flush)
+{
+    GRilIoTransportThread* self = GRILIO_TRANSPORT_THREAD(transport);
+
+    grilio_transport_thread_shutdown_io(self);
+    grilio_transport_disconnected(&self->parent);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoTransport*
+grilio_transport_thread_new(
+    int fd,
+    const char* sub,
+    gboolean can_close)
+{
+    if (G_LIKELY(fd >= 0 && (!sub || strlen(sub) == RIL_SUB_LEN))) {
+        const int flags = fcntl(fd, F_GETFL);
+
+        if (flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0) {
+            GRilIoTransportThread* self = g_object_new
+                (GRILIO_TYPE_TRANSPORT_THREAD, NULL);
+            int err;
+
+            self->fd = fd;
+            self->can_close = can_close;
+            if (sub) {
+                memcpy(self->sub, sub, RIL_SUB_LEN);
+            } else {
+                self->sub_pos = RIL_SUB_LEN;
+            }
+            self->io_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            self->main_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (self->io_event >= 0 && self->main_event >= 0) {
+                self->send_ring = grilio_ring_new(RIL_SEND_RING_SIZE);
+                self->recv_ring = grilio_ring_new(RIL_RECV_RING_SIZE);
+                self->main_event_id = g_unix_fd_add_full(G_PRIORITY_DEFAULT,
+                    self->main_event, G_IO_IN,
+                    grilio_transport_thread_main_event_callback, self, NULL);
+                err = pthread_create(&self->thread, NULL,
+                    grilio_transport_thread_io_proc, self);
+                if (!err) {
+                    self->thread_running = TRUE;
+                    return &self->parent;
+                }
+                GERR("Failed to start I/O thread: %s", strerror(err));
+            } else {
+                GERR("Failed to create eventfd: %s", strerror(errno));
+            }
+
+            /* Don't close the descriptor that we don't own */
+            self->can_close = FALSE;
+            g_object_unref(self);
+        } else {
+            GERR("Can't make fd %d non-blocking: %s", fd, strerror(errno));
+        }
+    }
+    return NULL;
+}
+
+gboolean
+grilio_transport_thread_set_affinity(
+    GRilIoTransport* transport,
+    int cpu)
+{
+    if (G_LIKELY(transport) && GRILIO_IS_TRANSPORT_THREAD(transport) &&
+        cpu >= 0 && cpu < CPU_SETSIZE) {
+        GRilIoTransportThread* self = GRILIO_TRANSPORT_THREAD(transport);
+
+        if (self->thread_running) {
+            cpu_set_t cpus;
+            int err;
+
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu, &cpus);
+            err = pthread_setaffinity_np(self->thread, sizeof(cpus), &cpus);
+            if (!err) {
+                return TRUE;
+            }
+            GWARN("%sfailed to set CPU affinity: %s", transport->log_prefix,
+                strerror(err));
+        }
+    }
+    return FALSE;
+}
+
+gboolean
+grilio_transport_thread_set_priority(
+    GRilIoTransport* transport,
+    int policy,
+    int priority)
+{
+    if (G_LIKELY(transport) && GRILIO_IS_TRANSPORT_THREAD(transport)) {
+        GRilIoTransportThread* self = GRILIO_TRANSPORT_THREAD(transport);
+
+        if (self->thread_running) {
+            struct sched_param param;
+            int err;
+
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = priority;
+            err = pthread_setschedparam(self->thread, policy, &param);
+            if (!err) {
+                return TRUE;
+            }
+            GWARN("%sfailed to set priority: %s", transport->log_prefix,
+                strerror(err));
+        }
+    }
+    return FALSE;
+}
+
+/*==========================================================================*
+ * Internals
+ *==========================================================================*/
+
+static
+void
+grilio_transport_thread_init(
+    GRilIoTransportThread* self)
+{
+    self->fd = -1;
+    self->io_event = -1;
+    self->main_event = -1;
+}
+
+static
+void
+grilio_transport_thread_finalize(
+    GObject* object)
+{
+    GRilIoTransportThread* self = GRILIO_TRANSPORT_THREAD(object);
+
+    grilio_transport_thread_shutdown_io(self);
+    grilio_buffer_unref(self->read_buf);
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
+static
+void
+grilio_transport_thread_class_init(
+    GRilIoTransportThreadClass* klass)
+{
+    klass->send = grilio_transport_thread_send;
+    klass->send_window = grilio_transport_thread_send_window;
+    klass->shutdown = grilio_transport_thread_shutdown;
+    G_OBJECT_CLASS(klass)->finalize = grilio_transport_thread_finalize;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
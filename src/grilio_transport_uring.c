@@ -0,0 +1,1012 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Same wire protocol as grilio_transport_socket.c but the socket is
+ * driven by io_uring. A multishot receive is kept armed, feeding data
+ * into a ring of provided buffers, so there's no readiness poll before
+ * each read. Queued requests are submitted as a chain of linked writes
+ * with a single io_uring_enter() call. The completion ring is polled by
+ * the main loop.
+ *
+ * If io_uring isn't supported by the kernel (or compiled out), the socket
+ * transport is created instead.
+ */
+
+#include "grilio_transport_p.h"
+#include "grilio_transport_impl.h"
+#include "grilio_buffer.h"
+#include "grilio_p.h"
+
+#define GLOG_MODULE_NAME grilio_transport_uring_log
+#include <gutil_log.h>
+
+/* Log module */
+GLOG_MODULE_DEFINE2("grilio-uring", GRILIO_LOG_MODULE);
+
+#ifdef HAVE_IO_URING
+
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/* Initial size of the receive buffer (grows as needed) */
+#define RIL_READ_BUF_SIZE (0x1000)
+
+/* io_uring parameters */
+#define URING_ENTRIES (64)
+#define URING_SEND_WINDOW (32)  /* Must leave room for recv and sub */
+#define URING_BUF_GROUP (0)
+#define URING_BUF_COUNT (16)    /* Must be a power of 2 */
+#define URING_BUF_SIZE (0x1000)
+
+/* user_data tags */
+#define URING_TAG_RECV (1)
+#define URING_TAG_SUB (2)
+#define URING_TAG_WRITE (3)
+#define URING_TAG_CANCEL (4)
+#define URING_USER_DATA(tag,index) ((((guint64)(tag)) << 32) | (index))
+#define URING_USER_DATA_TAG(data) ((guint)((data) >> 32))
+#define URING_USER_DATA_INDEX(data) ((guint)(data))
+
+typedef struct grilio_transport_uring_packet {
+    GRilIoRequest* req;
+    guint32 header[3]; /* Including length */
+    struct iovec iov[2];
+    struct msghdr msg;
+    int result;
+} GRilIoTransportUringPacket;
+
+typedef GRilIoTransportClass GRilIoTransportUringClass;
+typedef struct grilio_transport_uring {
+    GRilIoTransport parent;
+    int fd;
+    gboolean can_close;
+    guint ring_source_id;
+
+    /* Ring */
+    int ring_fd;
+    void* sq_ptr;
+    gsize sq_size;
+    void* cq_ptr;
+    gsize cq_size;
+    struct io_uring_sqe* sqes;
+    gsize sqes_size;
+    guint* sq_head;
+    guint* sq_tail;
+    guint* sq_array;
+    guint sq_mask;
+    guint sq_entries;
+    guint sq_local_tail;
+    guint* cq_head;
+    guint* cq_tail;
+    guint cq_mask;
+    struct io_uring_cqe* cqes;
+    guint inflight;
+
+    /* Provided buffers */
+    struct io_uring_buf_ring* buf_ring;
+    gsize buf_ring_size;
+    guint8* bufs;
+    guint16 buf_tail;
+
+    /* Subscription */
+    gchar sub[RIL_SUB_LEN];
+    guint sub_pos;
+    struct iovec sub_iov;
+    struct msghdr sub_msg;
+    int sub_result;
+    gboolean sub_submitted;
+
+    /* Send */
+    GRilIoTransportUringPacket* send_queue; /* Never reallocated */
+    guint send_count;
+    guint send_pos; /* In the first packet, including header */
+    guint write_chain;
+    guint write_cqes;
+
+    /* Receive */
+    gboolean recv_armed;
+    gboolean multishot;
+    GRilIoBuffer* read_buf;
+    gsize read_start;
+    gsize read_end;
+} GRilIoTransportUring;
+
+G_DEFINE_TYPE(GRilIoTransportUring, grilio_transport_uring,
+    GRILIO_TYPE_TRANSPORT)
+
+#define PARENT_CLASS grilio_transport_uring_parent_class
+#define GRILIO_TYPE_TRANSPORT_URING (grilio_transport_uring_get_type())
+#define GRILIO_TRANSPORT_URING(obj) \
+    G_TYPE_CHECK_INSTANCE_CAST((obj), GRILIO_TYPE_TRANSPORT_URING, \
+    GRilIoTransportUring)
+
+/*==========================================================================*
+ * System calls
+ *==========================================================================*/
+
+static
+int
+grilio_transport_uring_setup(
+    guint entries,
+    struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static
+int
+grilio_transport_uring_enter(
+    int ring_fd,
+    guint to_submit,
+    guint min_complete,
+    guint flags)
+{
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit,
+        min_complete, flags, NULL, 0);
+}
+
+static
+int
+grilio_transport_uring_register(
+    int ring_fd,
+    guint opcode,
+    void* arg,
+    guint nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode,
+        arg, nr_args);
+}
+
+/*==========================================================================*
+ * Ring
+ *==========================================================================*/
+
+static
+void
+grilio_transport_uring_submit(
+    GRilIoTransportUring* self)
+{
+    const guint tail = *self->sq_tail;
+    const guint n = self->sq_local_tail - tail;
+
+    if (n) {
+        int ret;
+
+        /* Publish the entries before entering the kernel */
+        __atomic_store_n(self->sq_tail, self->sq_local_tail,
+            __ATOMIC_RELEASE);
+        do {
+            ret = grilio_transport_uring_enter(self->ring_fd, n, 0, 0);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) {
+            GWARN("%sio_uring_enter failed: %s", self->parent.log_prefix,
+                strerror(errno));
+        }
+    }
+}
+
+static
+struct io_uring_sqe*
+grilio_transport_uring_get_sqe(
+    GRilIoTransportUring* self)
+{
+    guint head = __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE);
+    struct io_uring_sqe* sqe;
+    guint index;
+
+    if ((self->sq_local_tail - head) >= self->sq_entries) {
+        /* Flush the submission queue */
+        grilio_transport_uring_submit(self);
+        head = __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE);
+        if ((self->sq_local_tail - head) >= self->sq_entries) {
+            return NULL;
+        }
+    }
+
+    index = self->sq_local_tail & self->sq_mask;
+    sqe = self->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    self->sq_array[index] = index;
+    self->sq_local_tail++;
+    self->inflight++;
+    return sqe;
+}
+
+static
+void
+grilio_transport_uring_buf_recycle(
+    GRilIoTransportUring* self,
+    guint16 bid)
+{
+    struct io_uring_buf* buf = self->buf_ring->bufs +
+        (self->buf_tail & (URING_BUF_COUNT - 1));
+
+    buf->addr = (guint64)(gsize)(self->bufs + bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    self->buf_tail++;
+    __atomic_store_n(&self->buf_ring->tail, self->buf_tail,
+        __ATOMIC_RELEASE);
+}
+
+static
+void
+grilio_transport_uring_free_ring(
+    GRilIoTransportUring* self)
+{
+    if (self->ring_fd >= 0) {
+        close(self->ring_fd);
+        self->ring_fd = -1;
+    }
+    if (self->sqes) {
+        munmap(self->sqes, self->sqes_size);
+        self->sqes = NULL;
+    }
+    if (self->cq_ptr && self->cq_ptr != self->sq_ptr) {
+        munmap(self->cq_ptr, self->cq_size);
+    }
+    self->cq_ptr = NULL;
+    if (self->sq_ptr) {
+        munmap(self->sq_ptr, self->sq_size);
+        self->sq_ptr = NULL;
+    }
+    if (self->buf_ring) {
+        munmap(self->buf_ring, self->buf_ring_size);
+        self->buf_ring = NULL;
+    }
+    g_free(self->bufs);
+    self->bufs = NULL;
+}
+
+static
+gboolean
+grilio_transport_uring_init_ring(
+    GRilIoTransportUring* self)
+{
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    guint8* sq;
+    guint8* cq;
+    guint16 i;
+
+    memset(&p, 0, sizeof(p));
+    self->ring_fd = grilio_transport_uring_setup(URING_ENTRIES, &p);
+    if (self->ring_fd < 0) {
+        GDEBUG("io_uring_setup failed: %s", strerror(errno));
+        return FALSE;
+    }
+
+    self->sq_size = p.sq_off.array + p.sq_entries * sizeof(guint);
+    self->cq_size = p.cq_off.cqes +
+        p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        self->sq_size = self->cq_size = MAX(self->sq_size, self->cq_size);
+    }
+    self->sq_ptr = mmap(NULL, self->sq_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, self->ring_fd, IORING_OFF_SQ_RING);
+    if (self->sq_ptr == MAP_FAILED) {
+        self->sq_ptr = NULL;
+        return FALSE;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        self->cq_ptr = self->sq_ptr;
+    } else {
+        self->cq_ptr = mmap(NULL, self->cq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, self->ring_fd, IORING_OFF_CQ_RING);
+        if (self->cq_ptr == MAP_FAILED) {
+            self->cq_ptr = NULL;
+            return FALSE;
+        }
+    }
+    self->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    self->sqes = mmap(NULL, self->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, self->ring_fd, IORING_OFF_SQES);
+    if (self->sqes == MAP_FAILED) {
+        self->sqes = NULL;
+        return FALSE;
+    }
+
+    sq = self->sq_ptr;
+    self->sq_head = (guint*)(sq + p.sq_off.head);
+    self->sq_tail = (guint*)(sq + p.sq_off.tail);
+    self->sq_array = (guint*)(sq + p.sq_off.array);
+    self->sq_mask = *(guint*)(sq + p.sq_off.ring_mask);
+    self->sq_entries = p.sq_entries;
+    self->sq_local_tail = *self->sq_tail;
+
+    cq = self->cq_ptr;
+    self->cq_head = (guint*)(cq + p.cq_off.head);
+    self->cq_tail = (guint*)(cq + p.cq_off.tail);
+    self->cq_mask = *(guint*)(cq + p.cq_off.ring_mask);
+    self->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    /* The buffer ring has to be page aligned */
+    self->buf_ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    self->buf_ring = mmap(NULL, self->buf_ring_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (self->buf_ring == MAP_FAILED) {
+        self->buf_ring = NULL;
+        return FALSE;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (guint64)(gsize)self->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (grilio_transport_uring_register(self->ring_fd,
+        IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        /* Requires Linux 5.19 */
+        GDEBUG("Can't register buffer ring: %s", strerror(errno));
+        return FALSE;
+    }
+
+    self->bufs = g_malloc(URING_BUF_COUNT * URING_BUF_SIZE);
+    for (i = 0; i < URING_BUF_COUNT; i++) {
+        grilio_transport_uring_buf_recycle(self, i);
+    }
+    return TRUE;
+}
+
+/*==========================================================================*
+ * Implementation
+ *==========================================================================*/
+
+static
+void
+grilio_transport_uring_drain(
+    GRilIoTransportUring* self)
+{
+    /*
+     * The kernel may still be using our buffers. Cancel whatever is
+     * still in flight and wait for all completions to arrive.
+     */
+    struct io_uring_sqe* sqe = grilio_transport_uring_get_sqe(self);
+
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = self->fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD |
+            IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = URING_USER_DATA(URING_TAG_CANCEL, 0);
+    }
+    grilio_transport_uring_submit(self);
+    while (self->inflight > 0) {
+        guint head = *self->cq_head;
+        const guint tail = __atomic_load_n(self->cq_tail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (grilio_transport_uring_enter(self->ring_fd, 0, 1,
+                IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                GWARN("%sio_uring_enter failed: %s",
+                    self->parent.log_prefix, strerror(errno));
+                break;
+            }
+            continue;
+        }
+        while (head != tail) {
+            const struct io_uring_cqe* cqe = self->cqes +
+                (head & self->cq_mask);
+
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                self->inflight--;
+            }
+            head++;
+        }
+        __atomic_store_n(self->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+static
+void
+grilio_transport_uring_shutdown_io(
+    GRilIoTransportUring* self)
+{
+    guint i;
+
+    if (self->ring_source_id) {
+        g_source_remove(self->ring_source_id);
+        self->ring_source_id = 0;
+    }
+    if (self->fd >= 0) {
+        /* Make sure that the other side notices */
+        shutdown(self->fd, SHUT_RDWR);
+        if (self->ring_fd >= 0) {
+            grilio_transport_uring_drain(self);
+        }
+        if (self->can_close) {
+            close(self->fd);
+        }
+        self->fd = -1;
+    }
+    grilio_transport_uring_free_ring(self);
+    for (i = 0; i < self->send_count; i++) {
+        grilio_request_unref(self->send_queue[i].req);
+    }
+    self->send_count = 0;
+    self->write_chain = 0;
+    self->write_cqes = 0;
+}
+
+/*==========================================================================*
+ * Read
+ *==========================================================================*/
+
+static
+void
+grilio_transport_uring_handle_read_error(
+    GRilIoTransportUring* self,
+    GError* error)
+{
+    GRilIoTransport* transport = &self->parent;
+
+    GERR("%sread failed: %s", transport->log_prefix, GERRMSG(error));
+    grilio_transport_shutdown(transport, FALSE);
+    grilio_transport_signal_read_error(transport, error);
+    g_error_free(error);
+}
+
+static
+void
+grilio_transport_uring_arm_recv(
+    GRilIoTransportUring* self)
+{
+    if (!self->recv_armed) {
+        struct io_uring_sqe* sqe = grilio_transport_uring_get_sqe(self);
+
+        if (sqe) {
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = self->fd;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = URING_BUF_GROUP;
+            if (self->multishot) {
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+            }
+            sqe->user_data = URING_USER_DATA(URING_TAG_RECV, 0);
+            self->recv_armed = TRUE;
+        }
+    }
+}
+
+static
+gboolean
+grilio_transport_uring_dispatch(
+    GRilIoTransportUring* self)
+{
+    while (self->fd >= 0) {
+        const gsize avail = self->read_end - self->read_start;
+        GError* error = NULL;
+        const gchar* packet;
+        guint32 len;
+
+        if (avail < 4) {
+            /* Need more bytes */
+            break;
+        }
+
+        memcpy(&len, GRILIO_BUFFER_DATA(self->read_buf) +
+            self->read_start, 4);
+        len = GUINT32_FROM_BE(len);
+        if (len > grilio_transport_max_packet_len(&self->parent)) {
+            /* Message is too long or stream is broken */
+            grilio_transport_uring_handle_read_error(self,
+                g_error_new(G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "Packet too long (%u bytes)", len));
+            return FALSE;
+        } else if ((avail - 4) < len) {
+            /* Need more bytes */
+            break;
+        }
+
+        /* Packet handlers expect the data to be properly aligned */
+        if ((self->read_start + 4) & 3) {
+            self->read_buf = grilio_buffer_reserve(self->read_buf,
+                &self->read_start, &self->read_end, RIL_READ_BUF_SIZE);
+        }
+
+        packet = GRILIO_BUFFER_DATA(self->read_buf) + self->read_start + 4;
+        self->read_start += len + 4;
+        if (!grilio_transport_handle_packet_buffer(&self->parent,
+            self->read_buf, packet, len, &error)) {
+            grilio_transport_uring_handle_read_error(self, error);
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static
+void
+grilio_transport_uring_append(
+    GRilIoTransportUring* self,
+    const void* data,
+    gsize len)
+{
+    const gsize avail = self->read_end - self->read_start;
+
+    /* Move the partial packet to the beginning of the buffer */
+    self->read_buf = grilio_buffer_reserve(self->read_buf,
+        &self->read_start, &self->read_end,
+        MAX(avail + len, RIL_READ_BUF_SIZE));
+    memcpy(GRILIO_BUFFER_DATA(self->read_buf) + self->read_end, data, len);
+    self->read_end += len;
+}
+
+static
+void
+grilio_transport_uring_recv_done(
+    GRilIoTransportUring* self,
+    int res,
+    guint flags)
+{
+    GRilIoTransport* transport = &self->parent;
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        /* Will have to re-arm it */
+        self->recv_armed = FALSE;
+    }
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        const guint16 bid = flags >> IORING_CQE_BUFFER_SHIFT;
+
+        /* Copy the data and give the buffer back right away */
+        if (res > 0) {
+            grilio_transport_uring_append(self,
+                self->bufs + bid * URING_BUF_SIZE, res);
+        }
+        grilio_transport_uring_buf_recycle(self, bid);
+    }
+
+    if (res > 0) {
+        grilio_transport_uring_dispatch(self);
+    } else if (!res) {
+        GERR("%shangup", transport->log_prefix);
+        grilio_transport_shutdown(transport, FALSE);
+    } else if (res == -ENOBUFS) {
+        /* Ran out of buffers, they have been recycled by now */
+        GVERBOSE("%sout of receive buffers", transport->log_prefix);
+    } else if (res == -EINVAL && self->multishot) {
+        /* Multishot receive requires Linux 6.0 */
+        GDEBUG("%smultishot receive not supported", transport->log_prefix);
+        self->multishot = FALSE;
+    } else if (res != -EINTR && res != -EAGAIN) {
+        grilio_transport_uring_handle_read_error(self,
+            grilio_transport_errno_error(-res));
+    }
+}
+
+/*==========================================================================*
+ * Write
+ *==========================================================================*/
+
+static
+void
+grilio_transport_uring_submit_writes(
+    GRilIoTransportUring* self)
+{
+    GRilIoTransport* transport = &self->parent;
+    struct io_uring_sqe* prev = NULL;
+    guint i;
+
+    if (self->write_cqes || self->fd < 0) {
+        /* Wait for the current chain to complete */
+        return;
+    }
+
+    /* Subscription always goes first */
+    self->sub_submitted = FALSE;
+    if (self->sub_pos < RIL_SUB_LEN) {
+        struct io_uring_sqe* sqe = grilio_transport_uring_get_sqe(self);
+
+        if (!sqe) {
+            return;
+        }
+        self->sub_iov.iov_base = self->sub + self->sub_pos;
+        self->sub_iov.iov_len = RIL_SUB_LEN - self->sub_pos;
+        memset(&self->sub_msg, 0, sizeof(self->sub_msg));
+        self->sub_msg.msg_iov = &self->sub_iov;
+        self->sub_msg.msg_iovlen = 1;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = self->fd;
+        sqe->addr = (guint64)(gsize)&self->sub_msg;
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        sqe->user_data = URING_USER_DATA(URING_TAG_SUB, 0);
+        self->sub_submitted = TRUE;
+        self->write_cqes++;
+        prev = sqe;
+    }
+
+    /* Requests are only sent when connected */
+    self->write_chain = 0;
+    for (i = 0; transport->connected && i < self->send_count; i++) {
+        GRilIoTransportUringPacket* packet = self->send_queue + i;
+        const guint datalen = grilio_request_size(packet->req);
+        struct io_uring_sqe* sqe;
+        guint skip = i ? 0 : self->send_pos;
+        int n = 0;
+
+        if (!(sqe = grilio_transport_uring_get_sqe(self))) {
+            break;
+        }
+        if (skip < sizeof(packet->header)) {
+            packet->iov[n].iov_base = ((guint8*)packet->header) + skip;
+            packet->iov[n].iov_len = sizeof(packet->header) - skip;
+            n++;
+            skip = 0;
+        } else {
+            skip -= sizeof(packet->header);
+        }
+        packet->iov[n].iov_base = packet->req->bytes->data + skip;
+        packet->iov[n].iov_len = datalen - skip;
+        n++;
+        memset(&packet->msg, 0, sizeof(packet->msg));
+        packet->msg.msg_iov = packet->iov;
+        packet->msg.msg_iovlen = n;
+        packet->result = -ECANCELED;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = self->fd;
+        sqe->addr = (guint64)(gsize)&packet->msg;
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        sqe->user_data = URING_USER_DATA(URING_TAG_WRITE, i);
+        self->write_chain++;
+        self->write_cqes++;
+        if (prev) {
+            /* Keep the writes in order */
+            prev->flags |= IOSQE_IO_LINK;
+        }
+        prev = sqe;
+    }
+
+    if (self->write_cqes) {
+        GVERBOSE("%ssubmitting %u write(s)", transport->log_prefix,
+            self->write_cqes);
+    }
+}
+
+static
+void
+grilio_transport_uring_handle_write_error(
+    GRilIoTransportUring* self,
+    int err)
+{
+    /* Don't emit DISCONNECTED signal just yet */
+    grilio_transport_uring_shutdown_io(self);
+    grilio_transport_handle_write_error(&self->parent,
+        grilio_transport_errno_error(err));
+}
+
+static
+gboolean
+grilio_transport_uring_chain_done(
+    GRilIoTransportUring* self)
+{
+    GRilIoTransport* transport = &self->parent;
+    GRilIoRequest** sent;
+    guint i, nsent = 0;
+
+    /* Figure out where we are */
+    if (self->sub_submitted) {
+        const int res = self->sub_result;
+
+        if (res > 0) {
+            self->sub_pos += res;
+        } else if (res != -ECANCELED && res != -EAGAIN && res != -EINTR) {
+            grilio_transport_uring_handle_write_error(self, -res);
+            return FALSE;
+        }
+        if (self->sub_pos < RIL_SUB_LEN) {
+            /* Resubmit the rest */
+            return TRUE;
+        }
+        GDEBUG("%ssubscribed for %c%c%c%c", transport->log_prefix,
+            self->sub[0], self->sub[1], self->sub[2], self->sub[3]);
+    }
+
+    for (i = 0; i < self->write_chain; i++) {
+        GRilIoTransportUringPacket* packet = self->send_queue + i;
+        const guint total = sizeof(packet->header) +
+            grilio_request_size(packet->req);
+        const int res = packet->result;
+
+        if (res >= 0) {
+            self->send_pos += res;
+            if (self->send_pos < total) {
+                /* Short write, resubmit the rest */
+                break;
+            }
+            self->send_pos = 0;
+            nsent++;
+        } else if (res == -ECANCELED || res == -EAGAIN || res == -EINTR) {
+            break;
+        } else {
+            grilio_transport_uring_handle_write_error(self, -res);
+            return FALSE;
+        }
+    }
+
+    /* Signal handlers may submit more requests, dequeue first */
+    sent = g_new(GRilIoRequest*, nsent + 1);
+    for (i = 0; i < nsent; i++) {
+        sent[i] = self->send_queue[i].req;
+    }
+    self->send_count -= nsent;
+    memmove(self->send_queue, self->send_queue + nsent,
+        sizeof(self->send_queue[0]) * self->send_count);
+    self->write_chain = 0;
+
+    for (i = 0; i < nsent; i++) {
+        if (self->fd >= 0) {
+            grilio_transport_signal_request_sent(transport, sent[i]);
+        }
+        grilio_request_unref(sent[i]);
+    }
+    g_free(sent);
+    return self->fd >= 0;
+}
+
+static
+void
+grilio_transport_uring_write_done(
+    GRilIoTransportUring* self,
+    guint tag,
+    guint index,
+    int res)
+{
+    if (tag == URING_TAG_SUB) {
+        self->sub_result = res;
+    } else if (index < self->send_count) {
+        self->send_queue[index].result = res;
+    }
+    GASSERT(self->write_cqes);
+    if (self->write_cqes && !(--self->write_cqes)) {
+        if (grilio_transport_uring_chain_done(self)) {
+            grilio_transport_uring_submit_writes(self);
+        }
+    }
+}
+
+/*==========================================================================*
+ * Completion
+ *==========================================================================*/
+
+static
+gboolean
+grilio_transport_uring_callback(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
+{
+    GRilIoTransportUring* self = GRILIO_TRANSPORT_URING(user_data);
+    gboolean result;
+
+    g_object_ref(self);
+    while (self->ring_fd >= 0) {
+        guint head = *self->cq_head;
+        const guint tail = __atomic_load_n(self->cq_tail, __ATOMIC_ACQUIRE);
+        struct io_uring_cqe cqe;
+
+        if (head == tail) {
+            break;
+        }
+
+        /* Copy the entry and release the slot before handling it */
+        cqe = self->cqes[head & self->cq_mask];
+        __atomic_store_n(self->cq_head, head + 1, __ATOMIC_RELEASE);
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            self->inflight--;
+        }
+
+        switch (URING_USER_DATA_TAG(cqe.user_data)) {
+        case URING_TAG_RECV:
+            grilio_transport_uring_recv_done(self, cqe.res, cqe.flags);
+            break;
+        case URING_TAG_SUB:
+        case URING_TAG_WRITE:
+            grilio_transport_uring_write_done(self,
+                URING_USER_DATA_TAG(cqe.user_data),
+                URING_USER_DATA_INDEX(cqe.user_data), cqe.res);
+            break;
+        }
+    }
+
+    if (self->ring_fd >= 0) {
+        grilio_transport_uring_arm_recv(self);
+        grilio_transport_uring_submit(self);
+    }
+
+    /* The source is removed by grilio_transport_uring_shutdown_io */
+    result = self->ring_source_id ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+    g_object_unref(self);
+    return result;
+}
+
+/*==========================================================================*
+ * Methods
+ *==========================================================================*/
+
+static
+GRILIO_SEND_STATUS
+grilio_transport_uring_send(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    guint code)
+{
+    GRilIoTransportUring* self = GRILIO_TRANSPORT_URING(transport);
+
+    if (req && self->fd >= 0 && self->send_count < URING_SEND_WINDOW) {
+        GRilIoTransportUringPacket* packet;
+        const guint datalen = grilio_request_size(req);
+        const guint serial = grilio_request_serial(req);
+
+        /* Length includes the header excluding the length iteslf */
+        packet = self->send_queue + (self->send_count++);
+        memset(packet, 0, sizeof(*packet));
+        packet->header[0] = GINT32_TO_BE(datalen + RIL_REQUEST_HEADER_SIZE);
+        packet->header[1] = GUINT32_TO_RIL(code);
+        packet->header[2] = GUINT32_TO_RIL(serial);
+        packet->req = grilio_request_ref(req);
+
+        /* Requests queued while the chain is in flight go in the next one */
+        grilio_transport_uring_submit_writes(self);
+        grilio_transport_uring_submit(self);
+        return GRILIO_SEND_PENDING;
+    }
+    return GRILIO_SEND_ERROR;
+}
+
+static
+guint
+grilio_transport_uring_send_window(
+    GRilIoTransport* transport)
+{
+    return URING_SEND_WINDOW;
+}
+
+static
+void
+grilio_transport_uring_shutdown(
+    GRilIoTransport* transport,
+    gboolean flush)
+{
+    GRilIoTransportUring* self = GRILIO_TRANSPORT_URING(transport);
+
+    grilio_transport_uring_shutdown_io(self);
+    grilio_transport_disconnected(&self->parent);
+}
+
+/*==========================================================================*
+ * API
+ *==========================================================================*/
+
+GRilIoTransport*
+grilio_transport_uring_new(
+    int fd,
+    const char* sub,
+    gboolean can_close)
+{
+    if (G_LIKELY(fd >= 0 && (!sub || strlen(sub) == RIL_SUB_LEN))) {
+        GRilIoTransportUring* self = g_object_new
+            (GRILIO_TYPE_TRANSPORT_URING, NULL);
+
+        if (grilio_transport_uring_init_ring(self)) {
+            self->fd = fd;
+            self->can_close = can_close;
+            if (sub) {
+                memcpy(self->sub, sub, RIL_SUB_LEN);
+            } else {
+                self->sub_pos = RIL_SUB_LEN;
+            }
+            self->ring_source_id = g_unix_fd_add_full(G_PRIORITY_DEFAULT,
+                self->ring_fd, G_IO_IN, grilio_transport_uring_callback,
+                self, NULL);
+            grilio_transport_uring_arm_recv(self);
+            grilio_transport_uring_submit_writes(self);
+            grilio_transport_uring_submit(self);
+            return &self->parent;
+        }
+
+        GDEBUG("io_uring is not available, using socket transport");
+        g_object_unref(self);
+        return grilio_transport_socket_new(fd, sub, can_close);
+    }
+    return NULL;
+}
+
+/*==========================================================================*
+ * Internals
+ *==========================================================================*/
+
+static
+void
+grilio_transport_uring_init(
+    GRilIoTransportUring* self)
+{
+    self->fd = -1;
+    self->ring_fd = -1;
+    self->multishot = TRUE;
+    /* The kernel reads packet headers from here, don't move them */
+    self->send_queue = g_new(GRilIoTransportUringPacket, URING_SEND_WINDOW);
+}
+
+static
+void
+grilio_transport_uring_finalize(
+    GObject* object)
+{
+    GRilIoTransportUring* self = GRILIO_TRANSPORT_URING(object);
+
+    grilio_transport_uring_shutdown_io(self);
+    g_free(self->send_queue);
+    grilio_buffer_unref(self->read_buf);
+    G_OBJECT_CLASS(PARENT_CLASS)->finalize(object);
+}
+
+static
+void
+grilio_transport_uring_class_init(
+    GRilIoTransportUringClass* klass)
+{
+    klass->send = grilio_transport_uring_send;
+    klass->send_window = grilio_transport_uring_send_window;
+    klass->shutdown = grilio_transport_uring_shutdown;
+    G_OBJECT_CLASS(klass)->finalize = grilio_transport_uring_finalize;
+}
+
+#else /* !HAVE_IO_URING */
+
+GRilIoTransport*
+grilio_transport_uring_new(
+    int fd,
+    const char* sub,
+    gboolean can_close)
+{
+    GDEBUG("io_uring support is not compiled in, using socket transport");
+    return grilio_transport_socket_new(fd, sub, can_close);
+}
+
+#endif /* !HAVE_IO_URING */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures CPU time spent by the library per request (or indication)
+ * with the in-process loopback transport, i.e. the cost of the channel,
+ * queue and dispatch machinery alone, without any system calls.
+ */
+
+#include "grilio_transport_p.h"
+#include "grilio_channel.h"
+#include "grilio_queue.h"
+#include "grilio_request.h"
+#include "grilio_p.h"
+
+#include <gutil_log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_COUNT (10000)
+#define BENCH_UNSOL_CODE (2000)
+#define BENCH_REQUEST_CODE (100)
+#define BENCH_RIL_VERSION (10)
+
+typedef struct bench_run {
+    GMainLoop* loop;
+    GRilIoTransport* transport;
+    GRilIoChannel* channel;
+    GRilIoQueue* queue;
+    guint count;
+    guint done;
+} BenchRun;
+
+typedef struct bench_time {
+    gint64 cpu;
+    gint64 wall;
+} BenchTime;
+
+static
+gint64
+bench_cpu_time(
+    void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ((gint64)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static
+void
+bench_time_start(
+    BenchTime* t)
+{
+    t->cpu = bench_cpu_time();
+    t->wall = g_get_monotonic_time();
+}
+
+static
+void
+bench_time_stop(
+    BenchTime* t)
+{
+    t->cpu = bench_cpu_time() - t->cpu;
+    t->wall = (g_get_monotonic_time() - t->wall) * 1000;
+}
+
+static
+void
+bench_report(
+    const char* name,
+    const BenchTime* t,
+    guint count)
+{
+    printf("%-14s %8.0f ns/packet (cpu) %8.0f ns/packet (wall)\n",
+        name, ((double)t->cpu)/count, ((double)t->wall)/count);
+}
+
+static
+void
+bench_respond(
+    GRilIoTransport* transport,
+    guint code,
+    guint serial,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    grilio_transport_loopback_respond(transport, serial, GRILIO_STATUS_OK,
+        NULL, 0);
+}
+
+static
+void
+bench_channel_connected(
+    GRilIoChannel* channel,
+    void* user_data)
+{
+    g_main_loop_quit(((BenchRun*)user_data)->loop);
+}
+
+static
+void
+bench_init(
+    BenchRun* run,
+    guint count)
+{
+    memset(run, 0, sizeof(*run));
+    run->count = count;
+    run->loop = g_main_loop_new(NULL, FALSE);
+    run->transport = grilio_transport_loopback_new(bench_respond, run);
+}
+
+static
+void
+bench_init_channel(
+    BenchRun* run,
+    guint count)
+{
+    gulong id;
+
+    bench_init(run, count);
+    run->channel = grilio_channel_new(run->transport);
+    id = grilio_channel_add_connected_handler(run->channel,
+        bench_channel_connected, run);
+    grilio_transport_loopback_connect(run->transport, BENCH_RIL_VERSION);
+    g_main_loop_run(run->loop);
+    grilio_channel_remove_handler(run->channel, id);
+    g_assert(run->channel->connected);
+}
+
+static
+void
+bench_deinit(
+    BenchRun* run)
+{
+    grilio_queue_unref(run->queue);
+    grilio_channel_shutdown(run->channel, FALSE);
+    grilio_channel_unref(run->channel);
+    grilio_transport_shutdown(run->transport, FALSE);
+    grilio_transport_unref(run->transport);
+    g_main_loop_unref(run->loop);
+}
+
+/*==========================================================================*
+ * Transport
+ *==========================================================================*/
+
+static
+void
+bench_transport_send(
+    BenchRun* run,
+    GRilIoRequest* req)
+{
+    req->current_id = run->done + 1;
+    g_assert(grilio_transport_send(run->transport, req,
+        BENCH_REQUEST_CODE) == GRILIO_SEND_OK);
+}
+
+static
+void
+bench_transport_response(
+    GRilIoTransport* transport,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    BenchRun* run = user_data;
+
+    if (++(run->done) == run->count) {
+        g_main_loop_quit(run->loop);
+    } else {
+        GRilIoRequest* req = grilio_request_new();
+
+        bench_transport_send(run, req);
+        grilio_request_unref(req);
+    }
+}
+
+static
+void
+bench_transport(
+    guint count)
+{
+    BenchRun run;
+    BenchTime t;
+    GRilIoRequest* req = grilio_request_new();
+    gulong id;
+
+    bench_init(&run, count);
+    id = grilio_transport_add_response_handler(run.transport,
+        bench_transport_response, &run);
+
+    bench_time_start(&t);
+    bench_transport_send(&run, req);
+    g_main_loop_run(run.loop);
+    bench_time_stop(&t);
+    bench_report("transport", &t, count);
+
+    grilio_transport_remove_handler(run.transport, id);
+    grilio_request_unref(req);
+    bench_deinit(&run);
+}
+
+/*==========================================================================*
+ * Channel
+ *==========================================================================*/
+
+static
+void
+bench_channel_burst_response(
+    GRilIoChannel* channel,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    BenchRun* run = user_data;
+
+    if (++(run->done) == run->count) {
+        g_main_loop_quit(run->loop);
+    }
+}
+
+static
+void
+bench_channel_serial_response(
+    GRilIoChannel* channel,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    BenchRun* run = user_data;
+
+    if (++(run->done) == run->count) {
+        g_main_loop_quit(run->loop);
+    } else {
+        grilio_channel_send_request_full(channel, NULL, BENCH_REQUEST_CODE,
+            bench_channel_serial_response, NULL, run);
+    }
+}
+
+static
+void
+bench_channel_serial(
+    guint count)
+{
+    BenchRun run;
+    BenchTime t;
+
+    bench_init_channel(&run, count);
+    bench_time_start(&t);
+    grilio_channel_send_request_full(run.channel, NULL, BENCH_REQUEST_CODE,
+        bench_channel_serial_response, NULL, &run);
+    g_main_loop_run(run.loop);
+    bench_time_stop(&t);
+    bench_report("channel", &t, count);
+    bench_deinit(&run);
+}
+
+static
+void
+bench_channel_burst(
+    guint count)
+{
+    BenchRun run;
+    BenchTime t;
+    guint i;
+
+    bench_init_channel(&run, count);
+    bench_time_start(&t);
+    for (i = 0; i < count; i++) {
+        grilio_channel_send_request_full(run.channel, NULL,
+            BENCH_REQUEST_CODE, bench_channel_burst_response, NULL, &run);
+    }
+    g_main_loop_run(run.loop);
+    bench_time_stop(&t);
+    bench_report("channel-burst", &t, count);
+    bench_deinit(&run);
+}
+
+static
+void
+bench_queue_burst(
+    guint count)
+{
+    BenchRun run;
+    BenchTime t;
+    guint i;
+
+    bench_init_channel(&run, count);
+    run.queue = grilio_queue_new(run.channel);
+    bench_time_start(&t);
+    for (i = 0; i < count; i++) {
+        grilio_queue_send_request_full(run.queue, NULL,
+            BENCH_REQUEST_CODE, bench_channel_burst_response, NULL, &run);
+    }
+    g_main_loop_run(run.loop);
+    bench_time_stop(&t);
+    bench_report("queue-burst", &t, count);
+    bench_deinit(&run);
+}
+
+/*==========================================================================*
+ * Unsol
+ *==========================================================================*/
+
+static
+void
+bench_unsol_event(
+    GRilIoChannel* channel,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    BenchRun* run = user_data;
+
+    if (++(run->done) == run->count) {
+        g_main_loop_quit(run->loop);
+    }
+}
+
+static
+void
+bench_unsol(
+    guint count)
+{
+    BenchRun run;
+    BenchTime t;
+    gulong id;
+    guint i;
+
+    bench_init_channel(&run, count);
+    id = grilio_channel_add_unsol_event_handler(run.channel,
+        bench_unsol_event, BENCH_UNSOL_CODE, &run);
+    bench_time_start(&t);
+    for (i = 0; i < count; i++) {
+        grilio_transport_loopback_indicate(run.transport, BENCH_UNSOL_CODE,
+            NULL, 0);
+    }
+    g_main_loop_run(run.loop);
+    bench_time_stop(&t);
+    bench_report("unsol", &t, count);
+    grilio_channel_remove_handler(run.channel, id);
+    bench_deinit(&run);
+}
+
+/*==========================================================================*
+ * Main
+ *==========================================================================*/
+
+int main(int argc, char* argv[])
+{
+    guint count = BENCH_DEFAULT_COUNT;
+    int opt;
+
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
+    g_type_init();
+    G_GNUC_END_IGNORE_DEPRECATIONS;
+
+    gutil_log_timestamp = FALSE;
+    gutil_log_default.level = GLOG_LEVEL_NONE;
+    while ((opt = getopt(argc, argv, "n:v")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'v':
+            gutil_log_default.level = GLOG_LEVEL_VERBOSE;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n COUNT] [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!count) {
+        count = 1;
+    }
+
+    printf("%u requests\n", count);
+    bench_transport(count);
+    bench_channel_serial(count);
+    bench_channel_burst(count);
+    bench_queue_burst(count);
+    bench_unsol(count);
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
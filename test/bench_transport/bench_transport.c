@@ -0,0 +1,479 @@
+/*
+ * Copyright (C) 2018-2019 Jolla Ltd.
+ * Copyright (C) 2018-2019 Slava Monich <slava.monich@jolla.com>
+ *
+ * You may use this file under the terms of BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the names of the copyright holders nor the names of its
+ *      contributors may be used to endorse or promote products derived
+ *      from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Compares CPU time spent by the main thread per packet for different
+ * transport implementations. The other end of the socket is served by
+ * a separate thread which doesn't count.
+ */
+
+#include "grilio_transport_p.h"
+#include "grilio_request.h"
+#include "grilio_p.h"
+
+#include <gutil_log.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define BENCH_DEFAULT_COUNT (10000)
+#define BENCH_DEFAULT_SIZE (64)
+#define BENCH_UNSOL_CODE (2000)
+#define BENCH_REQUEST_CODE (100)
+#define BENCH_RIL_VERSION (10)
+
+typedef struct bench_transport {
+    const char* name;
+    GRilIoTransport* (*create)(int fd);
+} BenchTransport;
+
+typedef struct bench_io {
+    int fd;
+    const guint8* data;
+    gsize size;
+} BenchIo;
+
+typedef struct bench_run {
+    GMainLoop* loop;
+    GRilIoTransport* transport;
+    GRilIoRequest* req;
+    guint count;
+    guint done;
+} BenchRun;
+
+typedef struct bench_time {
+    gint64 cpu;
+    gint64 wall;
+} BenchTime;
+
+static
+GRilIoTransport*
+bench_socket_new(
+    int fd)
+{
+    return grilio_transport_socket_new(fd, NULL, FALSE);
+}
+
+static
+GRilIoTransport*
+bench_socket_batch_new(
+    int fd)
+{
+    GRilIoTransport* transport = grilio_transport_socket_new(fd, NULL, FALSE);
+
+    grilio_transport_socket_set_read_batch(transport, 64);
+    return transport;
+}
+
+static
+GRilIoTransport*
+bench_fd_new(
+    int fd)
+{
+    return grilio_transport_fd_new(fd, NULL, FALSE);
+}
+
+static
+GRilIoTransport*
+bench_uring_new(
+    int fd)
+{
+    return grilio_transport_uring_new(fd, NULL, FALSE);
+}
+
+static
+GRilIoTransport*
+bench_thread_new(
+    int fd)
+{
+    return grilio_transport_thread_new(fd, NULL, FALSE);
+}
+
+static const BenchTransport bench_transports[] = {
+    { "socket", bench_socket_new },
+    { "socket-batch", bench_socket_batch_new },
+    { "fd", bench_fd_new },
+    { "uring", bench_uring_new },
+    { "thread", bench_thread_new }
+};
+
+static
+gint64
+bench_cpu_time(
+    void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ((gint64)ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static
+void
+bench_time_start(
+    BenchTime* t)
+{
+    t->cpu = bench_cpu_time();
+    t->wall = g_get_monotonic_time();
+}
+
+static
+void
+bench_time_stop(
+    BenchTime* t)
+{
+    t->cpu = bench_cpu_time() - t->cpu;
+    t->wall = (g_get_monotonic_time() - t->wall) * 1000;
+}
+
+static
+void
+bench_report(
+    const char* name,
+    const char* what,
+    const BenchTime* t,
+    guint count)
+{
+    printf("%-14s %-5s %8.0f ns/packet (cpu) %8.0f ns/packet (wall)\n",
+        name, what, ((double)t->cpu)/count, ((double)t->wall)/count);
+}
+
+static
+gpointer
+bench_writer(
+    gpointer data)
+{
+    BenchIo* io = data;
+    gsize pos = 0;
+
+    while (pos < io->size) {
+        const gssize n = write(io->fd, io->data + pos, io->size - pos);
+
+        if (n > 0) {
+            pos += n;
+        } else if (n < 0 && errno != EINTR) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static
+gpointer
+bench_reader(
+    gpointer data)
+{
+    BenchIo* io = data;
+    guint8 buf[0x4000];
+    gsize total = 0;
+
+    while (total < io->size) {
+        const gssize n = read(io->fd, buf, sizeof(buf));
+
+        if (n > 0) {
+            total += n;
+        } else if (!n || errno != EINTR) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static
+void
+bench_append_unsol(
+    GByteArray* buf,
+    guint code,
+    const void* data,
+    guint len)
+{
+    guint32 header[3];
+
+    header[0] = GUINT32_TO_BE(len + RIL_UNSOL_HEADER_SIZE);
+    header[1] = GUINT32_TO_RIL(RIL_PACKET_TYPE_UNSOLICITED);
+    header[2] = GUINT32_TO_RIL(code);
+    g_byte_array_append(buf, (void*)header, sizeof(header));
+    g_byte_array_append(buf, data, len);
+}
+
+static
+void
+bench_append_connected(
+    GByteArray* buf)
+{
+    guint32 data[2];
+
+    data[0] = GUINT32_TO_RIL(1);
+    data[1] = GUINT32_TO_RIL(BENCH_RIL_VERSION);
+    bench_append_unsol(buf, RIL_UNSOL_RIL_CONNECTED, data, sizeof(data));
+}
+
+/*==========================================================================*
+ * Receive
+ *==========================================================================*/
+
+static
+void
+bench_recv_indication(
+    GRilIoTransport* transport,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    BenchRun* run = user_data;
+
+    if (code == BENCH_UNSOL_CODE && ++(run->done) == run->count) {
+        g_main_loop_quit(run->loop);
+    }
+}
+
+static
+void
+bench_recv(
+    const BenchTransport* bt,
+    guint count,
+    guint size)
+{
+    int fd[2];
+    guint i;
+    gulong id;
+    GThread* thread;
+    BenchRun run;
+    BenchTime t;
+    BenchIo io;
+    GByteArray* buf = g_byte_array_new();
+    guint8* payload = g_malloc0(size);
+
+    bench_append_connected(buf);
+    for (i = 0; i < count; i++) {
+        bench_append_unsol(buf, BENCH_UNSOL_CODE, payload, size);
+    }
+
+    memset(&run, 0, sizeof(run));
+    run.count = count;
+    run.loop = g_main_loop_new(NULL, FALSE);
+
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    run.transport = bt->create(fd[0]);
+    id = grilio_transport_add_indication_handler(run.transport,
+        bench_recv_indication, &run);
+
+    io.fd = fd[1];
+    io.data = buf->data;
+    io.size = buf->len;
+
+    bench_time_start(&t);
+    thread = g_thread_new("writer", bench_writer, &io);
+    g_main_loop_run(run.loop);
+    bench_time_stop(&t);
+    g_thread_join(thread);
+    bench_report(bt->name, "recv", &t, count);
+
+    grilio_transport_remove_handler(run.transport, id);
+    grilio_transport_unref(run.transport);
+    g_main_loop_unref(run.loop);
+    g_byte_array_unref(buf);
+    g_free(payload);
+    close(fd[0]);
+    close(fd[1]);
+}
+
+/*==========================================================================*
+ * Send
+ *==========================================================================*/
+
+static
+void
+bench_send_next(
+    BenchRun* run)
+{
+    while (run->done < run->count) {
+        switch (grilio_transport_send(run->transport, run->req,
+            BENCH_REQUEST_CODE)) {
+        case GRILIO_SEND_OK:
+            run->done++;
+            break;
+        case GRILIO_SEND_PENDING:
+            /* Wait for request_sent */
+            return;
+        case GRILIO_SEND_ERROR:
+            GERR("Send failed");
+            run->count = run->done;
+            break;
+        }
+    }
+    g_main_loop_quit(run->loop);
+}
+
+static
+void
+bench_send_connected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    g_main_loop_quit(((BenchRun*)user_data)->loop);
+}
+
+static
+void
+bench_send_request_sent(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    void* user_data)
+{
+    BenchRun* run = user_data;
+
+    run->done++;
+    bench_send_next(run);
+}
+
+static
+void
+bench_send(
+    const BenchTransport* bt,
+    guint count,
+    guint size)
+{
+    int fd[2];
+    gulong id[2];
+    GThread* thread;
+    BenchRun run;
+    BenchTime t;
+    BenchIo io;
+    GByteArray* buf = g_byte_array_new();
+    guint8* payload = g_malloc0(size);
+
+    memset(&run, 0, sizeof(run));
+    run.count = count;
+    run.loop = g_main_loop_new(NULL, FALSE);
+    run.req = grilio_request_sized_new(size);
+    grilio_request_append_bytes(run.req, payload, size);
+
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    run.transport = bt->create(fd[0]);
+    id[0] = grilio_transport_add_connected_handler(run.transport,
+        bench_send_connected, &run);
+    id[1] = grilio_transport_add_request_sent_handler(run.transport,
+        bench_send_request_sent, &run);
+
+    /* Wait until the transport gets connected */
+    bench_append_connected(buf);
+    g_assert(write(fd[1], buf->data, buf->len) == buf->len);
+    g_main_loop_run(run.loop);
+    g_assert(run.transport->connected);
+
+    io.fd = fd[1];
+    io.data = NULL;
+    io.size = ((gsize)count) * (size + RIL_REQUEST_HEADER_SIZE + 4);
+
+    bench_time_start(&t);
+    thread = g_thread_new("reader", bench_reader, &io);
+    bench_send_next(&run);
+    if (run.done < run.count) {
+        g_main_loop_run(run.loop);
+    }
+    bench_time_stop(&t);
+    g_thread_join(thread);
+    bench_report(bt->name, "send", &t, count);
+
+    grilio_transport_remove_all_handlers(run.transport, id);
+    grilio_transport_unref(run.transport);
+    grilio_request_unref(run.req);
+    g_main_loop_unref(run.loop);
+    g_byte_array_unref(buf);
+    g_free(payload);
+    close(fd[0]);
+    close(fd[1]);
+}
+
+/*==========================================================================*
+ * Main
+ *==========================================================================*/
+
+int main(int argc, char* argv[])
+{
+    guint i;
+    guint count = BENCH_DEFAULT_COUNT;
+    guint size = BENCH_DEFAULT_SIZE;
+    int opt;
+
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
+    g_type_init();
+    G_GNUC_END_IGNORE_DEPRECATIONS;
+
+    gutil_log_timestamp = FALSE;
+    gutil_log_default.level = GLOG_LEVEL_NONE;
+    while ((opt = getopt(argc, argv, "n:s:v")) != -1) {
+        switch (opt) {
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 's':
+            /* Keep it aligned */
+            size = (atoi(optarg) + 3) & ~3;
+            break;
+        case 'v':
+            gutil_log_default.level = GLOG_LEVEL_VERBOSE;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n COUNT] [-s SIZE] [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!count) {
+        count = 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    printf("%u packets, %u bytes each\n", count, size);
+    for (i = 0; i < G_N_ELEMENTS(bench_transports); i++) {
+        bench_recv(bench_transports + i, count, size);
+        bench_send(bench_transports + i, count, size);
+    }
+    return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
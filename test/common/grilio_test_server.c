@@ -35,6 +35,7 @@
 
 #include <gutil_log.h>
 
+#include <errno.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -56,6 +57,7 @@ struct grilio_test_server {
     GByteArray* write_data;
     GSList* handlers;
     GHashTable* code_handlers;
+    gboolean seqpacket;
 };
 
 typedef struct grilio_test_server_handler {
@@ -95,12 +97,39 @@ grilio_test_server_start_writing(
     }
 }
 
+static
+gboolean
+grilio_test_server_write_seqpacket(
+    GRilIoTestServer* server)
+{
+    /* Strip the length and send each packet as a separate message */
+    while (server->write_pos + 4 <= server->write_data->len) {
+        const guint8* ptr = server->write_data->data + server->write_pos;
+        const guint32 len = GUINT32_FROM_BE(*(guint32*)ptr);
+        if (send(server->server_fd, ptr + 4, len,
+            MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return TRUE;
+            }
+            GERR("%s", strerror(errno));
+            return FALSE;
+        }
+        server->write_pos += len + 4;
+    }
+    server->write_data = g_byte_array_set_size(server->write_data, 0);
+    server->write_pos = 0;
+    return FALSE;
+}
+
 static
 gboolean
 grilio_test_server_write(
     GRilIoTestServer* server)
 {
     GError* error = NULL;
+    if (server->seqpacket) {
+        return grilio_test_server_write_seqpacket(server);
+    }
     if (server->write_pos < server->write_data->len) {
         gsize bytes_written = 0;
         int len = server->write_data->len - server->write_pos;
@@ -142,6 +171,66 @@ grilio_test_server_call_handlers(
     }
 }
 
+static
+void
+grilio_test_server_handle_request(
+    GRilIoTestServer* server,
+    const guint32* header,
+    guint32 len)
+{
+    const guint32 code = GUINT32_FROM_RIL(header[0]);
+    const guint32 id = GUINT32_FROM_RIL(header[1]);
+    const guint32 data_len = len - RIL_REQUEST_HEADER_SIZE;
+    const void* data = header + 2;
+    GDEBUG("Request %u, id=%u, len=%u", code, id, data_len);
+    grilio_test_server_call_handlers(server->handlers, code, id,
+        data, data_len);
+    if (server->code_handlers) {
+        grilio_test_server_call_handlers(g_hash_table_lookup(
+            server->code_handlers, GINT_TO_POINTER(code)), code,
+            id, data, data_len);
+    }
+}
+
+static
+gboolean
+grilio_test_server_read_seqpacket(
+    GRilIoTestServer* server)
+{
+    /* Each message is one packet without the length prefix */
+    gssize len = recv(server->server_fd, NULL, 0,
+        MSG_DONTWAIT | MSG_PEEK | MSG_TRUNC);
+    if (len > 0) {
+        g_byte_array_set_size(server->read_buf, len);
+        len = recv(server->server_fd, server->read_buf->data, len,
+            MSG_DONTWAIT);
+    }
+    if (len < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return TRUE;
+        }
+        GERR("%s", strerror(errno));
+        return FALSE;
+    } else if (!len) {
+        GERR("EOF?");
+        return FALSE;
+    }
+    GVERBOSE("Received %ld bytes", (long)len);
+    if (server->sub_len < sizeof(server->sub)) {
+        GASSERT(len == sizeof(server->sub));
+        memcpy(server->sub, server->read_buf->data, sizeof(server->sub));
+        server->sub_len = sizeof(server->sub);
+        GDEBUG("Subscription %.4s", server->sub);
+        grilio_test_server_start_writing(server);
+    } else {
+        GASSERT(len >= RIL_REQUEST_HEADER_SIZE);
+        grilio_test_server_handle_request(server,
+            (const guint32*)server->read_buf->data, len);
+    }
+    g_byte_array_set_size(server->read_buf, 0);
+    return TRUE;
+}
+
 static
 gboolean
 grilio_test_server_read(
@@ -149,6 +238,9 @@ grilio_test_server_read(
 {
     GError* error = NULL;
     gsize bytes_read;
+    if (server->seqpacket) {
+        return grilio_test_server_read_seqpacket(server);
+    }
     if (server->sub_len < sizeof(server->sub)) {
         bytes_read = 0;
         if (g_io_channel_read_chars(server->io_channel,
@@ -188,19 +280,7 @@ grilio_test_server_read(
             const guint32 len = GUINT32_FROM_BE(header[0]);
             GASSERT(len >= 8);
             if (server->read_buf->len >= len + 4) {
-                const guint32 code = GUINT32_FROM_RIL(header[1]);
-                const guint32 id = GUINT32_FROM_RIL(header[2]);
-                const guint32 data_len = len - RIL_REQUEST_HEADER_SIZE;
-                const void* data = server->read_buf->data +
-                    (4 + RIL_REQUEST_HEADER_SIZE);
-                GDEBUG("Request %u, id=%u, len=%u", code, id, data_len);
-                grilio_test_server_call_handlers(server->handlers, code, id,
-                    data, data_len);
-                if (server->code_handlers) {
-                    grilio_test_server_call_handlers(g_hash_table_lookup(
-                        server->code_handlers, GINT_TO_POINTER(code)), code,
-                        id, data, data_len);
-                }
+                grilio_test_server_handle_request(server, header + 1, len);
                 g_byte_array_remove_range(server->read_buf, 0, len + 4);
             } else {
                 break;
@@ -236,12 +316,12 @@ grilio_test_server_write_callback(
     return ok;
 }
 
+static
 GRilIoTestServer*
-grilio_test_server_new(
+grilio_test_server_init(
+    GRilIoTestServer* server,
     gboolean expect_sub)
 {
-    GRilIoTestServer* server = g_new0(GRilIoTestServer, 1);
-    socketpair(AF_UNIX, SOCK_STREAM, 0, server->fd);
     server->io_channel = g_io_channel_unix_new(server->server_fd);
     server->read_buf = g_byte_array_new();
     server->write_data = g_byte_array_new();
@@ -256,6 +336,43 @@ grilio_test_server_new(
     return server;
 }
 
+static
+GRilIoTestServer*
+grilio_test_server_new_full(
+    gboolean expect_sub,
+    int type)
+{
+    GRilIoTestServer* server = g_new0(GRilIoTestServer, 1);
+    socketpair(AF_UNIX, type, 0, server->fd);
+    server->seqpacket = (type == SOCK_SEQPACKET);
+    return grilio_test_server_init(server, expect_sub);
+}
+
+GRilIoTestServer*
+grilio_test_server_new(
+    gboolean expect_sub)
+{
+    return grilio_test_server_new_full(expect_sub, SOCK_STREAM);
+}
+
+GRilIoTestServer*
+grilio_test_server_new_seqpacket(
+    gboolean expect_sub)
+{
+    return grilio_test_server_new_full(expect_sub, SOCK_SEQPACKET);
+}
+
+GRilIoTestServer*
+grilio_test_server_new_accepted(
+    int fd,
+    gboolean expect_sub)
+{
+    GRilIoTestServer* server = g_new0(GRilIoTestServer, 1);
+    server->server_fd = fd;
+    server->client_fd = -1;
+    return grilio_test_server_init(server, expect_sub);
+}
+
 void
 grilio_test_server_free(
     GRilIoTestServer* server)
@@ -268,7 +385,7 @@ grilio_test_server_free(
     g_byte_array_unref(server->read_buf);
     g_io_channel_unref(server->io_channel);
     if (server->server_fd >= 0) close(server->server_fd);
-    close(server->client_fd);
+    if (server->client_fd >= 0) close(server->client_fd);
     g_free(server);
 }
 
@@ -292,6 +409,15 @@ grilio_test_server_shutdown(
     GRilIoTestServer* server)
 {
     if (server->server_fd >= 0) {
+        /* The descriptor may get reused, the watches must go too */
+        if (server->write_watch_id) {
+            g_source_remove(server->write_watch_id);
+            server->write_watch_id = 0;
+        }
+        if (server->read_watch_id) {
+            g_source_remove(server->read_watch_id);
+            server->read_watch_id = 0;
+        }
         shutdown(server->server_fd, SHUT_RDWR);
         close(server->server_fd);
         server->server_fd= -1;
@@ -52,6 +52,17 @@ GRilIoTestServer*
 grilio_test_server_new(
     gboolean expect_sub);
 
+/* Packets are sent and received without the length prefix */
+GRilIoTestServer*
+grilio_test_server_new_seqpacket(
+    gboolean expect_sub);
+
+/* Takes ownership of the connected socket, e.g. returned by accept() */
+GRilIoTestServer*
+grilio_test_server_new_accepted(
+    int fd,
+    gboolean expect_sub);
+
 void
 grilio_test_server_free(
     GRilIoTestServer* server);
@@ -44,6 +44,12 @@
 #include <gutil_log.h>
 #include <gutil_macros.h>
 
+#include <glib-unix.h>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 #define TEST_TIMEOUT (10) /* seconds */
 
 #define RIL_REQUEST_TEST_0 (10)
@@ -1206,710 +1212,2437 @@ test_transaction2(
 }
 
 /*==========================================================================*
- * WriteError
+ * Transaction3
+ *
+ * Transaction requests go ahead of a long backlog queued by another
+ * queue and by the channel itself.
+ *
  *==========================================================================*/
 
+#define TRANSACTION3_BACKLOG (50)
+#define TRANSACTION3_COUNT (4)
+
+typedef struct test_transaction3_data {
+    Test test;
+    GRilIoQueue* q;
+    GRilIoQueue* tx;
+    int backlog_done;
+    int tx_done;
+} TestTransaction3;
+
 static
 void
-test_write_error_handler(
+test_transaction3_backlog_done(
     GRilIoChannel* io,
-    const GError* error,
+    int status,
+    const void* data,
+    guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    GDEBUG("%s", GERRMSG(error));
-    g_main_loop_quit(test->loop);
+    TestTransaction3* t = user_data;
+
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(t->tx_done == TRANSACTION3_COUNT);
+    t->backlog_done++;
+    GDEBUG("Backlog completion count %d", t->backlog_done);
+    if (t->backlog_done == 2 * TRANSACTION3_BACKLOG) {
+        g_main_loop_quit(t->test.loop);
+    }
 }
 
 static
 void
-test_write_completion(
+test_transaction3_tx_done(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    GDEBUG("Completion status %d", status);
+    TestTransaction3* t = user_data;
+
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(!t->backlog_done);
+    t->tx_done++;
+    GDEBUG("Transaction completion count %d", t->tx_done);
+    if (t->tx_done == TRANSACTION3_COUNT) {
+        grilio_queue_transaction_finish(t->tx);
+    }
 }
 
 static
 void
-test_write_error1_connected(
-    GRilIoChannel* io,
-    void* user_data)
+test_transaction3(
+    void)
 {
-    Test* test = user_data;
-    grilio_test_server_shutdown(test->server);
-    /* This should result in test_write_error getting invoked */
-    grilio_channel_add_error_handler(test->io, test_write_error_handler, test);
-    grilio_channel_send_request(io, NULL, RIL_REQUEST_TEST);
+    TestTransaction3* t = test_new(TestTransaction3, "Transaction3");
+    Test* test = &t->test;
+    int i;
+
+    t->q = grilio_queue_new(test->io);
+    t->tx = grilio_queue_new(test->io);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
+        test_response_reflect_ok, test);
+
+    g_assert(grilio_queue_transaction_start(t->tx) ==
+        GRILIO_TRANSACTION_STARTED);
+    for (i = 0; i < TRANSACTION3_BACKLOG; i++) {
+        grilio_queue_send_request_full(t->q, NULL, RIL_REQUEST_TEST,
+            test_transaction3_backlog_done, NULL, t);
+        grilio_channel_send_request_full(test->io, NULL, RIL_REQUEST_TEST,
+            test_transaction3_backlog_done, NULL, t);
+    }
+    for (i = 0; i < TRANSACTION3_COUNT; i++) {
+        grilio_queue_send_request_full(t->tx, NULL, RIL_REQUEST_TEST,
+            test_transaction3_tx_done, NULL, t);
+    }
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+    g_assert(t->tx_done == TRANSACTION3_COUNT);
+    g_assert(grilio_queue_transaction_state(t->tx) ==
+        GRILIO_TRANSACTION_NONE);
+
+    grilio_queue_unref(t->q);
+    grilio_queue_unref(t->tx);
+    test_free(test);
 }
 
+/*==========================================================================*
+ * Priority
+ *==========================================================================*/
+
+#define PRIORITY_COUNT (7)
+
+typedef struct test_priority_data {
+    Test test;
+    GRilIoQueue* q;
+    int order[PRIORITY_COUNT];
+    int responses;
+} TestPriority;
+
 static
 void
-test_write_error2_connected(
+test_priority_response(
     GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
     void* user_data)
 {
-    guint id;
-    Test* test = user_data;
-    grilio_test_server_shutdown(test->server);
-    /* This should result in test_write_error getting invoked */
-    grilio_channel_add_error_handler(test->io, test_write_error_handler, test);
-    id = grilio_channel_send_request(io, NULL, RIL_REQUEST_TEST);
-    /* The first cancel should succeed, the second one fail */
-    g_assert(grilio_channel_cancel_request(io, id, TRUE));
-    g_assert(!grilio_channel_cancel_request(io, id, TRUE));
-    /* There's no requests with zero id */
-    g_assert(!grilio_channel_cancel_request(io, 0, TRUE));
+    TestPriority* t = user_data;
+    GRilIoParser parser;
+    gint32 count, value;
+
+    g_assert(status == GRILIO_STATUS_OK);
+    grilio_parser_init(&parser, data, len);
+    g_assert(grilio_parser_get_int32(&parser, &count));
+    g_assert(grilio_parser_get_int32(&parser, &value));
+    g_assert(count == 1);
+    GDEBUG("Response %d", value);
+    g_assert(t->responses < PRIORITY_COUNT);
+    t->order[t->responses++] = value;
+    if (t->responses == PRIORITY_COUNT) {
+        g_main_loop_quit(t->test.loop);
+    }
 }
 
 static
 void
-test_write_error3_connected(
-    GRilIoChannel* io,
-    void* user_data)
-{
-    guint id;
-    Test* test = user_data;
-    grilio_test_server_shutdown(test->server);
-    /* This should result in test_write_error getting invoked */
-    grilio_channel_add_error_handler(test->io, test_write_error_handler, test);
-    id = grilio_channel_send_request_full(io, NULL,
-        RIL_REQUEST_TEST, test_write_completion, NULL, test);
-    /* The first cancel should succeed, the second one fail */
-    g_assert(grilio_channel_cancel_request(io, id, TRUE));
-    g_assert(!grilio_channel_cancel_request(io, id, TRUE));
-    /* INT_MAX is a non-existent id */
-    g_assert(!grilio_channel_cancel_request(io, INT_MAX, TRUE));
+test_priority_send(
+    TestPriority* t,
+    GRilIoQueue* q,
+    GRILIO_PRIORITY priority,
+    int value)
+{
+    GRilIoRequest* req = grilio_request_array_int32_new(1, value);
+
+    grilio_request_set_priority(req, priority);
+    if (q) {
+        grilio_queue_send_request_full(q, req, RIL_REQUEST_TEST,
+            test_priority_response, NULL, t);
+    } else {
+        grilio_channel_send_request_full(t->test.io, req, RIL_REQUEST_TEST,
+            test_priority_response, NULL, t);
+    }
+    grilio_request_unref(req);
 }
 
 static
 void
-test_write_error(
-    const char* name,
-    GRilIoChannelEventFunc connected)
+test_priority(
+    void)
 {
-    Test* test = test_new(Test, name);
-    grilio_channel_add_connected_handler(test->io, connected, test);
+    static const int expected[PRIORITY_COUNT] = { 5, 2, 3, 6, 0, 1, 4 };
+    TestPriority* t = test_new(TestPriority, "Priority");
+    Test* test = &t->test;
+    int i;
+
+    /* NULL resistance and invalid values */
+    grilio_request_set_priority(NULL, GRILIO_PRIORITY_HIGH);
+    grilio_queue_set_priority(NULL, GRILIO_PRIORITY_HIGH);
+    grilio_channel_set_priority_aging(NULL, 0);
+
+    /* No aging in this test */
+    grilio_channel_set_priority_aging(test->io, 0);
+    t->q = grilio_queue_new(test->io);
+    grilio_queue_set_priority(t->q, GRILIO_PRIORITY_HIGH);
+    grilio_queue_set_priority(t->q, (GRILIO_PRIORITY)42);
+    grilio_queue_set_priority(t->q, GRILIO_PRIORITY_LOW);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
+        test_response_reflect_ok, test);
+
+    /* Everything gets queued before the channel is connected */
+    test_priority_send(t, t->q, GRILIO_PRIORITY_DEFAULT, 0);
+    test_priority_send(t, t->q, GRILIO_PRIORITY_DEFAULT, 1);
+    test_priority_send(t, NULL, GRILIO_PRIORITY_DEFAULT, 2);
+    test_priority_send(t, t->q, GRILIO_PRIORITY_NORMAL, 3);
+    test_priority_send(t, NULL, GRILIO_PRIORITY_LOW, 4);
+    test_priority_send(t, t->q, GRILIO_PRIORITY_HIGH, 5);
+    test_priority_send(t, NULL, (GRILIO_PRIORITY)42, 6); /* Ignored */
+
+    /* Run the test */
     g_main_loop_run(test->loop);
+    for (i = 0; i < PRIORITY_COUNT; i++) {
+        g_assert(t->order[i] == expected[i]);
+    }
+
+    grilio_queue_unref(t->q);
     test_free(test);
 }
 
+/*==========================================================================*
+ * PriorityAging
+ *==========================================================================*/
+
 static
 void
-test_write_error1(
+test_priority_aging(
     void)
 {
-    g_assert(!grilio_channel_new_socket("/", NULL));
-    g_assert(!grilio_channel_new_socket(NULL, NULL));
-    test_write_error("WriteError1", test_write_error1_connected);
+    TestPriority* t = test_new(TestPriority, "PriorityAging");
+    Test* test = &t->test;
+    int i;
+
+    grilio_channel_set_priority_aging(test->io, 1);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
+        test_response_reflect_ok, test);
+
+    /* Low priority requests have been waiting for long enough
+     * to get ahead of high priority ones */
+    test_priority_send(t, NULL, GRILIO_PRIORITY_LOW, 0);
+    test_priority_send(t, NULL, GRILIO_PRIORITY_LOW, 1);
+    test_priority_send(t, NULL, GRILIO_PRIORITY_LOW, 2);
+    g_usleep(10000);
+    test_priority_send(t, NULL, GRILIO_PRIORITY_HIGH, 3);
+    test_priority_send(t, NULL, GRILIO_PRIORITY_NORMAL, 4);
+    test_priority_send(t, NULL, GRILIO_PRIORITY_HIGH, 5);
+    test_priority_send(t, NULL, GRILIO_PRIORITY_NORMAL, 6);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+    for (i = 0; i < 3; i++) {
+        g_assert(t->order[i] == i);
+    }
+    test_free(test);
 }
 
+/*==========================================================================*
+ * Window
+ *==========================================================================*/
+
+#define WINDOW_SIZE (2)
+#define WINDOW_COUNT (10)
+
+typedef struct test_window_data {
+    Test test;
+    int received;
+    int completed;
+    int closed;
+    int opened;
+} TestWindow;
+
 static
 void
-test_write_error2(
-    void)
+test_window_request(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
+    void* user_data)
 {
-    test_write_error("WriteError2", test_write_error2_connected);
+    TestWindow* t = user_data;
+
+    t->received++;
+    GDEBUG("Request #%d received", t->received);
+    g_assert(t->received - t->completed <= WINDOW_SIZE);
+    grilio_test_server_add_response_data(t->test.server, id,
+        GRILIO_STATUS_OK, NULL, 0);
 }
 
 static
 void
-test_write_error3(
-    void)
+test_window_response(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
 {
-    test_write_error("WriteError3", test_write_error3_connected);
-}
+    TestWindow* t = user_data;
 
-/*==========================================================================*
- * Disconnect
- *==========================================================================*/
+    g_assert(status == GRILIO_STATUS_OK);
+    t->completed++;
+    if (t->completed == WINDOW_COUNT) {
+        g_main_loop_quit(t->test.loop);
+    }
+}
 
 static
 void
-test_disconnect_handler(
+test_window_changed(
     GRilIoChannel* io,
     void* user_data)
 {
-    Test* test = user_data;
-    g_main_loop_quit(test->loop);
+    TestWindow* t = user_data;
+
+    if (grilio_channel_window_is_open(io)) {
+        t->opened++;
+        g_assert(t->opened == t->closed);
+    } else {
+        t->closed++;
+        g_assert(t->closed == t->opened + 1);
+    }
 }
 
 static
 void
-test_disconnect(
+test_window(
     void)
 {
-    Test* test = test_new(Test, "EOF");
-    grilio_channel_add_disconnected_handler(test->io,
-        test_disconnect_handler, test);
-    grilio_test_server_shutdown(test->server);
+    TestWindow* t = test_new(TestWindow, "Window");
+    Test* test = &t->test;
+    int i;
+
+    /* NULL resistance */
+    g_assert(!grilio_channel_add_window_changed_handler(NULL, NULL, NULL));
+    g_assert(!grilio_channel_add_window_changed_handler(test->io, NULL,
+        NULL));
+    g_assert(!grilio_channel_window_is_open(NULL));
+    g_assert(!grilio_channel_pending_window(NULL));
+    grilio_channel_set_max_pending(NULL, 0);
+    grilio_channel_set_adaptive_window(NULL, 0);
+
+    g_assert(!grilio_channel_pending_window(test->io));
+    grilio_channel_set_max_pending(test->io, WINDOW_SIZE);
+    g_assert(grilio_channel_pending_window(test->io) == WINDOW_SIZE);
+    g_assert(grilio_channel_window_is_open(test->io));
+    grilio_channel_add_window_changed_handler(test->io,
+        test_window_changed, t);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
+        test_window_request, t);
+    for (i = 0; i < WINDOW_COUNT; i++) {
+        grilio_channel_send_request_full(test->io, NULL, RIL_REQUEST_TEST,
+            test_window_response, NULL, t);
+    }
+
+    /* Run the test */
     g_main_loop_run(test->loop);
+    g_assert(t->received == WINDOW_COUNT);
+    g_assert(t->closed > 0);
+    g_assert(t->opened == t->closed);
+    g_assert(grilio_channel_window_is_open(test->io));
     test_free(test);
 }
 
 /*==========================================================================*
- * ShortPacket
+ * AdaptiveWindow
  *==========================================================================*/
 
+#define ADAPTIVE_WINDOW_MAX (4)
+
+typedef struct test_adaptive_window_data {
+    Test test;
+    int completed;
+} TestAdaptiveWindow;
+
 static
 void
-test_short_packet_handler(
+test_adaptive_window_ok(
     GRilIoChannel* io,
-    const GError* error,
+    int status,
+    const void* data,
+    guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    GDEBUG("%s", GERRMSG(error));
-    g_main_loop_quit(test->loop);
+    TestAdaptiveWindow* t = user_data;
+
+    g_assert(status == GRILIO_STATUS_OK);
+    t->completed++;
+    GDEBUG("Window %u after %d response(s)",
+        grilio_channel_pending_window(io), t->completed);
+    switch (t->completed) {
+    case 1:
+        /* 1 out of 2 */
+        g_assert(grilio_channel_pending_window(io) == 2);
+        break;
+    case 2:
+        g_assert(grilio_channel_pending_window(io) == 3);
+        break;
+    case 5:
+        g_assert(grilio_channel_pending_window(io) == 4);
+        break;
+    case 9:
+        /* Can't grow beyond the maximum */
+        g_assert(grilio_channel_pending_window(io) == ADAPTIVE_WINDOW_MAX);
+        g_main_loop_quit(t->test.loop);
+        break;
+    }
 }
 
 static
 void
-test_short_packet(
+test_adaptive_window_timeout(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestAdaptiveWindow* t = user_data;
+    int i;
+
+    g_assert(status == GRILIO_STATUS_TIMEOUT);
+    g_assert(grilio_channel_pending_window(io) == ADAPTIVE_WINDOW_MAX/2);
+    for (i = 0; i < 9; i++) {
+        grilio_channel_send_request_full(io, NULL, RIL_REQUEST_TEST,
+            test_adaptive_window_ok, NULL, t);
+    }
+}
+
+static
+void
+test_adaptive_window(
     void)
 {
-    Test* test = test_new(Test, "ShortPacket");
-    static char data[2] = {0xff, 0xff};
-    guint32 pktlen = GINT32_TO_BE(sizeof(data));
-    grilio_channel_add_error_handler(test->io, test_short_packet_handler, test);
-    grilio_test_server_add_data(test->server, &pktlen, sizeof(pktlen));
-    grilio_test_server_add_data(test->server, data, sizeof(data));
-    /* These two do nothing (but improve branch coverage): */
-    grilio_channel_add_error_handler(NULL, test_short_packet_handler, NULL);
-    grilio_channel_add_error_handler(test->io, NULL, NULL);
+    TestAdaptiveWindow* t = test_new(TestAdaptiveWindow, "AdaptiveWindow");
+    Test* test = &t->test;
+    GRilIoRequest* req = grilio_request_new();
+
+    grilio_channel_set_max_pending(test->io, 2 * ADAPTIVE_WINDOW_MAX);
+    grilio_channel_set_adaptive_window(test->io, 10000);
+    g_assert(grilio_channel_pending_window(test->io) ==
+        2 * ADAPTIVE_WINDOW_MAX);
+    grilio_channel_set_max_pending(test->io, ADAPTIVE_WINDOW_MAX);
+    g_assert(grilio_channel_pending_window(test->io) == ADAPTIVE_WINDOW_MAX);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
+        test_response_empty_ok, test);
+
+    /* This one doesn't get a response and times out */
+    grilio_request_set_timeout(req, 10);
+    grilio_channel_send_request_full(test->io, req, RIL_REQUEST_TEST_2,
+        test_adaptive_window_timeout, NULL, t);
+    grilio_request_unref(req);
+
+    /* Run the test */
     g_main_loop_run(test->loop);
+    g_assert(t->completed == 9);
+
+    /* Back to the fixed window */
+    grilio_channel_set_adaptive_window(test->io, 0);
+    g_assert(grilio_channel_pending_window(test->io) == ADAPTIVE_WINDOW_MAX);
+    grilio_channel_set_max_pending(test->io, 0);
+    g_assert(!grilio_channel_pending_window(test->io));
     test_free(test);
 }
 
 /*==========================================================================*
- * ShortResponse
+ * Dedup
  *==========================================================================*/
 
+#define DEDUP_TIMEOUT (500)
+
+typedef struct test_dedup_data {
+    Test test;
+    int received;
+    int ok;
+    int cancelled;
+    int timed_out;
+    guint leader_id;
+    guint follower_id;
+} TestDedup;
+
+typedef struct test_dedup_req {
+    TestDedup* t;
+    int value;
+} TestDedupReq;
+
 static
 void
-test_short_response_error(
-    GRilIoChannel* io,
-    const GError* error,
+test_dedup_request(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    GDEBUG("%s", GERRMSG(error));
-    g_main_loop_quit(test->loop);
+    TestDedup* t = user_data;
+
+    t->received++;
+    GDEBUG("Request #%d received", t->received);
+    grilio_test_server_add_response_data(t->test.server, id,
+        GRILIO_STATUS_OK, data, len);
 }
 
 static
 void
-test_short_response(
-    void)
+test_dedup_response(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
 {
-    Test* test = test_new(Test, "ShortResponse");
-    guint32 packet[4];
-    memset(packet, 0, sizeof(packet));
-    packet[0] = GUINT32_TO_BE(9); /* Has to be > 8 */
-    packet[1] = GUINT32_TO_RIL(RIL_PACKET_TYPE_SOLICITED);
-    grilio_channel_add_error_handler(test->io, test_short_response_error, test);
-    grilio_test_server_add_data(test->server, packet, sizeof(packet));
-    /* And wait for the connection to terminate */
-    g_main_loop_run(test->loop);
-    test_free(test);
+    TestDedupReq* r = user_data;
+    TestDedup* t = r->t;
+
+    switch (status) {
+    case GRILIO_STATUS_OK:
+        {
+            GRilIoParser parser;
+            int value;
+
+            /* Every caller gets the response to its own payload */
+            grilio_parser_init(&parser, data, len);
+            g_assert(grilio_parser_get_int32(&parser, &value));
+            g_assert(value == r->value);
+            t->ok++;
+            GDEBUG("Response #%d (%d)", t->ok, value);
+            if (t->ok == 5) {
+                /* The leader has been sent, cancel it */
+                g_assert(grilio_channel_cancel_request(io, t->leader_id,
+                    TRUE));
+                g_assert(!grilio_channel_cancel_request(io, t->leader_id,
+                    TRUE));
+                g_assert(grilio_channel_get_request(io, t->follower_id));
+            }
+        }
+        break;
+    case GRILIO_STATUS_CANCELLED:
+        t->cancelled++;
+        break;
+    case GRILIO_STATUS_TIMEOUT:
+        /* The remaining attached requests share the leader's fate */
+        t->timed_out++;
+        if (t->timed_out == 2) {
+            g_main_loop_quit(t->test.loop);
+        }
+        break;
+    default:
+        g_assert(FALSE);
+        break;
+    }
 }
 
-/*==========================================================================*
- * ShortResponse2
- *==========================================================================*/
+static
+guint
+test_dedup_send(
+    TestDedup* t,
+    GRilIoQueue* queue,
+    guint code,
+    int value,
+    int timeout)
+{
+    GRilIoRequest* req = grilio_request_new();
+    TestDedupReq* r = g_new0(TestDedupReq, 1);
+    guint id;
+
+    r->t = t;
+    r->value = value;
+    grilio_request_append_int32(req, value);
+    grilio_request_set_timeout(req, timeout);
+    if (queue) {
+        id = grilio_queue_send_request_full(queue, req, code,
+            test_dedup_response, g_free, r);
+    } else {
+        id = grilio_channel_send_request_full(t->test.io, req, code,
+            test_dedup_response, g_free, r);
+    }
+    grilio_request_unref(req);
+    g_assert(id);
+    return id;
+}
 
 static
 void
-test_short_response2(
+test_dedup(
     void)
 {
-    Test* test = test_new(Test, "ShortResponse2");
-    guint32 packet[4];
-    memset(packet, 0, sizeof(packet));
-    packet[0] = GUINT32_TO_BE(9); /* Has to be > 8 */
-    packet[1] = GUINT32_TO_RIL(RIL_PACKET_TYPE_SOLICITED_ACK_EXP);
-    grilio_channel_add_error_handler(test->io, test_short_response_error, test);
-    grilio_test_server_add_data(test->server, packet, sizeof(packet));
-    /* And wait for the connection to terminate */
+    TestDedup* t = test_new(TestDedup, "Dedup");
+    Test* test = &t->test;
+    GRilIoQueue* queue = grilio_queue_new(test->io);
+    guint id1, id2, id3;
+
+    /* NULL resistance */
+    grilio_channel_set_deduplicate(NULL, TRUE);
+    grilio_queue_set_deduplicate(NULL, TRUE);
+
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
+        test_dedup_request, t);
+
+    /* Identical requests get attached to the first one */
+    grilio_channel_set_deduplicate(test->io, TRUE);
+    id1 = test_dedup_send(t, NULL, RIL_REQUEST_TEST, 1, GRILIO_TIMEOUT_DEFAULT);
+    id2 = test_dedup_send(t, NULL, RIL_REQUEST_TEST, 1, GRILIO_TIMEOUT_DEFAULT);
+    id3 = test_dedup_send(t, NULL, RIL_REQUEST_TEST, 1, GRILIO_TIMEOUT_DEFAULT);
+    test_dedup_send(t, NULL, RIL_REQUEST_TEST, 2, GRILIO_TIMEOUT_DEFAULT);
+    g_assert(grilio_channel_get_request(test->io, id2));
+
+    /* These never get a response */
+    t->leader_id = test_dedup_send(t, NULL, RIL_REQUEST_TEST_2, 4,
+        DEDUP_TIMEOUT);
+    t->follower_id = test_dedup_send(t, NULL, RIL_REQUEST_TEST_2, 4,
+        GRILIO_TIMEOUT_DEFAULT);
+    test_dedup_send(t, NULL, RIL_REQUEST_TEST_2, 4, GRILIO_TIMEOUT_DEFAULT);
+
+    /* Only the requests submitted via the queue are deduplicated */
+    grilio_channel_set_deduplicate(test->io, FALSE);
+    grilio_queue_set_deduplicate(queue, TRUE);
+    test_dedup_send(t, queue, RIL_REQUEST_TEST, 3, GRILIO_TIMEOUT_DEFAULT);
+    test_dedup_send(t, queue, RIL_REQUEST_TEST, 3, GRILIO_TIMEOUT_DEFAULT);
+    test_dedup_send(t, NULL, RIL_REQUEST_TEST, 3, GRILIO_TIMEOUT_DEFAULT);
+
+    /* Cancelling the attached request doesn't affect the leader */
+    g_assert(grilio_channel_cancel_request(test->io, id3, TRUE));
+    g_assert(!grilio_channel_cancel_request(test->io, id3, TRUE));
+
+    /* Cancelling the leader passes the baton to the attached request */
+    g_assert(grilio_channel_cancel_request(test->io, id1, TRUE));
+    g_assert(!grilio_channel_get_request(test->io, id1));
+    g_assert(grilio_channel_get_request(test->io, id2));
+    g_assert(t->cancelled == 2);
+
+    /* Run the test */
     g_main_loop_run(test->loop);
+    g_assert(t->received == 4);
+    g_assert(t->ok == 5);
+    g_assert(t->cancelled == 3);
+    g_assert(t->timed_out == 2);
+    grilio_queue_unref(queue);
     test_free(test);
 }
 
 /*==========================================================================*
- * Logger
+ * DedupTransaction
  *==========================================================================*/
 
-typedef struct test_logger_packet {
-    GRILIO_PACKET_TYPE type;
-    guint id;
-    guint code;
-    const guint8* data;
-    guint len;
-    guint header_len;
-} TestLoggerPacket;
-
-#define TEST_LOGGER_DATA 0x01, 0x02, 0x03
-
-static const guint8 test_logger_packet_1[] = {
-    TEST_INT32_BYTES(RIL_PACKET_TYPE_UNSOLICITED),          /* type */
-    TEST_INT32_BYTES(RIL_UNSOL_RIL_CONNECTED),              /* id */
-    TEST_INT32_BYTES(1),
-    TEST_INT32_BYTES(GRILIO_RIL_VERSION)
-};
-static const guint8 test_logger_packet_2[] = {
-    TEST_INT32_BYTES(RIL_REQUEST_TEST),                     /* code */
-    TEST_INT32_BYTES(1)                                     /* id */
-};
-static const guint8 test_logger_packet_3[] = {
-    TEST_INT32_BYTES(RIL_REQUEST_TEST_1),                   /* code */
-    TEST_INT32_BYTES(2),                                    /* id */
-    TEST_LOGGER_DATA
-};
-static const guint8 test_logger_packet_4[] = {
-    TEST_INT32_BYTES(RIL_PACKET_TYPE_SOLICITED_ACK),        /* type */
-    TEST_INT32_BYTES(1)                                     /* id */
-};
-static const guint8 test_logger_packet_5[] = {
-    TEST_INT32_BYTES(RIL_PACKET_TYPE_SOLICITED_ACK_EXP),    /* type */
-    TEST_INT32_BYTES(1),                                    /* id */
-    TEST_INT32_BYTES(RIL_E_SUCCESS),                        /* status */
-    TEST_INT32_BYTES(8),
-    TEST_INT16_BYTES('L'), TEST_INT16_BYTES('O'),
-    TEST_INT16_BYTES('G'), TEST_INT16_BYTES('T'),
-    TEST_INT16_BYTES('E'), TEST_INT16_BYTES('S'),
-    TEST_INT16_BYTES('T'), TEST_INT16_BYTES('0'),
-    TEST_INT32_BYTES(0)
-};
-static const guint8 test_logger_packet_6[] = {
-    TEST_INT32_BYTES(RIL_RESPONSE_ACKNOWLEDGEMENT),         /* code */
-    TEST_INT32_BYTES(3)                                     /* id */
-};
-static const guint8 test_logger_packet_7[] = {
-    TEST_INT32_BYTES(RIL_PACKET_TYPE_SOLICITED),            /* type */
-    TEST_INT32_BYTES(2),                                    /* id */
-    TEST_INT32_BYTES(RIL_E_SUCCESS),                        /* status */
-    TEST_INT32_BYTES(8),
-    TEST_INT16_BYTES('L'), TEST_INT16_BYTES('O'),
-    TEST_INT16_BYTES('G'), TEST_INT16_BYTES('T'),
-    TEST_INT16_BYTES('E'), TEST_INT16_BYTES('S'),
-    TEST_INT16_BYTES('T'), TEST_INT16_BYTES('1'),
-    TEST_INT32_BYTES(0)
-};
-static const guint8 test_logger_packet_8[] = {
-    TEST_INT32_BYTES(RIL_PACKET_TYPE_UNSOLICITED_ACK_EXP),  /* type */
-    TEST_INT32_BYTES(RIL_REQUEST_TEST_2)                    /* id */
-};
-static const guint8 test_logger_packet_9[] = {
-    TEST_INT32_BYTES(RIL_RESPONSE_ACKNOWLEDGEMENT),         /* code */
-    TEST_INT32_BYTES(4)                                     /* id */
-};
-
-static const TestLoggerPacket test_logger_packets[] = {
-    {
-        GRILIO_PACKET_UNSOL,
-        0,
-        RIL_UNSOL_RIL_CONNECTED,
-        TEST_ARRAY_AND_SIZE(test_logger_packet_1),
-        RIL_UNSOL_HEADER_SIZE
-    },{
-        GRILIO_PACKET_REQ,
-        1,
-        RIL_REQUEST_TEST,
-        TEST_ARRAY_AND_SIZE(test_logger_packet_2),
-        RIL_REQUEST_HEADER_SIZE
-    },{
-        GRILIO_PACKET_REQ,
-        2,
-        RIL_REQUEST_TEST_1,
-        TEST_ARRAY_AND_SIZE(test_logger_packet_3),
-        RIL_REQUEST_HEADER_SIZE
-    },{
-        GRILIO_PACKET_ACK,
-        1,
-        0,
-        TEST_ARRAY_AND_SIZE(test_logger_packet_4),
-        RIL_ACK_HEADER_SIZE
-    },{
-        GRILIO_PACKET_RESP_ACK_EXP,
-        1,
-        0,
-        TEST_ARRAY_AND_SIZE(test_logger_packet_5),
-        RIL_RESPONSE_HEADER_SIZE
-    },{
-        GRILIO_PACKET_REQ,
-        3,
-        RIL_RESPONSE_ACKNOWLEDGEMENT,
-        TEST_ARRAY_AND_SIZE(test_logger_packet_6),
-        RIL_REQUEST_HEADER_SIZE
-    },{
-        GRILIO_PACKET_RESP,
-        2,
-        0,
-        TEST_ARRAY_AND_SIZE(test_logger_packet_7),
-        RIL_RESPONSE_HEADER_SIZE
-    },{
-        GRILIO_PACKET_UNSOL_ACK_EXP,
-        0,
-        RIL_REQUEST_TEST_2,
-        TEST_ARRAY_AND_SIZE(test_logger_packet_8),
-        RIL_UNSOL_HEADER_SIZE
-    },{
-        GRILIO_PACKET_REQ,
-        4,
-        RIL_RESPONSE_ACKNOWLEDGEMENT,
-        TEST_ARRAY_AND_SIZE(test_logger_packet_9),
-        RIL_ACK_HEADER_SIZE
-    }
-};
-
-typedef struct test_logger_data {
+typedef struct test_dedup_tx_data {
     Test test;
-    guint count;
-    guint count2;
-    guint reqid[2];
-} TestLogger;
+    int order[2];
+    int received;
+    int ok;
+} TestDedupTx;
 
 static
 void
-test_logger_response(
-    GRilIoChannel* io,
-    int status,
+test_dedup_tx_request(
+    guint code,
+    guint id,
     const void* data,
     guint len,
     void* user_data)
 {
-    GDEBUG("Response status %d", status);
+    TestDedupTx* t = user_data;
+    GRilIoParser parser;
+    int value;
+
+    grilio_parser_init(&parser, data, len);
+    g_assert(grilio_parser_get_int32(&parser, &value));
+    g_assert(t->received < G_N_ELEMENTS(t->order));
+    t->order[t->received++] = value;
+    GDEBUG("Request #%d (%d) received", t->received, value);
+    grilio_test_server_add_response_data(t->test.server, id,
+        GRILIO_STATUS_OK, data, len);
 }
 
 static
 void
-test_logger_cb(
+test_dedup_tx_response(
     GRilIoChannel* io,
-    GRILIO_PACKET_TYPE type,
-    guint id,
-    guint code,
+    int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestLogger* log = user_data;
-    const TestLoggerPacket* expect = test_logger_packets + (log->count++);
+    TestDedupTx* t = user_data;
 
-    GDEBUG("Packet #%u", log->count);
-    g_assert(log->count <= G_N_ELEMENTS(test_logger_packets));
-    g_assert(type == expect->type);
-    g_assert(id == expect->id);
-    g_assert(code == expect->code);
-    g_assert(len == expect->len);
-    g_assert(!memcmp(data, expect->data, len));
+    g_assert(status == GRILIO_STATUS_OK);
+    t->ok++;
+    if (t->ok == 2) {
+        g_main_loop_quit(t->test.loop);
+    }
 }
 
 static
-void
-test_logger1_cb(
-    GRilIoChannel* io,
-    GRILIO_PACKET_TYPE type,
-    guint id,
-    guint code,
-    const void* data,
-    guint len,
-    void* user_data)
+guint
+test_dedup_tx_send(
+    TestDedupTx* t,
+    GRilIoQueue* queue,
+    int value)
 {
-    TestLogger* log = user_data;
-    /* Count has already need incremented by test_logger_cb */
-    const TestLoggerPacket* expect = test_logger_packets + log->count - 1;
+    GRilIoRequest* req = grilio_request_new();
+    guint id;
 
-    GDEBUG("Packet #%u", log->count);
-    g_assert(log->count <= G_N_ELEMENTS(test_logger_packets));
-    g_assert(type == expect->type);
-    g_assert(id == expect->id);
-    g_assert(code == expect->code);
-    g_assert(len == expect->len);
-    g_assert(!memcmp(data, expect->data, len));
+    grilio_request_append_int32(req, value);
+    id = grilio_queue_send_request_full(queue, req, RIL_REQUEST_TEST,
+        test_dedup_tx_response, NULL, t);
+    grilio_request_unref(req);
+    g_assert(id);
+    return id;
 }
 
 static
 void
-test_logger2_cb(
-    GRilIoChannel* io,
-    GRILIO_PACKET_TYPE type,
-    guint id,
-    guint code,
-    const void* data,
-    guint len,
-    void* user_data)
+test_dedup_transaction(
+    void)
 {
-    TestLogger* log = user_data;
-    const TestLoggerPacket* expect = test_logger_packets + (log->count2++);
+    TestDedupTx* t = test_new(TestDedupTx, "DedupTransaction");
+    Test* test = &t->test;
+    GRilIoQueue* queue = grilio_queue_new(test->io);
+    guint id;
 
-    g_assert(log->count2 <= G_N_ELEMENTS(test_logger_packets));
-    g_assert(type == expect->type);
-    g_assert(id == expect->id);
-    g_assert(code == expect->code);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
+        test_dedup_tx_request, t);
+    grilio_queue_set_deduplicate(queue, TRUE);
+    g_assert(grilio_queue_transaction_start(queue) ==
+        GRILIO_TRANSACTION_STARTED);
+
+    /* The follower takes the leader's place, ahead of the second one */
+    id = test_dedup_tx_send(t, queue, 1);
+    test_dedup_tx_send(t, queue, 2);
+    test_dedup_tx_send(t, queue, 1);
+    g_assert(grilio_channel_cancel_request(test->io, id, FALSE));
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+    g_assert(t->received == 2);
+    g_assert(t->order[0] == 1);
+    g_assert(t->order[1] == 2);
+    grilio_queue_transaction_finish(queue);
+    grilio_queue_unref(queue);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * WriteError
+ *==========================================================================*/
+
+static
+void
+test_write_error_handler(
+    GRilIoChannel* io,
+    const GError* error,
+    void* user_data)
+{
+    Test* test = user_data;
+    GDEBUG("%s", GERRMSG(error));
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_write_completion(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    GDEBUG("Completion status %d", status);
+}
+
+static
+void
+test_write_error1_connected(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    Test* test = user_data;
+    grilio_test_server_shutdown(test->server);
+    /* This should result in test_write_error getting invoked */
+    grilio_channel_add_error_handler(test->io, test_write_error_handler, test);
+    grilio_channel_send_request(io, NULL, RIL_REQUEST_TEST);
+}
+
+static
+void
+test_write_error2_connected(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    guint id;
+    Test* test = user_data;
+    grilio_test_server_shutdown(test->server);
+    /* This should result in test_write_error getting invoked */
+    grilio_channel_add_error_handler(test->io, test_write_error_handler, test);
+    id = grilio_channel_send_request(io, NULL, RIL_REQUEST_TEST);
+    /* The first cancel should succeed, the second one fail */
+    g_assert(grilio_channel_cancel_request(io, id, TRUE));
+    g_assert(!grilio_channel_cancel_request(io, id, TRUE));
+    /* There's no requests with zero id */
+    g_assert(!grilio_channel_cancel_request(io, 0, TRUE));
+}
+
+static
+void
+test_write_error3_connected(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    guint id;
+    Test* test = user_data;
+    grilio_test_server_shutdown(test->server);
+    /* This should result in test_write_error getting invoked */
+    grilio_channel_add_error_handler(test->io, test_write_error_handler, test);
+    id = grilio_channel_send_request_full(io, NULL,
+        RIL_REQUEST_TEST, test_write_completion, NULL, test);
+    /* The first cancel should succeed, the second one fail */
+    g_assert(grilio_channel_cancel_request(io, id, TRUE));
+    g_assert(!grilio_channel_cancel_request(io, id, TRUE));
+    /* INT_MAX is a non-existent id */
+    g_assert(!grilio_channel_cancel_request(io, INT_MAX, TRUE));
+}
+
+static
+void
+test_write_error(
+    const char* name,
+    GRilIoChannelEventFunc connected)
+{
+    Test* test = test_new(Test, name);
+    grilio_channel_add_connected_handler(test->io, connected, test);
+    g_main_loop_run(test->loop);
+    test_free(test);
+}
+
+static
+void
+test_write_error1(
+    void)
+{
+    g_assert(!grilio_channel_new_socket("/", NULL));
+    g_assert(!grilio_channel_new_socket(NULL, NULL));
+    test_write_error("WriteError1", test_write_error1_connected);
+}
+
+static
+void
+test_write_error2(
+    void)
+{
+    test_write_error("WriteError2", test_write_error2_connected);
+}
+
+static
+void
+test_write_error3(
+    void)
+{
+    test_write_error("WriteError3", test_write_error3_connected);
+}
+
+/*==========================================================================*
+ * Disconnect
+ *==========================================================================*/
+
+static
+void
+test_disconnect_handler(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    Test* test = user_data;
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_disconnect(
+    void)
+{
+    Test* test = test_new(Test, "EOF");
+    grilio_channel_add_disconnected_handler(test->io,
+        test_disconnect_handler, test);
+    grilio_test_server_shutdown(test->server);
+    g_main_loop_run(test->loop);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * ShortPacket
+ *==========================================================================*/
+
+static
+void
+test_short_packet_handler(
+    GRilIoChannel* io,
+    const GError* error,
+    void* user_data)
+{
+    Test* test = user_data;
+    GDEBUG("%s", GERRMSG(error));
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_short_packet(
+    void)
+{
+    Test* test = test_new(Test, "ShortPacket");
+    static char data[2] = {0xff, 0xff};
+    guint32 pktlen = GINT32_TO_BE(sizeof(data));
+    grilio_channel_add_error_handler(test->io, test_short_packet_handler, test);
+    grilio_test_server_add_data(test->server, &pktlen, sizeof(pktlen));
+    grilio_test_server_add_data(test->server, data, sizeof(data));
+    /* These two do nothing (but improve branch coverage): */
+    grilio_channel_add_error_handler(NULL, test_short_packet_handler, NULL);
+    grilio_channel_add_error_handler(test->io, NULL, NULL);
+    g_main_loop_run(test->loop);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * ShortResponse
+ *==========================================================================*/
+
+static
+void
+test_short_response_error(
+    GRilIoChannel* io,
+    const GError* error,
+    void* user_data)
+{
+    Test* test = user_data;
+    GDEBUG("%s", GERRMSG(error));
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_short_response(
+    void)
+{
+    Test* test = test_new(Test, "ShortResponse");
+    guint32 packet[4];
+    memset(packet, 0, sizeof(packet));
+    packet[0] = GUINT32_TO_BE(9); /* Has to be > 8 */
+    packet[1] = GUINT32_TO_RIL(RIL_PACKET_TYPE_SOLICITED);
+    grilio_channel_add_error_handler(test->io, test_short_response_error, test);
+    grilio_test_server_add_data(test->server, packet, sizeof(packet));
+    /* And wait for the connection to terminate */
+    g_main_loop_run(test->loop);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * ShortResponse2
+ *==========================================================================*/
+
+static
+void
+test_short_response2(
+    void)
+{
+    Test* test = test_new(Test, "ShortResponse2");
+    guint32 packet[4];
+    memset(packet, 0, sizeof(packet));
+    packet[0] = GUINT32_TO_BE(9); /* Has to be > 8 */
+    packet[1] = GUINT32_TO_RIL(RIL_PACKET_TYPE_SOLICITED_ACK_EXP);
+    grilio_channel_add_error_handler(test->io, test_short_response_error, test);
+    grilio_test_server_add_data(test->server, packet, sizeof(packet));
+    /* And wait for the connection to terminate */
+    g_main_loop_run(test->loop);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * Logger
+ *==========================================================================*/
+
+typedef struct test_logger_packet {
+    GRILIO_PACKET_TYPE type;
+    guint id;
+    guint code;
+    const guint8* data;
+    guint len;
+    guint header_len;
+} TestLoggerPacket;
+
+#define TEST_LOGGER_DATA 0x01, 0x02, 0x03
+
+static const guint8 test_logger_packet_1[] = {
+    TEST_INT32_BYTES(RIL_PACKET_TYPE_UNSOLICITED),          /* type */
+    TEST_INT32_BYTES(RIL_UNSOL_RIL_CONNECTED),              /* id */
+    TEST_INT32_BYTES(1),
+    TEST_INT32_BYTES(GRILIO_RIL_VERSION)
+};
+static const guint8 test_logger_packet_2[] = {
+    TEST_INT32_BYTES(RIL_REQUEST_TEST),                     /* code */
+    TEST_INT32_BYTES(1)                                     /* id */
+};
+static const guint8 test_logger_packet_3[] = {
+    TEST_INT32_BYTES(RIL_REQUEST_TEST_1),                   /* code */
+    TEST_INT32_BYTES(2),                                    /* id */
+    TEST_LOGGER_DATA
+};
+static const guint8 test_logger_packet_4[] = {
+    TEST_INT32_BYTES(RIL_PACKET_TYPE_SOLICITED_ACK),        /* type */
+    TEST_INT32_BYTES(1)                                     /* id */
+};
+static const guint8 test_logger_packet_5[] = {
+    TEST_INT32_BYTES(RIL_PACKET_TYPE_SOLICITED_ACK_EXP),    /* type */
+    TEST_INT32_BYTES(1),                                    /* id */
+    TEST_INT32_BYTES(RIL_E_SUCCESS),                        /* status */
+    TEST_INT32_BYTES(8),
+    TEST_INT16_BYTES('L'), TEST_INT16_BYTES('O'),
+    TEST_INT16_BYTES('G'), TEST_INT16_BYTES('T'),
+    TEST_INT16_BYTES('E'), TEST_INT16_BYTES('S'),
+    TEST_INT16_BYTES('T'), TEST_INT16_BYTES('0'),
+    TEST_INT32_BYTES(0)
+};
+static const guint8 test_logger_packet_6[] = {
+    TEST_INT32_BYTES(RIL_RESPONSE_ACKNOWLEDGEMENT),         /* code */
+    TEST_INT32_BYTES(3)                                     /* id */
+};
+static const guint8 test_logger_packet_7[] = {
+    TEST_INT32_BYTES(RIL_PACKET_TYPE_SOLICITED),            /* type */
+    TEST_INT32_BYTES(2),                                    /* id */
+    TEST_INT32_BYTES(RIL_E_SUCCESS),                        /* status */
+    TEST_INT32_BYTES(8),
+    TEST_INT16_BYTES('L'), TEST_INT16_BYTES('O'),
+    TEST_INT16_BYTES('G'), TEST_INT16_BYTES('T'),
+    TEST_INT16_BYTES('E'), TEST_INT16_BYTES('S'),
+    TEST_INT16_BYTES('T'), TEST_INT16_BYTES('1'),
+    TEST_INT32_BYTES(0)
+};
+static const guint8 test_logger_packet_8[] = {
+    TEST_INT32_BYTES(RIL_PACKET_TYPE_UNSOLICITED_ACK_EXP),  /* type */
+    TEST_INT32_BYTES(RIL_REQUEST_TEST_2)                    /* id */
+};
+static const guint8 test_logger_packet_9[] = {
+    TEST_INT32_BYTES(RIL_RESPONSE_ACKNOWLEDGEMENT),         /* code */
+    TEST_INT32_BYTES(4)                                     /* id */
+};
+
+static const TestLoggerPacket test_logger_packets[] = {
+    {
+        GRILIO_PACKET_UNSOL,
+        0,
+        RIL_UNSOL_RIL_CONNECTED,
+        TEST_ARRAY_AND_SIZE(test_logger_packet_1),
+        RIL_UNSOL_HEADER_SIZE
+    },{
+        GRILIO_PACKET_REQ,
+        1,
+        RIL_REQUEST_TEST,
+        TEST_ARRAY_AND_SIZE(test_logger_packet_2),
+        RIL_REQUEST_HEADER_SIZE
+    },{
+        GRILIO_PACKET_REQ,
+        2,
+        RIL_REQUEST_TEST_1,
+        TEST_ARRAY_AND_SIZE(test_logger_packet_3),
+        RIL_REQUEST_HEADER_SIZE
+    },{
+        GRILIO_PACKET_ACK,
+        1,
+        0,
+        TEST_ARRAY_AND_SIZE(test_logger_packet_4),
+        RIL_ACK_HEADER_SIZE
+    },{
+        GRILIO_PACKET_RESP_ACK_EXP,
+        1,
+        0,
+        TEST_ARRAY_AND_SIZE(test_logger_packet_5),
+        RIL_RESPONSE_HEADER_SIZE
+    },{
+        GRILIO_PACKET_REQ,
+        3,
+        RIL_RESPONSE_ACKNOWLEDGEMENT,
+        TEST_ARRAY_AND_SIZE(test_logger_packet_6),
+        RIL_REQUEST_HEADER_SIZE
+    },{
+        GRILIO_PACKET_RESP,
+        2,
+        0,
+        TEST_ARRAY_AND_SIZE(test_logger_packet_7),
+        RIL_RESPONSE_HEADER_SIZE
+    },{
+        GRILIO_PACKET_UNSOL_ACK_EXP,
+        0,
+        RIL_REQUEST_TEST_2,
+        TEST_ARRAY_AND_SIZE(test_logger_packet_8),
+        RIL_UNSOL_HEADER_SIZE
+    },{
+        GRILIO_PACKET_REQ,
+        4,
+        RIL_RESPONSE_ACKNOWLEDGEMENT,
+        TEST_ARRAY_AND_SIZE(test_logger_packet_9),
+        RIL_ACK_HEADER_SIZE
+    }
+};
+
+typedef struct test_logger_data {
+    Test test;
+    guint count;
+    guint count2;
+    guint reqid[2];
+} TestLogger;
+
+static
+void
+test_logger_response(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    GDEBUG("Response status %d", status);
+}
+
+static
+void
+test_logger_cb(
+    GRilIoChannel* io,
+    GRILIO_PACKET_TYPE type,
+    guint id,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestLogger* log = user_data;
+    const TestLoggerPacket* expect = test_logger_packets + (log->count++);
+
+    GDEBUG("Packet #%u", log->count);
+    g_assert(log->count <= G_N_ELEMENTS(test_logger_packets));
+    g_assert(type == expect->type);
+    g_assert(id == expect->id);
+    g_assert(code == expect->code);
+    g_assert(len == expect->len);
+    g_assert(!memcmp(data, expect->data, len));
+}
+
+static
+void
+test_logger1_cb(
+    GRilIoChannel* io,
+    GRILIO_PACKET_TYPE type,
+    guint id,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestLogger* log = user_data;
+    /* Count has already need incremented by test_logger_cb */
+    const TestLoggerPacket* expect = test_logger_packets + log->count - 1;
+
+    GDEBUG("Packet #%u", log->count);
+    g_assert(log->count <= G_N_ELEMENTS(test_logger_packets));
+    g_assert(type == expect->type);
+    g_assert(id == expect->id);
+    g_assert(code == expect->code);
+    g_assert(len == expect->len);
+    g_assert(!memcmp(data, expect->data, len));
+}
+
+static
+void
+test_logger2_cb(
+    GRilIoChannel* io,
+    GRILIO_PACKET_TYPE type,
+    guint id,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestLogger* log = user_data;
+    const TestLoggerPacket* expect = test_logger_packets + (log->count2++);
+
+    g_assert(log->count2 <= G_N_ELEMENTS(test_logger_packets));
+    g_assert(type == expect->type);
+    g_assert(id == expect->id);
+    g_assert(code == expect->code);
     g_assert(len + expect->header_len == expect->len);
     g_assert(!memcmp(data, expect->data + expect->header_len, len));
 
-    if (log->count2 == G_N_ELEMENTS(test_logger_packets)) {
-        g_main_loop_quit(log->test.loop);
+    if (log->count2 == G_N_ELEMENTS(test_logger_packets)) {
+        g_main_loop_quit(log->test.loop);
+    }
+}
+
+static
+void
+test_logger_resp(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestLogger* log = user_data;
+    Test* test = &log->test;
+
+    grilio_test_server_add_ack(test->server, log->reqid[0]);
+    test_basic_response_ok_ack_exp(test->server, "LOGTEST0", log->reqid[0]);
+    test_basic_response_ok(test->server, "LOGTEST1", log->reqid[1]);
+    grilio_test_server_add_unsol_ack_exp(test->server, NULL, RIL_REQUEST_TEST_2);
+
+    /* Clear the name to improve branch coverage */
+    grilio_channel_set_name(test->io, NULL);
+}
+
+static
+void
+test_logger(
+    void)
+{
+    TestLogger* log = test_new(TestLogger, "Logger");
+    Test* test = &log->test;
+    guint logid[4];
+    int level = GLOG_LEVEL_ALWAYS;
+    static const guint8 data[] = { TEST_LOGGER_DATA };
+
+    /* Test NULL resistance */
+    g_assert(!grilio_channel_add_logger(NULL, NULL, NULL));
+    g_assert(!grilio_channel_add_logger(test->io, NULL, NULL));
+    g_assert(!grilio_channel_add_logger2(NULL, NULL, NULL));
+    g_assert(!grilio_channel_add_logger2(test->io, NULL, NULL));
+    grilio_channel_remove_logger(NULL, 0);
+
+    /* Add another default logger with GLOG_LEVEL_ALWAYS, mainly to
+     * improve code coverage. */
+    logid[0] = grilio_channel_add_default_logger(test->io, level);
+    logid[1] = grilio_channel_add_logger(test->io, test_logger_cb, log);
+    logid[2] = grilio_channel_add_logger(test->io, test_logger1_cb, log);
+    logid[3] = grilio_channel_add_logger2(test->io, test_logger2_cb, log);
+    g_assert(logid[0]);
+    g_assert(logid[1]);
+    g_assert(logid[2]);
+    g_assert(logid[3]);
+    gutil_log(GLOG_MODULE_CURRENT, level, "%s", "");
+
+    grilio_test_server_add_request_func(test->server,
+        RIL_REQUEST_TEST_1, test_logger_resp, log);
+
+    log->reqid[0] = test_basic_request(test, test_logger_response);
+    log->reqid[1] = test_basic_request_full(test, RIL_REQUEST_TEST_1,
+        data, sizeof(data), test_logger_response);
+    g_assert(log->reqid[0]);
+    g_assert(log->reqid[1]);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    /* Remove this one twice to make sure that invalid logger ids are
+     * handled properly, i.e. ignored. */
+    grilio_channel_remove_logger(test->io, logid[0]);
+    grilio_channel_remove_logger(test->io, logid[0]);
+    /* Leave one logger registered, let grilio_channel_finalize free it */
+    grilio_channel_remove_logger(test->io, logid[1]);
+    grilio_channel_remove_logger(test->io, logid[3]);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * Handlers
+ *==========================================================================*/
+
+#define TEST_HANDLERS_COUNT (2)
+#define TEST_HANDLERS_INC_EVENTS_COUNT (3)
+
+enum test_handlers_event {
+    TEST_HANDLERS_INC_EVENT = 1,
+    TEST_HANDLERS_REMOVE_EVENT,
+    TEST_HANDLERS_DONE_EVENT
+};
+
+typedef struct test_handlers_data {
+    Test test;
+    int count1;
+    int count2;
+    int ack_count;
+    gulong next_event_id;
+    gulong total_event_id;
+    gulong id1[TEST_HANDLERS_COUNT];
+    gulong id2[TEST_HANDLERS_COUNT];
+} TestHandlers;
+
+static
+void
+test_handlers_done(
+    GRilIoChannel* io,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    GDEBUG("Done");
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_handlers_remove(
+    GRilIoChannel* io,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestHandlers* h = user_data;
+    Test* test = &h->test;
+    int i;
+
+    g_assert(code == TEST_HANDLERS_REMOVE_EVENT);
+    GDEBUG("Removing handlers");
+    grilio_channel_remove_handlers(test->io, h->id2, TEST_HANDLERS_COUNT);
+
+    /* Doing it a few more times makes no difference */
+    grilio_channel_remove_handlers(test->io, h->id2, TEST_HANDLERS_COUNT);
+    grilio_channel_remove_handlers(test->io, h->id2, 0);
+    grilio_channel_remove_handlers(test->io, NULL, 0);
+    grilio_channel_remove_handlers(NULL, NULL, 0);
+
+    /* Submit more events. This time they should only increment count1 */
+    for (i=0; i<TEST_HANDLERS_INC_EVENTS_COUNT; i++) {
+        grilio_test_server_add_unsol(test->server, NULL,
+            TEST_HANDLERS_INC_EVENT);
+    }
+
+    /* Once those are handled, stop the test */
+    grilio_channel_remove_handler(test->io, h->next_event_id);
+    h->next_event_id = grilio_channel_add_unsol_event_handler(test->io,
+        test_handlers_done, TEST_HANDLERS_DONE_EVENT, h);
+    grilio_test_server_add_unsol(test->server, NULL, TEST_HANDLERS_DONE_EVENT);
+}
+
+static
+void
+test_handlers_inc(
+    GRilIoChannel* io,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    int* count = user_data;
+    (*count)++;
+    GDEBUG("Event %u data %p value %d", code, count, *count);
+}
+
+static
+void
+test_handlers_ack(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestHandlers* h = user_data;
+    h->ack_count++;
+    GDEBUG("Ack %d", h->ack_count);
+}
+
+static
+void
+test_handlers(
+    void)
+{
+    TestHandlers* h = test_new(TestHandlers, "Handlers");
+    Test* test = &h->test;
+    int i, total = 0;
+
+    /* Prepare the test */
+    for (i=0; i<TEST_HANDLERS_COUNT; i++) {
+        h->id1[i] = grilio_channel_add_unsol_event_handler(test->io,
+            test_handlers_inc, TEST_HANDLERS_INC_EVENT, &h->count1);
+        h->id2[i] = grilio_channel_add_unsol_event_handler(test->io,
+            test_handlers_inc, TEST_HANDLERS_INC_EVENT, &h->count2);
+    }
+    h->total_event_id = grilio_channel_add_unsol_event_handler(test->io,
+        test_handlers_inc, 0, &total);
+    for (i=0; i<TEST_HANDLERS_INC_EVENTS_COUNT; i++) {
+        grilio_test_server_add_unsol(test->server, NULL,
+            TEST_HANDLERS_INC_EVENT);
+    }
+
+    /* libgrilio is supposed to ack TEST_HANDLERS_REMOVE_EVENT exactly once */
+    grilio_test_server_add_request_func(test->server,
+        RIL_RESPONSE_ACKNOWLEDGEMENT, test_handlers_ack, h);
+
+    h->next_event_id = grilio_channel_add_unsol_event_handler(test->io,
+        test_handlers_remove, TEST_HANDLERS_REMOVE_EVENT, h);
+    grilio_test_server_add_unsol_ack_exp(test->server, NULL,
+        TEST_HANDLERS_REMOVE_EVENT);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    /* Check the final state */
+    g_assert(h->ack_count == 1);
+    g_assert(h->count1 == 2*TEST_HANDLERS_COUNT*TEST_HANDLERS_INC_EVENTS_COUNT);
+    g_assert(h->count2 == TEST_HANDLERS_COUNT*TEST_HANDLERS_INC_EVENTS_COUNT);
+    /* Total count includes RIL_UNSOL_RIL_CONNECTED + REMOVE and DONE */
+    g_assert(total == TEST_HANDLERS_COUNT*TEST_HANDLERS_INC_EVENTS_COUNT + 3);
+    for (i=0; i<TEST_HANDLERS_COUNT; i++) {
+        g_assert(!h->id2[i]);
+    }
+
+    /* Clean up */
+    grilio_channel_remove_handlers(test->io, h->id1, TEST_HANDLERS_COUNT);
+    grilio_channel_remove_handlers(test->io, h->id2, TEST_HANDLERS_COUNT);
+    grilio_channel_remove_handler(test->io, h->total_event_id);
+    grilio_channel_remove_handler(test->io, h->next_event_id);
+    /* These do nothing: */
+    grilio_channel_remove_handler(test->io, 0);
+    grilio_channel_remove_handler(NULL, 0);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * InvalidResp
+ *==========================================================================*/
+
+static
+void
+test_invalid_resp_no_completion(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    int* resp_count = user_data;
+    GDEBUG("Request 2 completed with status %d", status);
+    g_assert(status == GRILIO_STATUS_CANCELLED);
+    (*resp_count)++;
+}
+
+static
+void
+test_invalid_resp_req2_completion(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    GDEBUG("Request 2 completed with status %d", status);
+    g_assert(status == GRILIO_STATUS_OK);
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_invalid_resp(
+    void)
+{
+    Test* test = test_new(Test, "InvalidResp");
+    GRilIoRequest* req = grilio_request_new();
+    int resp_count = 0;
+
+    /* This one is going to end the test (eventually). */
+    const guint id1 = grilio_channel_send_request_full(test->io, NULL,
+        RIL_REQUEST_TEST, test_invalid_resp_req2_completion, NULL, test);
+
+    /* Response to this request will never arrive. */
+    grilio_channel_send_request_full(test->io, req,
+        RIL_REQUEST_TEST, test_invalid_resp_no_completion, NULL, &resp_count);
+
+    /* INT_MAX is not a valid request id */
+    g_assert(test_basic_response_ok(test->server, "IGNORE", INT_MAX));
+    g_assert(test_basic_response_ok(test->server, "DONE", id1));
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    /* Check the request state. It should be SENT */
+    g_assert(grilio_request_status(req) == GRILIO_REQUEST_SENT);
+    g_assert(!resp_count);
+    grilio_channel_cancel_all(test->io, TRUE);
+    g_assert(resp_count == 1);
+    grilio_request_unref(req);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * Retry1
+ *
+ * We create 3 requests - #1 with request timeout and retry, #2 with one
+ * retries and no request timeout and #3 with infinite number of retries
+ * and no request timeout.
+ *
+ * Then we send error reply to #2 and #3, wait for #1 to time out, send
+ * themselves another request to make sure that #2 and #3 have received
+ * their replies, send another error replies to #3 and #2, wait for #2 to
+ * complete with error and cancel #3. We expect reply count for #3 to be 1
+ *==========================================================================*/
+
+typedef struct test_retry1_data {
+    Test test;
+    int req2_status;
+    int req3_completed;
+    int req4_completed;
+    int req5_completed;
+    int req6_completed;
+    GRilIoRequest* req1;
+    GRilIoRequest* req2;
+    GRilIoRequest* req3;
+    GRilIoRequest* req4;
+    GRilIoRequest* req5;
+    GRilIoRequest* req6;
+} TestRetry1;
+
+static
+void
+test_retry1_continue(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestRetry1* retry = G_CAST(test, TestRetry1, test);
+    guint serial = grilio_request_serial(retry->req2);
+
+    /* This should result in req2 getting completed */
+    GDEBUG("Continuing...");
+    g_assert(serial != grilio_request_id(retry->req2));
+    g_assert(grilio_channel_get_request(io, serial) == retry->req2);
+    grilio_test_server_add_response(test->server, NULL, serial,
+        RIL_E_REQUEST_NOT_SUPPORTED);
+}
+
+static
+void
+test_retry1_req1_timeout(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    GDEBUG("Request 1 completed with status %d", status);
+    if (status == GRILIO_STATUS_TIMEOUT) {
+        test_basic_response_ok(test->server, "TEST",
+            test_basic_request(test, test_retry1_continue));
+    }
+}
+
+static
+gboolean
+test_retry1_req2_retry(
+    GRilIoRequest* request,
+    int ril_status,
+    const void* response_data,
+    guint response_len,
+    void* user_data)
+{
+    return ril_status == RIL_E_GENERIC_FAILURE;
+}
+
+static
+void
+test_retry1_req2_completion(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestRetry1* retry = G_CAST(test, TestRetry1, test);
+    retry->req2_status = status;
+    GDEBUG("Request 2 completed with status %d", status);
+    if (!retry->req3_completed) {
+        /* First cancel should succeed, the second one fail */
+        guint id3 = grilio_request_id(retry->req3);
+        if (grilio_channel_cancel_request(test->io, id3, TRUE) &&
+            !grilio_channel_cancel_request(test->io, id3, TRUE)) {
+            if (retry->req3_completed) {
+                g_main_loop_quit(test->loop);
+            }
+        }
+    }
+}
+
+static
+void
+test_retry1_count_completions(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    int* completed = user_data;
+    (*completed)++;
+}
+
+static
+void
+test_retry1_start(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestRetry1* retry = G_CAST(test, TestRetry1, test);
+    GRilIoQueue* q;
+
+    grilio_channel_send_request_full(test->io, retry->req1,
+        RIL_REQUEST_TEST, test_retry1_req1_timeout, NULL, test);
+    grilio_channel_send_request_full(test->io, retry->req2,
+        RIL_REQUEST_TEST, test_retry1_req2_completion, NULL, test);
+    grilio_channel_send_request_full(test->io, retry->req3,
+        RIL_REQUEST_TEST, test_retry1_count_completions, NULL,
+        &retry->req3_completed);
+    grilio_channel_send_request_full(test->io, retry->req4,
+        RIL_REQUEST_TEST, test_retry1_count_completions, NULL,
+        &retry->req4_completed);
+    grilio_channel_send_request_full(test->io, retry->req5,
+        RIL_REQUEST_TEST, test_retry1_count_completions, NULL,
+        &retry->req5_completed);
+    grilio_channel_send_request_full(test->io, retry->req6,
+        RIL_REQUEST_TEST, test_retry1_count_completions, NULL,
+        &retry->req6_completed);
+
+    /* Can't send the same request twice */
+    q = grilio_queue_new(test->io);
+    g_assert(!grilio_queue_send_request(q, retry->req6, RIL_REQUEST_TEST));
+    grilio_queue_unref(q);
+    g_assert(!grilio_channel_send_request(test->io, retry->req6,
+        RIL_REQUEST_TEST));
+    g_assert(grilio_channel_get_request(test->io,
+        grilio_request_id(retry->req6)) == retry->req6);
+
+    grilio_test_server_add_response(test->server, NULL,
+        retry->req2->current_id, RIL_E_GENERIC_FAILURE);
+    grilio_test_server_add_response(test->server, NULL,
+        retry->req3->current_id, RIL_E_REQUEST_NOT_SUPPORTED);
+    grilio_test_server_add_response(test->server, NULL,
+        retry->req4->current_id, RIL_E_REQUEST_NOT_SUPPORTED);
+    grilio_test_server_add_response(test->server, NULL,
+        retry->req5->current_id, RIL_E_REQUEST_NOT_SUPPORTED);
+    grilio_test_server_add_response(test->server, NULL,
+        retry->req6->current_id, RIL_E_REQUEST_NOT_SUPPORTED);
+    /* And wait for req1 to timeout */
+}
+
+static
+void
+test_retry1(
+    void)
+{
+    TestRetry1* retry = test_new(TestRetry1, "Retry1");
+    Test* test = &retry->test;
+
+    /* Prepare the test */
+    retry->req1 = grilio_request_new();
+    retry->req2 = grilio_request_new();
+    retry->req3 = grilio_request_new();
+    retry->req4 = grilio_request_new();
+    retry->req5 = grilio_request_new();
+    retry->req6 = grilio_request_new();
+
+    grilio_request_set_retry(retry->req1, 10, 1);
+    grilio_request_set_timeout(retry->req1, 10);
+    grilio_request_set_retry(retry->req2, 0, 1);
+    grilio_request_set_retry_func(retry->req2, test_retry1_req2_retry);
+    grilio_request_set_retry(retry->req3, 0, -1);
+    grilio_request_set_retry(retry->req4, INT_MAX-1, -1);
+    grilio_request_set_retry(retry->req5, INT_MAX, -1);
+    grilio_request_set_retry(retry->req6, INT_MAX, -1);
+
+    /* Start after we have been connected */
+    g_assert(!test->io->connected);
+    grilio_channel_add_connected_handler(test->io, test_retry1_start, test);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    /* Check the final state */
+    g_assert(grilio_request_status(retry->req4) == GRILIO_REQUEST_RETRY);
+    g_assert(grilio_request_status(retry->req5) == GRILIO_REQUEST_RETRY);
+    g_assert(grilio_request_status(retry->req6) == GRILIO_REQUEST_RETRY);
+    g_assert(grilio_channel_get_request(test->io,
+        grilio_request_id(retry->req4)) == retry->req4);
+    g_assert(grilio_channel_get_request(test->io,
+        grilio_request_id(retry->req6)) == retry->req6);
+
+    grilio_channel_cancel_request(test->io,
+        grilio_request_id(retry->req5), TRUE);
+    grilio_channel_cancel_request(test->io,
+        grilio_request_id(retry->req4), TRUE);
+    grilio_channel_cancel_all(test->io, TRUE);
+
+    g_assert(grilio_request_status(retry->req4) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(retry->req5) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(retry->req6) == GRILIO_REQUEST_CANCELLED);
+    g_assert(!grilio_channel_get_request(test->io,
+        grilio_request_id(retry->req6)));
+    g_assert(retry->req2_status == RIL_E_REQUEST_NOT_SUPPORTED);
+    g_assert(retry->req3_completed == 1);
+    g_assert(retry->req4_completed == 1);
+    g_assert(grilio_request_retry_count(retry->req1) == 1);
+    g_assert(grilio_request_retry_count(retry->req2) == 1);
+    g_assert(grilio_request_retry_count(retry->req3) == 1);
+    g_assert(grilio_request_retry_count(retry->req4) == 0);
+
+    /* Clean up */
+    grilio_request_unref(retry->req1);
+    grilio_request_unref(retry->req2);
+    grilio_request_unref(retry->req3);
+    grilio_request_unref(retry->req4);
+    grilio_request_unref(retry->req5);
+    grilio_request_unref(retry->req6);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * Retry2
+ *
+ * Makes sure that request ids are incremented on each retry. Two requests
+ * are rejected, the third one times out.
+ *==========================================================================*/
+
+typedef struct test_retry2_data {
+    Test test;
+    guint log_id;
+    guint req_id;
+    GRilIoRequest* req;
+} TestRetry2;
+
+static
+void
+test_retry2_req_done(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestRetry2* retry = G_CAST(test, TestRetry2, test);
+    GDEBUG("Request %u completed with status %d",
+        grilio_request_id(retry->req), status);
+    if (status == RIL_E_GENERIC_FAILURE) {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_retry2_log(
+    GRilIoChannel* channel,
+    GRILIO_PACKET_TYPE type,
+    guint id,
+    guint code,
+    const void* data,
+    guint data_len,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestRetry2* retry = G_CAST(test, TestRetry2, test);
+    if (type == GRILIO_PACKET_REQ) {
+        if (!retry->req_id) {
+            GDEBUG("No request id yet, assuming %u", id);
+            retry->req_id = id;
+        } else {
+            retry->req_id++;
+            g_assert(retry->req_id == id);
+        }
+        if (retry->req_id == id) {
+            GDEBUG("Failing request %u", id);
+            grilio_test_server_add_response(test->server, NULL, id,
+                RIL_E_GENERIC_FAILURE);
+        }
+    }
+}
+
+static
+void
+test_retry2_start(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestRetry2* retry = G_CAST(test, TestRetry2, test);
+
+    retry->req_id = grilio_channel_send_request_full(test->io, retry->req,
+        RIL_REQUEST_TEST, test_retry2_req_done, NULL, test);
+}
+
+static
+void
+test_retry2(
+    void)
+{
+    TestRetry2* retry = test_new(TestRetry2, "Retry2");
+    Test* test = &retry->test;
+    guint id;
+
+    /* Prepare the test */
+    retry->log_id = grilio_channel_add_logger(test->io, test_retry2_log, test);
+    retry->req = grilio_request_new();
+    grilio_request_set_retry(retry->req, 10, 2);
+
+    /* Start after we have been connected */
+    g_assert(!test->io->connected);
+    grilio_channel_add_connected_handler(test->io, test_retry2_start, test);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    /* Check the final state */
+    g_assert(grilio_request_retry_count(retry->req) == 2);
+
+    /* Clean up */
+    id = grilio_request_id(retry->req);
+    g_assert(grilio_request_status(retry->req) == GRILIO_REQUEST_DONE);
+    /* Since it's done, cancel will fail */
+    g_assert(!grilio_channel_cancel_request(test->io, id, FALSE));
+    grilio_request_unref(retry->req);
+    grilio_channel_remove_logger(test->io, retry->log_id);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * Retry3
+ *
+ * Makes sure that we don't retry pending request.
+ *
+ * 1. Create request with a long response and retry timeouts and 1 retry
+ * 2. Reply to it with an error, it gets scheduled for retry
+ * 3. Call grilio_channel_retry_request, it should be retried immediately
+ * 4. Call grilio_channel_retry_request again. It should fail.
+ *
+ * The same thing is done with 2 requests to improve the coverage.
+ *
+ *==========================================================================*/
+
+typedef struct test_retry3_data {
+    Test test;
+    guint dummy_id;
+    GRilIoRequest* req1;
+    GRilIoRequest* req2;
+    int status1;
+    int status2;
+} TestRetry3;
+
+static
+void
+test_retry3_req_completed(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    int* completion_status = user_data;
+    GDEBUG("Request completed with status %d", status);
+    *completion_status = status;
+}
+
+static
+void
+test_retry3_check_req(
+    GRilIoChannel* io,
+    GRilIoRequest* req,
+    guint dummy_id)
+{
+    const guint id = grilio_request_id(req);
+    g_assert(!grilio_channel_retry_request(NULL, dummy_id));
+    g_assert(!grilio_channel_retry_request(io, dummy_id));
+    g_assert(!grilio_channel_retry_request(io, 0));
+    g_assert(grilio_channel_retry_request(io, id));
+    g_assert(!grilio_channel_retry_request(io, id)); /* Must fail */
+    g_assert(!grilio_channel_retry_request(io, dummy_id));
+    g_assert(grilio_channel_cancel_request(io, id, TRUE));
+}
+
+static
+void
+test_retry3_retry_and_cancel(
+    GRilIoChannel* io,
+    int error,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestRetry3* retry = G_CAST(test, TestRetry3, test);
+    if (error) {
+        GDEBUG("Unexpected completion status %d", error);
+    } else {
+        test_retry3_check_req(io, retry->req1, retry->dummy_id);
+        test_retry3_check_req(io, retry->req2, retry->dummy_id);
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_retry3_start(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestRetry3* retry = G_CAST(test, TestRetry3, test);
+
+    grilio_channel_send_request_full(test->io, retry->req1,
+        RIL_REQUEST_TEST, test_retry3_req_completed, NULL, &retry->status1);
+    grilio_channel_send_request_full(test->io, retry->req2,
+        RIL_REQUEST_TEST, test_retry3_req_completed, NULL, &retry->status2);
+    grilio_test_server_add_response(test->server, NULL,
+        grilio_request_id(retry->req1), RIL_E_GENERIC_FAILURE);
+    grilio_test_server_add_response(test->server, NULL,
+        grilio_request_id(retry->req2), RIL_E_GENERIC_FAILURE);
+
+    /* By the time this request completes, the first one should already
+     * be in the retry queue */
+    retry->dummy_id = test_basic_request(test, test_retry3_retry_and_cancel);
+    test_basic_response_ok(test->server, NULL, retry->dummy_id);
+}
+
+static
+void
+test_retry3(
+    void)
+{
+    TestRetry3* retry = test_new(TestRetry3, "Retry3");
+    Test* test = &retry->test;
+    guint id1, id2;
+
+    /* Prepare the test */
+    retry->req1 = grilio_request_new();
+    retry->req2 = grilio_request_new();
+    grilio_request_set_timeout(retry->req1, INT_MAX);
+    grilio_request_set_timeout(retry->req2, INT_MAX);
+    grilio_request_set_retry(retry->req1, INT_MAX, 1);
+    grilio_request_set_retry(retry->req2, INT_MAX-1, 1);
+
+    /* Start after we have been connected */
+    g_assert(!test->io->connected);
+    grilio_channel_add_connected_handler(test->io, test_retry3_start, test);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    /* Check the final state */
+    g_assert(grilio_request_retry_count(retry->req1) == 1);
+    g_assert(grilio_request_retry_count(retry->req2) == 1);
+    g_assert(retry->status1 == GRILIO_STATUS_CANCELLED);
+    g_assert(retry->status2 == GRILIO_STATUS_CANCELLED);
+
+    id1 = grilio_request_id(retry->req1);
+    id2 = grilio_request_id(retry->req2);
+    grilio_channel_cancel_request(test->io, id1, FALSE);
+    grilio_channel_cancel_request(test->io, id2, FALSE);
+    grilio_request_unref(retry->req1);
+    grilio_request_unref(retry->req2);
+}
+
+/*==========================================================================*
+ * Timeout1
+ *==========================================================================*/
+
+typedef struct test_timeout1_data {
+    Test test;
+    int timeout_count;
+    guint req_id;
+    guint timer_id;
+} TestTimeout1;
+
+static
+gboolean
+test_timeout1_done(
+    gpointer user_data)
+{
+    Test* test = user_data;
+    TestTimeout1* timeout = G_CAST(test, TestTimeout1, test);
+    timeout->timer_id = 0;
+    GDEBUG("Cancelling request %u", timeout->req_id);
+    if (grilio_channel_cancel_request(test->io, timeout->req_id, TRUE) &&
+        timeout->timeout_count == 1) {
+        g_main_loop_quit(test->loop);
+    }
+    return FALSE;
+}
+
+static
+void
+test_timeout1_response(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestTimeout1* timeout = G_CAST(test, TestTimeout1, test);
+    GDEBUG("Completion status %d", status);
+    if (status == GRILIO_STATUS_TIMEOUT) {
+        timeout->timeout_count++;
+        if (!timeout->timer_id) {
+            timeout->timer_id = g_timeout_add(200, test_timeout1_done, test);
+        }
+    }
+}
+
+static
+void
+test_timeout1_submit_requests(
+    Test* test,
+    GRilIoChannelResponseFunc fn)
+{
+    TestTimeout1* timeout = G_CAST(test, TestTimeout1, test);
+    GRilIoRequest* req1 = grilio_request_new();
+    GRilIoRequest* req2 = grilio_request_new();
+    grilio_channel_set_timeout(test->io, 10);
+    grilio_request_set_timeout(req2, INT_MAX);
+
+    grilio_channel_send_request_full(test->io, req1,
+        RIL_REQUEST_TEST, fn, NULL, test);
+    timeout->req_id = grilio_channel_send_request_full(test->io, req2,
+        RIL_REQUEST_TEST, test_timeout1_response, NULL, test);
+    grilio_request_unref(req1);
+    grilio_request_unref(req2);
+}
+
+static
+void
+test_timeout1_start(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestTimeout1* timeout = G_CAST(test, TestTimeout1, test);
+    if (status == GRILIO_STATUS_TIMEOUT) {
+        GDEBUG("Starting...");
+        if (grilio_channel_cancel_request(test->io, timeout->req_id, FALSE)) {
+            test_timeout1_submit_requests(test, test_timeout1_response);
+        }
     }
 }
 
 static
 void
-test_logger_resp(
-    guint code,
-    guint id,
+test_timeout1(
+    void)
+{
+    TestTimeout1* timeout = test_new(TestTimeout1, "Timeout1");
+    Test* test = &timeout->test;
+    test_timeout1_submit_requests(test, test_timeout1_start);
+    g_assert(!timeout->timer_id);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * Timeout2
+ *==========================================================================*/
+
+typedef struct test_timeout2_data {
+    Test test;
+    GRilIoRequest* req1;
+    GRilIoRequest* req2;
+} TestTimeout2;
+
+static
+void
+test_timeout2_req2_completed(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    GDEBUG("Request 2 completion status %d", status);
+    g_assert(status == GRILIO_STATUS_TIMEOUT);
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_timeout2_start(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestTimeout2* ts = G_CAST(test, TestTimeout2, test);
+    GDEBUG("Starting...");
+    grilio_channel_send_request(test->io, ts->req1, RIL_REQUEST_TEST);
+    grilio_channel_send_request_full(test->io, ts->req2,
+        RIL_REQUEST_TEST, test_timeout2_req2_completed, NULL, test);
+}
+
+static
+void
+test_timeout2(
+    void)
+{
+    TestTimeout2* t = test_new(TestTimeout2, "Timeout2");
+    Test* test = &t->test;
+    guint serial_id;
+
+    /* Prepare the test */
+    t->req1 = grilio_request_new();
+    t->req2 = grilio_request_new();
+    grilio_channel_set_timeout(test->io, 10);
+    grilio_request_set_timeout(t->req2, 20);
+
+    /* Start after we have been connected */
+    g_assert(!test->io->connected);
+    serial_id = grilio_channel_serialize(test->io);
+    g_assert(serial_id);
+    grilio_channel_add_connected_handler(test->io, test_timeout2_start, test);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    /* Check the final state */
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
+    grilio_channel_deserialize(test->io, serial_id);
+    grilio_request_unref(t->req1);
+    grilio_request_unref(t->req2);
+    test_free(test);
+}
+
+/*==========================================================================*
+ * Timeout3
+ *
+ * Requests submitted with different timeouts must time out in the
+ * order of their deadlines. One of them gets cancelled half way.
+ *
+ *==========================================================================*/
+
+#define TIMEOUT3_COUNT (8)
+#define TIMEOUT3_CANCEL (5)
+
+static const int test_timeout3_order[TIMEOUT3_COUNT] = {
+    3, 7, 0, 5, 1, 6, 2, 4
+};
+
+typedef struct test_timeout3_data {
+    Test test;
+    GRilIoRequest* req[TIMEOUT3_COUNT];
+    gboolean done[TIMEOUT3_COUNT];
+    int completed;
+    int last;
+} TestTimeout3;
+
+static
+void
+test_timeout3_completed(
+    GRilIoChannel* io,
+    int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestLogger* log = user_data;
-    Test* test = &log->test;
+    Test* test = user_data;
+    TestTimeout3* t = G_CAST(test, TestTimeout3, test);
+    int i, rank = -1;
 
-    grilio_test_server_add_ack(test->server, log->reqid[0]);
-    test_basic_response_ok_ack_exp(test->server, "LOGTEST0", log->reqid[0]);
-    test_basic_response_ok(test->server, "LOGTEST1", log->reqid[1]);
-    grilio_test_server_add_unsol_ack_exp(test->server, NULL, RIL_REQUEST_TEST_2);
+    g_assert(status == GRILIO_STATUS_TIMEOUT);
+    for (i = 0; i < TIMEOUT3_COUNT; i++) {
+        if (!t->done[i] &&
+            grilio_request_status(t->req[i]) == GRILIO_REQUEST_DONE) {
+            t->done[i] = TRUE;
+            rank = test_timeout3_order[i];
+            break;
+        }
+    }
 
-    /* Clear the name to improve branch coverage */
-    grilio_channel_set_name(test->io, NULL);
+    GDEBUG("Request with rank %d timed out", rank);
+    g_assert(rank > t->last);
+    g_assert(rank != TIMEOUT3_CANCEL);
+    t->last = rank;
+    t->completed++;
+    if (t->completed == 2) {
+        /* Cancel the one that hasn't expired yet */
+        for (i = 0; i < TIMEOUT3_COUNT; i++) {
+            if (test_timeout3_order[i] == TIMEOUT3_CANCEL) {
+                g_assert(grilio_channel_cancel_request(io,
+                    grilio_request_id(t->req[i]), FALSE));
+            }
+        }
+    }
+    if (t->completed == TIMEOUT3_COUNT - 1) {
+        g_main_loop_quit(test->loop);
+    }
 }
 
 static
 void
-test_logger(
-    void)
+test_timeout3_start(
+    GRilIoChannel* io,
+    void* user_data)
 {
-    TestLogger* log = test_new(TestLogger, "Logger");
-    Test* test = &log->test;
-    guint logid[4];
-    int level = GLOG_LEVEL_ALWAYS;
-    static const guint8 data[] = { TEST_LOGGER_DATA };
-
-    /* Test NULL resistance */
-    g_assert(!grilio_channel_add_logger(NULL, NULL, NULL));
-    g_assert(!grilio_channel_add_logger(test->io, NULL, NULL));
-    g_assert(!grilio_channel_add_logger2(NULL, NULL, NULL));
-    g_assert(!grilio_channel_add_logger2(test->io, NULL, NULL));
-    grilio_channel_remove_logger(NULL, 0);
+    Test* test = user_data;
+    TestTimeout3* t = G_CAST(test, TestTimeout3, test);
+    int i;
 
-    /* Add another default logger with GLOG_LEVEL_ALWAYS, mainly to
-     * improve code coverage. */
-    logid[0] = grilio_channel_add_default_logger(test->io, level);
-    logid[1] = grilio_channel_add_logger(test->io, test_logger_cb, log);
-    logid[2] = grilio_channel_add_logger(test->io, test_logger1_cb, log);
-    logid[3] = grilio_channel_add_logger2(test->io, test_logger2_cb, log);
-    g_assert(logid[0]);
-    g_assert(logid[1]);
-    g_assert(logid[2]);
-    g_assert(logid[3]);
-    gutil_log(GLOG_MODULE_CURRENT, level, "%s", "");
+    for (i = 0; i < TIMEOUT3_COUNT; i++) {
+        grilio_channel_send_request_full(io, t->req[i], RIL_REQUEST_TEST,
+            test_timeout3_completed, NULL, test);
+    }
+}
 
-    grilio_test_server_add_request_func(test->server,
-        RIL_REQUEST_TEST_1, test_logger_resp, log);
+static
+void
+test_timeout3(
+    void)
+{
+    TestTimeout3* t = test_new(TestTimeout3, "Timeout3");
+    Test* test = &t->test;
+    int i;
 
-    log->reqid[0] = test_basic_request(test, test_logger_response);
-    log->reqid[1] = test_basic_request_full(test, RIL_REQUEST_TEST_1,
-        data, sizeof(data), test_logger_response);
-    g_assert(log->reqid[0]);
-    g_assert(log->reqid[1]);
+    t->last = -1;
+    for (i = 0; i < TIMEOUT3_COUNT; i++) {
+        t->req[i] = grilio_request_new();
+        grilio_request_set_timeout(t->req[i],
+            10 * (test_timeout3_order[i] + 1));
+    }
+    grilio_channel_add_connected_handler(test->io, test_timeout3_start, test);
 
     /* Run the test */
     g_main_loop_run(test->loop);
 
-    /* Remove this one twice to make sure that invalid logger ids are
-     * handled properly, i.e. ignored. */
-    grilio_channel_remove_logger(test->io, logid[0]);
-    grilio_channel_remove_logger(test->io, logid[0]);
-    /* Leave one logger registered, let grilio_channel_finalize free it */
-    grilio_channel_remove_logger(test->io, logid[1]);
-    grilio_channel_remove_logger(test->io, logid[3]);
+    /* Check the final state */
+    g_assert(t->completed == TIMEOUT3_COUNT - 1);
+    for (i = 0; i < TIMEOUT3_COUNT; i++) {
+        g_assert(grilio_request_status(t->req[i]) ==
+            ((test_timeout3_order[i] == TIMEOUT3_CANCEL) ?
+            GRILIO_REQUEST_CANCELLED : GRILIO_REQUEST_DONE));
+        grilio_request_unref(t->req[i]);
+    }
     test_free(test);
 }
 
 /*==========================================================================*
- * Handlers
+ * TimerSlack
+ *
+ * Deadlines within the slack interval expire in a single wakeup.
+ *
  *==========================================================================*/
 
-#define TEST_HANDLERS_COUNT (2)
-#define TEST_HANDLERS_INC_EVENTS_COUNT (3)
-
-enum test_handlers_event {
-    TEST_HANDLERS_INC_EVENT = 1,
-    TEST_HANDLERS_REMOVE_EVENT,
-    TEST_HANDLERS_DONE_EVENT
-};
+#define TIMER_SLACK_COUNT (3)
 
-typedef struct test_handlers_data {
+typedef struct test_timer_slack_data {
     Test test;
-    int count1;
-    int count2;
-    int ack_count;
-    gulong next_event_id;
-    gulong total_event_id;
-    gulong id1[TEST_HANDLERS_COUNT];
-    gulong id2[TEST_HANDLERS_COUNT];
-} TestHandlers;
+    GRilIoRequest* req[TIMER_SLACK_COUNT];
+    gint64 start;
+    int completed;
+} TestTimerSlack;
+
+static
+gboolean
+test_timer_slack_check(
+    gpointer user_data)
+{
+    TestTimerSlack* t = user_data;
+
+    /* All of them have expired at once */
+    g_assert(t->completed == TIMER_SLACK_COUNT);
+    g_main_loop_quit(t->test.loop);
+    return G_SOURCE_REMOVE;
+}
 
 static
 void
-test_handlers_done(
+test_timer_slack_completed(
     GRilIoChannel* io,
-    guint code,
+    int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    GDEBUG("Done");
-    g_main_loop_quit(test->loop);
+    TestTimerSlack* t = user_data;
+
+    g_assert(status == GRILIO_STATUS_TIMEOUT);
+    /* Deadlines are never missed in the other direction */
+    g_assert(g_get_monotonic_time() - t->start >= 10000);
+    if (!t->completed++) {
+        g_idle_add(test_timer_slack_check, t);
+    }
 }
 
 static
 void
-test_handlers_remove(
+test_timer_slack_start(
     GRilIoChannel* io,
-    guint code,
-    const void* data,
-    guint len,
     void* user_data)
 {
-    TestHandlers* h = user_data;
-    Test* test = &h->test;
+    TestTimerSlack* t = user_data;
     int i;
 
-    g_assert(code == TEST_HANDLERS_REMOVE_EVENT);
-    GDEBUG("Removing handlers");
-    grilio_channel_remove_handlers(test->io, h->id2, TEST_HANDLERS_COUNT);
+    t->start = g_get_monotonic_time();
+    for (i = 0; i < TIMER_SLACK_COUNT; i++) {
+        grilio_channel_send_request_full(io, t->req[i], RIL_REQUEST_TEST,
+            test_timer_slack_completed, NULL, t);
+    }
+}
 
-    /* Doing it a few more times makes no difference */
-    grilio_channel_remove_handlers(test->io, h->id2, TEST_HANDLERS_COUNT);
-    grilio_channel_remove_handlers(test->io, h->id2, 0);
-    grilio_channel_remove_handlers(test->io, NULL, 0);
-    grilio_channel_remove_handlers(NULL, NULL, 0);
+static
+void
+test_timer_slack(
+    void)
+{
+    TestTimerSlack* t = test_new(TestTimerSlack, "TimerSlack");
+    Test* test = &t->test;
+    int i;
 
-    /* Submit more events. This time they should only increment count1 */
-    for (i=0; i<TEST_HANDLERS_INC_EVENTS_COUNT; i++) {
-        grilio_test_server_add_unsol(test->server, NULL,
-            TEST_HANDLERS_INC_EVENT);
+    grilio_channel_set_timer_slack(NULL, 0);
+    grilio_channel_set_timer_slack(test->io, 100);
+    for (i = 0; i < TIMER_SLACK_COUNT; i++) {
+        t->req[i] = grilio_request_new();
+        grilio_request_set_timeout(t->req[i], 10 * (i + 1));
     }
+    grilio_channel_add_connected_handler(test->io, test_timer_slack_start, t);
 
-    /* Once those are handled, stop the test */
-    grilio_channel_remove_handler(test->io, h->next_event_id);
-    h->next_event_id = grilio_channel_add_unsol_event_handler(test->io,
-        test_handlers_done, TEST_HANDLERS_DONE_EVENT, h);
-    grilio_test_server_add_unsol(test->server, NULL, TEST_HANDLERS_DONE_EVENT);
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    /* Check the final state */
+    for (i = 0; i < TIMER_SLACK_COUNT; i++) {
+        g_assert(grilio_request_status(t->req[i]) == GRILIO_REQUEST_DONE);
+        grilio_request_unref(t->req[i]);
+    }
+    test_free(test);
 }
 
+/*==========================================================================*
+ * Serialize1
+ *==========================================================================*/
+
+typedef struct test_serialize1_data {
+    Test test;
+    guint serial_id;
+    GRilIoRequest* req1;
+    GRilIoRequest* req2;
+    GRilIoRequest* req3;
+    GRilIoRequest* req4;
+    GRilIoRequest* req5;
+} TestSerialize1;
+
 static
 void
-test_handlers_inc(
+test_serialize1_req1_completed(
     GRilIoChannel* io,
-    guint code,
+    int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    int* count = user_data;
-    (*count)++;
-    GDEBUG("Event %u data %p value %d", code, count, *count);
+    Test* test = user_data;
+    TestSerialize1* t = G_CAST(test, TestSerialize1, test);
+    GDEBUG("Request 1 completion status %d", status);
+    g_assert(status == GRILIO_STATUS_OK);
+    /* Request has completed, retry fails */
+    g_assert(!grilio_channel_retry_request(test->io,
+        grilio_request_id(t->req1)));
+    /* Request 2 should now be pending, so retry says TRUE */
+    g_assert(grilio_channel_retry_request(test->io,
+        grilio_request_id(t->req2)));
+    /* The second request is sent before this callback is invoked,
+     * cancel the third one */
+    g_assert(grilio_channel_cancel_request(test->io,
+        grilio_request_id(t->req3), FALSE));
+    /* This one gets ignored: */
+    grilio_test_server_add_response(test->server, NULL,
+        grilio_request_id(t->req3), GRILIO_STATUS_OK);
 }
 
 static
 void
-test_handlers_ack(
+test_serialize1_req2_resp(
     guint code,
     guint id,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestHandlers* h = user_data;
-    h->ack_count++;
-    GDEBUG("Ack %d", h->ack_count);
-}
-
-static
-void
-test_handlers(
-    void)
-{
-    TestHandlers* h = test_new(TestHandlers, "Handlers");
-    Test* test = &h->test;
-    int i, total = 0;
-
-    /* Prepare the test */
-    for (i=0; i<TEST_HANDLERS_COUNT; i++) {
-        h->id1[i] = grilio_channel_add_unsol_event_handler(test->io,
-            test_handlers_inc, TEST_HANDLERS_INC_EVENT, &h->count1);
-        h->id2[i] = grilio_channel_add_unsol_event_handler(test->io,
-            test_handlers_inc, TEST_HANDLERS_INC_EVENT, &h->count2);
-    }
-    h->total_event_id = grilio_channel_add_unsol_event_handler(test->io,
-        test_handlers_inc, 0, &total);
-    for (i=0; i<TEST_HANDLERS_INC_EVENTS_COUNT; i++) {
-        grilio_test_server_add_unsol(test->server, NULL,
-            TEST_HANDLERS_INC_EVENT);
-    }
-
-    /* libgrilio is supposed to ack TEST_HANDLERS_REMOVE_EVENT exactly once */
-    grilio_test_server_add_request_func(test->server,
-        RIL_RESPONSE_ACKNOWLEDGEMENT, test_handlers_ack, h);
-
-    h->next_event_id = grilio_channel_add_unsol_event_handler(test->io,
-        test_handlers_remove, TEST_HANDLERS_REMOVE_EVENT, h);
-    grilio_test_server_add_unsol_ack_exp(test->server, NULL,
-        TEST_HANDLERS_REMOVE_EVENT);
-
-    /* Run the test */
-    g_main_loop_run(test->loop);
-
-    /* Check the final state */
-    g_assert(h->ack_count == 1);
-    g_assert(h->count1 == 2*TEST_HANDLERS_COUNT*TEST_HANDLERS_INC_EVENTS_COUNT);
-    g_assert(h->count2 == TEST_HANDLERS_COUNT*TEST_HANDLERS_INC_EVENTS_COUNT);
-    /* Total count includes RIL_UNSOL_RIL_CONNECTED + REMOVE and DONE */
-    g_assert(total == TEST_HANDLERS_COUNT*TEST_HANDLERS_INC_EVENTS_COUNT + 3);
-    for (i=0; i<TEST_HANDLERS_COUNT; i++) {
-        g_assert(!h->id2[i]);
-    }
-
-    /* Clean up */
-    grilio_channel_remove_handlers(test->io, h->id1, TEST_HANDLERS_COUNT);
-    grilio_channel_remove_handlers(test->io, h->id2, TEST_HANDLERS_COUNT);
-    grilio_channel_remove_handler(test->io, h->total_event_id);
-    grilio_channel_remove_handler(test->io, h->next_event_id);
-    /* These do nothing: */
-    grilio_channel_remove_handler(test->io, 0);
-    grilio_channel_remove_handler(NULL, 0);
-    test_free(test);
+    Test* test = user_data;
+    TestSerialize1* t = G_CAST(test, TestSerialize1, test);
+    grilio_test_server_add_response(test->server, NULL, id,
+        RIL_E_GENERIC_FAILURE);
+    /* De-serialize the channel */
+    grilio_channel_deserialize(test->io, t->serial_id);
 }
 
-/*==========================================================================*
- * InvalidResp
- *==========================================================================*/
+static
+void
+test_serialize1_req2_completed(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestSerialize1* t = G_CAST(test, TestSerialize1, test);
+    GDEBUG("Request 2 completion status %d", status);
+    g_assert(status == RIL_E_GENERIC_FAILURE);
+    grilio_test_server_add_response(test->server, NULL,
+        grilio_request_id(t->req4), RIL_E_REQUEST_NOT_SUPPORTED);
+    grilio_test_server_add_response(test->server, NULL,
+        grilio_request_id(t->req5), GRILIO_STATUS_OK);
+}
 
 static
 void
-test_invalid_resp_no_completion(
+test_serialize1_req3_completed(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    int* resp_count = user_data;
-    GDEBUG("Request 2 completed with status %d", status);
+    GDEBUG("Request 3 completion status %d", status);
     g_assert(status == GRILIO_STATUS_CANCELLED);
-    (*resp_count)++;
 }
 
 static
 void
-test_invalid_resp_req2_completion(
+test_serialize1_req4_completed(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    GDEBUG("Request 4 completion status %d", status);
+    g_assert(status == RIL_E_REQUEST_NOT_SUPPORTED);
+}
+
+static
+void
+test_serialize1_req5_completed(
     GRilIoChannel* io,
     int status,
     const void* data,
@@ -1917,95 +3650,139 @@ test_invalid_resp_req2_completion(
     void* user_data)
 {
     Test* test = user_data;
-    GDEBUG("Request 2 completed with status %d", status);
+    GDEBUG("Request 5 completion status %d", status);
     g_assert(status == GRILIO_STATUS_OK);
     g_main_loop_quit(test->loop);
 }
 
 static
 void
-test_invalid_resp(
+test_serialize1_start(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestSerialize1* t = G_CAST(test, TestSerialize1, test);
+    GDEBUG("Starting...");
+    grilio_request_set_blocking(t->req2, TRUE);
+    grilio_channel_send_request_full(test->io, t->req2,
+        RIL_REQUEST_TEST_2, test_serialize1_req2_completed, NULL, test);
+    grilio_channel_send_request_full(test->io, t->req3,
+        RIL_REQUEST_TEST, test_serialize1_req3_completed, NULL, test);
+    grilio_channel_send_request_full(test->io, t->req4,
+        RIL_REQUEST_TEST, test_serialize1_req4_completed, NULL, test);
+    grilio_channel_send_request_full(test->io, t->req5,
+        RIL_REQUEST_TEST, test_serialize1_req5_completed, NULL, test);
+    grilio_test_server_add_response(test->server, NULL,
+        grilio_request_id(t->req1), GRILIO_STATUS_OK);
+    g_assert(grilio_channel_has_pending_requests(test->io));
+}
+
+static
+void
+test_serialize1(
     void)
 {
-    Test* test = test_new(Test, "InvalidResp");
-    GRilIoRequest* req = grilio_request_new();
-    int resp_count = 0;
+    TestSerialize1* t = test_new(TestSerialize1, "Serialize1");
+    Test* test = &t->test;
+    guint id;
 
-    /* This one is going to end the test (eventually). */
-    const guint id1 = grilio_channel_send_request_full(test->io, NULL,
-        RIL_REQUEST_TEST, test_invalid_resp_req2_completion, NULL, test);
+    /* Prepare the test */
+    t->req1 = grilio_request_new();
+    t->req2 = grilio_request_new();
+    t->req3 = grilio_request_new();
+    t->req4 = grilio_request_new();
+    t->req5 = grilio_request_new();
+    grilio_channel_set_timeout(test->io, GRILIO_TIMEOUT_DEFAULT);
+    grilio_request_set_timeout(t->req1, INT_MAX);
 
-    /* Response to this request will never arrive. */
-    grilio_channel_send_request_full(test->io, req,
-        RIL_REQUEST_TEST, test_invalid_resp_no_completion, NULL, &resp_count);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_2,
+        test_serialize1_req2_resp, test);
 
-    /* INT_MAX is not a valid request id */
-    g_assert(test_basic_response_ok(test->server, "IGNORE", INT_MAX));
-    g_assert(test_basic_response_ok(test->server, "DONE", id1));
+    /* Start after we have been connected */
+    g_assert(!test->io->connected);
+    t->serial_id = grilio_channel_serialize(test->io);
+    g_assert(t->serial_id);
+    /* Increment/decrement serialization count */
+    grilio_channel_deserialize(test->io, grilio_channel_serialize(test->io));
+    /* Submit the first request. There's nothing to retry, just make sure
+     * that grilio_channel_retry_request returns TRUE. */
+    id = grilio_channel_send_request_full(test->io, t->req1, RIL_REQUEST_TEST,
+        test_serialize1_req1_completed, NULL, test);
+    g_assert(grilio_channel_retry_request(test->io, id));
+    /* And wait for the channel to get connected */
+    grilio_channel_add_connected_handler(test->io,
+        test_serialize1_start, test);
 
     /* Run the test */
     g_main_loop_run(test->loop);
 
-    /* Check the request state. It should be SENT */
-    g_assert(grilio_request_status(req) == GRILIO_REQUEST_SENT);
-    g_assert(!resp_count);
-    grilio_channel_cancel_all(test->io, TRUE);
-    g_assert(resp_count == 1);
-    grilio_request_unref(req);
+    /* Check the final state */
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req5) == GRILIO_REQUEST_DONE);
+    grilio_request_unref(t->req1);
+    grilio_request_unref(t->req2);
+    grilio_request_unref(t->req3);
+    grilio_request_unref(t->req4);
+    grilio_request_unref(t->req5);
+    grilio_channel_deserialize(test->io, t->serial_id); // No effect
+    grilio_channel_deserialize(test->io, 0); // No effect
     test_free(test);
 }
 
 /*==========================================================================*
- * Retry1
- *
- * We create 3 requests - #1 with request timeout and retry, #2 with one
- * retries and no request timeout and #3 with infinite number of retries
- * and no request timeout.
- *
- * Then we send error reply to #2 and #3, wait for #1 to time out, send
- * themselves another request to make sure that #2 and #3 have received
- * their replies, send another error replies to #3 and #2, wait for #2 to
- * complete with error and cancel #3. We expect reply count for #3 to be 1
+ * Serialize2
  *==========================================================================*/
 
-typedef struct test_retry1_data {
+typedef struct test_serialize2_data {
     Test test;
-    int req2_status;
-    int req3_completed;
-    int req4_completed;
-    int req5_completed;
-    int req6_completed;
+    guint serial_id;
     GRilIoRequest* req1;
     GRilIoRequest* req2;
     GRilIoRequest* req3;
-    GRilIoRequest* req4;
-    GRilIoRequest* req5;
-    GRilIoRequest* req6;
-} TestRetry1;
+} TestSerialize2;
 
 static
 void
-test_retry1_continue(
-    GRilIoChannel* io,
-    int status,
+test_serialize2_req3_resp(
+    guint code,
+    guint id,
     const void* data,
     guint len,
     void* user_data)
 {
     Test* test = user_data;
-    TestRetry1* retry = G_CAST(test, TestRetry1, test);
-    guint serial = grilio_request_serial(retry->req2);
+    TestSerialize2* t = G_CAST(test, TestSerialize2, test);
+    grilio_test_server_add_response(test->server, NULL, id,
+        RIL_E_GENERIC_FAILURE);
+    /* De-serialize the channel */
+    grilio_channel_deserialize(test->io, t->serial_id);
+}
 
-    /* This should result in req2 getting completed */
-    GDEBUG("Continuing...");
-    g_assert(serial != grilio_request_id(retry->req2));
-    grilio_test_server_add_response(test->server, NULL, serial,
-        RIL_E_REQUEST_NOT_SUPPORTED);
+static
+void
+test_serialize2_req1_resp(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestSerialize2* t = G_CAST(test, TestSerialize2, test);
+    g_assert(grilio_request_id(t->req1) == id);
+    grilio_test_server_add_response(test->server, NULL, id, GRILIO_STATUS_OK);
+    /* Request 2 should is now pending, cancel it */
+    g_assert(grilio_channel_cancel_request(test->io,
+        grilio_request_id(t->req2), TRUE));
 }
 
 static
 void
-test_retry1_req1_timeout(
+test_serialize2_req3_completed(
     GRilIoChannel* io,
     int status,
     const void* data,
@@ -2013,28 +3790,85 @@ test_retry1_req1_timeout(
     void* user_data)
 {
     Test* test = user_data;
-    GDEBUG("Request 1 completed with status %d", status);
-    if (status == GRILIO_STATUS_TIMEOUT) {
-        test_basic_response_ok(test->server, "TEST",
-            test_basic_request(test, test_retry1_continue));
-    }
+    GDEBUG("Request 3 completion status %d", status);
+    g_assert(status == RIL_E_GENERIC_FAILURE);
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_serialize2_start(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    Test* test = user_data;
+    TestSerialize2* t = G_CAST(test, TestSerialize2, test);
+    GDEBUG("Starting...");
+    grilio_channel_send_request(test->io, t->req2, RIL_REQUEST_TEST);
+    grilio_channel_send_request_full(test->io, t->req3, RIL_REQUEST_TEST_3,
+        test_serialize2_req3_completed, NULL, test);
+}
+
+static
+void
+test_serialize2(
+    void)
+{
+    TestSerialize2* t = test_new(TestSerialize2, "Serialize2");
+    Test* test = &t->test;
+    guint id;
+
+    /* Prepare the test */
+    t->req1 = grilio_request_new();
+    t->req2 = grilio_request_new();
+    t->req3 = grilio_request_new();
+
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
+        test_response_reflect_ok, test);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_1,
+        test_serialize2_req1_resp, test);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_3,
+        test_serialize2_req3_resp, test);
+
+    /* Start after we have been connected */
+    g_assert(!test->io->connected);
+    t->serial_id = grilio_channel_serialize(test->io);
+    g_assert(t->serial_id);
+    /* Submit the first request. There's nothing to retry, just make sure
+     * that grilio_channel_retry_request returns TRUE. */
+    id = grilio_channel_send_request(test->io, t->req1, RIL_REQUEST_TEST_1);
+    g_assert(grilio_channel_retry_request(test->io, id));
+    /* And wait for the channel to get connected */
+    grilio_channel_add_connected_handler(test->io,
+        test_serialize2_start, test);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    /* Check the final state */
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_DONE);
+    grilio_request_unref(t->req1);
+    grilio_request_unref(t->req2);
+    grilio_request_unref(t->req3);
+    test_free(test);
 }
 
-static
-gboolean
-test_retry1_req2_retry(
-    GRilIoRequest* request,
-    int ril_status,
-    const void* response_data,
-    guint response_len,
-    void* user_data)
-{
-    return ril_status == RIL_E_GENERIC_FAILURE;
-}
+/*==========================================================================*
+ * Serialize3
+ *==========================================================================*/
+
+typedef struct test_serialize3_data {
+    Test test;
+    GRilIoRequest* req1;
+    GRilIoRequest* req2;
+    GRilIoRequest* req3;
+} TestSerialize3;
 
 static
 void
-test_retry1_req2_completion(
+test_serialize3_req1_completed(
     GRilIoChannel* io,
     int status,
     const void* data,
@@ -2042,1567 +3876,1931 @@ test_retry1_req2_completion(
     void* user_data)
 {
     Test* test = user_data;
-    TestRetry1* retry = G_CAST(test, TestRetry1, test);
-    retry->req2_status = status;
-    GDEBUG("Request 2 completed with status %d", status);
-    if (!retry->req3_completed) {
-        /* First cancel should succeed, the second one fail */
-        guint id3 = grilio_request_id(retry->req3);
-        if (grilio_channel_cancel_request(test->io, id3, TRUE) &&
-            !grilio_channel_cancel_request(test->io, id3, TRUE)) {
-            if (retry->req3_completed) {
-                g_main_loop_quit(test->loop);
-            }
-        }
-    }
+    TestSerialize3* t = G_CAST(test, TestSerialize3, test);
+    GDEBUG("Request 1 completion status %d", status);
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(!grilio_channel_get_request(test->io,
+        grilio_request_id(t->req1)));
+    g_assert(grilio_channel_get_request(test->io,
+        grilio_request_id(t->req2)) == t->req2);
+    grilio_channel_cancel_all(test->io, TRUE);
 }
 
 static
 void
-test_retry1_count_completions(
+test_serialize3_req3_completed(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    int* completed = user_data;
-    (*completed)++;
+    Test* test = user_data;
+    GDEBUG("Request 3 completion status %d", status);
+    g_assert(status == GRILIO_STATUS_CANCELLED);
+    g_main_loop_quit(test->loop);
 }
 
 static
 void
-test_retry1_start(
+test_serialize3_start(
     GRilIoChannel* io,
     void* user_data)
 {
     Test* test = user_data;
-    TestRetry1* retry = G_CAST(test, TestRetry1, test);
-    GRilIoQueue* q;
+    TestSerialize3* t = G_CAST(test, TestSerialize3, test);
+    GDEBUG("Starting...");
 
-    grilio_channel_send_request_full(test->io, retry->req1,
-        RIL_REQUEST_TEST, test_retry1_req1_timeout, NULL, test);
-    grilio_channel_send_request_full(test->io, retry->req2,
-        RIL_REQUEST_TEST, test_retry1_req2_completion, NULL, test);
-    grilio_channel_send_request_full(test->io, retry->req3,
-        RIL_REQUEST_TEST, test_retry1_count_completions, NULL,
-        &retry->req3_completed);
-    grilio_channel_send_request_full(test->io, retry->req4,
-        RIL_REQUEST_TEST, test_retry1_count_completions, NULL,
-        &retry->req4_completed);
-    grilio_channel_send_request_full(test->io, retry->req5,
-        RIL_REQUEST_TEST, test_retry1_count_completions, NULL,
-        &retry->req5_completed);
-    grilio_channel_send_request_full(test->io, retry->req6,
-        RIL_REQUEST_TEST, test_retry1_count_completions, NULL,
-        &retry->req6_completed);
+    grilio_channel_send_request(test->io, t->req2, RIL_REQUEST_TEST);
+    grilio_channel_send_request_full(test->io, t->req3,
+        RIL_REQUEST_TEST, test_serialize3_req3_completed, NULL, test);
+    grilio_test_server_add_response(test->server, NULL,
+        grilio_request_id(t->req1), GRILIO_STATUS_OK);
 
-    /* Can't send the same request twice */
-    q = grilio_queue_new(test->io);
-    g_assert(!grilio_queue_send_request(q, retry->req6, RIL_REQUEST_TEST));
-    grilio_queue_unref(q);
-    g_assert(!grilio_channel_send_request(test->io, retry->req6,
-        RIL_REQUEST_TEST));
     g_assert(grilio_channel_get_request(test->io,
-        grilio_request_id(retry->req6)) == retry->req6);
-
-    grilio_test_server_add_response(test->server, NULL,
-        retry->req2->current_id, RIL_E_GENERIC_FAILURE);
-    grilio_test_server_add_response(test->server, NULL,
-        retry->req3->current_id, RIL_E_REQUEST_NOT_SUPPORTED);
-    grilio_test_server_add_response(test->server, NULL,
-        retry->req4->current_id, RIL_E_REQUEST_NOT_SUPPORTED);
-    grilio_test_server_add_response(test->server, NULL,
-        retry->req5->current_id, RIL_E_REQUEST_NOT_SUPPORTED);
-    grilio_test_server_add_response(test->server, NULL,
-        retry->req6->current_id, RIL_E_REQUEST_NOT_SUPPORTED);
-    /* And wait for req1 to timeout */
+        grilio_request_id(t->req1)) == t->req1);
+    g_assert(grilio_channel_get_request(test->io,
+        grilio_request_id(t->req2)) == t->req2);
+    g_assert(grilio_channel_get_request(test->io,
+        grilio_request_id(t->req3)) == t->req3);
 }
 
 static
 void
-test_retry1(
+test_serialize3(
     void)
 {
-    TestRetry1* retry = test_new(TestRetry1, "Retry1");
-    Test* test = &retry->test;
+    TestSerialize3* t = test_new(TestSerialize3, "Serialize3");
+    Test* test = &t->test;
+    guint serial_id;
 
     /* Prepare the test */
-    retry->req1 = grilio_request_new();
-    retry->req2 = grilio_request_new();
-    retry->req3 = grilio_request_new();
-    retry->req4 = grilio_request_new();
-    retry->req5 = grilio_request_new();
-    retry->req6 = grilio_request_new();
-
-    grilio_request_set_retry(retry->req1, 10, 1);
-    grilio_request_set_timeout(retry->req1, 10);
-    grilio_request_set_retry(retry->req2, 0, 1);
-    grilio_request_set_retry_func(retry->req2, test_retry1_req2_retry);
-    grilio_request_set_retry(retry->req3, 0, -1);
-    grilio_request_set_retry(retry->req4, INT_MAX-1, -1);
-    grilio_request_set_retry(retry->req5, INT_MAX, -1);
-    grilio_request_set_retry(retry->req6, INT_MAX, -1);
+    t->req1 = grilio_request_new();
+    t->req2 = grilio_request_new();
+    t->req3 = grilio_request_new();
 
     /* Start after we have been connected */
     g_assert(!test->io->connected);
-    grilio_channel_add_connected_handler(test->io, test_retry1_start, test);
+    serial_id = grilio_channel_serialize(test->io);
+    g_assert(serial_id);
+    grilio_channel_send_request_full(test->io, t->req1, RIL_REQUEST_TEST,
+        test_serialize3_req1_completed, NULL, test);
+    /* And Wait for the channel to get connected */
+    grilio_channel_add_connected_handler(test->io,
+        test_serialize3_start, test);
 
     /* Run the test */
     g_main_loop_run(test->loop);
 
     /* Check the final state */
-    g_assert(grilio_request_status(retry->req4) == GRILIO_REQUEST_RETRY);
-    g_assert(grilio_request_status(retry->req5) == GRILIO_REQUEST_RETRY);
-    g_assert(grilio_request_status(retry->req6) == GRILIO_REQUEST_RETRY);
-
-    grilio_channel_cancel_request(test->io,
-        grilio_request_id(retry->req5), TRUE);
-    grilio_channel_cancel_request(test->io,
-        grilio_request_id(retry->req4), TRUE);
-    grilio_channel_cancel_all(test->io, TRUE);
-
-    g_assert(grilio_request_status(retry->req4) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(retry->req5) == GRILIO_REQUEST_CANCELLED);
-    g_assert(retry->req2_status == RIL_E_REQUEST_NOT_SUPPORTED);
-    g_assert(retry->req3_completed == 1);
-    g_assert(retry->req4_completed == 1);
-    g_assert(grilio_request_retry_count(retry->req1) == 1);
-    g_assert(grilio_request_retry_count(retry->req2) == 1);
-    g_assert(grilio_request_retry_count(retry->req3) == 1);
-    g_assert(grilio_request_retry_count(retry->req4) == 0);
-
-    /* Clean up */
-    grilio_request_unref(retry->req1);
-    grilio_request_unref(retry->req2);
-    grilio_request_unref(retry->req3);
-    grilio_request_unref(retry->req4);
-    grilio_request_unref(retry->req5);
-    grilio_request_unref(retry->req6);
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_CANCELLED);
+    grilio_request_unref(t->req1);
+    grilio_request_unref(t->req2);
+    grilio_request_unref(t->req3);
+    grilio_channel_deserialize(test->io, serial_id);
     test_free(test);
 }
 
 /*==========================================================================*
- * Retry2
- *
- * Makes sure that request ids are incremented on each retry. Two requests
- * are rejected, the third one times out.
+ * Block1
  *==========================================================================*/
 
-typedef struct test_retry2_data {
+typedef struct test_block1_data {
     Test test;
-    guint log_id;
-    guint req_id;
-    GRilIoRequest* req;
-} TestRetry2;
+    GRilIoRequest* req1; /* Blocking, cancelled before it's sent */
+    GRilIoRequest* req2; /* Blocking, cancelled after it's sent */
+    GRilIoRequest* req3; /* Blocking, should complete normally */
+    GRilIoRequest* req4; /* Non-blocking, should complete normally */
+    gboolean req3_done;
+    gboolean req4_done;
+} TestBlock1;
 
 static
 void
-test_retry2_req_done(
-    GRilIoChannel* io,
+test_block1_req3_done(
+    GRilIoChannel* channel,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    TestRetry2* retry = G_CAST(test, TestRetry2, test);
-    GDEBUG("Request %u completed with status %d",
-        grilio_request_id(retry->req), status);
-    if (status == RIL_E_GENERIC_FAILURE) {
-        g_main_loop_quit(test->loop);
-    }
+    TestBlock1* t = user_data;
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(!t->req3_done);
+    g_assert(!t->req4_done);
+    t->req3_done = TRUE;
 }
 
 static
 void
-test_retry2_log(
+test_block1_req4_done(
     GRilIoChannel* channel,
-    GRILIO_PACKET_TYPE type,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestBlock1* t = user_data;
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(t->req3_done);
+    g_assert(!t->req4_done);
+    t->req4_done = TRUE;
+    g_main_loop_quit(t->test.loop);
+}
+
+static
+void
+test_block1_resp2(
+    guint code,
     guint id,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestBlock1* t = user_data;
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_SENT);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_QUEUED);
+    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_QUEUED);
+    g_assert(grilio_request_id(t->req2) == id);
+    /* This one is pending, retry says FALSE  */
+    g_assert(!grilio_channel_retry_request(t->test.io, id));
+    /* This one is queued, retry says TRUE */
+    g_assert(grilio_channel_retry_request(t->test.io,
+        grilio_request_id(t->req3)));
+    /* Cancel this request */
+    g_assert(grilio_channel_cancel_request(t->test.io, id, FALSE));
+    /* And assert that request status has changed */
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
+    /* Send the response to unblock the channel */
+    grilio_test_server_add_response_data(t->test.server, id,
+        GRILIO_STATUS_OK, NULL, 0);
+}
+
+static
+void
+test_block1_resp3(
     guint code,
+    guint id,
     const void* data,
-    guint data_len,
+    guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    TestRetry2* retry = G_CAST(test, TestRetry2, test);
-    if (type == GRILIO_PACKET_REQ) {
-        if (!retry->req_id) {
-            GDEBUG("No request id yet, assuming %u", id);
-            retry->req_id = id;
-        } else {
-            retry->req_id++;
-            g_assert(retry->req_id == id);
-        }
-        if (retry->req_id == id) {
-            GDEBUG("Failing request %u", id);
-            grilio_test_server_add_response(test->server, NULL, id,
-                RIL_E_GENERIC_FAILURE);
-        }
-    }
+    TestBlock1* t = user_data;
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_SENT);
+    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_QUEUED);
+    grilio_test_server_add_response_data(t->test.server, id,
+        GRILIO_STATUS_OK, NULL, 0);
 }
 
 static
 void
-test_retry2_start(
+test_block1_connected(
     GRilIoChannel* io,
     void* user_data)
 {
-    Test* test = user_data;
-    TestRetry2* retry = G_CAST(test, TestRetry2, test);
-
-    retry->req_id = grilio_channel_send_request_full(test->io, retry->req,
-        RIL_REQUEST_TEST, test_retry2_req_done, NULL, test);
+    TestBlock1* t = user_data;
+    /* Nothing has been sent yet */
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_QUEUED);
+    /* Cancel this one before it's been sent */
+    g_assert(grilio_channel_cancel_request(t->test.io,
+        grilio_request_id(t->req1), FALSE));
 }
 
 static
 void
-test_retry2(
+test_block1(
     void)
 {
-    TestRetry2* retry = test_new(TestRetry2, "Retry2");
-    Test* test = &retry->test;
-    guint id;
+    TestBlock1* t = test_new(TestBlock1, "Block1");
+    Test* test = &t->test;
 
-    /* Prepare the test */
-    retry->log_id = grilio_channel_add_logger(test->io, test_retry2_log, test);
-    retry->req = grilio_request_new();
-    grilio_request_set_retry(retry->req, 10, 2);
+    t->req1 = grilio_request_new();
+    t->req2 = grilio_request_new();
+    t->req3 = grilio_request_new();
+    t->req4 = grilio_request_new();
 
-    /* Start after we have been connected */
-    g_assert(!test->io->connected);
-    grilio_channel_add_connected_handler(test->io, test_retry2_start, test);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_2,
+        test_block1_resp2, t);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_3,
+        test_block1_resp3, t);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_4,
+        test_response_empty_ok, t);
+
+    grilio_request_set_blocking(t->req1, TRUE);
+    grilio_channel_send_request(test->io, t->req1, RIL_REQUEST_TEST_1);
+    grilio_request_set_blocking(t->req2, TRUE);
+    grilio_channel_send_request(test->io, t->req2, RIL_REQUEST_TEST_2);
+    grilio_request_set_blocking(t->req3, TRUE);
+    grilio_channel_send_request_full(test->io, t->req3, RIL_REQUEST_TEST_3,
+        test_block1_req3_done, NULL, t);
+    grilio_channel_send_request_full(test->io, t->req4, RIL_REQUEST_TEST_4,
+        test_block1_req4_done, NULL, t);
 
     /* Run the test */
+    grilio_channel_add_connected_handler(test->io, test_block1_connected, t);
     g_main_loop_run(test->loop);
 
-    /* Check the final state */
-    g_assert(grilio_request_retry_count(retry->req) == 2);
-
-    /* Clean up */
-    id = grilio_request_id(retry->req);
-    g_assert(grilio_request_status(retry->req) == GRILIO_REQUEST_DONE);
-    /* Since it's done, cancel will fail */
-    g_assert(!grilio_channel_cancel_request(test->io, id, FALSE));
-    grilio_request_unref(retry->req);
-    grilio_channel_remove_logger(test->io, retry->log_id);
+    g_assert(t->req3_done);
+    g_assert(t->req4_done);
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_DONE);
+    grilio_request_unref(t->req1);
+    grilio_request_unref(t->req2);
+    grilio_request_unref(t->req3);
+    grilio_request_unref(t->req4);
     test_free(test);
 }
 
 /*==========================================================================*
- * Retry3
- *
- * Makes sure that we don't retry pending request.
- *
- * 1. Create request with a long response and retry timeouts and 1 retry
- * 2. Reply to it with an error, it gets scheduled for retry
- * 3. Call grilio_channel_retry_request, it should be retried immediately
- * 4. Call grilio_channel_retry_request again. It should fail.
- *
- * The same thing is done with 2 requests to improve the coverage.
- *
+ * Block2
  *==========================================================================*/
 
-typedef struct test_retry3_data {
+typedef struct test_block2_data {
     Test test;
-    guint dummy_id;
     GRilIoRequest* req1;
     GRilIoRequest* req2;
-    int status1;
-    int status2;
-} TestRetry3;
-
-static
-void
-test_retry3_req_completed(
-    GRilIoChannel* io,
-    int status,
-    const void* data,
-    guint len,
-    void* user_data)
-{
-    int* completion_status = user_data;
-    GDEBUG("Request completed with status %d", status);
-    *completion_status = status;
-}
-
-static
-void
-test_retry3_check_req(
-    GRilIoChannel* io,
-    GRilIoRequest* req,
-    guint dummy_id)
-{
-    const guint id = grilio_request_id(req);
-    g_assert(!grilio_channel_retry_request(NULL, dummy_id));
-    g_assert(!grilio_channel_retry_request(io, dummy_id));
-    g_assert(!grilio_channel_retry_request(io, 0));
-    g_assert(grilio_channel_retry_request(io, id));
-    g_assert(!grilio_channel_retry_request(io, id)); /* Must fail */
-    g_assert(!grilio_channel_retry_request(io, dummy_id));
-    g_assert(grilio_channel_cancel_request(io, id, TRUE));
-}
+    GRilIoRequest* req3;
+    GRilIoRequest* req4;
+} TestBlock2;
 
 static
-void
-test_retry3_retry_and_cancel(
-    GRilIoChannel* io,
-    int error,
-    const void* data,
-    guint len,
+gboolean
+test_block2_cancel_req1(
     void* user_data)
 {
-    Test* test = user_data;
-    TestRetry3* retry = G_CAST(test, TestRetry3, test);
-    if (error) {
-        GDEBUG("Unexpected completion status %d", error);
-    } else {
-        test_retry3_check_req(io, retry->req1, retry->dummy_id);
-        test_retry3_check_req(io, retry->req2, retry->dummy_id);
-        g_main_loop_quit(test->loop);
-    }
+    TestBlock2* t = user_data;
+    /* By now req1 should have been sent */
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_SENT);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_QUEUED);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_QUEUED);
+    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_QUEUED);
+    /* Cancel the last one first */
+    g_assert(grilio_channel_cancel_request(t->test.io,
+        grilio_request_id(t->req4), TRUE));
+    /* Cancel everything else */
+    grilio_channel_cancel_all(t->test.io, FALSE);
+    /* And assert that its status has changed */
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
+    g_main_loop_quit(t->test.loop);
+    return G_SOURCE_REMOVE;
 }
 
 static
 void
-test_retry3_start(
+test_block2_connected(
     GRilIoChannel* io,
     void* user_data)
 {
-    Test* test = user_data;
-    TestRetry3* retry = G_CAST(test, TestRetry3, test);
-
-    grilio_channel_send_request_full(test->io, retry->req1,
-        RIL_REQUEST_TEST, test_retry3_req_completed, NULL, &retry->status1);
-    grilio_channel_send_request_full(test->io, retry->req2,
-        RIL_REQUEST_TEST, test_retry3_req_completed, NULL, &retry->status2);
-    grilio_test_server_add_response(test->server, NULL,
-        grilio_request_id(retry->req1), RIL_E_GENERIC_FAILURE);
-    grilio_test_server_add_response(test->server, NULL,
-        grilio_request_id(retry->req2), RIL_E_GENERIC_FAILURE);
-
-    /* By the time this request completes, the first one should already
-     * be in the retry queue */
-    retry->dummy_id = test_basic_request(test, test_retry3_retry_and_cancel);
-    test_basic_response_ok(test->server, NULL, retry->dummy_id);
+    TestBlock2* t = user_data;
+    /* Nothing has been sent yet */
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_QUEUED);
+    /* Will cancel req1 after it's been sent */
+    g_assert(g_idle_add(test_block2_cancel_req1, t));
 }
 
 static
 void
-test_retry3(
+test_block2(
     void)
 {
-    TestRetry3* retry = test_new(TestRetry3, "Retry3");
-    Test* test = &retry->test;
-    guint id1, id2;
+    TestBlock2* t = test_new(TestBlock2, "Block2");
+    Test* test = &t->test;
 
-    /* Prepare the test */
-    retry->req1 = grilio_request_new();
-    retry->req2 = grilio_request_new();
-    grilio_request_set_timeout(retry->req1, INT_MAX);
-    grilio_request_set_timeout(retry->req2, INT_MAX);
-    grilio_request_set_retry(retry->req1, INT_MAX, 1);
-    grilio_request_set_retry(retry->req2, INT_MAX-1, 1);
+    t->req1 = grilio_request_new();
+    t->req2 = grilio_request_new();
+    t->req3 = grilio_request_new();
+    t->req4 = grilio_request_new();
 
-    /* Start after we have been connected */
-    g_assert(!test->io->connected);
-    grilio_channel_add_connected_handler(test->io, test_retry3_start, test);
+    grilio_request_set_blocking(t->req1, TRUE);
+    grilio_channel_send_request(test->io, t->req1, RIL_REQUEST_TEST);
+    grilio_request_set_blocking(t->req2, TRUE);
+    grilio_channel_send_request(test->io, t->req2, RIL_REQUEST_TEST);
+    grilio_channel_send_request(test->io, t->req3, RIL_REQUEST_TEST);
+    grilio_channel_send_request(test->io, t->req4, RIL_REQUEST_TEST);
 
     /* Run the test */
+    grilio_channel_add_connected_handler(test->io, test_block2_connected, t);
     g_main_loop_run(test->loop);
 
-    /* Check the final state */
-    g_assert(grilio_request_retry_count(retry->req1) == 1);
-    g_assert(grilio_request_retry_count(retry->req2) == 1);
-    g_assert(retry->status1 == GRILIO_STATUS_CANCELLED);
-    g_assert(retry->status2 == GRILIO_STATUS_CANCELLED);
-
-    id1 = grilio_request_id(retry->req1);
-    id2 = grilio_request_id(retry->req2);
-    grilio_channel_cancel_request(test->io, id1, FALSE);
-    grilio_channel_cancel_request(test->io, id2, FALSE);
-    grilio_request_unref(retry->req1);
-    grilio_request_unref(retry->req2);
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_CANCELLED);
+    grilio_request_unref(t->req1);
+    grilio_request_unref(t->req2);
+    grilio_request_unref(t->req3);
+    grilio_request_unref(t->req4);
+    test_free(test);
 }
 
 /*==========================================================================*
- * Timeout1
+ * BlockTimeout
  *==========================================================================*/
 
-typedef struct test_timeout1_data {
-    Test test;
-    int timeout_count;
-    guint req_id;
-    guint timer_id;
-} TestTimeout1;
+typedef struct test_block_timeout_data {
+    Test test;
+    int req2_completed;
+    GRilIoRequest* req1;
+    GRilIoRequest* req2;
+} TestBlockTimeout;
 
 static
-gboolean
-test_timeout1_done(
-    gpointer user_data)
+void
+test_block_timeout_req2_completed(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
 {
-    Test* test = user_data;
-    TestTimeout1* timeout = G_CAST(test, TestTimeout1, test);
-    timeout->timer_id = 0;
-    GDEBUG("Cancelling request %u", timeout->req_id);
-    if (grilio_channel_cancel_request(test->io, timeout->req_id, TRUE) &&
-        timeout->timeout_count == 1) {
-        g_main_loop_quit(test->loop);
-    }
-    return FALSE;
+    TestBlockTimeout* t = user_data;
+    GDEBUG("Request 2 completion status %d", status);
+    t->req2_completed++;
+    g_assert(status == GRILIO_STATUS_OK);
 }
 
 static
 void
-test_timeout1_response(
+test_block_timeout_req1_completed(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    TestTimeout1* timeout = G_CAST(test, TestTimeout1, test);
-    GDEBUG("Completion status %d", status);
-    if (status == GRILIO_STATUS_TIMEOUT) {
-        timeout->timeout_count++;
-        if (!timeout->timer_id) {
-            timeout->timer_id = g_timeout_add(200, test_timeout1_done, test);
-        }
-    }
+    TestBlockTimeout* t = user_data;
+    GDEBUG("Request 1 completion status %d", status);
+    g_assert(status == GRILIO_STATUS_TIMEOUT);
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
 }
 
 static
 void
-test_timeout1_submit_requests(
-    Test* test,
-    GRilIoChannelResponseFunc fn)
+test_block_timeout(
+    void)
 {
-    TestTimeout1* timeout = G_CAST(test, TestTimeout1, test);
-    GRilIoRequest* req1 = grilio_request_new();
-    GRilIoRequest* req2 = grilio_request_new();
-    grilio_channel_set_timeout(test->io, 10);
-    grilio_request_set_timeout(req2, INT_MAX);
+    TestBlockTimeout* t = test_new(TestBlockTimeout, "BlockTimeout");
+    Test* test = &t->test;
 
-    grilio_channel_send_request_full(test->io, req1,
-        RIL_REQUEST_TEST, fn, NULL, test);
-    timeout->req_id = grilio_channel_send_request_full(test->io, req2,
-        RIL_REQUEST_TEST, test_timeout1_response, NULL, test);
-    grilio_request_unref(req1);
-    grilio_request_unref(req2);
+    t->req1 = grilio_request_new();
+    t->req2 = grilio_request_new();
+
+    /* Reply to the second one (and ack it), let the first one to time out */
+    grilio_test_server_add_request_func(test->server,
+        RIL_RESPONSE_ACKNOWLEDGEMENT, test_response_quit, test);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_2,
+        test_response_empty_ok_ack, test);
+
+    grilio_request_set_blocking(t->req1, TRUE);
+    grilio_request_set_timeout(t->req1, 10);
+    grilio_channel_send_request_full(test->io, t->req1, RIL_REQUEST_TEST_1,
+        test_block_timeout_req1_completed, NULL, t);
+    grilio_channel_send_request_full(test->io, t->req2, RIL_REQUEST_TEST_2,
+        test_block_timeout_req2_completed, NULL, t);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    g_assert(t->req2_completed == 1);
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
+    grilio_request_unref(t->req1);
+    grilio_request_unref(t->req2);
+    test_free(test);
 }
 
+/*==========================================================================*
+ * PendingTimeout
+ *==========================================================================*/
+
+typedef struct test_pending_timeout_data {
+    Test test;
+    GRilIoRequest* req1;
+    GRilIoRequest* req2;
+} TestPendingTimeout;
+
 static
 void
-test_timeout1_start(
+test_pending_timeout_req2_completed(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    TestTimeout1* timeout = G_CAST(test, TestTimeout1, test);
-    if (status == GRILIO_STATUS_TIMEOUT) {
-        GDEBUG("Starting...");
-        if (grilio_channel_cancel_request(test->io, timeout->req_id, FALSE)) {
-            test_timeout1_submit_requests(test, test_timeout1_response);
-        }
-    }
+    TestPendingTimeout* t = user_data;
+    GDEBUG("Request 2 completion status %d", status);
+    g_assert(status == GRILIO_STATUS_OK);
+    g_main_loop_quit(t->test.loop);
 }
 
 static
 void
-test_timeout1(
+test_pending_timeout(
     void)
 {
-    TestTimeout1* timeout = test_new(TestTimeout1, "Timeout1");
-    Test* test = &timeout->test;
-    test_timeout1_submit_requests(test, test_timeout1_start);
-    g_assert(!timeout->timer_id);
+    TestPendingTimeout* t = test_new(TestPendingTimeout, "PendingTimeout");
+    Test* test = &t->test;
+
+    t->req1 = grilio_request_new();
+    t->req2 = grilio_request_new();
+
+    /* Reply to the second one, let the first one to time out */
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_2,
+        test_response_empty_ok, test);
+
+    grilio_request_set_blocking(t->req1, TRUE);
+    grilio_request_set_timeout(t->req1, -1);
+    grilio_channel_send_request(test->io, t->req1, RIL_REQUEST_TEST_1);
+    grilio_channel_send_request_full(test->io, t->req2, RIL_REQUEST_TEST_2,
+        test_pending_timeout_req2_completed, NULL, t);
+
+    /* First request expires in 10 ms and the second one is sent */
+    grilio_channel_set_pending_timeout(test->io, 1);
+    grilio_channel_set_pending_timeout(test->io, 10);
+    /* Resistance to invalid parameters */
+    grilio_channel_set_pending_timeout(NULL, 0);
+    grilio_channel_set_pending_timeout(test->io, 0);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    /* The first request remains in the SENT state */
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_SENT);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
+    grilio_request_unref(t->req1);
+    grilio_request_unref(t->req2);
     test_free(test);
 }
 
+
 /*==========================================================================*
- * Timeout2
+ * Drop
  *==========================================================================*/
 
-typedef struct test_timeout2_data {
+typedef struct test_drop_data {
     Test test;
     GRilIoRequest* req1;
     GRilIoRequest* req2;
-} TestTimeout2;
+    GRilIoRequest* req3;
+    gboolean req1_done;
+    gboolean req2_done;
+    gboolean req3_done;
+} TestDrop;
 
 static
 void
-test_timeout2_req2_completed(
-    GRilIoChannel* io,
+test_drop_req_done(
+    GRilIoChannel* channel,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    GDEBUG("Request 2 completion status %d", status);
-    g_assert(status == GRILIO_STATUS_TIMEOUT);
-    g_main_loop_quit(test->loop);
+    gboolean* done = user_data;
+    (*done) = TRUE;
 }
 
 static
 void
-test_timeout2_start(
+test_drop_req3_done(
+    GRilIoChannel* channel,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestDrop* t = user_data;
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_DONE);
+    t->req3_done = TRUE;
+    g_main_loop_quit(t->test.loop);
+}
+
+static
+gboolean
+test_drop_req1_expired(
+    gpointer user_data)
+{
+    TestDrop* t = user_data;
+    guint id1 = grilio_request_id(t->req1);
+    g_assert(!t->req2_done);
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_SENT);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_QUEUED);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_QUEUED);
+    g_assert(grilio_channel_get_request(t->test.io,
+        grilio_request_id(t->req3)) == t->req3);
+    grilio_channel_drop_request(t->test.io, id1);
+    grilio_channel_drop_request(t->test.io, id1); /* And again */
+    return G_SOURCE_REMOVE;
+}
+
+static
+void
+test_drop_connected(
     GRilIoChannel* io,
     void* user_data)
 {
-    Test* test = user_data;
-    TestTimeout2* ts = G_CAST(test, TestTimeout2, test);
-    GDEBUG("Starting...");
-    grilio_channel_send_request(test->io, ts->req1, RIL_REQUEST_TEST);
-    grilio_channel_send_request_full(test->io, ts->req2,
-        RIL_REQUEST_TEST, test_timeout2_req2_completed, NULL, test);
+    TestDrop* t = user_data;
+    g_timeout_add(10, test_drop_req1_expired, t);
 }
 
 static
 void
-test_timeout2(
+test_drop(
     void)
 {
-    TestTimeout2* t = test_new(TestTimeout2, "Timeout2");
+    TestDrop* t = test_new(TestDrop, "Drop");
     Test* test = &t->test;
-    guint serial_id;
 
-    /* Prepare the test */
     t->req1 = grilio_request_new();
     t->req2 = grilio_request_new();
-    grilio_channel_set_timeout(test->io, 10);
-    grilio_request_set_timeout(t->req2, 20);
+    t->req3 = grilio_request_new();
 
-    /* Start after we have been connected */
-    g_assert(!test->io->connected);
-    serial_id = grilio_channel_serialize(test->io);
-    g_assert(serial_id);
-    grilio_channel_add_connected_handler(test->io, test_timeout2_start, test);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_2,
+        test_response_empty_ok, t);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_3,
+        test_response_empty_ok, t);
+
+    /* There won't be any reply to req1 */
+    grilio_request_set_timeout(t->req1, 0);
+    grilio_channel_send_request_full(test->io, t->req1, RIL_REQUEST_TEST_1,
+        test_drop_req_done, NULL, &t->req1_done);
+    /* But req2 and req3 will be allowed to run after we drop req1 */
+    grilio_request_set_blocking(t->req2, TRUE);
+    grilio_channel_send_request_full(test->io, t->req2, RIL_REQUEST_TEST_2,
+        test_drop_req_done, NULL, &t->req2_done);
+    grilio_request_set_blocking(t->req3, TRUE);
+    grilio_channel_send_request_full(test->io, t->req3, RIL_REQUEST_TEST_3,
+        test_drop_req3_done, NULL, t);
+
+    /* NULL is ignored */
+    grilio_channel_drop_request(NULL, 0);
 
     /* Run the test */
+    grilio_channel_add_connected_handler(test->io, test_drop_connected, t);
     g_main_loop_run(test->loop);
 
-    /* Check the final state */
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
+    g_assert(!t->req1_done);
+    g_assert(t->req2_done);
+    g_assert(t->req3_done);
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
     g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
-    grilio_channel_deserialize(test->io, serial_id);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_DONE);
     grilio_request_unref(t->req1);
     grilio_request_unref(t->req2);
+    grilio_request_unref(t->req3);
     test_free(test);
 }
 
 /*==========================================================================*
- * Serialize1
+ * Cancel1
  *==========================================================================*/
 
-typedef struct test_serialize1_data {
+typedef struct test_cancel1_data {
     Test test;
-    guint serial_id;
     GRilIoRequest* req1;
     GRilIoRequest* req2;
     GRilIoRequest* req3;
-    GRilIoRequest* req4;
-    GRilIoRequest* req5;
-} TestSerialize1;
+} TestCancel1;
 
 static
 void
-test_serialize1_req1_completed(
+test_cancel1_req2_completed(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    TestSerialize1* t = G_CAST(test, TestSerialize1, test);
-    GDEBUG("Request 1 completion status %d", status);
-    g_assert(status == GRILIO_STATUS_OK);
-    /* Request has completed, retry fails */
-    g_assert(!grilio_channel_retry_request(test->io,
-        grilio_request_id(t->req1)));
-    /* Request 2 should now be pending, so retry says TRUE */
-    g_assert(grilio_channel_retry_request(test->io,
-        grilio_request_id(t->req2)));
-    /* The second request is sent before this callback is invoked,
-     * cancel the third one */
-    g_assert(grilio_channel_cancel_request(test->io,
-        grilio_request_id(t->req3), FALSE));
-    /* This one gets ignored: */
-    grilio_test_server_add_response(test->server, NULL,
-        grilio_request_id(t->req3), GRILIO_STATUS_OK);
-}
-
-static
-void
-test_serialize1_req2_resp(
-    guint code,
-    guint id,
-    const void* data,
-    guint len,
-    void* user_data)
-{
-    Test* test = user_data;
-    TestSerialize1* t = G_CAST(test, TestSerialize1, test);
-    grilio_test_server_add_response(test->server, NULL, id,
-        RIL_E_GENERIC_FAILURE);
-    /* De-serialize the channel */
-    grilio_channel_deserialize(test->io, t->serial_id);
+    TestCancel1* t = user_data;
+    GDEBUG("Request 2 completion status %d", status);
+    g_assert(status == GRILIO_STATUS_CANCELLED);
+    /* This one has already been cancelled */
+    g_assert(!grilio_channel_cancel_request(t->test.io,
+        grilio_request_id(t->req2), TRUE));
+    /* Cancel req3 from the req2 completion callback */
+    g_assert(grilio_channel_cancel_request(t->test.io,
+        grilio_request_id(t->req3), TRUE));
+    g_main_loop_quit(t->test.loop);
 }
 
 static
 void
-test_serialize1_req2_completed(
+test_cancel1_req1_completed(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    TestSerialize1* t = G_CAST(test, TestSerialize1, test);
-    GDEBUG("Request 2 completion status %d", status);
-    g_assert(status == RIL_E_GENERIC_FAILURE);
-    grilio_test_server_add_response(test->server, NULL,
-        grilio_request_id(t->req4), RIL_E_REQUEST_NOT_SUPPORTED);
-    grilio_test_server_add_response(test->server, NULL,
-        grilio_request_id(t->req5), GRILIO_STATUS_OK);
+    TestCancel1* t = user_data;
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
+    /* Cancel everything */
+    grilio_channel_cancel_all(t->test.io, TRUE);
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_CANCELLED);
 }
 
 static
 void
-test_serialize1_req3_completed(
-    GRilIoChannel* io,
-    int status,
-    const void* data,
-    guint len,
-    void* user_data)
+test_cancel1(
+    void)
 {
-    GDEBUG("Request 3 completion status %d", status);
-    g_assert(status == GRILIO_STATUS_CANCELLED);
+    TestCancel1* t = test_new(TestCancel1, "Cancel1");
+    Test* test = &t->test;
+
+    t->req1 = grilio_request_new();
+    t->req2 = grilio_request_new();
+    t->req3 = grilio_request_new();
+
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
+        test_response_empty_ok, test);
+
+    grilio_channel_send_request_full(test->io, t->req1, RIL_REQUEST_TEST,
+        test_cancel1_req1_completed, NULL, t);
+    grilio_channel_send_request_full(test->io, t->req2, RIL_REQUEST_TEST,
+        test_cancel1_req2_completed, NULL, t);
+    grilio_channel_send_request(test->io, t->req3, RIL_REQUEST_TEST);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+
+    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
+    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
+    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_CANCELLED);
+    grilio_request_unref(t->req1);
+    grilio_request_unref(t->req2);
+    grilio_request_unref(t->req3);
+    test_free(test);
 }
 
+/*==========================================================================*
+ * Pipeline
+ *==========================================================================*/
+
+#define PIPELINE_WINDOW (4)
+#define PIPELINE_COUNT (8)
+#define PIPELINE_BIG_SIZE (0x40001)
+#define PIPELINE_CANCEL (2)
+
+typedef struct test_pipeline_data {
+    Test test;
+    guint id[PIPELINE_COUNT];
+    int responses;
+    gboolean cancelled;
+} TestPipeline;
+
 static
 void
-test_serialize1_req4_completed(
+test_pipeline_response(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    GDEBUG("Request 4 completion status %d", status);
-    g_assert(status == RIL_E_REQUEST_NOT_SUPPORTED);
+    TestPipeline* t = user_data;
+    GRilIoParser parser;
+    gint32 count, value;
+
+    if (status == GRILIO_STATUS_CANCELLED) {
+        g_assert(!t->cancelled);
+        t->cancelled = TRUE;
+        return;
+    }
+
+    g_assert(status == GRILIO_STATUS_OK);
+    grilio_parser_init(&parser, data, len);
+    g_assert(grilio_parser_get_int32(&parser, &count));
+    g_assert(grilio_parser_get_int32(&parser, &value));
+    g_assert(grilio_parser_at_end(&parser));
+    g_assert(count == 1);
+
+    /* Responses arrive in order, except for the cancelled one */
+    if (t->responses == PIPELINE_CANCEL) {
+        t->responses++;
+    }
+    GDEBUG("Response %d", value);
+    g_assert(value == ++t->responses);
+    if (t->responses == PIPELINE_COUNT) {
+        g_main_loop_quit(t->test.loop);
+    }
 }
 
 static
 void
-test_serialize1_req5_completed(
+test_pipeline_big_response(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    GDEBUG("Request 5 completion status %d", status);
+    TestPipeline* t = user_data;
+
     g_assert(status == GRILIO_STATUS_OK);
-    g_main_loop_quit(test->loop);
+    g_assert(!t->responses);
+    t->responses++;
 }
 
 static
 void
-test_serialize1_start(
+test_pipeline_connected(
     GRilIoChannel* io,
     void* user_data)
 {
-    Test* test = user_data;
-    TestSerialize1* t = G_CAST(test, TestSerialize1, test);
-    GDEBUG("Starting...");
-    grilio_request_set_blocking(t->req2, TRUE);
-    grilio_channel_send_request_full(test->io, t->req2,
-        RIL_REQUEST_TEST_2, test_serialize1_req2_completed, NULL, test);
-    grilio_channel_send_request_full(test->io, t->req3,
-        RIL_REQUEST_TEST, test_serialize1_req3_completed, NULL, test);
-    grilio_channel_send_request_full(test->io, t->req4,
-        RIL_REQUEST_TEST, test_serialize1_req4_completed, NULL, test);
-    grilio_channel_send_request_full(test->io, t->req5,
-        RIL_REQUEST_TEST, test_serialize1_req5_completed, NULL, test);
-    grilio_test_server_add_response(test->server, NULL,
-        grilio_request_id(t->req1), GRILIO_STATUS_OK);
-    g_assert(grilio_channel_has_pending_requests(test->io));
+    TestPipeline* t = user_data;
+    GRilIoRequest* req = grilio_request_sized_new(PIPELINE_BIG_SIZE);
+    int i;
+
+    /* The first request is too big to be written in one go */
+    for (i = 0; i < PIPELINE_BIG_SIZE; i++) {
+        grilio_request_append_byte(req, (guchar)i);
+    }
+    t->id[0] = grilio_channel_send_request_full(io, req, RIL_REQUEST_TEST_1,
+        test_pipeline_big_response, NULL, t);
+    grilio_request_unref(req);
+
+    for (i = 1; i < PIPELINE_COUNT; i++) {
+        req = grilio_request_array_int32_new(1, i + 1);
+        t->id[i] = grilio_channel_send_request_full(io, req,
+            RIL_REQUEST_TEST_0, test_pipeline_response, NULL, t);
+        grilio_request_unref(req);
+    }
+
+    /* The first PIPELINE_WINDOW requests have been passed to transport */
+    for (i = 0; i < PIPELINE_COUNT; i++) {
+        req = grilio_channel_get_request(io, t->id[i]);
+        g_assert(req);
+        g_assert(grilio_request_status(req) == ((i < PIPELINE_WINDOW) ?
+            GRILIO_REQUEST_SENDING : GRILIO_REQUEST_QUEUED));
+    }
+
+    /* Cancel the one which is being sent */
+    req = grilio_channel_get_request(io, t->id[PIPELINE_CANCEL]);
+    g_assert(grilio_channel_cancel_request(io, t->id[PIPELINE_CANCEL], TRUE));
+    g_assert(grilio_request_status(req) == GRILIO_REQUEST_CANCELLED);
+    g_assert(t->cancelled);
+    g_assert(!grilio_channel_cancel_request(io, t->id[PIPELINE_CANCEL], TRUE));
 }
 
 static
 void
-test_serialize1(
+test_pipeline(
     void)
 {
-    TestSerialize1* t = test_new(TestSerialize1, "Serialize1");
+    TestPipeline* t = test_new(TestPipeline, "Pipeline");
     Test* test = &t->test;
-    guint id;
-
-    /* Prepare the test */
-    t->req1 = grilio_request_new();
-    t->req2 = grilio_request_new();
-    t->req3 = grilio_request_new();
-    t->req4 = grilio_request_new();
-    t->req5 = grilio_request_new();
-    grilio_channel_set_timeout(test->io, GRILIO_TIMEOUT_DEFAULT);
-    grilio_request_set_timeout(t->req1, INT_MAX);
-
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_2,
-        test_serialize1_req2_resp, test);
 
-    /* Start after we have been connected */
-    g_assert(!test->io->connected);
-    t->serial_id = grilio_channel_serialize(test->io);
-    g_assert(t->serial_id);
-    /* Increment/decrement serialization count */
-    grilio_channel_deserialize(test->io, grilio_channel_serialize(test->io));
-    /* Submit the first request. There's nothing to retry, just make sure
-     * that grilio_channel_retry_request returns TRUE. */
-    id = grilio_channel_send_request_full(test->io, t->req1, RIL_REQUEST_TEST,
-        test_serialize1_req1_completed, NULL, test);
-    g_assert(grilio_channel_retry_request(test->io, id));
-    /* And wait for the channel to get connected */
-    grilio_channel_add_connected_handler(test->io,
-        test_serialize1_start, test);
+    grilio_transport_socket_set_send_window(test->transport, PIPELINE_WINDOW);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_0,
+        test_response_reflect_ok, test);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_1,
+        test_response_empty_ok, test);
+    grilio_channel_add_connected_handler(test->io, test_pipeline_connected, t);
 
     /* Run the test */
     g_main_loop_run(test->loop);
-
-    /* Check the final state */
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req5) == GRILIO_REQUEST_DONE);
-    grilio_request_unref(t->req1);
-    grilio_request_unref(t->req2);
-    grilio_request_unref(t->req3);
-    grilio_request_unref(t->req4);
-    grilio_request_unref(t->req5);
-    grilio_channel_deserialize(test->io, t->serial_id); // No effect
-    grilio_channel_deserialize(test->io, 0); // No effect
+    g_assert(t->responses == PIPELINE_COUNT);
+    g_assert(t->cancelled);
     test_free(test);
 }
 
 /*==========================================================================*
- * Serialize2
+ * Table
+ *
+ * Lots of requests in flight at the same time, every third one gets
+ * cancelled. The request table has to grow and shrink back.
+ *
  *==========================================================================*/
 
-typedef struct test_serialize2_data {
+#define TABLE_COUNT (200)
+#define TABLE_CANCEL(i) (((i) % 3) == 2)
+
+typedef struct test_table_data {
     Test test;
-    guint serial_id;
-    GRilIoRequest* req1;
-    GRilIoRequest* req2;
-    GRilIoRequest* req3;
-} TestSerialize2;
+    guint id[TABLE_COUNT];
+    int responses;
+    int last;
+} TestTable;
 
 static
 void
-test_serialize2_req3_resp(
-    guint code,
-    guint id,
+test_table_response(
+    GRilIoChannel* io,
+    int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    TestSerialize2* t = G_CAST(test, TestSerialize2, test);
-    grilio_test_server_add_response(test->server, NULL, id,
-        RIL_E_GENERIC_FAILURE);
-    /* De-serialize the channel */
-    grilio_channel_deserialize(test->io, t->serial_id);
+    TestTable* t = user_data;
+    GRilIoParser parser;
+    gint32 count, value;
+
+    g_assert(status == GRILIO_STATUS_OK);
+    grilio_parser_init(&parser, data, len);
+    g_assert(grilio_parser_get_int32(&parser, &count));
+    g_assert(grilio_parser_get_int32(&parser, &value));
+    g_assert(count == 1);
+    g_assert(value > t->last);
+    g_assert(!TABLE_CANCEL(value));
+    t->last = value;
+    t->responses++;
+    if (value == TABLE_COUNT - 1) {
+        g_main_loop_quit(t->test.loop);
+    }
 }
 
 static
 void
-test_serialize2_req1_resp(
-    guint code,
-    guint id,
-    const void* data,
-    guint len,
+test_table_connected(
+    GRilIoChannel* io,
     void* user_data)
 {
-    Test* test = user_data;
-    TestSerialize2* t = G_CAST(test, TestSerialize2, test);
-    g_assert(grilio_request_id(t->req1) == id);
-    grilio_test_server_add_response(test->server, NULL, id, GRILIO_STATUS_OK);
-    /* Request 2 should is now pending, cancel it */
-    g_assert(grilio_channel_cancel_request(test->io,
-        grilio_request_id(t->req2), TRUE));
+    TestTable* t = user_data;
+    int i;
+
+    for (i = 0; i < TABLE_COUNT; i++) {
+        GRilIoRequest* req = grilio_request_array_int32_new(1, i);
+
+        t->id[i] = grilio_channel_send_request_full(io, req,
+            RIL_REQUEST_TEST, test_table_response, NULL, t);
+        g_assert(grilio_channel_get_request(io, t->id[i]) == req);
+        grilio_request_unref(req);
+    }
+
+    for (i = 0; i < TABLE_COUNT; i++) {
+        if (TABLE_CANCEL(i)) {
+            g_assert(grilio_channel_cancel_request(io, t->id[i], FALSE));
+            g_assert(!grilio_channel_get_request(io, t->id[i]));
+            g_assert(!grilio_channel_cancel_request(io, t->id[i], FALSE));
+        } else {
+            g_assert(grilio_channel_get_request(io, t->id[i]));
+        }
+    }
+}
+
+static
+void
+test_table(
+    void)
+{
+    TestTable* t = test_new(TestTable, "Table");
+    Test* test = &t->test;
+    int i;
+
+    t->last = -1;
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
+        test_response_reflect_ok, test);
+    grilio_channel_add_connected_handler(test->io, test_table_connected, t);
+
+    /* Run the test */
+    g_main_loop_run(test->loop);
+    g_assert(t->responses == TABLE_COUNT - TABLE_COUNT/3);
+    g_assert(!grilio_channel_has_pending_requests(test->io));
+    for (i = 0; i < TABLE_COUNT; i++) {
+        g_assert(!grilio_channel_get_request(test->io, t->id[i]));
+    }
+    test_free(test);
 }
 
+/*==========================================================================*
+ * QueueCancel
+ *
+ * Two queues with interleaved requests. One of them gets cancelled
+ * as a whole, plus one request from the middle of the other one.
+ *
+ *==========================================================================*/
+
+#define QUEUE_CANCEL_COUNT (100)
+#define QUEUE_CANCEL_ONE (QUEUE_CANCEL_COUNT/2)
+
+typedef struct test_queue_cancel_data {
+    Test test;
+    GRilIoQueue* queue[2];
+    guint id[2][QUEUE_CANCEL_COUNT];
+    int responses;
+    int cancelled;
+    int last;
+} TestQueueCancel;
+
 static
 void
-test_serialize2_req3_completed(
+test_queue_cancel_response(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    Test* test = user_data;
-    GDEBUG("Request 3 completion status %d", status);
-    g_assert(status == RIL_E_GENERIC_FAILURE);
-    g_main_loop_quit(test->loop);
+    TestQueueCancel* t = user_data;
+    GRilIoParser parser;
+    gint32 count, value;
+
+    if (status == GRILIO_STATUS_CANCELLED) {
+        t->cancelled++;
+        return;
+    }
+
+    g_assert(status == GRILIO_STATUS_OK);
+    grilio_parser_init(&parser, data, len);
+    g_assert(grilio_parser_get_int32(&parser, &count));
+    g_assert(grilio_parser_get_int32(&parser, &value));
+    g_assert(count == 1);
+    g_assert(value > t->last);
+    g_assert(value != QUEUE_CANCEL_ONE);
+    t->last = value;
+    t->responses++;
+    if (value == QUEUE_CANCEL_COUNT - 1) {
+        g_main_loop_quit(t->test.loop);
+    }
 }
 
 static
 void
-test_serialize2_start(
+test_queue_cancel_connected(
     GRilIoChannel* io,
     void* user_data)
 {
-    Test* test = user_data;
-    TestSerialize2* t = G_CAST(test, TestSerialize2, test);
-    GDEBUG("Starting...");
-    grilio_channel_send_request(test->io, t->req2, RIL_REQUEST_TEST);
-    grilio_channel_send_request_full(test->io, t->req3, RIL_REQUEST_TEST_3,
-        test_serialize2_req3_completed, NULL, test);
+    TestQueueCancel* t = user_data;
+    int i, k;
+
+    for (i = 0; i < QUEUE_CANCEL_COUNT; i++) {
+        for (k = 0; k < 2; k++) {
+            GRilIoRequest* req = grilio_request_array_int32_new(1, i);
+
+            t->id[k][i] = grilio_queue_send_request_full(t->queue[k], req,
+                RIL_REQUEST_TEST, test_queue_cancel_response, NULL, t);
+            grilio_request_unref(req);
+        }
+    }
+
+    /* Request from another queue can't be cancelled */
+    g_assert(!grilio_queue_cancel_request(t->queue[1],
+        t->id[0][QUEUE_CANCEL_ONE], TRUE));
+    g_assert(grilio_queue_cancel_request(t->queue[0],
+        t->id[0][QUEUE_CANCEL_ONE], TRUE));
+    g_assert(!grilio_channel_get_request(io, t->id[0][QUEUE_CANCEL_ONE]));
+    g_assert(t->cancelled == 1);
+
+    grilio_queue_cancel_all(t->queue[1], TRUE);
+    g_assert(t->cancelled == QUEUE_CANCEL_COUNT + 1);
+    for (i = 0; i < QUEUE_CANCEL_COUNT; i++) {
+        g_assert(!grilio_channel_get_request(io, t->id[1][i]));
+        if (i != QUEUE_CANCEL_ONE) {
+            g_assert(grilio_channel_get_request(io, t->id[0][i]));
+        }
+    }
 }
 
 static
 void
-test_serialize2(
+test_queue_cancel(
     void)
 {
-    TestSerialize2* t = test_new(TestSerialize2, "Serialize2");
+    TestQueueCancel* t = test_new(TestQueueCancel, "QueueCancel");
     Test* test = &t->test;
-    guint id;
-
-    /* Prepare the test */
-    t->req1 = grilio_request_new();
-    t->req2 = grilio_request_new();
-    t->req3 = grilio_request_new();
 
+    t->last = -1;
+    t->queue[0] = grilio_queue_new(test->io);
+    t->queue[1] = grilio_queue_new(test->io);
     grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
         test_response_reflect_ok, test);
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_1,
-        test_serialize2_req1_resp, test);
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_3,
-        test_serialize2_req3_resp, test);
-
-    /* Start after we have been connected */
-    g_assert(!test->io->connected);
-    t->serial_id = grilio_channel_serialize(test->io);
-    g_assert(t->serial_id);
-    /* Submit the first request. There's nothing to retry, just make sure
-     * that grilio_channel_retry_request returns TRUE. */
-    id = grilio_channel_send_request(test->io, t->req1, RIL_REQUEST_TEST_1);
-    g_assert(grilio_channel_retry_request(test->io, id));
-    /* And wait for the channel to get connected */
     grilio_channel_add_connected_handler(test->io,
-        test_serialize2_start, test);
+        test_queue_cancel_connected, t);
 
     /* Run the test */
     g_main_loop_run(test->loop);
-
-    /* Check the final state */
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_DONE);
-    grilio_request_unref(t->req1);
-    grilio_request_unref(t->req2);
-    grilio_request_unref(t->req3);
+    g_assert(t->responses == QUEUE_CANCEL_COUNT - 1);
+    g_assert(t->cancelled == QUEUE_CANCEL_COUNT + 1);
+    grilio_queue_unref(t->queue[0]);
+    grilio_queue_unref(t->queue[1]);
     test_free(test);
 }
 
 /*==========================================================================*
- * Serialize3
+ * Bytes
  *==========================================================================*/
 
-typedef struct test_serialize3_data {
+#define BYTES_COUNT (16)
+#define BYTES_CANCEL (5)
+
+typedef struct test_bytes_data {
     Test test;
-    GRilIoRequest* req1;
-    GRilIoRequest* req2;
-    GRilIoRequest* req3;
-} TestSerialize3;
+    guint id[BYTES_COUNT];
+    GBytes* bytes[BYTES_COUNT];
+    int responses;
+    gboolean cancelled;
+} TestBytes;
 
 static
 void
-test_serialize3_req1_completed(
+test_bytes_response(
     GRilIoChannel* io,
     int status,
-    const void* data,
-    guint len,
+    GBytes* bytes,
     void* user_data)
 {
-    Test* test = user_data;
-    TestSerialize3* t = G_CAST(test, TestSerialize3, test);
-    GDEBUG("Request 1 completion status %d", status);
+    TestBytes* t = user_data;
+    GRilIoParser parser;
+    gint32 count, value;
+    gsize len;
+    const void* data;
+
+    if (status == GRILIO_STATUS_CANCELLED) {
+        g_assert(!bytes);
+        g_assert(!t->cancelled);
+        t->cancelled = TRUE;
+        return;
+    }
+
     g_assert(status == GRILIO_STATUS_OK);
-    g_assert(!grilio_channel_get_request(test->io,
-        grilio_request_id(t->req1)));
-    g_assert(grilio_channel_get_request(test->io,
-        grilio_request_id(t->req2)) == t->req2);
-    grilio_channel_cancel_all(test->io, TRUE);
-}
+    g_assert(bytes);
+    data = g_bytes_get_data(bytes, &len);
+    grilio_parser_init(&parser, data, len);
+    g_assert(grilio_parser_get_int32(&parser, &count));
+    g_assert(grilio_parser_get_int32(&parser, &value));
+    g_assert(grilio_parser_at_end(&parser));
+    g_assert(count == 1);
+    g_assert(value > 0 && value <= BYTES_COUNT);
+    g_assert(!t->bytes[value - 1]);
 
-static
-void
-test_serialize3_req3_completed(
-    GRilIoChannel* io,
-    int status,
-    const void* data,
-    guint len,
-    void* user_data)
-{
-    Test* test = user_data;
-    GDEBUG("Request 3 completion status %d", status);
-    g_assert(status == GRILIO_STATUS_CANCELLED);
-    g_main_loop_quit(test->loop);
+    /* Hold on to the payload, it must survive the following reads */
+    t->bytes[value - 1] = g_bytes_ref(bytes);
+    if (++t->responses == BYTES_COUNT - 1) {
+        g_main_loop_quit(t->test.loop);
+    }
 }
 
 static
 void
-test_serialize3_start(
+test_bytes_connected(
     GRilIoChannel* io,
     void* user_data)
 {
-    Test* test = user_data;
-    TestSerialize3* t = G_CAST(test, TestSerialize3, test);
-    GDEBUG("Starting...");
+    TestBytes* t = user_data;
+    int i;
 
-    grilio_channel_send_request(test->io, t->req2, RIL_REQUEST_TEST);
-    grilio_channel_send_request_full(test->io, t->req3,
-        RIL_REQUEST_TEST, test_serialize3_req3_completed, NULL, test);
-    grilio_test_server_add_response(test->server, NULL,
-        grilio_request_id(t->req1), GRILIO_STATUS_OK);
+    for (i = 0; i < BYTES_COUNT; i++) {
+        GRilIoRequest* req = grilio_request_array_int32_new(1, i + 1);
 
-    g_assert(grilio_channel_get_request(test->io,
-        grilio_request_id(t->req1)) == t->req1);
-    g_assert(grilio_channel_get_request(test->io,
-        grilio_request_id(t->req2)) == t->req2);
-    g_assert(grilio_channel_get_request(test->io,
-        grilio_request_id(t->req3)) == t->req3);
+        t->id[i] = grilio_channel_send_request_bytes(io, req,
+            RIL_REQUEST_TEST_0, test_bytes_response, NULL, t);
+        grilio_request_unref(req);
+    }
+    g_assert(grilio_channel_cancel_request(io, t->id[BYTES_CANCEL], TRUE));
+    g_assert(t->cancelled);
 }
 
 static
 void
-test_serialize3(
-    void)
+test_bytes_run(
+    guint batch)
 {
-    TestSerialize3* t = test_new(TestSerialize3, "Serialize3");
+    TestBytes* t = test_new(TestBytes, "Bytes");
     Test* test = &t->test;
-    guint serial_id;
-
-    /* Prepare the test */
-    t->req1 = grilio_request_new();
-    t->req2 = grilio_request_new();
-    t->req3 = grilio_request_new();
+    int i;
 
-    /* Start after we have been connected */
-    g_assert(!test->io->connected);
-    serial_id = grilio_channel_serialize(test->io);
-    g_assert(serial_id);
-    grilio_channel_send_request_full(test->io, t->req1, RIL_REQUEST_TEST,
-        test_serialize3_req1_completed, NULL, test);
-    /* And Wait for the channel to get connected */
-    grilio_channel_add_connected_handler(test->io,
-        test_serialize3_start, test);
+    grilio_transport_socket_set_read_batch(test->transport, batch);
+    grilio_transport_socket_set_send_window(test->transport, BYTES_COUNT);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_0,
+        test_response_reflect_ok, test);
+    grilio_channel_add_connected_handler(test->io, test_bytes_connected, t);
 
     /* Run the test */
     g_main_loop_run(test->loop);
+    g_assert(t->responses == BYTES_COUNT - 1);
+    g_assert(t->cancelled);
 
-    /* Check the final state */
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_CANCELLED);
-    grilio_request_unref(t->req1);
-    grilio_request_unref(t->req2);
-    grilio_request_unref(t->req3);
-    grilio_channel_deserialize(test->io, serial_id);
+    /* Check that none of the payloads got overwritten */
+    for (i = 0; i < BYTES_COUNT; i++) {
+        if (i == BYTES_CANCEL) {
+            g_assert(!t->bytes[i]);
+        } else {
+            GRilIoParser parser;
+            gint32 count, value;
+            gsize len;
+            const void* data = g_bytes_get_data(t->bytes[i], &len);
+
+            grilio_parser_init(&parser, data, len);
+            g_assert(grilio_parser_get_int32(&parser, &count));
+            g_assert(grilio_parser_get_int32(&parser, &value));
+            g_assert(count == 1);
+            g_assert(value == i + 1);
+            g_bytes_unref(t->bytes[i]);
+        }
+    }
     test_free(test);
 }
 
+static
+void
+test_bytes(
+    void)
+{
+    test_bytes_run(0);
+}
+
+static
+void
+test_bytes_batch(
+    void)
+{
+    test_bytes_run(4);
+}
+
 /*==========================================================================*
- * Block1
+ * Stream
  *==========================================================================*/
 
-typedef struct test_block1_data {
+#define STREAM_SIZE (0x12345)
+#define STREAM_MAX_LEN (0x20000)
+#define STREAM_UNSOL_CODE (2000)
+
+typedef struct test_stream_data {
     Test test;
-    GRilIoRequest* req1; /* Blocking, cancelled before it's sent */
-    GRilIoRequest* req2; /* Blocking, cancelled after it's sent */
-    GRilIoRequest* req3; /* Blocking, should complete normally */
-    GRilIoRequest* req4; /* Non-blocking, should complete normally */
-    gboolean req3_done;
-    gboolean req4_done;
-} TestBlock1;
+    guint8* data;
+    guint received;
+    guint fragments;
+    guint small_fragments;
+    int done;
+} TestStream;
 
 static
 void
-test_block1_req3_done(
-    GRilIoChannel* channel,
+test_stream_check_done(
+    TestStream* t)
+{
+    if (++t->done == 4) {
+        g_main_loop_quit(t->test.loop);
+    }
+}
+
+static
+void
+test_stream_big_request(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestStream* t = user_data;
+
+    grilio_test_server_add_response_data(t->test.server, id,
+        GRILIO_STATUS_OK, t->data, STREAM_SIZE);
+}
+
+static
+void
+test_stream_fragment(
+    GRilIoChannel* io,
     int status,
+    guint offset,
+    guint total,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestBlock1* t = user_data;
+    TestStream* t = user_data;
+
     g_assert(status == GRILIO_STATUS_OK);
-    g_assert(!t->req3_done);
-    g_assert(!t->req4_done);
-    t->req3_done = TRUE;
+    g_assert(total == STREAM_SIZE);
+    g_assert(offset == t->received);
+    g_assert(offset + len <= total);
+    g_assert(!memcmp(data, t->data + offset, len));
+    t->received += len;
+    t->fragments++;
 }
 
 static
 void
-test_block1_req4_done(
-    GRilIoChannel* channel,
+test_stream_response(
+    GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestBlock1* t = user_data;
+    TestStream* t = user_data;
+
+    /* The data have been passed to the fragment callback */
     g_assert(status == GRILIO_STATUS_OK);
-    g_assert(t->req3_done);
-    g_assert(!t->req4_done);
-    t->req4_done = TRUE;
-    g_main_loop_quit(t->test.loop);
+    g_assert(!data);
+    g_assert(!len);
+    g_assert(t->received == STREAM_SIZE);
+    g_assert(t->fragments > 1);
+    test_stream_check_done(t);
 }
 
 static
 void
-test_block1_resp2(
-    guint code,
-    guint id,
+test_stream_small_fragment(
+    GRilIoChannel* io,
+    int status,
+    guint offset,
+    guint total,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestStream* t = user_data;
+
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(!offset);
+    g_assert(total == len);
+    g_assert(len == 8);
+    t->small_fragments++;
+}
+
+static
+void
+test_stream_small_response(
+    GRilIoChannel* io,
+    int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestBlock1* t = user_data;
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_SENT);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_QUEUED);
-    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_QUEUED);
-    g_assert(grilio_request_id(t->req2) == id);
-    /* This one is pending, retry says FALSE  */
-    g_assert(!grilio_channel_retry_request(t->test.io, id));
-    /* This one is queued, retry says TRUE */
-    g_assert(grilio_channel_retry_request(t->test.io,
-        grilio_request_id(t->req3)));
-    /* Cancel this request */
-    g_assert(grilio_channel_cancel_request(t->test.io, id, FALSE));
-    /* And assert that request status has changed */
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
-    /* Send the response to unblock the channel */
-    grilio_test_server_add_response_data(t->test.server, id,
-        GRILIO_STATUS_OK, NULL, 0);
+    TestStream* t = user_data;
+
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(!data);
+    g_assert(t->small_fragments == 1);
+    test_stream_check_done(t);
 }
 
 static
 void
-test_block1_resp3(
-    guint code,
-    guint id,
+test_stream_full_response(
+    GRilIoChannel* io,
+    int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestBlock1* t = user_data;
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_SENT);
-    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_QUEUED);
-    grilio_test_server_add_response_data(t->test.server, id,
-        GRILIO_STATUS_OK, NULL, 0);
+    TestStream* t = user_data;
+
+    /* Reassembled by the channel */
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(len == STREAM_SIZE);
+    g_assert(!memcmp(data, t->data, len));
+    test_stream_check_done(t);
 }
 
 static
 void
-test_block1_connected(
+test_stream_unsol(
     GRilIoChannel* io,
+    guint code,
+    const void* data,
+    guint len,
     void* user_data)
 {
-    TestBlock1* t = user_data;
-    /* Nothing has been sent yet */
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_QUEUED);
-    /* Cancel this one before it's been sent */
-    g_assert(grilio_channel_cancel_request(t->test.io,
-        grilio_request_id(t->req1), FALSE));
+    TestStream* t = user_data;
+
+    /* Reassembled by the transport */
+    g_assert(code == STREAM_UNSOL_CODE);
+    g_assert(len == STREAM_SIZE);
+    g_assert(!memcmp(data, t->data, len));
+    test_stream_check_done(t);
 }
 
 static
 void
-test_block1(
-    void)
+test_stream_run(
+    guint batch)
 {
-    TestBlock1* t = test_new(TestBlock1, "Block1");
+    TestStream* t = test_new(TestStream, "Stream");
     Test* test = &t->test;
+    GRilIoRequest* req = grilio_request_array_int32_new(1, 1);
+    guint i;
 
-    t->req1 = grilio_request_new();
-    t->req2 = grilio_request_new();
-    t->req3 = grilio_request_new();
-    t->req4 = grilio_request_new();
-
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_2,
-        test_block1_resp2, t);
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_3,
-        test_block1_resp3, t);
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_4,
-        test_response_empty_ok, t);
+    t->data = g_malloc(STREAM_SIZE);
+    for (i = 0; i < STREAM_SIZE; i++) {
+        t->data[i] = (guint8)(i * 7 + 1);
+    }
 
-    grilio_request_set_blocking(t->req1, TRUE);
-    grilio_channel_send_request(test->io, t->req1, RIL_REQUEST_TEST_1);
-    grilio_request_set_blocking(t->req2, TRUE);
-    grilio_channel_send_request(test->io, t->req2, RIL_REQUEST_TEST_2);
-    grilio_request_set_blocking(t->req3, TRUE);
-    grilio_channel_send_request_full(test->io, t->req3, RIL_REQUEST_TEST_3,
-        test_block1_req3_done, NULL, t);
-    grilio_channel_send_request_full(test->io, t->req4, RIL_REQUEST_TEST_4,
-        test_block1_req4_done, NULL, t);
+    grilio_transport_socket_set_read_batch(test->transport, batch);
+    grilio_transport_socket_set_max_packet_len(test->transport,
+        STREAM_MAX_LEN);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_0,
+        test_response_reflect_ok, test);
+    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_1,
+        test_stream_big_request, t);
+    grilio_channel_add_unsol_event_handler(test->io, test_stream_unsol,
+        STREAM_UNSOL_CODE, t);
+    grilio_test_server_add_unsol_data(test->server, STREAM_UNSOL_CODE,
+        t->data, STREAM_SIZE);
+
+    g_assert(grilio_channel_send_request_stream(test->io, NULL,
+        RIL_REQUEST_TEST_1, test_stream_fragment, test_stream_response,
+        NULL, t));
+    g_assert(grilio_channel_send_request_full(test->io, NULL,
+        RIL_REQUEST_TEST_1, test_stream_full_response, NULL, t));
+    g_assert(grilio_channel_send_request_stream(test->io, req,
+        RIL_REQUEST_TEST_0, test_stream_small_fragment,
+        test_stream_small_response, NULL, t));
+    grilio_request_unref(req);
 
     /* Run the test */
-    grilio_channel_add_connected_handler(test->io, test_block1_connected, t);
     g_main_loop_run(test->loop);
+    g_assert(t->done == 4);
+    g_free(t->data);
+    test_free(test);
+}
 
-    g_assert(t->req3_done);
-    g_assert(t->req4_done);
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_DONE);
-    grilio_request_unref(t->req1);
-    grilio_request_unref(t->req2);
-    grilio_request_unref(t->req3);
-    grilio_request_unref(t->req4);
+static
+void
+test_stream(
+    void)
+{
+    /* NULL tolerance */
+    grilio_transport_socket_set_max_packet_len(NULL, 0);
+
+    test_stream_run(0);
+    test_stream_run(4);
+}
+
+static
+void
+test_stream_too_long_run(
+    guint batch)
+{
+    Test* test = test_new(Test, "StreamTooLong");
+    const gsize size = STREAM_MAX_LEN + 1;
+    void* data = g_malloc0(size);
+
+    grilio_transport_socket_set_read_batch(test->transport, batch);
+    grilio_transport_socket_set_max_packet_len(test->transport,
+        STREAM_MAX_LEN);
+    grilio_channel_add_error_handler(test->io, test_short_packet_handler,
+        test);
+    grilio_test_server_add_unsol_data(test->server, STREAM_UNSOL_CODE,
+        data, size);
+    g_main_loop_run(test->loop);
+    g_assert(!test->transport->connected);
+    g_free(data);
     test_free(test);
 }
 
+static
+void
+test_stream_too_long(
+    void)
+{
+    test_stream_too_long_run(0);
+    test_stream_too_long_run(4);
+}
+
 /*==========================================================================*
- * Block2
+ * Reconnect
  *==========================================================================*/
 
-typedef struct test_block2_data {
-    Test test;
-    GRilIoRequest* req1;
-    GRilIoRequest* req2;
-    GRilIoRequest* req3;
-    GRilIoRequest* req4;
-} TestBlock2;
+typedef struct test_reconnect_data {
+    GMainLoop* loop;
+    char* dir;
+    char* path;
+    int listen_fd;
+    guint listen_id;
+    guint timeout_id;
+    GRilIoTestServer* server[2];
+    GRilIoTestRequestFunc server_fn;
+    int accepted;
+    GRilIoTransport* transport;
+    GRilIoChannel* io;
+    int connected;
+    int disconnected;
+    int responses;
+} TestReconnect;
 
 static
-gboolean
-test_block2_cancel_req1(
+void
+test_reconnect_server_response(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
     void* user_data)
 {
-    TestBlock2* t = user_data;
-    /* By now req1 should have been sent */
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_SENT);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_QUEUED);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_QUEUED);
-    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_QUEUED);
-    /* Cancel the last one first */
-    g_assert(grilio_channel_cancel_request(t->test.io,
-        grilio_request_id(t->req4), TRUE));
-    /* Cancel everything else */
-    grilio_channel_cancel_all(t->test.io, FALSE);
-    /* And assert that its status has changed */
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
-    g_main_loop_quit(t->test.loop);
-    return G_SOURCE_REMOVE;
+    TestReconnect* t = user_data;
+
+    grilio_test_server_add_response_data(t->server[t->accepted - 1], id,
+        GRILIO_STATUS_OK, NULL, 0);
 }
 
 static
-void
-test_block2_connected(
-    GRilIoChannel* io,
-    void* user_data)
+gboolean
+test_reconnect_accept(
+    gint fd,
+    GIOCondition condition,
+    gpointer user_data)
 {
-    TestBlock2* t = user_data;
-    /* Nothing has been sent yet */
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_QUEUED);
-    /* Will cancel req1 after it's been sent */
-    g_assert(g_idle_add(test_block2_cancel_req1, t));
+    TestReconnect* t = user_data;
+    int sock = accept(fd, NULL, NULL);
+
+    g_assert(sock >= 0);
+    g_assert(t->accepted < (int)G_N_ELEMENTS(t->server));
+    GDEBUG("Accepted connection #%d", t->accepted + 1);
+    t->server[t->accepted] = grilio_test_server_new_accepted(sock, TRUE);
+    grilio_test_server_add_request_func(t->server[t->accepted++],
+        RIL_REQUEST_TEST_0, t->server_fn, t);
+    return G_SOURCE_CONTINUE;
 }
 
 static
 void
-test_block2(
-    void)
+test_reconnect_listen(
+    TestReconnect* t)
 {
-    TestBlock2* t = test_new(TestBlock2, "Block2");
-    Test* test = &t->test;
-
-    t->req1 = grilio_request_new();
-    t->req2 = grilio_request_new();
-    t->req3 = grilio_request_new();
-    t->req4 = grilio_request_new();
+    struct sockaddr_un addr;
 
-    grilio_request_set_blocking(t->req1, TRUE);
-    grilio_channel_send_request(test->io, t->req1, RIL_REQUEST_TEST);
-    grilio_request_set_blocking(t->req2, TRUE);
-    grilio_channel_send_request(test->io, t->req2, RIL_REQUEST_TEST);
-    grilio_channel_send_request(test->io, t->req3, RIL_REQUEST_TEST);
-    grilio_channel_send_request(test->io, t->req4, RIL_REQUEST_TEST);
-
-    /* Run the test */
-    grilio_channel_add_connected_handler(test->io, test_block2_connected, t);
-    g_main_loop_run(test->loop);
-
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req4) == GRILIO_REQUEST_CANCELLED);
-    grilio_request_unref(t->req1);
-    grilio_request_unref(t->req2);
-    grilio_request_unref(t->req3);
-    grilio_request_unref(t->req4);
-    test_free(test);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, t->path, sizeof(addr.sun_path) - 1);
+    t->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    g_assert(t->listen_fd >= 0);
+    g_assert(!bind(t->listen_fd, (struct sockaddr*)&addr, sizeof(addr)));
+    g_assert(!listen(t->listen_fd, 1));
+    t->listen_id = g_unix_fd_add(t->listen_fd, G_IO_IN,
+        test_reconnect_accept, t);
 }
 
-/*==========================================================================*
- * BlockTimeout
- *==========================================================================*/
+static
+gboolean
+test_reconnect_listen_cb(
+    gpointer user_data)
+{
+    TestReconnect* t = user_data;
 
-typedef struct test_block_timeout_data {
-    Test test;
-    int req2_completed;
-    GRilIoRequest* req1;
-    GRilIoRequest* req2;
-} TestBlockTimeout;
+    /* The transport has been failing to connect for a while */
+    GDEBUG("Listening on %s", t->path);
+    test_reconnect_listen(t);
+    return G_SOURCE_REMOVE;
+}
 
 static
 void
-test_block_timeout_req2_completed(
+test_reconnect_response(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestBlockTimeout* t = user_data;
-    GDEBUG("Request 2 completion status %d", status);
-    t->req2_completed++;
+    TestReconnect* t = user_data;
+
     g_assert(status == GRILIO_STATUS_OK);
+    t->responses++;
+    GDEBUG("Response %d", t->responses);
+    if (t->responses == 1) {
+        /* Simulate rild restart */
+        g_assert(t->accepted == 1);
+        grilio_test_server_shutdown(t->server[0]);
+    } else {
+        g_assert(t->responses == 2);
+        g_assert(t->accepted == 2);
+        g_main_loop_quit(t->loop);
+    }
 }
 
 static
 void
-test_block_timeout_req1_completed(
+test_reconnect_connected(
     GRilIoChannel* io,
-    int status,
-    const void* data,
-    guint len,
     void* user_data)
 {
-    TestBlockTimeout* t = user_data;
-    GDEBUG("Request 1 completion status %d", status);
-    g_assert(status == GRILIO_STATUS_TIMEOUT);
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
+    TestReconnect* t = user_data;
+
+    t->connected++;
+    GDEBUG("Connected %d time(s)", t->connected);
+    g_assert(t->connected == t->accepted);
 }
 
 static
 void
-test_block_timeout(
-    void)
+test_reconnect_disconnected(
+    GRilIoChannel* io,
+    void* user_data)
 {
-    TestBlockTimeout* t = test_new(TestBlockTimeout, "BlockTimeout");
-    Test* test = &t->test;
-
-    t->req1 = grilio_request_new();
-    t->req2 = grilio_request_new();
-
-    /* Reply to the second one (and ack it), let the first one to time out */
-    grilio_test_server_add_request_func(test->server,
-        RIL_RESPONSE_ACKNOWLEDGEMENT, test_response_quit, test);
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_2,
-        test_response_empty_ok_ack, test);
-
-    grilio_request_set_blocking(t->req1, TRUE);
-    grilio_request_set_timeout(t->req1, 10);
-    grilio_channel_send_request_full(test->io, t->req1, RIL_REQUEST_TEST_1,
-        test_block_timeout_req1_completed, NULL, t);
-    grilio_channel_send_request_full(test->io, t->req2, RIL_REQUEST_TEST_2,
-        test_block_timeout_req2_completed, NULL, t);
-
-    /* Run the test */
-    g_main_loop_run(test->loop);
+    TestReconnect* t = user_data;
 
-    g_assert(t->req2_completed == 1);
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
-    grilio_request_unref(t->req1);
-    grilio_request_unref(t->req2);
-    test_free(test);
+    t->disconnected++;
+    g_assert(!io->connected);
+    if (t->disconnected == 1) {
+        /* This one will be sent after reconnect */
+        g_assert(grilio_channel_send_request_full(io, NULL,
+            RIL_REQUEST_TEST_0, test_reconnect_response, NULL, t));
+    }
 }
 
-/*==========================================================================*
- * PendingTimeout
- *==========================================================================*/
+static
+gboolean
+test_reconnect_timeout(
+    gpointer user_data)
+{
+    TestReconnect* t = user_data;
 
-typedef struct test_pending_timeout_data {
-    Test test;
-    GRilIoRequest* req1;
-    GRilIoRequest* req2;
-} TestPendingTimeout;
+    t->timeout_id = 0;
+    g_main_loop_quit(t->loop);
+    GERR("TIMEOUT");
+    return G_SOURCE_REMOVE;
+}
 
 static
 void
-test_pending_timeout_req2_completed(
-    GRilIoChannel* io,
-    int status,
-    const void* data,
-    guint len,
-    void* user_data)
-{
-    TestPendingTimeout* t = user_data;
-    GDEBUG("Request 2 completion status %d", status);
-    g_assert(status == GRILIO_STATUS_OK);
-    g_main_loop_quit(t->test.loop);
+test_reconnect_init(
+    TestReconnect* t,
+    GRilIoTestRequestFunc server_fn)
+{
+    memset(t, 0, sizeof(*t));
+    t->loop = g_main_loop_new(NULL, FALSE);
+    t->dir = g_dir_make_tmp("test_io_XXXXXX", NULL);
+    t->path = g_build_filename(t->dir, "rild", NULL);
+    t->listen_fd = -1;
+    t->server_fn = server_fn;
+    if (!(test_opt.flags & TEST_FLAG_DEBUG)) {
+        t->timeout_id = g_timeout_add_seconds(TEST_TIMEOUT,
+            test_reconnect_timeout, t);
+    }
 }
 
 static
 void
-test_pending_timeout(
+test_reconnect_cleanup(
+    TestReconnect* t)
+{
+    guint i;
+
+    g_assert((test_opt.flags & TEST_FLAG_DEBUG) || t->timeout_id);
+    if (t->timeout_id) g_source_remove(t->timeout_id);
+    grilio_channel_unref(t->io);
+    grilio_transport_unref(t->transport);
+    for (i = 0; i < G_N_ELEMENTS(t->server); i++) {
+        if (t->server[i]) {
+            grilio_test_server_free(t->server[i]);
+        }
+    }
+    g_source_remove(t->listen_id);
+    close(t->listen_fd);
+    unlink(t->path);
+    rmdir(t->dir);
+    g_free(t->path);
+    g_free(t->dir);
+    g_main_loop_unref(t->loop);
+}
+
+static
+void
+test_reconnect(
     void)
 {
-    TestPendingTimeout* t = test_new(TestPendingTimeout, "PendingTimeout");
-    Test* test = &t->test;
-
-    t->req1 = grilio_request_new();
-    t->req2 = grilio_request_new();
+    TestReconnect t;
 
-    /* Reply to the second one, let the first one to time out */
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_2,
-        test_response_empty_ok, test);
+    test_reconnect_init(&t, test_reconnect_server_response);
 
-    grilio_request_set_blocking(t->req1, TRUE);
-    grilio_request_set_timeout(t->req1, -1);
-    grilio_channel_send_request(test->io, t->req1, RIL_REQUEST_TEST_1);
-    grilio_channel_send_request_full(test->io, t->req2, RIL_REQUEST_TEST_2,
-        test_pending_timeout_req2_completed, NULL, t);
+    /* Invalid parameters */
+    g_assert(!grilio_transport_reconnect_new(NULL, NULL));
+    g_assert(!grilio_transport_reconnect_new(t.path, ""));
+    grilio_transport_reconnect_set_delay(NULL, 0, 0);
 
-    /* First request expires in 10 ms and the second one is sent */
-    grilio_channel_set_pending_timeout(test->io, 1);
-    grilio_channel_set_pending_timeout(test->io, 10);
-    /* Resistance to invalid parameters */
-    grilio_channel_set_pending_timeout(NULL, 0);
-    grilio_channel_set_pending_timeout(test->io, 0);
+    /* Nobody is listening yet */
+    t.transport = grilio_transport_reconnect_new(t.path, "SUB1");
+    g_assert(t.transport);
+    grilio_transport_reconnect_set_delay(t.transport, 1, 20);
+    t.io = grilio_channel_new(t.transport);
+    grilio_channel_set_name(t.io, "TEST");
+    grilio_channel_add_connected_handler(t.io, test_reconnect_connected, &t);
+    grilio_channel_add_disconnected_handler(t.io,
+        test_reconnect_disconnected, &t);
+    g_assert(grilio_channel_send_request_full(t.io, NULL, RIL_REQUEST_TEST_0,
+        test_reconnect_response, NULL, &t));
+    g_timeout_add(50, test_reconnect_listen_cb, &t);
 
     /* Run the test */
-    g_main_loop_run(test->loop);
+    g_main_loop_run(t.loop);
+    g_assert(t.connected == 2);
+    g_assert(t.disconnected == 1);
+    g_assert(t.responses == 2);
 
-    /* The first request remains in the SENT state */
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_SENT);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
-    grilio_request_unref(t->req1);
-    grilio_request_unref(t->req2);
-    test_free(test);
+    /* Shutdown is final */
+    grilio_channel_shutdown(t.io, FALSE);
+    g_assert(!t.io->connected);
+    g_assert(t.disconnected == 2);
+    test_reconnect_cleanup(&t);
 }
 
-
 /*==========================================================================*
- * Drop
+ * ReconnectBytes
+ *
+ * Responses coming through the reconnect transport must be sliced out
+ * of the socket's receive buffer rather than copied.
  *==========================================================================*/
 
-typedef struct test_drop_data {
-    Test test;
-    GRilIoRequest* req1;
-    GRilIoRequest* req2;
-    GRilIoRequest* req3;
-    gboolean req1_done;
-    gboolean req2_done;
-    gboolean req3_done;
-} TestDrop;
+#define RECONNECT_BYTES_VALUE (42)
+
+typedef struct test_reconnect_bytes_data {
+    TestReconnect r;
+    GBytes* bytes;
+    const void* data;
+} TestReconnectBytes;
 
 static
 void
-test_drop_req_done(
-    GRilIoChannel* channel,
-    int status,
+test_reconnect_bytes_server_response(
+    guint code,
+    guint id,
     const void* data,
     guint len,
     void* user_data)
 {
-    gboolean* done = user_data;
-    (*done) = TRUE;
+    TestReconnect* t = user_data;
+
+    grilio_test_server_add_response_data(t->server[t->accepted - 1], id,
+        GRILIO_STATUS_OK, data, len);
 }
 
 static
 void
-test_drop_req3_done(
-    GRilIoChannel* channel,
+test_reconnect_bytes_transport_response(
+    GRilIoTransport* transport,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestDrop* t = user_data;
-    g_assert(status == GRILIO_STATUS_OK);
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_DONE);
-    t->req3_done = TRUE;
-    g_main_loop_quit(t->test.loop);
-}
+    TestReconnectBytes* t = user_data;
 
-static
-gboolean
-test_drop_req1_expired(
-    gpointer user_data)
-{
-    TestDrop* t = user_data;
-    guint id1 = grilio_request_id(t->req1);
-    g_assert(!t->req2_done);
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_SENT);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_QUEUED);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_QUEUED);
-    g_assert(grilio_channel_get_request(t->test.io,
-        grilio_request_id(t->req3)) == t->req3);
-    grilio_channel_drop_request(t->test.io, id1);
-    grilio_channel_drop_request(t->test.io, id1); /* And again */
-    return G_SOURCE_REMOVE;
+    /* Remember where the data were when they arrived */
+    g_assert(!t->data);
+    t->data = data;
 }
 
 static
 void
-test_drop_connected(
+test_reconnect_bytes_response(
     GRilIoChannel* io,
+    int status,
+    GBytes* bytes,
     void* user_data)
 {
-    TestDrop* t = user_data;
-    g_timeout_add(10, test_drop_req1_expired, t);
+    TestReconnectBytes* t = user_data;
+
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(bytes);
+    g_assert(!t->bytes);
+    t->bytes = g_bytes_ref(bytes);
+    g_main_loop_quit(t->r.loop);
 }
 
 static
 void
-test_drop(
+test_reconnect_bytes(
     void)
 {
-    TestDrop* t = test_new(TestDrop, "Drop");
-    Test* test = &t->test;
+    TestReconnectBytes t;
+    GRilIoRequest* req = grilio_request_array_int32_new(1,
+        RECONNECT_BYTES_VALUE);
+    GRilIoParser parser;
+    gint32 count, value;
+    gulong id;
+    gsize len;
+    const void* data;
+
+    memset(&t, 0, sizeof(t));
+    test_reconnect_init(&t.r, test_reconnect_bytes_server_response);
+    test_reconnect_listen(&t.r);
+    t.r.transport = grilio_transport_reconnect_new(t.r.path, "SUB1");
+    g_assert(t.r.transport);
+    t.r.io = grilio_channel_new(t.r.transport);
+    id = grilio_transport_add_response_handler(t.r.transport,
+        test_reconnect_bytes_transport_response, &t);
+    g_assert(grilio_channel_send_request_bytes(t.r.io, req,
+        RIL_REQUEST_TEST_0, test_reconnect_bytes_response, NULL, &t));
+    grilio_request_unref(req);
 
-    t->req1 = grilio_request_new();
-    t->req2 = grilio_request_new();
-    t->req3 = grilio_request_new();
+    /* Run the test */
+    g_main_loop_run(t.r.loop);
+    g_assert(t.bytes);
+    g_assert(t.data);
 
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_2,
-        test_response_empty_ok, t);
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST_3,
-        test_response_empty_ok, t);
+    /* Same data, not a copy */
+    data = g_bytes_get_data(t.bytes, &len);
+    g_assert(data == t.data);
+    grilio_parser_init(&parser, data, len);
+    g_assert(grilio_parser_get_int32(&parser, &count));
+    g_assert(grilio_parser_get_int32(&parser, &value));
+    g_assert(grilio_parser_at_end(&parser));
+    g_assert(count == 1);
+    g_assert(value == RECONNECT_BYTES_VALUE);
+    g_bytes_unref(t.bytes);
 
-    /* There won't be any reply to req1 */
-    grilio_request_set_timeout(t->req1, 0);
-    grilio_channel_send_request_full(test->io, t->req1, RIL_REQUEST_TEST_1,
-        test_drop_req_done, NULL, &t->req1_done);
-    /* But req2 and req3 will be allowed to run after we drop req1 */
-    grilio_request_set_blocking(t->req2, TRUE);
-    grilio_channel_send_request_full(test->io, t->req2, RIL_REQUEST_TEST_2,
-        test_drop_req_done, NULL, &t->req2_done);
-    grilio_request_set_blocking(t->req3, TRUE);
-    grilio_channel_send_request_full(test->io, t->req3, RIL_REQUEST_TEST_3,
-        test_drop_req3_done, NULL, t);
+    grilio_transport_remove_handler(t.r.transport, id);
+    grilio_channel_shutdown(t.r.io, FALSE);
+    test_reconnect_cleanup(&t.r);
+}
 
-    /* NULL is ignored */
-    grilio_channel_drop_request(NULL, 0);
+/*==========================================================================*
+ * Replay
+ *==========================================================================*/
 
-    /* Run the test */
-    grilio_channel_add_connected_handler(test->io, test_drop_connected, t);
-    g_main_loop_run(test->loop);
+#define REPLAY_REQUEST_COUNT (3)
+#define REPLAY_WAIT_TIMEOUT_MS (200)
 
-    g_assert(!t->req1_done);
-    g_assert(t->req2_done);
-    g_assert(t->req3_done);
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_DONE);
-    grilio_request_unref(t->req1);
-    grilio_request_unref(t->req2);
-    grilio_request_unref(t->req3);
-    test_free(test);
+static
+gboolean
+test_replay_restart(
+    gpointer user_data)
+{
+    TestReconnect* t = user_data;
+
+    /* Simulate rild crash */
+    GDEBUG("Restarting rild");
+    grilio_test_server_shutdown(t->server[0]);
+    return G_SOURCE_REMOVE;
 }
 
-/*==========================================================================*
- * Cancel1
- *==========================================================================*/
+static
+void
+test_replay_server_request(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestReconnect* t = user_data;
 
-typedef struct test_cancel1_data {
-    Test test;
-    GRilIoRequest* req1;
-    GRilIoRequest* req2;
-    GRilIoRequest* req3;
-} TestCancel1;
+    if (t->accepted == 1) {
+        /* The first instance never replies */
+        if (++(t->responses) == REPLAY_REQUEST_COUNT) {
+            g_idle_add(test_replay_restart, t);
+        }
+    } else {
+        /* Only the idempotent request is expected to be resubmitted */
+        g_assert(t->accepted == 2);
+        grilio_test_server_add_response_data(t->server[1], id,
+            GRILIO_STATUS_OK, data, len);
+    }
+}
 
 static
 void
-test_cancel1_req2_completed(
+test_replay_check_done(
+    TestReconnect* t)
+{
+    if (!grilio_channel_has_pending_requests(t->io) &&
+        t->disconnected == 1 && t->connected == 2 &&
+        t->responses == REPLAY_REQUEST_COUNT + 3) {
+        g_main_loop_quit(t->loop);
+    }
+}
+
+static
+void
+test_replay_failed(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestCancel1* t = user_data;
-    GDEBUG("Request 2 completion status %d", status);
-    g_assert(status == GRILIO_STATUS_CANCELLED);
-    /* This one has already been cancelled */
-    g_assert(!grilio_channel_cancel_request(t->test.io,
-        grilio_request_id(t->req2), TRUE));
-    /* Cancel req3 from the req2 completion callback */
-    g_assert(grilio_channel_cancel_request(t->test.io,
-        grilio_request_id(t->req3), TRUE));
-    g_main_loop_quit(t->test.loop);
+    TestReconnect* t = user_data;
+
+    /* Fails immediately, even before the disconnected signal */
+    GDEBUG("Request failed");
+    g_assert(status == GRILIO_STATUS_DISCONNECTED);
+    g_assert(!t->disconnected);
+    g_assert(t->connected == 1);
+    t->responses++;
 }
 
 static
 void
-test_cancel1_req1_completed(
+test_replay_resubmitted(
     GRilIoChannel* io,
     int status,
     const void* data,
     guint len,
     void* user_data)
 {
-    TestCancel1* t = user_data;
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
-    /* Cancel everything */
-    grilio_channel_cancel_all(t->test.io, TRUE);
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_CANCELLED);
+    TestReconnect* t = user_data;
+    GRilIoParser rilp;
+    gint32 val;
+
+    GDEBUG("Request resubmitted");
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(t->connected == 2);
+    grilio_parser_init(&rilp, data, len);
+    g_assert(grilio_parser_get_int32(&rilp, &val));
+    g_assert(val == 1);
+    t->responses++;
+    test_replay_check_done(t);
 }
 
 static
 void
-test_cancel1(
+test_replay_timeout(
+    GRilIoChannel* io,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestReconnect* t = user_data;
+
+    GDEBUG("Request timed out");
+    g_assert(status == GRILIO_STATUS_TIMEOUT);
+    t->responses++;
+    test_replay_check_done(t);
+}
+
+static
+void
+test_replay_connected(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    TestReconnect* t = user_data;
+
+    t->connected++;
+    GDEBUG("Connected %d time(s)", t->connected);
+    test_replay_check_done(t);
+}
+
+static
+void
+test_replay_disconnected(
+    GRilIoChannel* io,
+    void* user_data)
+{
+    TestReconnect* t = user_data;
+
+    t->disconnected++;
+    GDEBUG("Disconnected");
+}
+
+static
+void
+test_replay(
     void)
 {
-    TestCancel1* t = test_new(TestCancel1, "Cancel1");
-    Test* test = &t->test;
+    TestReconnect t;
+    GRilIoRequest* req;
 
-    t->req1 = grilio_request_new();
-    t->req2 = grilio_request_new();
-    t->req3 = grilio_request_new();
+    test_reconnect_init(&t, test_replay_server_request);
+    test_reconnect_listen(&t);
+    t.transport = grilio_transport_reconnect_new(t.path, "SUB1");
+    grilio_transport_reconnect_set_delay(t.transport, 1, 20);
+    t.io = grilio_channel_new(t.transport);
+    grilio_channel_set_name(t.io, "TEST");
+    grilio_channel_set_replay(NULL, GRILIO_REPLAY_FAIL);
+    grilio_request_set_replay(NULL, GRILIO_REPLAY_FAIL);
+    grilio_channel_set_replay(t.io, GRILIO_REPLAY_FAIL);
+    grilio_channel_add_connected_handler(t.io, test_replay_connected, &t);
+    grilio_channel_add_disconnected_handler(t.io,
+        test_replay_disconnected, &t);
+
+    /* This one follows the channel's policy */
+    req = grilio_request_array_int32_new(1, 0);
+    g_assert(grilio_channel_send_request_full(t.io, req, RIL_REQUEST_TEST_0,
+        test_replay_failed, NULL, &t));
+    grilio_request_unref(req);
 
-    grilio_test_server_add_request_func(test->server, RIL_REQUEST_TEST,
-        test_response_empty_ok, test);
+    /* This one is idempotent */
+    req = grilio_request_array_int32_new(1, 1);
+    grilio_request_set_replay(req, GRILIO_REPLAY_RESUBMIT);
+    g_assert(grilio_channel_send_request_full(t.io, req, RIL_REQUEST_TEST_0,
+        test_replay_resubmitted, NULL, &t));
+    grilio_request_unref(req);
 
-    grilio_channel_send_request_full(test->io, t->req1, RIL_REQUEST_TEST,
-        test_cancel1_req1_completed, NULL, t);
-    grilio_channel_send_request_full(test->io, t->req2, RIL_REQUEST_TEST,
-        test_cancel1_req2_completed, NULL, t);
-    grilio_channel_send_request(test->io, t->req3, RIL_REQUEST_TEST);
+    /* And this one keeps waiting for the response */
+    req = grilio_request_array_int32_new(1, 2);
+    grilio_request_set_replay(req, GRILIO_REPLAY_WAIT);
+    grilio_request_set_timeout(req, REPLAY_WAIT_TIMEOUT_MS);
+    g_assert(grilio_channel_send_request_full(t.io, req, RIL_REQUEST_TEST_0,
+        test_replay_timeout, NULL, &t));
+    grilio_request_unref(req);
 
     /* Run the test */
-    g_main_loop_run(test->loop);
-
-    g_assert(grilio_request_status(t->req1) == GRILIO_REQUEST_DONE);
-    g_assert(grilio_request_status(t->req2) == GRILIO_REQUEST_CANCELLED);
-    g_assert(grilio_request_status(t->req3) == GRILIO_REQUEST_CANCELLED);
-    grilio_request_unref(t->req1);
-    grilio_request_unref(t->req2);
-    grilio_request_unref(t->req3);
-    test_free(test);
+    g_main_loop_run(t.loop);
+    g_assert(t.accepted == 2);
+    g_assert(t.connected == 2);
+    g_assert(t.disconnected == 1);
+    test_reconnect_cleanup(&t);
 }
 
 /*==========================================================================*
@@ -3624,6 +5822,13 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_PREFIX "AsyncWrite", test_async_write);
     g_test_add_func(TEST_PREFIX "Transaction1", test_transaction1);
     g_test_add_func(TEST_PREFIX "Transaction2", test_transaction2);
+    g_test_add_func(TEST_PREFIX "Transaction3", test_transaction3);
+    g_test_add_func(TEST_PREFIX "Priority", test_priority);
+    g_test_add_func(TEST_PREFIX "PriorityAging", test_priority_aging);
+    g_test_add_func(TEST_PREFIX "Window", test_window);
+    g_test_add_func(TEST_PREFIX "AdaptiveWindow", test_adaptive_window);
+    g_test_add_func(TEST_PREFIX "Dedup", test_dedup);
+    g_test_add_func(TEST_PREFIX "DedupTransaction", test_dedup_transaction);
     g_test_add_func(TEST_PREFIX "WriteError1", test_write_error1);
     g_test_add_func(TEST_PREFIX "WriteError2", test_write_error2);
     g_test_add_func(TEST_PREFIX "WriteError3", test_write_error3);
@@ -3639,6 +5844,8 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_PREFIX "Retry3", test_retry3);
     g_test_add_func(TEST_PREFIX "Timeout1", test_timeout1);
     g_test_add_func(TEST_PREFIX "Timeout2", test_timeout2);
+    g_test_add_func(TEST_PREFIX "Timeout3", test_timeout3);
+    g_test_add_func(TEST_PREFIX "TimerSlack", test_timer_slack);
     g_test_add_func(TEST_PREFIX "Serialize1", test_serialize1);
     g_test_add_func(TEST_PREFIX "Serialize2", test_serialize2);
     g_test_add_func(TEST_PREFIX "Serialize3", test_serialize3);
@@ -3648,6 +5855,16 @@ int main(int argc, char* argv[])
     g_test_add_func(TEST_PREFIX "PendingTimeout", test_pending_timeout);
     g_test_add_func(TEST_PREFIX "Drop", test_drop);
     g_test_add_func(TEST_PREFIX "Cancel1", test_cancel1);
+    g_test_add_func(TEST_PREFIX "Pipeline", test_pipeline);
+    g_test_add_func(TEST_PREFIX "Table", test_table);
+    g_test_add_func(TEST_PREFIX "QueueCancel", test_queue_cancel);
+    g_test_add_func(TEST_PREFIX "Bytes", test_bytes);
+    g_test_add_func(TEST_PREFIX "BytesBatch", test_bytes_batch);
+    g_test_add_func(TEST_PREFIX "Stream", test_stream);
+    g_test_add_func(TEST_PREFIX "StreamTooLong", test_stream_too_long);
+    g_test_add_func(TEST_PREFIX "Reconnect", test_reconnect);
+    g_test_add_func(TEST_PREFIX "ReconnectBytes", test_reconnect_bytes);
+    g_test_add_func(TEST_PREFIX "Replay", test_replay);
     signal(SIGPIPE, SIG_IGN);
     test_init(&test_opt, argc, argv);
     return g_test_run();
@@ -33,11 +33,32 @@
 #include "test_common.h"
 
 #include "grilio_transport_p.h"
+#include "grilio_p.h"
 
 #include "grilio_test_server.h"
 
+#include "grilio_request.h"
+#include "grilio_shm_server.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
 static TestOpt test_opt;
 
+typedef
+GRilIoTransport*
+(*TestTransportNewFunc)(
+    int fd,
+    const char* sub,
+    gboolean can_close);
+
+typedef
+GRilIoTestServer*
+(*TestServerNewFunc)(
+    gboolean expect_sub);
+
 static
 void
 test_dummy_cb(
@@ -96,6 +117,1949 @@ test_basic(
     grilio_test_server_free(server);
 }
 
+/*==========================================================================*
+ * Batch
+ *==========================================================================*/
+
+#define TEST_BATCH_COUNT (8)
+#define TEST_BATCH_LARGE_SIZE (0x2345)
+#define TEST_BATCH_LAST_CODE (TEST_BATCH_COUNT - 1)
+
+typedef struct test_batch_data {
+    GMainLoop* loop;
+    guint count;
+    gboolean connected;
+} TestBatch;
+
+static
+void
+test_batch_indication(
+    GRilIoTransport* transport,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestBatch* test = user_data;
+
+    g_assert(type == GRILIO_INDICATION_UNSOLICITED);
+    if (code == RIL_UNSOL_RIL_CONNECTED) {
+        g_assert(!test->connected);
+        g_assert(!test->count);
+        test->connected = TRUE;
+    } else {
+        const guint8* bytes = data;
+        guint i;
+
+        /* Packets must arrive in order */
+        g_assert(test->connected);
+        g_assert(code == test->count);
+        g_assert(len == (code == 1 ? TEST_BATCH_LARGE_SIZE : code));
+        for (i = 0; i < len; i++) {
+            g_assert(bytes[i] == (guint8)(code + i));
+        }
+        test->count++;
+        if (code == TEST_BATCH_LAST_CODE) {
+            g_main_loop_quit(test->loop);
+        }
+    }
+}
+
+static
+void
+test_batch_run_full(
+    TestServerNewFunc server_new,
+    TestTransportNewFunc transport_new,
+    guint batch,
+    int chunk)
+{
+    TestBatch test;
+    GRilIoTestServer* server = server_new(FALSE);
+    GRilIoTransport* trans = transport_new(grilio_test_server_fd(server),
+        NULL, FALSE);
+    guint8* buf = g_malloc(TEST_BATCH_LARGE_SIZE);
+    gulong id;
+    guint i;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, FALSE);
+    grilio_transport_socket_set_read_batch(trans, batch);
+    id = grilio_transport_add_indication_handler(trans,
+        test_batch_indication, &test);
+
+    /* Odd sizes break the alignment, one packet doesn't fit the buffer */
+    grilio_test_server_set_chunk(server, chunk);
+    for (i = 0; i < TEST_BATCH_COUNT; i++) {
+        const guint len = (i == 1) ? TEST_BATCH_LARGE_SIZE : i;
+        guint k;
+
+        for (k = 0; k < len; k++) {
+            buf[k] = (guint8)(i + k);
+        }
+        grilio_test_server_add_unsol_data(server, i, buf, len);
+    }
+
+    g_main_loop_run(test.loop);
+    g_assert(test.connected);
+    g_assert(test.count == TEST_BATCH_COUNT);
+    g_assert(trans->connected);
+    g_assert(trans->ril_version == GRILIO_RIL_VERSION);
+
+    grilio_transport_remove_handler(trans, id);
+    grilio_transport_unref(trans);
+    grilio_test_server_free(server);
+    g_main_loop_unref(test.loop);
+    g_free(buf);
+}
+
+static
+void
+test_batch_run(
+    TestTransportNewFunc transport_new,
+    guint batch,
+    int chunk)
+{
+    test_batch_run_full(grilio_test_server_new, transport_new, batch, chunk);
+}
+
+static
+void
+test_batch(
+    void)
+{
+    /* NULL tolerance */
+    grilio_transport_socket_set_read_batch(NULL, 0);
+
+    test_batch_run(grilio_transport_socket_new, 1, 0);
+    test_batch_run(grilio_transport_socket_new, 3, 0);
+    test_batch_run(grilio_transport_socket_new, 100, 0);
+}
+
+static
+void
+test_batch_chunk(
+    void)
+{
+    test_batch_run(grilio_transport_socket_new, 2, 5);
+    test_batch_run(grilio_transport_socket_new, 100, 1000);
+}
+
+/*==========================================================================*
+ * BatchTooLong
+ *==========================================================================*/
+
+static
+void
+test_batch_read_error(
+    GRilIoTransport* transport,
+    const GError* error,
+    void* user_data)
+{
+    g_main_loop_quit((GMainLoop*)user_data);
+}
+
+static
+void
+test_batch_too_long_run(
+    TestTransportNewFunc transport_new)
+{
+    static const guint8 data[] = {
+        TEST_INT32_BE(0x10000), 0x00, 0x00, 0x00, 0x00
+    };
+    GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+    GRilIoTestServer* server = grilio_test_server_new(FALSE);
+    GRilIoTransport* trans = transport_new(grilio_test_server_fd(server),
+        NULL, FALSE);
+    gulong id;
+
+    grilio_transport_socket_set_read_batch(trans, 5);
+    id = grilio_transport_add_read_error_handler(trans,
+        test_batch_read_error, loop);
+    grilio_test_server_add_data(server, data, sizeof(data));
+
+    g_main_loop_run(loop);
+    g_assert(!trans->connected);
+
+    grilio_transport_remove_handler(trans, id);
+    grilio_transport_unref(trans);
+    grilio_test_server_free(server);
+    g_main_loop_unref(loop);
+}
+
+static
+void
+test_batch_too_long(
+    void)
+{
+    test_batch_too_long_run(grilio_transport_socket_new);
+}
+
+/*==========================================================================*
+ * MaxPacketLen
+ *==========================================================================*/
+
+#define TEST_MAX_PACKET_LEN_CODE (1)
+
+typedef struct test_max_packet_len_data {
+    GMainLoop* loop;
+    guint len;
+    gboolean error;
+} TestMaxPacketLen;
+
+static
+void
+test_max_packet_len_indication(
+    GRilIoTransport* transport,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestMaxPacketLen* test = user_data;
+
+    if (code != RIL_UNSOL_RIL_CONNECTED) {
+        g_assert(code == TEST_MAX_PACKET_LEN_CODE);
+        test->len = len;
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_max_packet_len_read_error(
+    GRilIoTransport* transport,
+    const GError* error,
+    void* user_data)
+{
+    TestMaxPacketLen* test = user_data;
+
+    test->error = TRUE;
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_max_packet_len_run_full(
+    TestServerNewFunc server_new,
+    TestTransportNewFunc transport_new,
+    guint max_len,
+    guint len,
+    TestMaxPacketLen* test)
+{
+    GRilIoTestServer* server = server_new(FALSE);
+    GRilIoTransport* trans = transport_new(grilio_test_server_fd(server),
+        NULL, FALSE);
+    void* data = g_malloc0(len);
+    gulong id[2];
+
+    memset(test, 0, sizeof(*test));
+    test->loop = g_main_loop_new(NULL, FALSE);
+    grilio_transport_set_max_packet_len(trans, max_len);
+    id[0] = grilio_transport_add_indication_handler(trans,
+        test_max_packet_len_indication, test);
+    id[1] = grilio_transport_add_read_error_handler(trans,
+        test_max_packet_len_read_error, test);
+    grilio_test_server_add_unsol_data(server, TEST_MAX_PACKET_LEN_CODE,
+        data, len);
+
+    g_main_loop_run(test->loop);
+
+    grilio_transport_remove_handlers(trans, id, G_N_ELEMENTS(id));
+    grilio_transport_unref(trans);
+    grilio_test_server_free(server);
+    g_main_loop_unref(test->loop);
+    g_free(data);
+}
+
+static
+void
+test_max_packet_len_run(
+    TestServerNewFunc server_new,
+    TestTransportNewFunc transport_new)
+{
+    TestMaxPacketLen test;
+
+    /* Larger than the default limit */
+    test_max_packet_len_run_full(server_new, transport_new,
+        0x20000, 0x10000, &test);
+    g_assert(!test.error);
+    g_assert(test.len == 0x10000);
+
+    /* Lower than the default limit */
+    test_max_packet_len_run_full(server_new, transport_new,
+        0x100, 0x200, &test);
+    g_assert(test.error);
+    g_assert(!test.len);
+}
+
+static
+void
+test_max_packet_len(
+    void)
+{
+    /* NULL tolerance */
+    grilio_transport_set_max_packet_len(NULL, 0);
+
+    test_max_packet_len_run(grilio_test_server_new,
+        grilio_transport_socket_new);
+}
+
+/*==========================================================================*
+ * Slice
+ *==========================================================================*/
+
+#define TEST_SLICE_CODE (1)
+#define TEST_SLICE_LEN (0x100)
+
+static
+void
+test_slice_indication(
+    GRilIoTransport* transport,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    if (code != RIL_UNSOL_RIL_CONNECTED) {
+        GBytes* bytes = grilio_transport_packet_bytes(transport, data, len);
+
+        /* Must be a slice of the receive buffer, not a copy */
+        g_assert(code == TEST_SLICE_CODE);
+        g_assert(len == TEST_SLICE_LEN);
+        g_assert(g_bytes_get_data(bytes, NULL) == data);
+        g_bytes_unref(bytes);
+        g_main_loop_quit((GMainLoop*)user_data);
+    }
+}
+
+static
+void
+test_slice_run(
+    TestServerNewFunc server_new,
+    TestTransportNewFunc transport_new)
+{
+    GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+    GRilIoTestServer* server = server_new(FALSE);
+    GRilIoTransport* trans = transport_new(grilio_test_server_fd(server),
+        NULL, FALSE);
+    void* data = g_malloc0(TEST_SLICE_LEN);
+    gulong id = grilio_transport_add_indication_handler(trans,
+        test_slice_indication, loop);
+
+    grilio_test_server_add_unsol_data(server, TEST_SLICE_CODE, data,
+        TEST_SLICE_LEN);
+    g_main_loop_run(loop);
+
+    grilio_transport_remove_handler(trans, id);
+    grilio_transport_unref(trans);
+    grilio_test_server_free(server);
+    g_main_loop_unref(loop);
+    g_free(data);
+}
+
+static
+void
+test_slice(
+    void)
+{
+    test_slice_run(grilio_test_server_new, grilio_transport_socket_new);
+}
+
+/*==========================================================================*
+ * Stats
+ *==========================================================================*/
+
+#define TEST_STATS_COUNT (10)
+#define TEST_STATS_BUF_SIZE (0x10000)
+#define TEST_STATS_CODE (123)
+
+static
+void
+test_stats_indication(
+    GRilIoTransport* transport,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    if (code == TEST_STATS_COUNT) {
+        g_main_loop_quit((GMainLoop*)user_data);
+    }
+}
+
+static
+void
+test_stats(
+    void)
+{
+    GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+    GRilIoTestServer* server = grilio_test_server_new(FALSE);
+    GRilIoTransport* trans = grilio_transport_socket_new
+        (grilio_test_server_fd(server), NULL, FALSE);
+    GRilIoTransport* loopback = grilio_transport_loopback_new(NULL, NULL);
+    GRilIoRequest* req = grilio_request_array_int32_new(1, 1);
+    GRilIoTransportSocketStats stats;
+    int rcvbuf = 0, sndbuf = 0;
+    gulong id;
+    guint i;
+
+    /* Invalid parameters */
+    g_assert(!grilio_transport_socket_get_stats(NULL, &stats));
+    g_assert(!grilio_transport_socket_get_stats(trans, NULL));
+    g_assert(!grilio_transport_socket_get_stats(loopback, &stats));
+    g_assert(!grilio_transport_socket_set_buffer_size(NULL, 0, 0));
+    g_assert(!grilio_transport_socket_set_buffer_size(loopback, 0, 0));
+    g_assert(!grilio_transport_socket_get_buffer_size(loopback, NULL, NULL));
+    grilio_transport_socket_reset_stats(NULL);
+    grilio_transport_unref(loopback);
+
+    /* Buffer sizes */
+    g_assert(grilio_transport_socket_set_buffer_size(trans, 0, 0));
+    g_assert(grilio_transport_socket_set_buffer_size(trans,
+        TEST_STATS_BUF_SIZE, TEST_STATS_BUF_SIZE));
+    g_assert(grilio_transport_socket_get_buffer_size(trans, NULL, NULL));
+    g_assert(grilio_transport_socket_get_buffer_size(trans, &rcvbuf,
+        &sndbuf));
+    g_assert(rcvbuf >= TEST_STATS_BUF_SIZE);
+    g_assert(sndbuf >= TEST_STATS_BUF_SIZE);
+
+    /* Read counters */
+    g_assert(grilio_transport_socket_get_stats(trans, &stats));
+    g_assert(!stats.read_packets);
+    grilio_transport_socket_set_read_batch(trans, TEST_STATS_COUNT + 1);
+    id = grilio_transport_add_indication_handler(trans,
+        test_stats_indication, loop);
+    for (i = 1; i <= TEST_STATS_COUNT; i++) {
+        grilio_test_server_add_unsol_data(server, i, NULL, 0);
+    }
+    g_main_loop_run(loop);
+    g_assert(trans->connected);
+    g_assert(grilio_transport_socket_get_stats(trans, &stats));
+    g_assert(stats.read_packets == TEST_STATS_COUNT + 1); /* + CONNECTED */
+    g_assert(stats.read_bytes == 20 + TEST_STATS_COUNT * 12);
+    g_assert(stats.read_calls > 0);
+    g_assert(stats.read_calls <= stats.read_packets + stats.read_eagain);
+    g_assert(stats.max_read_backlog > 0);
+    g_assert(!stats.write_calls);
+
+    /* Write counters */
+    grilio_transport_socket_reset_stats(trans);
+    req->current_id = 1;
+    g_assert(grilio_transport_send(trans, req, TEST_STATS_CODE) ==
+        GRILIO_SEND_OK);
+    g_assert(grilio_transport_socket_get_stats(trans, &stats));
+    g_assert(!stats.read_calls);
+    g_assert(stats.write_calls == 1);
+    g_assert(stats.write_packets == 1);
+    g_assert(stats.write_bytes == 4 + RIL_REQUEST_HEADER_SIZE +
+        grilio_request_size(req));
+    g_assert(!stats.write_partial);
+    g_assert(!stats.write_eagain);
+    g_assert(stats.max_write_backlog == 1);
+
+    /* No socket after shutdown */
+    grilio_transport_shutdown(trans, FALSE);
+    g_assert(!grilio_transport_socket_set_buffer_size(trans, 0, 0));
+    g_assert(!grilio_transport_socket_get_buffer_size(trans, NULL, NULL));
+
+    grilio_transport_remove_handler(trans, id);
+    grilio_transport_unref(trans);
+    grilio_request_unref(req);
+    grilio_test_server_free(server);
+    g_main_loop_unref(loop);
+}
+
+/*==========================================================================*
+ * Write
+ *==========================================================================*/
+
+#define TEST_WRITE_CODE (123)
+#define TEST_WRITE_SIZE (0x40001)
+
+typedef struct test_write_data {
+    GMainLoop* loop;
+    GRilIoRequest* req;
+    gboolean sent;
+    gboolean received;
+} TestWrite;
+
+static
+void
+test_write_connected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    TestWrite* test = user_data;
+
+    /* Too big to be written in one go */
+    g_assert(grilio_transport_send(transport, test->req, TEST_WRITE_CODE) ==
+        GRILIO_SEND_PENDING);
+}
+
+static
+void
+test_write_sent(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    void* user_data)
+{
+    TestWrite* test = user_data;
+
+    g_assert(req == test->req);
+    g_assert(!test->sent);
+    test->sent = TRUE;
+    if (test->received) {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_write_request(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestWrite* test = user_data;
+
+    g_assert(code == TEST_WRITE_CODE);
+    g_assert(len == grilio_request_size(test->req));
+    g_assert(!memcmp(data, grilio_request_data(test->req), len));
+    g_assert(!test->received);
+    test->received = TRUE;
+    if (test->sent) {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_write_run(
+    TestTransportNewFunc transport_new)
+{
+    TestWrite test;
+    GRilIoTestServer* server = grilio_test_server_new(TRUE);
+    GRilIoTransport* trans = transport_new(grilio_test_server_fd(server),
+        "SUB1", FALSE);
+    gulong id[2];
+    guint i;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, FALSE);
+    test.req = grilio_request_sized_new(TEST_WRITE_SIZE);
+    for (i = 0; i < TEST_WRITE_SIZE; i++) {
+        grilio_request_append_byte(test.req, (guchar)i);
+    }
+
+    grilio_test_server_add_request_func(server, TEST_WRITE_CODE,
+        test_write_request, &test);
+    id[0] = grilio_transport_add_connected_handler(trans,
+        test_write_connected, &test);
+    id[1] = grilio_transport_add_request_sent_handler(trans,
+        test_write_sent, &test);
+
+    g_main_loop_run(test.loop);
+    g_assert(test.sent);
+    g_assert(test.received);
+
+    grilio_transport_remove_handler(trans, id[0]);
+    grilio_transport_remove_handler(trans, id[1]);
+    grilio_transport_unref(trans);
+    grilio_test_server_free(server);
+    grilio_request_unref(test.req);
+    g_main_loop_unref(test.loop);
+}
+
+static
+void
+test_write(
+    void)
+{
+    test_write_run(grilio_transport_socket_new);
+}
+
+/*==========================================================================*
+ * Pipeline
+ *==========================================================================*/
+
+#define TEST_PIPELINE_CODE (124)
+#define TEST_PIPELINE_COUNT (4)
+
+typedef struct test_pipeline_data {
+    GMainLoop* loop;
+    GRilIoRequest* req[TEST_PIPELINE_COUNT];
+    guint sent;
+    guint received;
+} TestPipeline;
+
+static
+void
+test_pipeline_check_done(
+    TestPipeline* test)
+{
+    if (test->sent == TEST_PIPELINE_COUNT &&
+        test->received == TEST_PIPELINE_COUNT) {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_pipeline_connected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    TestPipeline* test = user_data;
+    int i;
+
+    /* The first one is too big to be written in one go */
+    for (i = 0; i < TEST_PIPELINE_COUNT; i++) {
+        g_assert(grilio_transport_send(transport, test->req[i],
+            TEST_PIPELINE_CODE) == GRILIO_SEND_PENDING);
+    }
+}
+
+static
+void
+test_pipeline_sent(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    void* user_data)
+{
+    TestPipeline* test = user_data;
+
+    /* Requests are sent in order */
+    g_assert(test->sent < TEST_PIPELINE_COUNT);
+    g_assert(req == test->req[test->sent]);
+    test->sent++;
+    test_pipeline_check_done(test);
+}
+
+static
+void
+test_pipeline_request(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestPipeline* test = user_data;
+    GRilIoRequest* req;
+
+    /* And received in the same order */
+    g_assert(test->received < TEST_PIPELINE_COUNT);
+    req = test->req[test->received++];
+    g_assert(code == TEST_PIPELINE_CODE);
+    g_assert(len == grilio_request_size(req));
+    g_assert(!memcmp(data, grilio_request_data(req), len));
+    test_pipeline_check_done(test);
+}
+
+static
+void
+test_pipeline(
+    void)
+{
+    TestPipeline test;
+    GRilIoTestServer* server = grilio_test_server_new(TRUE);
+    GRilIoTransport* trans = grilio_transport_socket_new
+        (grilio_test_server_fd(server), "SUB1", FALSE);
+    gulong id[2];
+    guint i;
+
+    /* NULL tolerance */
+    grilio_transport_socket_set_send_window(NULL, 0);
+    g_assert(grilio_transport_send_window(NULL) == 1);
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, FALSE);
+    test.req[0] = grilio_request_sized_new(TEST_WRITE_SIZE);
+    for (i = 0; i < TEST_WRITE_SIZE; i++) {
+        grilio_request_append_byte(test.req[0], (guchar)i);
+    }
+    for (i = 1; i < TEST_PIPELINE_COUNT; i++) {
+        test.req[i] = grilio_request_new();
+        grilio_request_append_int32(test.req[i], i);
+    }
+
+    g_assert(grilio_transport_send_window(trans) == 1);
+    grilio_transport_socket_set_send_window(trans, TEST_PIPELINE_COUNT);
+    g_assert(grilio_transport_send_window(trans) == TEST_PIPELINE_COUNT);
+
+    grilio_test_server_add_request_func(server, TEST_PIPELINE_CODE,
+        test_pipeline_request, &test);
+    id[0] = grilio_transport_add_connected_handler(trans,
+        test_pipeline_connected, &test);
+    id[1] = grilio_transport_add_request_sent_handler(trans,
+        test_pipeline_sent, &test);
+
+    g_main_loop_run(test.loop);
+    g_assert(test.sent == TEST_PIPELINE_COUNT);
+    g_assert(test.received == TEST_PIPELINE_COUNT);
+
+    grilio_transport_remove_handler(trans, id[0]);
+    grilio_transport_remove_handler(trans, id[1]);
+    grilio_transport_unref(trans);
+    grilio_test_server_free(server);
+    for (i = 0; i < TEST_PIPELINE_COUNT; i++) {
+        grilio_request_unref(test.req[i]);
+    }
+    g_main_loop_unref(test.loop);
+}
+
+/*==========================================================================*
+ * Fd
+ *==========================================================================*/
+
+static
+void
+test_fd(
+    void)
+{
+    int fd[2];
+    GRilIoTransport* trans;
+
+    /* Invalid parameters */
+    g_assert(!grilio_transport_fd_new(-1, NULL, FALSE));
+    g_assert(!grilio_transport_fd_new(0, "", FALSE));
+
+    /* The rest is the same as for the socket transport */
+    test_batch_run(grilio_transport_fd_new, 0, 0);
+    test_batch_run(grilio_transport_fd_new, 0, 5);
+    test_batch_too_long_run(grilio_transport_fd_new);
+    test_max_packet_len_run(grilio_test_server_new, grilio_transport_fd_new);
+    test_slice_run(grilio_test_server_new, grilio_transport_fd_new);
+    test_write_run(grilio_transport_fd_new);
+
+    /* Closes the descriptor */
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    trans = grilio_transport_fd_new(fd[0], NULL, TRUE);
+    g_assert(trans);
+    grilio_transport_shutdown(trans, FALSE);
+    g_assert(!trans->connected);
+    g_assert(fcntl(fd[0], F_GETFD) < 0);
+    grilio_transport_unref(trans);
+    close(fd[1]);
+}
+
+/*==========================================================================*
+ * Seqpacket
+ *==========================================================================*/
+
+#define TEST_SEQPACKET_CODE (125)
+
+typedef struct test_seqpacket_data {
+    GMainLoop* loop;
+    GRilIoRequest* req;
+    gboolean received;
+} TestSeqpacket;
+
+static
+void
+test_seqpacket_connected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    TestSeqpacket* test = user_data;
+
+    /* The whole packet is sent with one system call */
+    g_assert(grilio_transport_send(transport, test->req,
+        TEST_SEQPACKET_CODE) == GRILIO_SEND_OK);
+}
+
+static
+void
+test_seqpacket_request(
+    guint code,
+    guint id,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestSeqpacket* test = user_data;
+
+    g_assert(code == TEST_SEQPACKET_CODE);
+    g_assert(id == grilio_request_serial(test->req));
+    g_assert(len == grilio_request_size(test->req));
+    g_assert(!memcmp(data, grilio_request_data(test->req), len));
+    test->received = TRUE;
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_seqpacket_write(
+    void)
+{
+    TestSeqpacket test;
+    GRilIoTestServer* server = grilio_test_server_new_seqpacket(TRUE);
+    GRilIoTransport* trans = grilio_transport_seqpacket_new
+        (grilio_test_server_fd(server), "SUB1", FALSE);
+    gulong id;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, FALSE);
+    test.req = grilio_request_array_utf8_new(2, "foo", "bar");
+    grilio_test_server_add_request_func(server, TEST_SEQPACKET_CODE,
+        test_seqpacket_request, &test);
+    id = grilio_transport_add_connected_handler(trans,
+        test_seqpacket_connected, &test);
+
+    g_main_loop_run(test.loop);
+    g_assert(test.received);
+
+    grilio_transport_remove_handler(trans, id);
+    grilio_transport_unref(trans);
+    grilio_test_server_free(server);
+    grilio_request_unref(test.req);
+    g_main_loop_unref(test.loop);
+}
+
+static
+void
+test_seqpacket_too_long(
+    void)
+{
+    const guint len = 0x10000;
+    void* data = g_malloc0(len);
+    GMainLoop* loop = g_main_loop_new(NULL, FALSE);
+    GRilIoTestServer* server = grilio_test_server_new_seqpacket(FALSE);
+    GRilIoTransport* trans = grilio_transport_seqpacket_new
+        (grilio_test_server_fd(server), NULL, FALSE);
+    gulong id = grilio_transport_add_read_error_handler(trans,
+        test_batch_read_error, loop);
+
+    grilio_test_server_add_unsol_data(server, 1, data, len);
+    g_main_loop_run(loop);
+    g_assert(!trans->connected);
+
+    grilio_transport_remove_handler(trans, id);
+    grilio_transport_unref(trans);
+    grilio_test_server_free(server);
+    g_main_loop_unref(loop);
+    g_free(data);
+}
+
+static
+void
+test_seqpacket(
+    void)
+{
+    int fd[2];
+    GRilIoTransport* trans;
+
+    /* Invalid parameters */
+    g_assert(!grilio_transport_seqpacket_new(-1, NULL, FALSE));
+    g_assert(!grilio_transport_seqpacket_new(0, "", FALSE));
+
+    /* Not a SOCK_SEQPACKET socket */
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    g_assert(!grilio_transport_seqpacket_new(fd[0], NULL, FALSE));
+    close(fd[0]);
+    close(fd[1]);
+
+    test_batch_run_full(grilio_test_server_new_seqpacket,
+        grilio_transport_seqpacket_new, 0, 0);
+    test_seqpacket_write();
+    test_seqpacket_too_long();
+    test_max_packet_len_run(grilio_test_server_new_seqpacket,
+        grilio_transport_seqpacket_new);
+    test_slice_run(grilio_test_server_new_seqpacket,
+        grilio_transport_seqpacket_new);
+
+    /* Closes the descriptor */
+    g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fd));
+    trans = grilio_transport_seqpacket_new(fd[0], NULL, TRUE);
+    g_assert(trans);
+    grilio_transport_shutdown(trans, FALSE);
+    g_assert(!trans->connected);
+    g_assert(fcntl(fd[0], F_GETFD) < 0);
+    grilio_transport_unref(trans);
+    close(fd[1]);
+}
+
+/*==========================================================================*
+ * Shm
+ *==========================================================================*/
+
+#define TEST_SHM_CODE (126)
+#define TEST_SHM_UNSOL_CODE (2000)
+#define TEST_SHM_REQ_COUNT (32)
+#define TEST_SHM_REQ_SIZE (0x2001)
+#define TEST_SHM_UNSOL_COUNT (40)
+#define TEST_SHM_UNSOL_SIZE (0x1ffe)
+
+typedef struct test_shm_data {
+    GMainLoop* loop;
+    GRilIoTransport* trans;
+    GRilIoShmServer* server;
+    GRilIoRequest* req[TEST_SHM_REQ_COUNT];
+    guint submitted;
+    guint sent;
+    guint received;
+    guint responses;
+    guint indications;
+    gboolean pending;
+    gboolean server_connected;
+    gboolean server_disconnected;
+} TestShm;
+
+static
+void
+test_shm_check_done(
+    TestShm* test)
+{
+    if (test->responses == TEST_SHM_REQ_COUNT &&
+        test->indications == TEST_SHM_UNSOL_COUNT) {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_shm_submit(
+    TestShm* test)
+{
+    /* Keep submitting until the ring fills up */
+    while (test->submitted < TEST_SHM_REQ_COUNT && !test->pending) {
+        GRilIoRequest* req = test->req[test->submitted++];
+
+        switch (grilio_transport_send(test->trans, req, TEST_SHM_CODE)) {
+        case GRILIO_SEND_OK:
+            test->sent++;
+            break;
+        case GRILIO_SEND_PENDING:
+            test->pending = TRUE;
+            break;
+        case GRILIO_SEND_ERROR:
+            g_assert_not_reached();
+            break;
+        }
+    }
+}
+
+static
+void
+test_shm_connected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    test_shm_submit(user_data);
+}
+
+static
+void
+test_shm_sent(
+    GRilIoTransport* transport,
+    GRilIoRequest* req,
+    void* user_data)
+{
+    TestShm* test = user_data;
+
+    g_assert(test->pending);
+    g_assert(req == test->req[test->submitted - 1]);
+    test->pending = FALSE;
+    test->sent++;
+    test_shm_submit(test);
+}
+
+static
+void
+test_shm_response(
+    GRilIoTransport* transport,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestShm* test = user_data;
+    GRilIoRequest* req = test->req[test->responses++];
+
+    g_assert(type == GRILIO_RESPONSE_SOLICITED);
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(serial == grilio_request_serial(req));
+    g_assert(len == grilio_request_size(req));
+    g_assert(!memcmp(data, grilio_request_data(req), len));
+    test_shm_check_done(test);
+}
+
+static
+void
+test_shm_indication(
+    GRilIoTransport* transport,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestShm* test = user_data;
+
+    if (code == TEST_SHM_UNSOL_CODE) {
+        const guint8* bytes = data;
+
+        g_assert(len == TEST_SHM_UNSOL_SIZE);
+        g_assert(bytes[0] == (guint8)test->indications);
+        g_assert(bytes[len - 1] == (guint8)test->indications);
+        test->indications++;
+        test_shm_check_done(test);
+    }
+}
+
+static
+void
+test_shm_server_connected(
+    GRilIoShmServer* server,
+    void* user_data)
+{
+    TestShm* test = user_data;
+    const guint32 connected[] = {
+        GUINT32_TO_RIL(RIL_PACKET_TYPE_UNSOLICITED),
+        GUINT32_TO_RIL(RIL_UNSOL_RIL_CONNECTED),
+        GUINT32_TO_RIL(1), GUINT32_TO_RIL(9)
+    };
+    guint32* unsol = g_malloc(RIL_UNSOL_HEADER_SIZE + TEST_SHM_UNSOL_SIZE);
+    guint i;
+
+    g_assert(!test->server_connected);
+    test->server_connected = TRUE;
+    g_assert_cmpstr(grilio_shm_server_subscription(server), == ,"SUB1");
+    g_assert(grilio_shm_server_send(server, connected, sizeof(connected)));
+
+    /* These don't fit into the ring all at once */
+    unsol[0] = GUINT32_TO_RIL(RIL_PACKET_TYPE_UNSOLICITED);
+    unsol[1] = GUINT32_TO_RIL(TEST_SHM_UNSOL_CODE);
+    for (i = 0; i < TEST_SHM_UNSOL_COUNT; i++) {
+        memset(unsol + 2, i, TEST_SHM_UNSOL_SIZE);
+        g_assert(grilio_shm_server_send(server, unsol,
+            RIL_UNSOL_HEADER_SIZE + TEST_SHM_UNSOL_SIZE));
+    }
+    g_free(unsol);
+}
+
+static
+void
+test_shm_server_packet(
+    GRilIoShmServer* server,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestShm* test = user_data;
+    GRilIoRequest* req = test->req[test->received++];
+    const guint32* header = data;
+    const guint datalen = len - RIL_REQUEST_HEADER_SIZE;
+    guint32* resp = g_malloc(RIL_RESPONSE_HEADER_SIZE + datalen);
+
+    g_assert(len >= RIL_REQUEST_HEADER_SIZE);
+    g_assert(GUINT32_FROM_RIL(header[0]) == TEST_SHM_CODE);
+    g_assert(GUINT32_FROM_RIL(header[1]) == grilio_request_serial(req));
+    g_assert(datalen == grilio_request_size(req));
+    g_assert(!memcmp(header + 2, grilio_request_data(req), datalen));
+
+    /* Reflect the data back */
+    resp[0] = GUINT32_TO_RIL(RIL_PACKET_TYPE_SOLICITED);
+    resp[1] = header[1];
+    resp[2] = GUINT32_TO_RIL(RIL_E_SUCCESS);
+    memcpy(resp + 3, header + 2, datalen);
+    g_assert(grilio_shm_server_send(server, resp,
+        RIL_RESPONSE_HEADER_SIZE + datalen));
+    g_free(resp);
+}
+
+static
+void
+test_shm_server_disconnected(
+    GRilIoShmServer* server,
+    void* user_data)
+{
+    TestShm* test = user_data;
+
+    g_assert(!test->server_disconnected);
+    test->server_disconnected = TRUE;
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_shm_disconnected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    g_main_loop_quit((GMainLoop*)user_data);
+}
+
+static
+void
+test_shm(
+    void)
+{
+    static const GRilIoShmServerCallbacks cb = {
+        test_shm_server_connected,
+        test_shm_server_packet,
+        test_shm_server_disconnected
+    };
+    TestShm test;
+    GRilIoRequest* req;
+    gulong id[4];
+    int fd[2];
+    guint i;
+
+    /* Invalid parameters */
+    g_assert(!grilio_transport_shm_new(-1, NULL, FALSE));
+    g_assert(!grilio_transport_shm_new(0, "", FALSE));
+    g_assert(!grilio_shm_server_new(-1, FALSE, NULL, NULL));
+    g_assert(!grilio_shm_server_subscription(NULL));
+    g_assert(!grilio_shm_server_send(NULL, NULL, 0));
+    grilio_shm_server_free(NULL);
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, FALSE);
+    for (i = 0; i < TEST_SHM_REQ_COUNT; i++) {
+        guint k;
+
+        req = test.req[i] = grilio_request_sized_new(TEST_SHM_REQ_SIZE);
+        for (k = 0; k < TEST_SHM_REQ_SIZE; k++) {
+            grilio_request_append_byte(req, (guchar)(i + k));
+        }
+        req->current_id = i + 1;
+    }
+
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    test.server = grilio_shm_server_new(fd[1], TRUE, &cb, &test);
+    g_assert(test.server);
+    g_assert(!grilio_shm_server_subscription(test.server));
+    test.trans = grilio_transport_shm_new(fd[0], "SUB1", TRUE);
+    g_assert(test.trans);
+    id[0] = grilio_transport_add_connected_handler(test.trans,
+        test_shm_connected, &test);
+    id[1] = grilio_transport_add_request_sent_handler(test.trans,
+        test_shm_sent, &test);
+    id[2] = grilio_transport_add_response_handler(test.trans,
+        test_shm_response, &test);
+    id[3] = grilio_transport_add_indication_handler(test.trans,
+        test_shm_indication, &test);
+
+    g_main_loop_run(test.loop);
+    g_assert(test.trans->connected);
+    g_assert(test.trans->ril_version == 9);
+    g_assert(test.sent == TEST_SHM_REQ_COUNT);
+    g_assert(test.received == TEST_SHM_REQ_COUNT);
+
+    /* Too big for the ring */
+    req = grilio_request_sized_new(0x10000);
+    g_byte_array_set_size(req->bytes, 0x10000);
+    g_assert(grilio_transport_send(test.trans, req, TEST_SHM_CODE) ==
+        GRILIO_SEND_ERROR);
+    grilio_request_unref(req);
+
+    /* The server notices when the client goes away */
+    grilio_transport_shutdown(test.trans, FALSE);
+    g_assert(!test.trans->connected);
+    g_main_loop_run(test.loop);
+    g_assert(test.server_disconnected);
+    g_assert(!grilio_shm_server_send(test.server, NULL, 0));
+    grilio_shm_server_free(test.server);
+    grilio_transport_remove_all_handlers(test.trans, id);
+    grilio_transport_unref(test.trans);
+
+    /* And vice versa */
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    test.server = grilio_shm_server_new(fd[1], TRUE, NULL, NULL);
+    test.trans = grilio_transport_shm_new(fd[0], NULL, TRUE);
+    id[0] = grilio_transport_add_disconnected_handler(test.trans,
+        test_shm_disconnected, test.loop);
+    grilio_shm_server_free(test.server);
+    g_main_loop_run(test.loop);
+    g_assert(!test.trans->connected);
+    grilio_transport_remove_handler(test.trans, id[0]);
+    grilio_transport_unref(test.trans);
+
+    /* Garbage instead of the handshake */
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    test.server_disconnected = FALSE;
+    test.server = grilio_shm_server_new(fd[1], TRUE, &cb, &test);
+    g_assert(write(fd[0], "garbage", 7) == 7);
+    g_main_loop_run(test.loop);
+    g_assert(test.server_disconnected);
+    grilio_shm_server_free(test.server);
+    close(fd[0]);
+
+    for (i = 0; i < TEST_SHM_REQ_COUNT; i++) {
+        grilio_request_unref(test.req[i]);
+    }
+    g_main_loop_unref(test.loop);
+}
+
+/*==========================================================================*
+ * Loopback
+ *==========================================================================*/
+
+#define TEST_LOOPBACK_CODE (127)
+#define TEST_LOOPBACK_UNSOL_CODE (2000)
+#define TEST_LOOPBACK_RIL_VERSION (11)
+
+typedef struct test_loopback_data {
+    GMainLoop* loop;
+    GRilIoRequest* req;
+    gboolean requested;
+    gboolean responded;
+    gboolean indicated;
+} TestLoopback;
+
+static
+void
+test_loopback_connected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    TestLoopback* test = user_data;
+
+    g_assert(transport->ril_version == TEST_LOOPBACK_RIL_VERSION);
+    g_assert(grilio_transport_send(transport, test->req,
+        TEST_LOOPBACK_CODE) == GRILIO_SEND_OK);
+    g_assert(test->requested);
+}
+
+static
+void
+test_loopback_request(
+    GRilIoTransport* transport,
+    guint code,
+    guint serial,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestLoopback* test = user_data;
+
+    g_assert(code == TEST_LOOPBACK_CODE);
+    g_assert(serial == grilio_request_serial(test->req));
+    g_assert(len == grilio_request_size(test->req));
+    g_assert(!memcmp(data, grilio_request_data(test->req), len));
+    g_assert(!test->requested);
+    test->requested = TRUE;
+
+    /* Nothing gets delivered synchronously */
+    g_assert(grilio_transport_loopback_indicate(transport,
+        TEST_LOOPBACK_UNSOL_CODE, NULL, 0));
+    g_assert(grilio_transport_loopback_respond(transport, serial,
+        GRILIO_STATUS_OK, data, len));
+    g_assert(!test->indicated);
+    g_assert(!test->responded);
+}
+
+static
+void
+test_loopback_indication(
+    GRilIoTransport* transport,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestLoopback* test = user_data;
+
+    if (code == TEST_LOOPBACK_UNSOL_CODE) {
+        g_assert(type == GRILIO_INDICATION_UNSOLICITED);
+        g_assert(!len);
+        g_assert(!test->indicated);
+        g_assert(!test->responded);
+        test->indicated = TRUE;
+    }
+}
+
+static
+void
+test_loopback_response(
+    GRilIoTransport* transport,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestLoopback* test = user_data;
+
+    g_assert(type == GRILIO_RESPONSE_SOLICITED);
+    g_assert(serial == grilio_request_serial(test->req));
+    g_assert(status == GRILIO_STATUS_OK);
+    g_assert(len == grilio_request_size(test->req));
+    g_assert(!memcmp(data, grilio_request_data(test->req), len));
+    g_assert(test->indicated);
+    g_assert(!test->responded);
+    test->responded = TRUE;
+    g_main_loop_quit(test->loop);
+}
+
+static
+void
+test_loopback(
+    void)
+{
+    TestLoopback test;
+    GRilIoTransport* trans;
+    gulong id[3];
+
+    /* Invalid parameters */
+    g_assert(!grilio_transport_loopback_connect(NULL, 0));
+    g_assert(!grilio_transport_loopback_respond(NULL, 0, 0, NULL, 0));
+    g_assert(!grilio_transport_loopback_indicate(NULL, 0, NULL, 0));
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, FALSE);
+    test.req = grilio_request_array_utf8_new(2, "foo", "bar");
+    test.req->current_id = 1;
+    trans = grilio_transport_loopback_new(test_loopback_request, &test);
+    g_assert(!grilio_transport_loopback_indicate(trans, 0, NULL, 1));
+    id[0] = grilio_transport_add_connected_handler(trans,
+        test_loopback_connected, &test);
+    id[1] = grilio_transport_add_indication_handler(trans,
+        test_loopback_indication, &test);
+    id[2] = grilio_transport_add_response_handler(trans,
+        test_loopback_response, &test);
+
+    g_assert(grilio_transport_loopback_connect(trans,
+        TEST_LOOPBACK_RIL_VERSION));
+    g_assert(!trans->connected);
+    g_main_loop_run(test.loop);
+    g_assert(trans->connected);
+    g_assert(test.responded);
+
+    /* Queued packets are dropped on shutdown */
+    g_assert(grilio_transport_loopback_respond(trans, 1, 0, NULL, 0));
+    grilio_transport_shutdown(trans, FALSE);
+    g_assert(!trans->connected);
+    g_assert(grilio_transport_send(trans, test.req, TEST_LOOPBACK_CODE) ==
+        GRILIO_SEND_ERROR);
+    g_assert(!grilio_transport_loopback_respond(trans, 1, 0, NULL, 0));
+
+    grilio_transport_remove_all_handlers(trans, id);
+    grilio_transport_unref(trans);
+    grilio_request_unref(test.req);
+    g_main_loop_unref(test.loop);
+}
+
+/*==========================================================================*
+ * Capture
+ *==========================================================================*/
+
+#define TEST_CAPTURE_CODE (127)
+#define TEST_CAPTURE_UNKNOWN_CODE (128)
+#define TEST_CAPTURE_UNSOL_CODE (2000)
+#define TEST_CAPTURE_SERIAL (42)
+
+static const char test_capture_data[] = "capture";
+
+typedef struct test_capture_data {
+    GMainLoop* loop;
+    GRilIoRequest* req;
+    GRilIoRequest* unknown_req;
+    guint responses;
+    gboolean indicated;
+} TestCapture;
+
+static
+void
+test_capture_connected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    TestCapture* test = user_data;
+
+    g_assert(grilio_transport_send(transport, test->req,
+        TEST_CAPTURE_CODE) == GRILIO_SEND_OK);
+    if (test->unknown_req) {
+        g_assert(grilio_transport_send(transport, test->unknown_req,
+            TEST_CAPTURE_UNKNOWN_CODE) == GRILIO_SEND_OK);
+    }
+}
+
+static
+void
+test_capture_request(
+    GRilIoTransport* transport,
+    guint code,
+    guint serial,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    g_assert(code == TEST_CAPTURE_CODE);
+    g_assert(grilio_transport_loopback_respond(transport, serial,
+        GRILIO_STATUS_OK, test_capture_data, sizeof(test_capture_data)));
+    g_assert(grilio_transport_loopback_indicate(transport,
+        TEST_CAPTURE_UNSOL_CODE, NULL, 0));
+}
+
+static
+void
+test_capture_check_done(
+    TestCapture* test)
+{
+    if (test->indicated && test->responses == (test->unknown_req ? 2 : 1)) {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_capture_indication(
+    GRilIoTransport* transport,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestCapture* test = user_data;
+
+    if (code == TEST_CAPTURE_UNSOL_CODE) {
+        g_assert(!test->indicated);
+        test->indicated = TRUE;
+        test_capture_check_done(test);
+    }
+}
+
+static
+void
+test_capture_response(
+    GRilIoTransport* transport,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestCapture* test = user_data;
+
+    if (serial == grilio_request_serial(test->req)) {
+        g_assert(status == GRILIO_STATUS_OK);
+        g_assert(len == sizeof(test_capture_data));
+        g_assert(!memcmp(data, test_capture_data, len));
+    } else {
+        /* Nothing has been recorded for this one */
+        g_assert(serial == grilio_request_serial(test->unknown_req));
+        g_assert(status != GRILIO_STATUS_OK);
+    }
+    test->responses++;
+    test_capture_check_done(test);
+}
+
+static
+void
+test_capture_run(
+    GRilIoTransport* trans,
+    TestCapture* test)
+{
+    gulong id[3];
+
+    test->responses = 0;
+    test->indicated = FALSE;
+    id[0] = grilio_transport_add_connected_handler(trans,
+        test_capture_connected, test);
+    id[1] = grilio_transport_add_indication_handler(trans,
+        test_capture_indication, test);
+    id[2] = grilio_transport_add_response_handler(trans,
+        test_capture_response, test);
+    g_main_loop_run(test->loop);
+    grilio_transport_remove_all_handlers(trans, id);
+}
+
+static
+void
+test_capture(
+    void)
+{
+    TestCapture test;
+    GRilIoTransport* trans;
+    char* dir = g_dir_make_tmp("test_transport_XXXXXX", NULL);
+    char* path = g_build_filename(dir, "capture", NULL);
+    char* junk = g_build_filename(dir, "junk", NULL);
+    int i;
+
+    memset(&test, 0, sizeof(test));
+    test.loop = g_main_loop_new(NULL, FALSE);
+    test.req = grilio_request_new();
+    test.req->current_id = 1;
+
+    /* Invalid parameters */
+    trans = grilio_transport_loopback_new(test_capture_request, &test);
+    g_assert(!grilio_transport_capture_start(NULL, path));
+    g_assert(!grilio_transport_capture_start(trans, NULL));
+    g_assert(!grilio_transport_capture_start(trans, dir));
+    grilio_transport_capture_stop(NULL);
+    g_assert(!grilio_transport_playback_new(NULL, FALSE));
+    g_assert(!grilio_transport_playback_new(path, FALSE));
+    g_assert(g_file_set_contents(junk, "junk", -1, NULL));
+    g_assert(!grilio_transport_playback_new(junk, FALSE));
+
+    /* Record */
+    g_assert(grilio_transport_capture_start(trans, path));
+    g_assert(grilio_transport_loopback_connect(trans, 10));
+    test_capture_run(trans, &test);
+    grilio_transport_capture_stop(trans);
+    grilio_transport_unref(trans);
+
+    /* Play it back, both as fast as possible and in real time */
+    test.req->current_id = TEST_CAPTURE_SERIAL;
+    test.unknown_req = grilio_request_new();
+    test.unknown_req->current_id = TEST_CAPTURE_SERIAL + 1;
+    for (i = 0; i < 2; i++) {
+        trans = grilio_transport_playback_new(path, i);
+        g_assert(trans);
+        test_capture_run(trans, &test);
+        g_assert(trans->connected);
+        grilio_transport_shutdown(trans, FALSE);
+        g_assert(!trans->connected);
+        g_assert(grilio_transport_send(trans, test.req, TEST_CAPTURE_CODE) ==
+            GRILIO_SEND_ERROR);
+        grilio_transport_unref(trans);
+    }
+
+    grilio_request_unref(test.req);
+    grilio_request_unref(test.unknown_req);
+    g_main_loop_unref(test.loop);
+    unlink(path);
+    unlink(junk);
+    rmdir(dir);
+    g_free(path);
+    g_free(junk);
+    g_free(dir);
+}
+
+/*==========================================================================*
+ * Fault
+ *==========================================================================*/
+
+#define TEST_FAULT_CODE (127)
+#define TEST_FAULT_SLOW_CODE (128)
+#define TEST_FAULT_UNSOL_CODE (2000)
+#define TEST_FAULT_LATENCY_MS (100)
+#define TEST_FAULT_COUNT (32)
+
+typedef struct test_fault_data {
+    GMainLoop* loop;
+    GRilIoTransport* target;
+    GRilIoTransport* trans;
+    gulong id[5];
+    guint serial[TEST_FAULT_COUNT];
+    guint responses;
+    guint expected;
+    guint write_errors;
+} TestFault;
+
+static
+void
+test_fault_request(
+    GRilIoTransport* transport,
+    guint code,
+    guint serial,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    g_assert(grilio_transport_loopback_respond(transport, serial,
+        GRILIO_STATUS_OK, NULL, 0));
+}
+
+static
+void
+test_fault_connected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    g_main_loop_quit(((TestFault*)user_data)->loop);
+}
+
+static
+void
+test_fault_response(
+    GRilIoTransport* transport,
+    GRILIO_RESPONSE_TYPE type,
+    guint serial,
+    int status,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    TestFault* test = user_data;
+
+    g_assert(test->responses < TEST_FAULT_COUNT);
+    test->serial[test->responses++] = serial;
+    if (test->responses == test->expected) {
+        g_main_loop_quit(test->loop);
+    }
+}
+
+static
+void
+test_fault_indication(
+    GRilIoTransport* transport,
+    GRILIO_INDICATION_TYPE type,
+    guint code,
+    const void* data,
+    guint len,
+    void* user_data)
+{
+    if (code == TEST_FAULT_UNSOL_CODE) {
+        g_main_loop_quit(((TestFault*)user_data)->loop);
+    }
+}
+
+static
+void
+test_fault_write_error(
+    GRilIoTransport* transport,
+    const GError* error,
+    void* user_data)
+{
+    ((TestFault*)user_data)->write_errors++;
+}
+
+static
+void
+test_fault_disconnected(
+    GRilIoTransport* transport,
+    void* user_data)
+{
+    g_main_loop_quit(((TestFault*)user_data)->loop);
+}
+
+static
+void
+test_fault_init(
+    TestFault* test,
+    guint32 seed)
+{
+    memset(test, 0, sizeof(*test));
+    test->loop = g_main_loop_new(NULL, FALSE);
+    test->target = grilio_transport_loopback_new(test_fault_request, test);
+    test->trans = grilio_transport_fault_new(test->target, seed);
+    test->id[0] = grilio_transport_add_connected_handler(test->trans,
+        test_fault_connected, test);
+    test->id[1] = grilio_transport_add_response_handler(test->trans,
+        test_fault_response, test);
+    test->id[2] = grilio_transport_add_indication_handler(test->trans,
+        test_fault_indication, test);
+    test->id[3] = grilio_transport_add_write_error_handler(test->trans,
+        test_fault_write_error, test);
+    test->id[4] = grilio_transport_add_disconnected_handler(test->trans,
+        test_fault_disconnected, test);
+    g_assert(grilio_transport_loopback_connect(test->target, 10));
+    g_main_loop_run(test->loop);
+    g_assert(test->trans->connected);
+    g_assert(test->trans->ril_version == 10);
+}
+
+static
+GRILIO_SEND_STATUS
+test_fault_send(
+    TestFault* test,
+    guint serial,
+    guint code)
+{
+    GRilIoRequest* req = grilio_request_new();
+    GRILIO_SEND_STATUS status;
+
+    req->current_id = serial;
+    status = grilio_transport_send(test->trans, req, code);
+    grilio_request_unref(req);
+    return status;
+}
+
+static
+void
+test_fault_deinit(
+    TestFault* test)
+{
+    grilio_transport_shutdown(test->trans, FALSE);
+    g_assert(!test->trans->connected);
+    grilio_transport_remove_all_handlers(test->trans, test->id);
+    grilio_transport_unref(test->trans);
+    grilio_transport_unref(test->target);
+    g_main_loop_unref(test->loop);
+}
+
+static
+guint32
+test_fault_drop_mask(
+    guint32 seed)
+{
+    TestFault test;
+    guint32 mask = 0;
+    guint i;
+
+    test_fault_init(&test, seed);
+    grilio_transport_fault_set_drop_rate(test.trans, 0.5);
+    for (i = 0; i < TEST_FAULT_COUNT; i++) {
+        g_assert(test_fault_send(&test, i + 1, TEST_FAULT_CODE) ==
+            GRILIO_SEND_OK);
+    }
+    g_assert(grilio_transport_loopback_indicate(test.target,
+        TEST_FAULT_UNSOL_CODE, NULL, 0));
+    g_main_loop_run(test.loop);
+    for (i = 0; i < test.responses; i++) {
+        mask |= 1u << (test.serial[i] - 1);
+    }
+    test_fault_deinit(&test);
+    return mask;
+}
+
+static
+void
+test_fault(
+    void)
+{
+    TestFault test;
+    GRilIoTransport* trans;
+    gint64 start;
+    guint32 mask;
+
+    /* Invalid parameters */
+    g_assert(!grilio_transport_fault_new(NULL, 0));
+    grilio_transport_fault_set_latency(NULL, 0, 0, 0);
+    grilio_transport_fault_set_drop_rate(NULL, 0);
+    grilio_transport_fault_set_reorder_rate(NULL, 0);
+    grilio_transport_fault_set_write_error_rate(NULL, 0);
+    trans = grilio_transport_loopback_new(NULL, NULL);
+    grilio_transport_fault_set_latency(trans, 0, 0, 0);
+    grilio_transport_unref(trans);
+
+    /* Latency */
+    test_fault_init(&test, 0);
+    grilio_transport_fault_set_latency(test.trans, TEST_FAULT_SLOW_CODE,
+        TEST_FAULT_LATENCY_MS, TEST_FAULT_LATENCY_MS);
+    start = g_get_monotonic_time();
+    test.expected = 2;
+    g_assert(test_fault_send(&test, 1, TEST_FAULT_SLOW_CODE) ==
+        GRILIO_SEND_OK);
+    g_assert(test_fault_send(&test, 2, TEST_FAULT_CODE) == GRILIO_SEND_OK);
+    g_main_loop_run(test.loop);
+    g_assert(g_get_monotonic_time() - start >=
+        TEST_FAULT_LATENCY_MS * 1000);
+    g_assert(test.serial[0] == 2);
+    g_assert(test.serial[1] == 1);
+    test_fault_deinit(&test);
+
+    /* Reordering */
+    test_fault_init(&test, 0);
+    grilio_transport_fault_set_reorder_rate(test.trans, 1);
+    test.expected = 2;
+    g_assert(test_fault_send(&test, 1, TEST_FAULT_CODE) == GRILIO_SEND_OK);
+    g_assert(test_fault_send(&test, 2, TEST_FAULT_CODE) == GRILIO_SEND_OK);
+    g_main_loop_run(test.loop);
+    g_assert(test.serial[0] == 2);
+    g_assert(test.serial[1] == 1);
+    test_fault_deinit(&test);
+
+    /* Dropped responses */
+    test_fault_init(&test, 0);
+    grilio_transport_fault_set_drop_rate(test.trans, 1);
+    g_assert(test_fault_send(&test, 1, TEST_FAULT_CODE) == GRILIO_SEND_OK);
+    g_assert(grilio_transport_loopback_indicate(test.target,
+        TEST_FAULT_UNSOL_CODE, NULL, 0));
+    g_main_loop_run(test.loop);
+    g_assert(!test.responses);
+    test_fault_deinit(&test);
+
+    /* Write errors */
+    test_fault_init(&test, 0);
+    grilio_transport_fault_set_write_error_rate(test.trans, 1);
+    g_assert(test_fault_send(&test, 1, TEST_FAULT_CODE) ==
+        GRILIO_SEND_ERROR);
+    /* Reported on a fresh stack, the way real transports do it */
+    g_assert(!test.write_errors);
+    g_main_loop_run(test.loop);
+    g_assert(test.write_errors == 1);
+    g_assert(!test.trans->connected);
+    test_fault_deinit(&test);
+
+    /* Same seed, same faults */
+    mask = test_fault_drop_mask(1234);
+    g_assert(mask);
+    g_assert(mask != 0xffffffff);
+    g_assert(test_fault_drop_mask(1234) == mask);
+}
+
+/*==========================================================================*
+ * Uring
+ *==========================================================================*/
+
+static
+gboolean
+test_uring_check(
+    GRilIoTransport* trans)
+{
+    return !g_strcmp0(G_OBJECT_TYPE_NAME(trans), "GRilIoTransportUring");
+}
+
+static
+GRilIoTransport*
+test_uring_new(
+    int fd,
+    const char* sub,
+    gboolean can_close)
+{
+    GRilIoTransport* trans = grilio_transport_uring_new(fd, sub, can_close);
+
+    /* Make sure that it didn't fall back to the socket transport */
+    g_assert(trans);
+    g_assert(test_uring_check(trans));
+    return trans;
+}
+
+static
+void
+test_uring(
+    void)
+{
+    int fd[2];
+    GRilIoTransport* trans;
+    gboolean supported;
+
+    /* Invalid parameters */
+    g_assert(!grilio_transport_uring_new(-1, NULL, FALSE));
+    g_assert(!grilio_transport_uring_new(0, "", FALSE));
+
+    /* Check if io_uring is actually available */
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    trans = grilio_transport_uring_new(fd[0], NULL, TRUE);
+    g_assert(trans);
+    supported = test_uring_check(trans);
+    grilio_transport_unref(trans);
+    close(fd[1]);
+    if (!supported) {
+        g_test_skip("io_uring is not available");
+        return;
+    }
+
+    /* The rest is the same as for the socket transport */
+    test_batch_run(test_uring_new, 0, 0);
+    test_batch_run(test_uring_new, 0, 5);
+    test_batch_run(test_uring_new, 0, 0x2001);
+    test_batch_too_long_run(test_uring_new);
+    test_max_packet_len_run(grilio_test_server_new, test_uring_new);
+    test_slice_run(grilio_test_server_new, test_uring_new);
+    test_write_run(test_uring_new);
+
+    /* Closes the descriptor */
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    trans = test_uring_new(fd[0], NULL, TRUE);
+    grilio_transport_shutdown(trans, FALSE);
+    g_assert(!trans->connected);
+    g_assert(fcntl(fd[0], F_GETFD) < 0);
+    grilio_transport_unref(trans);
+    close(fd[1]);
+}
+
+/*==========================================================================*
+ * Thread
+ *==========================================================================*/
+
+static
+void
+test_thread(
+    void)
+{
+    int fd[2];
+    GRilIoTransport* trans;
+
+    /* Invalid parameters */
+    g_assert(!grilio_transport_thread_new(-1, NULL, FALSE));
+    g_assert(!grilio_transport_thread_new(0, "", FALSE));
+    g_assert(!grilio_transport_thread_set_affinity(NULL, 0));
+    g_assert(!grilio_transport_thread_set_priority(NULL, SCHED_OTHER, 0));
+
+    /* The rest is the same as for the socket transport */
+    test_batch_run(grilio_transport_thread_new, 0, 0);
+    test_batch_run(grilio_transport_thread_new, 0, 5);
+    test_batch_too_long_run(grilio_transport_thread_new);
+    test_max_packet_len_run(grilio_test_server_new,
+        grilio_transport_thread_new);
+    test_slice_run(grilio_test_server_new, grilio_transport_thread_new);
+    test_write_run(grilio_transport_thread_new);
+
+    /* Thread parameters */
+    g_assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    trans = grilio_transport_thread_new(fd[0], NULL, TRUE);
+    g_assert(trans);
+    g_assert(!grilio_transport_thread_set_affinity(trans, -1));
+    g_assert(grilio_transport_thread_set_affinity(trans, 0));
+    g_assert(grilio_transport_thread_set_priority(trans, SCHED_OTHER, 0));
+
+    /* Closes the descriptor */
+    grilio_transport_shutdown(trans, FALSE);
+    g_assert(!trans->connected);
+    g_assert(fcntl(fd[0], F_GETFD) < 0);
+    g_assert(!grilio_transport_thread_set_affinity(trans, 0));
+    grilio_transport_unref(trans);
+    close(fd[1]);
+}
+
+/*==========================================================================*
+ * Pool
+ *==========================================================================*/
+
+static
+void
+test_pool(
+    void)
+{
+    GRilIoTransportPoolStats stats;
+
+    /* NULL tolerance */
+    grilio_transport_pool_get_stats(NULL);
+
+    /* Nothing is cached with zero high-water mark */
+    grilio_transport_pool_set_idle_timeout(0);
+    grilio_transport_pool_set_high_water_mark(0);
+    grilio_transport_pool_get_stats(&stats);
+    g_assert(!stats.bytes_in_use);
+    g_assert(!stats.bytes_held);
+    test_batch_run(grilio_transport_socket_new, 100, 0);
+    test_batch_run(grilio_transport_fd_new, 0, 0);
+    grilio_transport_pool_get_stats(&stats);
+    g_assert(!stats.bytes_held);
+    g_assert(!stats.buffers_held);
+
+    /* Released buffers are kept up to the high-water mark */
+    grilio_transport_pool_set_high_water_mark(0x100000);
+    test_batch_run(grilio_transport_socket_new, 100, 0);
+    test_batch_run(grilio_transport_fd_new, 0, 0);
+    grilio_transport_pool_get_stats(&stats);
+    g_assert(!stats.bytes_in_use);
+    g_assert(!stats.buffers_in_use);
+    g_assert(stats.bytes_held);
+    g_assert(stats.buffers_held);
+
+    /* Lowering the high-water mark releases the excess */
+    grilio_transport_pool_set_high_water_mark(0x1000);
+    grilio_transport_pool_get_stats(&stats);
+    g_assert(stats.bytes_held <= 0x1000);
+
+    /* And the rest gets released when they stay unused for long enough */
+    grilio_transport_pool_set_idle_timeout(10);
+    do {
+        g_main_context_iteration(NULL, TRUE);
+        grilio_transport_pool_get_stats(&stats);
+    } while (stats.bytes_held);
+    g_assert(!stats.buffers_held);
+    grilio_transport_pool_set_high_water_mark(0x40000);
+}
+
 /*==========================================================================*
  * Common
  *==========================================================================*/
@@ -109,6 +2073,23 @@ int main(int argc, char* argv[])
     G_GNUC_END_IGNORE_DEPRECATIONS;
     g_test_init(&argc, &argv, NULL);
     g_test_add_func(TEST_PREFIX "Basic", test_basic);
+    g_test_add_func(TEST_PREFIX "Batch", test_batch);
+    g_test_add_func(TEST_PREFIX "BatchChunk", test_batch_chunk);
+    g_test_add_func(TEST_PREFIX "BatchTooLong", test_batch_too_long);
+    g_test_add_func(TEST_PREFIX "MaxPacketLen", test_max_packet_len);
+    g_test_add_func(TEST_PREFIX "Slice", test_slice);
+    g_test_add_func(TEST_PREFIX "Stats", test_stats);
+    g_test_add_func(TEST_PREFIX "Write", test_write);
+    g_test_add_func(TEST_PREFIX "Pipeline", test_pipeline);
+    g_test_add_func(TEST_PREFIX "Fd", test_fd);
+    g_test_add_func(TEST_PREFIX "Seqpacket", test_seqpacket);
+    g_test_add_func(TEST_PREFIX "Shm", test_shm);
+    g_test_add_func(TEST_PREFIX "Loopback", test_loopback);
+    g_test_add_func(TEST_PREFIX "Capture", test_capture);
+    g_test_add_func(TEST_PREFIX "Fault", test_fault);
+    g_test_add_func(TEST_PREFIX "Uring", test_uring);
+    g_test_add_func(TEST_PREFIX "Thread", test_thread);
+    g_test_add_func(TEST_PREFIX "Pool", test_pool);
     signal(SIGPIPE, SIG_IGN);
     test_init(&test_opt, argc, argv);
     return g_test_run();